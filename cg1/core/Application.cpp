@@ -3,11 +3,23 @@
 #include "cg1.h"
 #include <iostream>
 #include "../scenes/Scene.h"
+#include "../gfx/GLStateCache.h"
+#include "../gfx/GeometryArena.h"
+#include "../gfx/TextureUploader.h"
+#include "../gfx/TextureArena.h"
+#include "../gfx/TextureStreamer.h"
+#include "AssetLoader.h"
+#include "AssetRegistry.h"
 #include <imgui.h>
 #include "imgui_impl_glfw_gl3.h"
 
 namespace cg1 {
 
+    /** The time per frame available for uploading loaded assets in seconds. */
+    static constexpr double assetUploadTimeBudget = 0.004;
+    /** The initial GPU memory budget of the streamed texture levels in bytes. */
+    static constexpr std::size_t textureMemoryBudget = 32 * 1024 * 1024;
+
     /**
      *  Constructor, creates the cg1 application.
      *  @param applicationName the name of the application (will appear as the window title).
@@ -63,6 +75,13 @@ namespace cg1 {
         glDepthFunc(GL_LEQUAL);
         glEnable(GL_DEPTH_TEST);
 
+        glStateCache_ = std::make_unique<GLStateCache>();
+        geometryArena_ = std::make_unique<GeometryArena>();
+        textureUploader_ = std::make_unique<TextureUploader>();
+        textureArena_ = std::make_unique<TextureArena>();
+        textureStreamer_ = std::make_unique<TextureStreamer>(textureMemoryBudget);
+        assetLoader_ = std::make_unique<AssetLoader>();
+        assetRegistry_ = std::make_unique<AssetRegistry>();
         scene_ = std::make_unique<Scene>();
     }
 
@@ -72,7 +91,15 @@ namespace cg1 {
     Application::~Application() noexcept
     {
         ImGui_ImplGlfwGL3_Shutdown();
+        // the pending uploads refer to objects of the scene
+        assetLoader_.reset();
         scene_.reset();
+        assetRegistry_.reset();
+        textureStreamer_.reset();
+        textureArena_.reset();
+        textureUploader_.reset();
+        geometryArena_.reset();
+        glStateCache_.reset();
         if (window_) glfwDestroyWindow(window_);
         glfwTerminate();
     }
@@ -108,8 +135,16 @@ namespace cg1 {
         glClearDepth(1.0);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+        assetLoader_->processUploads(assetUploadTimeBudget);
+        textureStreamer_->update();
         scene_->renderScene();
-        if (DRAW_GUI) ImGui::Render();
+        if (DRAW_GUI) {
+            ImGui::Render();
+            // the GUI leaves texture unit 0 active and restores the 2D texture of the previously active unit on it.
+            glStateCache_->invalidateActiveTexture();
+            glStateCache_->invalidateTexture(0, GL_TEXTURE_2D);
+        }
+        glStateCache_->endFrame();
 
         // Flip Buffers and Draw
         glfwSwapBuffers(window_);
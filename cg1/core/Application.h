@@ -9,6 +9,13 @@ struct GLFWwindow;
 namespace cg1 {
 
     class Scene;
+    class GLStateCache;
+    class GeometryArena;
+    class AssetLoader;
+    class AssetRegistry;
+    class TextureUploader;
+    class TextureArena;
+    class TextureStreamer;
 
     class Application final
     {
@@ -59,6 +66,20 @@ namespace cg1 {
         glm::vec3 mousePositionNormalized_;
         /** Holds the (main) camera object. */
         CG1Camera camera_;
+        /** Holds the shadow copy of the OpenGL bindings. */
+        std::unique_ptr<GLStateCache> glStateCache_;
+        /** Holds the shared buffers of all meshes. */
+        std::unique_ptr<GeometryArena> geometryArena_;
+        /** Holds the staging buffers of all texture uploads. */
+        std::unique_ptr<TextureUploader> textureUploader_;
+        /** Holds the shared array textures of all textures. */
+        std::unique_ptr<TextureArena> textureArena_;
+        /** Holds the mip level residency of all streamed textures. */
+        std::unique_ptr<TextureStreamer> textureStreamer_;
+        /** Holds the background loader of all assets. */
+        std::unique_ptr<AssetLoader> assetLoader_;
+        /** Holds the shared meshes and textures. */
+        std::unique_ptr<AssetRegistry> assetRegistry_;
         /** Holds the current scene. */
         std::unique_ptr<Scene> scene_;
     };
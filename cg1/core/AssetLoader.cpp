@@ -0,0 +1,165 @@
+#include "AssetLoader.h"
+#include <GLFW/glfw3.h>
+#include <cassert>
+#include <iostream>
+
+namespace cg1 {
+
+    AssetLoader* AssetLoader::instance_ = nullptr;
+
+    /** Constructor, makes this the loader used by all assets. */
+    AssetLoader::AssetLoader() :
+        numLoading_{ 0 },
+        batchActive_{ false },
+        batchStartTime_{ 0.0 }
+    {
+        assert(instance_ == nullptr);
+        instance_ = this;
+    }
+
+    /**
+     *  Destructor, waits for all assets loading on worker threads and drops the pending uploads. Needs to be
+     *  destroyed before the objects the uploads refer to.
+     */
+    AssetLoader::~AssetLoader() noexcept
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        loadFinished_.wait(lock, [this]() { return numLoading_ == 0; });
+        uploads_.clear();
+        instance_ = nullptr;
+    }
+
+    /**
+     *  Returns the loader used by all assets.
+     *  @return the current asset loader.
+     */
+    AssetLoader& AssetLoader::getInstance()
+    {
+        assert(instance_ != nullptr);
+        return *instance_;
+    }
+
+    /**
+     *  Executes queued uploads until the time budget is used up. At least one upload is executed per call, so
+     *  large assets cannot stall the loading.
+     *  @param timeBudget the time available for uploads in seconds.
+     *  @return whether uploads were executed.
+     */
+    bool AssetLoader::processUploads(double timeBudget)
+    {
+        auto startTime = glfwGetTime();
+        bool uploaded = false;
+        do {
+            std::function<void()> upload;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (uploads_.empty()) break;
+                upload = std::move(uploads_.front());
+                uploads_.pop_front();
+            }
+            auto uploadStartTime = glfwGetTime();
+            upload();
+            uploaded = true;
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            batchStatistics_.uploadTime += glfwGetTime() - uploadStartTime;
+        } while (glfwGetTime() - startTime < timeBudget);
+        finishBatch();
+        return uploaded;
+    }
+
+    /**
+     *  Adds the time a load spent in its decoding and compression stages to the current batch. Called by load
+     *  functions on the worker threads.
+     *  @param decodeTime the time spent decoding in seconds.
+     *  @param compressTime the time spent compressing in seconds.
+     */
+    void AssetLoader::addStageTimes(double decodeTime, double compressTime)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        batchStatistics_.decodeTime += decodeTime;
+        batchStatistics_.compressTime += compressTime;
+    }
+
+    /**
+     *  Returns the number of assets that are loading or waiting for their upload.
+     *  @return the number of pending assets.
+     */
+    unsigned int AssetLoader::getNumPending() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return numLoading_ + static_cast<unsigned int>(uploads_.size());
+    }
+
+    /**
+     *  Returns the timing of the last batch of assets, i.e. of all assets requested while the loader was busy.
+     *  @return the statistics of the last finished batch.
+     */
+    AssetLoadStatistics AssetLoader::getLastStatistics() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return lastStatistics_;
+    }
+
+    /** Counts a new asset loading on a worker thread, starts a new batch if the loader was idle. */
+    void AssetLoader::beginLoad()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!batchActive_) {
+            batchActive_ = true;
+            batchStartTime_ = getTime();
+            batchStatistics_ = AssetLoadStatistics();
+        }
+        ++numLoading_;
+    }
+
+    /**
+     *  Queues the upload of a loaded asset.
+     *  @param upload the upload function, empty if the asset could not be loaded.
+     *  @param loadTime the time spent loading the asset in seconds.
+     */
+    void AssetLoader::finishLoad(std::function<void()> upload, double loadTime)
+    {
+        // notify while locked, the destructor may destroy the condition variable right after the last load.
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (upload) {
+            uploads_.push_back(std::move(upload));
+            ++batchStatistics_.numAssets;
+        }
+        batchStatistics_.loadTime += loadTime;
+        --numLoading_;
+        loadFinished_.notify_all();
+    }
+
+    /** Ends the current batch and reports its timing once all its assets are loaded and uploaded. */
+    void AssetLoader::finishBatch()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!batchActive_ || numLoading_ > 0 || !uploads_.empty()) return;
+        batchActive_ = false;
+        batchStatistics_.totalTime = getTime() - batchStartTime_;
+        lastStatistics_ = batchStatistics_;
+        std::cout << "Loaded " << lastStatistics_.numAssets << " assets in " << lastStatistics_.totalTime << "s (load "
+            << lastStatistics_.loadTime << "s on " << ThreadPool::getShared().getNumThreads() << " worker threads, decode "
+            << lastStatistics_.decodeTime << "s, compress " << lastStatistics_.compressTime << "s, upload "
+            << lastStatistics_.uploadTime << "s on the render thread)." << std::endl;
+    }
+
+    /**
+     *  Returns the time used for the load statistics, can be called from any thread.
+     *  @return the time in seconds.
+     */
+    double AssetLoader::getTime()
+    {
+        return glfwGetTime();
+    }
+
+    /**
+     *  Reports an asset that could not be loaded.
+     *  @param e the exception thrown while loading.
+     */
+    void AssetLoader::reportError(const std::exception& e)
+    {
+        std::cerr << "Failed to load asset: " << e.what() << std::endl;
+    }
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "cg1.h"
+#include "core/ThreadPool.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+
+namespace cg1 {
+
+    /** The timing of a batch of assets requested together, e.g. by the scene at startup. */
+    struct AssetLoadStatistics
+    {
+        /** Holds the number of loaded assets. */
+        unsigned int numAssets = 0;
+        /** Holds the time spent on worker threads in seconds, summed over all assets. */
+        double loadTime = 0.0;
+        /** Holds the part of the load time spent decoding image files in seconds. */
+        double decodeTime = 0.0;
+        /** Holds the part of the load time spent compressing textures in seconds. */
+        double compressTime = 0.0;
+        /** Holds the time spent uploading on the render thread in seconds. */
+        double uploadTime = 0.0;
+        /** Holds the time from the first request to the last upload in seconds. */
+        double totalTime = 0.0;
+    };
+
+    /**
+     * Loads assets in the background. The file loading and decoding runs on the shared thread pool, the OpenGL
+     * uploads of the loaded data are queued and executed on the render thread within a time budget per frame.
+     */
+    class AssetLoader final
+    {
+    public:
+        AssetLoader();
+        AssetLoader(const AssetLoader&) = delete;
+        AssetLoader& operator=(const AssetLoader&) = delete;
+        AssetLoader(AssetLoader&&) = delete;
+        AssetLoader& operator=(AssetLoader&&) = delete;
+        ~AssetLoader() noexcept;
+
+        static AssetLoader& getInstance();
+
+        /**
+         *  Loads an asset in the background. The upload function is called with the loaded data on the render
+         *  thread, the data is released afterwards.
+         *  @param load the function loading the data on a worker thread, must not use OpenGL.
+         *  @param upload the function uploading the data on the render thread.
+         */
+        template<typename Load, typename Upload> void load(Load load, Upload upload)
+        {
+            using Data = decltype(load());
+            beginLoad();
+            ThreadPool::getShared().enqueue([this, load, upload]() {
+                auto startTime = getTime();
+                std::function<void()> loadedUpload;
+                try {
+                    auto data = std::make_shared<Data>(load());
+                    loadedUpload = [upload, data]() { upload(*data); };
+                } catch (const std::exception& e) {
+                    reportError(e);
+                }
+                finishLoad(std::move(loadedUpload), getTime() - startTime);
+            });
+        }
+
+        bool processUploads(double timeBudget);
+        void addStageTimes(double decodeTime, double compressTime);
+
+        unsigned int getNumPending() const;
+        AssetLoadStatistics getLastStatistics() const;
+
+    private:
+        void beginLoad();
+        void finishLoad(std::function<void()> upload, double loadTime);
+        void finishBatch();
+        static double getTime();
+        static void reportError(const std::exception& e);
+
+        /** Holds the loader used by all assets. */
+        static AssetLoader* instance_;
+
+        /** Holds the uploads of loaded assets waiting for the render thread. */
+        std::deque<std::function<void()>> uploads_;
+        /** Holds the number of assets loading on a worker thread. */
+        unsigned int numLoading_;
+        /** Holds whether a batch of assets is loading. */
+        bool batchActive_;
+        /** Holds the time the current batch was started. */
+        double batchStartTime_;
+        /** Holds the timing of the current batch. */
+        AssetLoadStatistics batchStatistics_;
+        /** Holds the timing of the last finished batch. */
+        AssetLoadStatistics lastStatistics_;
+        /** Holds the mutex guarding the upload queue and the counter. */
+        mutable std::mutex mutex_;
+        /** Holds the condition variable signaling finished loads. */
+        std::condition_variable loadFinished_;
+    };
+}
@@ -0,0 +1,187 @@
+#include "AssetRegistry.h"
+#include "AssetLoader.h"
+#include <cassert>
+#include <iostream>
+#include <sstream>
+
+namespace cg1 {
+
+    AssetRegistry* AssetRegistry::instance_ = nullptr;
+
+    namespace {
+        /**
+         *  Returns the name of a vertex layout used in the asset keys.
+         *  @param vertexFormat the vertex layout.
+         */
+        const char* getVertexFormatName(VertexFormat vertexFormat)
+        {
+            switch (vertexFormat) {
+            case VertexFormat::Packed: return "packed";
+            case VertexFormat::PackedHalfPosition: return "packed-half";
+            default: return "float";
+            }
+        }
+
+        /**
+         *  Returns the name of a texture usage used in the asset keys.
+         *  @param usage the texture usage.
+         */
+        const char* getTextureUsageName(TextureUsage usage)
+        {
+            return usage == TextureUsage::NormalMap ? "normal" : "color";
+        }
+    }
+
+    /** Constructor, makes this the registry used by all objects. */
+    AssetRegistry::AssetRegistry()
+    {
+        assert(instance_ == nullptr);
+        instance_ = this;
+    }
+
+    /** Destructor. Assets still in use stay valid, they are only no longer shared with new requests. */
+    AssetRegistry::~AssetRegistry() noexcept
+    {
+        instance_ = nullptr;
+    }
+
+    /**
+     *  Returns the registry used by all objects.
+     *  @return the current asset registry.
+     */
+    AssetRegistry& AssetRegistry::getInstance()
+    {
+        assert(instance_ != nullptr);
+        return *instance_;
+    }
+
+    /**
+     *  Returns the shared mesh for a file, the file is loaded in the background if it is not registered yet.
+     *  @param meshFilename the mesh file relative to the resources directory.
+     *  @param vertexFormat the vertex layout the mesh is uploaded with.
+     *  @param usage how the mesh is drawn, selects the import steps.
+     *  @return the shared mesh asset.
+     */
+    std::shared_ptr<MeshAsset> AssetRegistry::getMesh(const std::string& meshFilename, VertexFormat vertexFormat,
+        MeshUsage usage)
+    {
+        auto filename = canonicalizePath(meshFilename);
+        auto key = filename + "?" + getVertexFormatName(vertexFormat);
+        if (usage == MeshUsage::Displaced) key += "?displaced";
+        auto& entry = meshes_[key];
+        if (auto asset = entry.lock()) return asset;
+
+        pruneExpired(meshes_);
+        auto asset = std::make_shared<MeshAsset>(key);
+        meshes_[key] = asset;
+        std::weak_ptr<MeshAsset> weakAsset = asset;
+        AssetLoader::getInstance().load([filename, usage]() { return Mesh::LoadFile(filename, usage); },
+            [weakAsset, vertexFormat](const MeshFileData& fileData) {
+            // skip the upload if all objects using the asset were deleted in the meantime.
+            if (auto asset = weakAsset.lock()) asset->setResource(std::make_unique<Mesh>(fileData, vertexFormat));
+        });
+        return asset;
+    }
+
+    /**
+     *  Returns the shared texture for a file, the file is loaded in the background if it is not registered yet.
+     *  @param texFilename the texture file relative to the resources directory.
+     *  @param usage what the texture is used for, selects the compression format.
+     *  @return the shared texture asset.
+     */
+    std::shared_ptr<TextureAsset> AssetRegistry::getTexture(const std::string& texFilename, TextureUsage usage)
+    {
+        auto filename = canonicalizePath(texFilename);
+        auto key = filename + "?" + getTextureUsageName(usage);
+        auto& entry = textures_[key];
+        if (auto asset = entry.lock()) return asset;
+
+        pruneExpired(textures_);
+        auto asset = std::make_shared<TextureAsset>(key);
+        textures_[key] = asset;
+        std::weak_ptr<TextureAsset> weakAsset = asset;
+        AssetLoader::getInstance().load([filename, usage]() {
+            auto fileData = Texture::loadFile(filename, usage);
+            AssetLoader::getInstance().addStageTimes(fileData.decodeTime, fileData.compressTime);
+            return fileData;
+        },
+            [weakAsset](TextureFileData& fileData) {
+            auto asset = weakAsset.lock();
+            if (!asset) return;
+            std::cout << "Uploading texture " << asset->getName() << " ...";
+            // the texture arena sets the sampler parameters, all textures repeat and use trilinear filtering.
+            asset->setResource(std::make_unique<Texture>(std::move(fileData)));
+            std::cout << "Done." << std::endl;
+        });
+        return asset;
+    }
+
+    /**
+     *  Returns the memory and reference counts of all assets in use.
+     *  @return the information about each registered asset.
+     */
+    std::vector<AssetInfo> AssetRegistry::getAssetInfos()
+    {
+        pruneExpired(meshes_);
+        pruneExpired(textures_);
+
+        std::vector<AssetInfo> result;
+        result.reserve(meshes_.size() + textures_.size());
+        for (const auto& entry : meshes_) {
+            auto asset = entry.second.lock();
+            if (!asset) continue;
+            // the local handle is not counted.
+            result.push_back({ entry.first, "Mesh", asset->isLoaded() ? asset->get()->GetMemorySize() : 0,
+                asset.use_count() - 1, asset->isLoaded() });
+        }
+        for (const auto& entry : textures_) {
+            auto asset = entry.second.lock();
+            if (!asset) continue;
+            result.push_back({ entry.first, "Texture", asset->isLoaded() ? asset->get()->getMemorySize() : 0,
+                asset.use_count() - 1, asset->isLoaded() });
+        }
+        return result;
+    }
+
+    /**
+     *  Lexically normalizes a path, so different spellings of the same file map to the same asset. Backslashes are
+     *  converted to slashes, empty and "." components are removed and ".." components are resolved.
+     *  @param filename the path to normalize.
+     *  @return the canonical path.
+     */
+    std::string AssetRegistry::canonicalizePath(const std::string& filename)
+    {
+        auto path = filename;
+        for (auto& c : path) if (c == '\\') c = '/';
+        auto absolute = !path.empty() && path[0] == '/';
+
+        std::vector<std::string> components;
+        std::istringstream stream(path);
+        std::string component;
+        while (std::getline(stream, component, '/')) {
+            if (component.empty() || component == ".") continue;
+            if (component == ".." && !components.empty() && components.back() != "..") components.pop_back();
+            else if (component != ".." || !absolute) components.push_back(component);
+        }
+
+        std::string result = absolute ? "/" : "";
+        for (std::size_t i = 0; i < components.size(); ++i) {
+            if (i > 0) result += "/";
+            result += components[i];
+        }
+        return result;
+    }
+
+    /**
+     *  Removes the entries of assets no longer in use.
+     *  @param assets the registered assets.
+     */
+    template<typename Resource>
+    void AssetRegistry::pruneExpired(std::map<std::string, std::weak_ptr<Asset<Resource>>>& assets)
+    {
+        for (auto it = assets.begin(); it != assets.end();) {
+            if (it->second.expired()) it = assets.erase(it);
+            else ++it;
+        }
+    }
+}
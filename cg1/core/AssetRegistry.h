@@ -0,0 +1,93 @@
+#pragma once
+
+#include "cg1.h"
+#include "gfx/Mesh.h"
+#include "gfx/Texture.h"
+#include <map>
+
+namespace cg1 {
+
+    /**
+     * A GPU resource shared by all objects using the same file. The resource is created once its file is loaded and
+     * uploaded, it is released with the last handle to the asset.
+     */
+    template<typename Resource> class Asset final
+    {
+    public:
+        explicit Asset(const std::string& name) : name_(name) {}
+        Asset(const Asset&) = delete;
+        Asset& operator=(const Asset&) = delete;
+
+        /** Returns whether the resource is uploaded. */
+        bool isLoaded() const noexcept { return resource_ != nullptr; }
+        /** Returns the resource, nullptr while it is not loaded. */
+        Resource* get() const noexcept { return resource_.get(); }
+        /** Returns the key the asset is registered with. */
+        const std::string& getName() const noexcept { return name_; }
+        /** Sets the uploaded resource. */
+        void setResource(std::unique_ptr<Resource> resource) noexcept { resource_ = std::move(resource); }
+
+    private:
+        /** Holds the key the asset is registered with. */
+        std::string name_;
+        /** Holds the resource. */
+        std::unique_ptr<Resource> resource_;
+    };
+
+    using MeshAsset = Asset<Mesh>;
+    using TextureAsset = Asset<Texture>;
+
+    /** Information about a registered asset for display. */
+    struct AssetInfo
+    {
+        /** Holds the key the asset is registered with. */
+        std::string name;
+        /** Holds the kind of the asset. */
+        const char* type;
+        /** Holds the GPU memory used by the asset in bytes. */
+        std::size_t memorySize;
+        /** Holds the number of handles to the asset. */
+        long useCount;
+        /** Holds whether the asset is uploaded. */
+        bool loaded;
+    };
+
+    /**
+     * Deduplicates meshes and textures. Assets are registered by their canonical path and import options, all
+     * requests for the same key share one resource. The registry only holds weak references, so an asset is
+     * released as soon as no object uses it anymore. Must only be used on the render thread.
+     */
+    class AssetRegistry final
+    {
+    public:
+        AssetRegistry();
+        AssetRegistry(const AssetRegistry&) = delete;
+        AssetRegistry& operator=(const AssetRegistry&) = delete;
+        AssetRegistry(AssetRegistry&&) = delete;
+        AssetRegistry& operator=(AssetRegistry&&) = delete;
+        ~AssetRegistry() noexcept;
+
+        static AssetRegistry& getInstance();
+
+        std::shared_ptr<MeshAsset> getMesh(const std::string& meshFilename,
+            VertexFormat vertexFormat = VertexFormat::Packed, MeshUsage usage = MeshUsage::Static);
+        std::shared_ptr<TextureAsset> getTexture(const std::string& texFilename,
+            TextureUsage usage = TextureUsage::Color);
+
+        std::vector<AssetInfo> getAssetInfos();
+
+        static std::string canonicalizePath(const std::string& filename);
+
+    private:
+        template<typename Resource>
+        static void pruneExpired(std::map<std::string, std::weak_ptr<Asset<Resource>>>& assets);
+
+        /** Holds the registry used by all objects. */
+        static AssetRegistry* instance_;
+
+        /** Holds the registered meshes. */
+        std::map<std::string, std::weak_ptr<MeshAsset>> meshes_;
+        /** Holds the registered textures. */
+        std::map<std::string, std::weak_ptr<TextureAsset>> textures_;
+    };
+}
@@ -0,0 +1,105 @@
+#include "FileCache.h"
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+namespace cg1 {
+    namespace filecache {
+
+        /**
+         *  Queries size and modification time of a file.
+         *  @param filename the name of the file.
+         *  @param stamp the stamp to fill.
+         *  @return whether the file exists.
+         */
+        bool getFileStamp(const std::string& filename, FileStamp& stamp)
+        {
+#ifdef _WIN32
+            struct _stat64 fileStat;
+            if (_stat64(filename.c_str(), &fileStat) != 0) return false;
+#else
+            struct stat fileStat;
+            if (stat(filename.c_str(), &fileStat) != 0) return false;
+#endif
+            stamp.size = static_cast<std::uint64_t>(fileStat.st_size);
+            stamp.modificationTime = static_cast<std::int64_t>(fileStat.st_mtime);
+            return true;
+        }
+
+        /**
+         *  Calculates the 64 bit FNV-1a hash of a block of memory.
+         *  @param data the data to hash.
+         *  @param size the size of the data in bytes.
+         *  @param seed the hash to continue from.
+         *  @return the hash value.
+         */
+        std::uint64_t hash(const void* data, std::size_t size, std::uint64_t seed) noexcept
+        {
+            auto bytes = static_cast<const unsigned char*>(data);
+            for (std::size_t i = 0; i < size; ++i) {
+                seed ^= bytes[i];
+                seed *= 1099511628211ull;
+            }
+            return seed;
+        }
+
+        /**
+         *  Calculates the 64 bit FNV-1a hash of a string.
+         *  @param str the string to hash.
+         *  @param seed the hash to continue from.
+         *  @return the hash value.
+         */
+        std::uint64_t hash(const std::string& str, std::uint64_t seed) noexcept
+        {
+            return hash(str.data(), str.size(), seed);
+        }
+
+        /**
+         *  Returns the name of the file in the cache directory that belongs to a source file.
+         *  @param sourceFilename the name of the source file.
+         *  @param key the cache key (source path, options, format version).
+         *  @param extension the extension of the cache file.
+         *  @return the full name of the cache file.
+         */
+        std::string getCacheFilename(const std::string& sourceFilename, std::uint64_t key, const std::string& extension)
+        {
+            auto nameStart = sourceFilename.find_last_of("/\\");
+            auto name = sourceFilename.substr(nameStart == std::string::npos ? 0 : nameStart + 1);
+            for (auto& c : name) if (c == ' ' || c == '.') c = '_';
+
+            std::stringstream result;
+            result << config::cacheBasePath << name << "_" << std::hex << std::setw(16) << std::setfill('0') << key
+                << extension;
+            return result.str();
+        }
+
+        /**
+         *  Writes a file by writing a temporary file first and then renaming it, so readers never see partially
+         *  written cache files.
+         *  @param filename the name of the file to write.
+         *  @param contents the file contents.
+         *  @return whether the file was written.
+         */
+        bool replaceFile(const std::string& filename, const std::vector<char>& contents)
+        {
+            // assets are loaded in parallel, so two threads may write the same cache file.
+            std::string tmpFilename = filename + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+            {
+                std::ofstream file(tmpFilename, std::ofstream::binary | std::ofstream::trunc);
+                if (!file) return false;
+                file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+                if (!file) return false;
+            }
+            std::remove(filename.c_str());
+            if (std::rename(tmpFilename.c_str(), filename.c_str()) != 0) {
+                std::remove(tmpFilename.c_str());
+                return false;
+            }
+            return true;
+        }
+    }
+}
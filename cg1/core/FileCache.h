@@ -0,0 +1,60 @@
+#pragma once
+
+#include "cg1.h"
+#include <cstdint>
+
+namespace cg1 {
+    namespace filecache {
+
+        /** Identifies a version of a source file without reading its contents. */
+        struct FileStamp
+        {
+            /** Holds the file size in bytes. */
+            std::uint64_t size = 0;
+            /** Holds the last modification time. */
+            std::int64_t modificationTime = 0;
+        };
+
+        /** Initial value of the FNV-1a hash. */
+        constexpr std::uint64_t hashSeed = 14695981039346656037ull;
+
+        bool getFileStamp(const std::string& filename, FileStamp& stamp);
+        std::uint64_t hash(const void* data, std::size_t size, std::uint64_t seed = hashSeed) noexcept;
+        std::uint64_t hash(const std::string& str, std::uint64_t seed = hashSeed) noexcept;
+        std::string getCacheFilename(const std::string& sourceFilename, std::uint64_t key, const std::string& extension);
+        bool replaceFile(const std::string& filename, const std::vector<char>& contents);
+
+        /**
+         *  Appends the raw bytes of an object to a buffer.
+         *  @param buffer the buffer to append to.
+         *  @param value the object to append.
+         */
+        template<typename T> void append(std::vector<char>& buffer, const T& value)
+        {
+            auto bytes = reinterpret_cast<const char*>(&value);
+            buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+        }
+
+        /**
+         *  Appends the raw bytes of an array of objects to a buffer.
+         *  @param buffer the buffer to append to.
+         *  @param values the first object to append.
+         *  @param count the number of objects to append.
+         */
+        template<typename T> void append(std::vector<char>& buffer, const T* values, std::size_t count)
+        {
+            auto bytes = reinterpret_cast<const char*>(values);
+            buffer.insert(buffer.end(), bytes, bytes + sizeof(T) * count);
+        }
+
+        /**
+         *  Pads a buffer with zeros to the given alignment.
+         *  @param buffer the buffer to pad.
+         *  @param alignment the alignment in bytes.
+         */
+        inline void align(std::vector<char>& buffer, std::size_t alignment)
+        {
+            buffer.resize((buffer.size() + alignment - 1) / alignment * alignment, 0);
+        }
+    }
+}
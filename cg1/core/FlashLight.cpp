@@ -55,6 +55,7 @@ void FlashLight::lookAt(glm::vec3 P, glm::vec3 C)
 	glm::vec3 lookDir = glm::normalize(C-P);
 
 	m_ModelMatrix = glm::inverse(viewTransform);
+	updateBounds();
 
 	m_light->position = glm::vec4(P,1);
 	m_light->coneDirection = lookDir;
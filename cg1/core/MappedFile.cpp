@@ -0,0 +1,140 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace cg1 {
+
+    /** Default constructor, creates an empty mapping. */
+    MappedFile::MappedFile() noexcept :
+        data_{ nullptr },
+        size_{ 0 }
+#ifdef _WIN32
+        , file_{ nullptr },
+        mapping_{ nullptr }
+#endif
+    {
+    }
+
+    /**
+     *  Constructor, maps a file into memory.
+     *  Empty files or files that cannot be opened result in a mapping that is not open.
+     *  @param filename the name of the file to map.
+     */
+    MappedFile::MappedFile(const std::string& filename) :
+        MappedFile()
+    {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            CloseHandle(file);
+            return;
+        }
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr) {
+            CloseHandle(file);
+            return;
+        }
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (view == nullptr) {
+            CloseHandle(mapping);
+            CloseHandle(file);
+            return;
+        }
+        file_ = file;
+        mapping_ = mapping;
+        data_ = static_cast<const char*>(view);
+        size_ = static_cast<std::size_t>(fileSize.QuadPart);
+#else
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+            close(fd);
+            return;
+        }
+        void* view = mmap(nullptr, static_cast<std::size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        // the mapping keeps its own reference to the file.
+        close(fd);
+        if (view == MAP_FAILED) return;
+        data_ = static_cast<const char*>(view);
+        size_ = static_cast<std::size_t>(fileStat.st_size);
+#endif
+    }
+
+    /**
+     *  Move-constructor.
+     *  @param rhs the object to move.
+     */
+    MappedFile::MappedFile(MappedFile&& rhs) noexcept :
+        data_{ rhs.data_ },
+        size_{ rhs.size_ }
+#ifdef _WIN32
+        , file_{ rhs.file_ },
+        mapping_{ rhs.mapping_ }
+#endif
+    {
+        rhs.data_ = nullptr;
+        rhs.size_ = 0;
+#ifdef _WIN32
+        rhs.file_ = nullptr;
+        rhs.mapping_ = nullptr;
+#endif
+    }
+
+    /**
+     *  Move-assignment operator.
+     *  @param rhs the object to move.
+     *  @return reference to this object.
+     */
+    MappedFile& MappedFile::operator=(MappedFile&& rhs) noexcept
+    {
+        if (this != &rhs) {
+            unmap();
+            data_ = rhs.data_;
+            size_ = rhs.size_;
+            rhs.data_ = nullptr;
+            rhs.size_ = 0;
+#ifdef _WIN32
+            file_ = rhs.file_;
+            mapping_ = rhs.mapping_;
+            rhs.file_ = nullptr;
+            rhs.mapping_ = nullptr;
+#endif
+        }
+        return *this;
+    }
+
+    /** Destructor. */
+    MappedFile::~MappedFile() noexcept
+    {
+        unmap();
+    }
+
+    /** Releases the mapping. */
+    void MappedFile::unmap() noexcept
+    {
+#ifdef _WIN32
+        if (data_ != nullptr) UnmapViewOfFile(data_);
+        if (mapping_ != nullptr) CloseHandle(mapping_);
+        if (file_ != nullptr) CloseHandle(file_);
+        file_ = nullptr;
+        mapping_ = nullptr;
+#else
+        if (data_ != nullptr) munmap(const_cast<char*>(data_), size_);
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+}
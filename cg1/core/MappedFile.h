@@ -0,0 +1,43 @@
+#pragma once
+
+#include "cg1.h"
+#include <cstddef>
+
+namespace cg1 {
+
+    /**
+     * Read-only view of a whole file mapped into memory.
+     */
+    class MappedFile final
+    {
+    public:
+        MappedFile() noexcept;
+        explicit MappedFile(const std::string& filename);
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        MappedFile(MappedFile&&) noexcept;
+        MappedFile& operator=(MappedFile&&) noexcept;
+        ~MappedFile() noexcept;
+
+        /** Returns whether the file could be mapped. */
+        bool isOpen() const noexcept { return data_ != nullptr; }
+        /** Returns the first byte of the mapped file. */
+        const char* data() const noexcept { return data_; }
+        /** Returns the size of the mapped file in bytes. */
+        std::size_t size() const noexcept { return size_; }
+
+    private:
+        void unmap() noexcept;
+
+        /** Holds the mapped memory. */
+        const char* data_;
+        /** Holds the size of the mapping. */
+        std::size_t size_;
+#ifdef _WIN32
+        /** Holds the file handle. */
+        void* file_;
+        /** Holds the file mapping handle. */
+        void* mapping_;
+#endif
+    };
+}
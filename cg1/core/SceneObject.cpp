@@ -1,10 +1,14 @@
 #include "SceneObject.h"
 #include <glm/glm.hpp>
 #include <type_traits>
+#include <algorithm>
 #include "../gfx/GPUProgram.h"
 #include "../core/Camera.h"
 #include "../gfx/Texture.h"
+#include "../gfx/TextureStreamer.h"
 #include "../gfx/Mesh.h"
+#include "../gfx/BoundingVolumeHierarchy.h"
+#include "AssetRegistry.h"
 #include <imgui.h>
 #include <glm/gtc/matrix_transform.hpp>
 
@@ -22,53 +26,136 @@ SceneObject::SceneObject()
 
 SceneObject::~SceneObject()
 {
+	if (m_pBvh && m_bvhLeaf >= 0)
+		m_pBvh->remove(m_bvhLeaf);
 }
 
-SceneObject::SceneObject(const std::string& mesh, std::initializer_list<std::string> textures) : m_ModelMatrix(glm::mat4(1.0)){
+SceneObject::SceneObject(const std::string& mesh, std::initializer_list<TextureFile> textures, MeshUsage meshUsage) : m_ModelMatrix(glm::mat4(1.0)){
 	bumpMappingStatus = 0;
-	
-	m_pMesh = std::make_unique<Mesh>(PATH_MESHES + "/" + mesh);
-	int i = 0;
-	for (std::initializer_list<std::string>::iterator it = textures.begin(); it != textures.end(); ++it) {
-		std::cout << "Loading texture " << *it << " ...";
-		m_Textures.push_back(std::make_unique<Texture>(PATH_TEXTURES + "/" + *it));
-		glActiveTexture(GL_TEXTURE0 + i);
-		glBindTexture(GL_TEXTURE_2D, m_Textures.back()->getTextureId());
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glGenerateMipmap(GL_TEXTURE_2D);
-		std::cout << "Done." << std::endl;
-		i++;
-	}
 	m_shaderMode = tShaderMode::DEFAULT;
+
+	// the files are loaded in the background and shared with other objects using them,
+	// the object is drawn once the mesh and all textures are uploaded
+	AssetRegistry& registry = AssetRegistry::getInstance();
+	m_pMesh = registry.getMesh(PATH_MESHES + "/" + mesh, VertexFormat::Packed, meshUsage);
+	for (std::initializer_list<TextureFile>::iterator it = textures.begin(); it != textures.end(); ++it)
+		m_Textures.push_back(registry.getTexture(PATH_TEXTURES + "/" + it->filename, it->usage));
 }
 
-void SceneObject::bindTexturesAndDrawMesh() {
-	int i = 0;
-	for (std::vector<std::unique_ptr<Texture> >::iterator it = m_Textures.begin(); it != m_Textures.end(); ++it) {
-		glActiveTexture(GL_TEXTURE0 + i);
-		glBindTexture(GL_TEXTURE_2D, (*it)->getTextureId());
-		++i;
+bool SceneObject::isLoaded()
+{
+	if (!m_pMesh || !m_pMesh->isLoaded())
+		return false;
+	for (std::vector<std::shared_ptr<TextureAsset> >::iterator it = m_Textures.begin(); it != m_Textures.end(); ++it) {
+		if (!(*it)->isLoaded())
+			return false;
+	}
+	return true;
+}
+
+void SceneObject::bindTextures() {
+	if (!isLoaded())
+		return;
+	for (unsigned int i = 0; i < m_Textures.size() && i < 2; ++i)
+		TextureArena::getInstance().bind(i, m_Textures[i]->get()->getAllocation());
+}
+
+glm::ivec2 SceneObject::getTextureLayers() {
+	glm::ivec2 layers(0, 0);
+	if (!isLoaded())
+		return layers;
+	for (unsigned int i = 0; i < m_Textures.size() && i < 2; ++i)
+		layers[i] = m_Textures[i]->get()->getAllocation().layer;
+	return layers;
+}
+
+glm::ivec2 SceneObject::getTexturePools() {
+	glm::ivec2 pools(-1, -1);
+	if (!isLoaded())
+		return pools;
+	for (unsigned int i = 0; i < m_Textures.size() && i < 2; ++i)
+		pools[i] = m_Textures[i]->get()->getAllocation().pool;
+	return pools;
+}
+
+void SceneObject::drawMesh(const LodSelection* lodSelection, ClusterCulling* clusterCulling,
+		SubMeshCulling* subMeshCulling) {
+	if (!isLoaded())
+		return;
+	if (lodSelection)
+		m_pMesh->get()->DrawComplete(m_ModelMatrix, *lodSelection, clusterCulling, subMeshCulling);
+	else
+		m_pMesh->get()->DrawComplete();
+}
+
+BoundingVolume SceneObject::getBoundingVolume() {
+	if (!m_pMesh || !m_pMesh->isLoaded())
+		return BoundingVolume();
+	return m_pMesh->get()->GetBoundingVolume().transform(m_ModelMatrix);
+}
+
+void SceneObject::setBoundingVolumeHierarchy(BoundingVolumeHierarchy* bvh, std::uint32_t index) {
+	if (m_pBvh && m_bvhLeaf >= 0)
+		m_pBvh->remove(m_bvhLeaf);
+	m_pBvh = bvh;
+	m_bvhLeaf = -1;
+	m_bvhIndex = index;
+	updateBounds();
+}
+
+bool SceneObject::updateBounds() {
+	if (!m_pBvh)
+		return false;
+	BoundingVolume volume = getBoundingVolume();
+	if (volume.isEmpty())
+		return false;
+	// leaves only move in the tree if the object leaves their enlarged box
+	if (m_bvhLeaf < 0)
+		m_bvhLeaf = m_pBvh->insert(volume, m_bvhIndex);
+	else
+		m_pBvh->update(m_bvhLeaf, volume);
+	return true;
+}
+
+void SceneObject::requestTextureLevels(const LodSelection& lodSelection) {
+	if (!m_pMesh || !m_pMesh->isLoaded())
+		return;
+	// the projected diameter of the bounding sphere approximates the size of the textures on screen
+	glm::vec4 sphere = m_pMesh->get()->GetBoundingSphere();
+	float scale = std::max(glm::length(glm::vec3(m_ModelMatrix[0])),
+		std::max(glm::length(glm::vec3(m_ModelMatrix[1])), glm::length(glm::vec3(m_ModelMatrix[2]))));
+	glm::vec3 center = glm::vec3(m_ModelMatrix * glm::vec4(glm::vec3(sphere), 1.0f));
+	float distance = std::max(glm::length(center - lodSelection.cameraPosition) - scale * sphere.w, 1e-3f);
+	float footprint = 2.0f * sphere.w * scale * lodSelection.pixelScale / distance;
+	for (std::vector<std::shared_ptr<TextureAsset> >::iterator it = m_Textures.begin(); it != m_Textures.end(); ++it) {
+		if ((*it)->isLoaded())
+			TextureStreamer::getInstance().request(*(*it)->get(), footprint);
 	}
-	m_pMesh->DrawComplete();
+}
+
+bool SceneObject::hasPackedVertices()
+{
+	return m_pMesh && m_pMesh->isLoaded() && m_pMesh->get()->HasPackedVertices();
 }
 
 void SceneObject::setTransformation(glm::vec3 T, glm::vec3 RAxis, float angle, glm::vec3 S)
 {
 	m_ModelMatrix = glm::translate(glm::mat4(1.0f), T)*glm::rotate(glm::mat4(1.0f), angle, RAxis)*glm::scale(glm::mat4(1.0f),S);
+	updateBounds();
 }
 void SceneObject::translate(glm::vec3 direction) {
 	m_ModelMatrix = glm::translate(m_ModelMatrix, direction);
+	updateBounds();
 }
 
 void SceneObject::rotate(GLfloat angle, glm::vec3 axis) {
 	m_ModelMatrix = glm::rotate(m_ModelMatrix, angle, axis);
+	updateBounds();
 }
 
 void SceneObject::scale(glm::vec3 factors) {
 	m_ModelMatrix = glm::scale(m_ModelMatrix, factors);
+	updateBounds();
 }
 
 glm::mat4 SceneObject::getModelMatrix() {
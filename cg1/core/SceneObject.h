@@ -3,13 +3,17 @@
 #include <glm/glm.hpp>
 #include "core/Camera.h"
 #include "core/FreeCamera.h"
+#include "core/AssetRegistry.h"
 
 namespace cg1 {
 
 	class GPUProgram;
 	class Camera;
-	class Mesh;
-	class Texture;
+	struct LodSelection;
+	struct ClusterCulling;
+	struct SubMeshCulling;
+	struct BoundingVolume;
+	class BoundingVolumeHierarchy;
 	
 	static const std::string PATH_MESHES = "meshes";
 	static const std::string PATH_TEXTURES = "textures";
@@ -28,6 +32,15 @@ namespace cg1 {
 		};
 		MaterialAttributes materialAttributes;
 
+		// a texture file and what it is used for, plain file names are color textures.
+		// the first two textures are bound to the color and normal map samplers
+		struct TextureFile {
+		public:
+			TextureFile(const char* filename, TextureUsage usage = TextureUsage::Color) : filename(filename), usage(usage) {}
+			std::string filename;
+			TextureUsage usage;
+		};
+
         typedef enum {
         	DEFAULT = 0,
 			WATER = 1,
@@ -36,7 +49,7 @@ namespace cg1 {
         } tShaderMode;
 
 		SceneObject();
-		SceneObject(const std::string& mesh, std::initializer_list<std::string> textures);
+		SceneObject(const std::string& mesh, std::initializer_list<TextureFile> textures, MeshUsage meshUsage = MeshUsage::Static);
 		virtual ~SceneObject();
 
 		typedef enum{
@@ -45,7 +58,23 @@ namespace cg1 {
 		} tObjectType;
 		virtual tObjectType getType(){return tObjectType::TYPE_DEFAULT;}
 
-		void bindTexturesAndDrawMesh();
+		// binds the texture arrays (only if they change), diffuse texture to unit 0 and normal map to unit 1
+		void bindTextures();
+		// the layers of the diffuse texture and the normal map inside their texture arrays
+		glm::ivec2 getTextureLayers();
+		// the texture arena pools of the diffuse texture and the normal map, -1 if not loaded
+		glm::ivec2 getTexturePools();
+		// draws the full mesh if no level of detail selection is given, clusters and sub-meshes are only culled if a view is given
+		void drawMesh(const LodSelection* lodSelection = nullptr, ClusterCulling* clusterCulling = nullptr,
+				SubMeshCulling* subMeshCulling = nullptr);
+		// the bounding box and sphere of the mesh in world space, empty if the mesh is not loaded
+		BoundingVolume getBoundingVolume();
+		// registers the object in a bounding volume hierarchy, the leaf follows every change of the model matrix
+		void setBoundingVolumeHierarchy(BoundingVolumeHierarchy* bvh, std::uint32_t index);
+		// moves the leaf to the current bounds, false if the mesh is not loaded yet and the object has no leaf
+		bool updateBounds();
+		// tells the texture streamer which mip levels the textures need at the objects current screen size
+		void requestTextureLevels(const LodSelection& lodSelection);
 
 		// transformations for m_pModelMatrix
 		void translate(glm::vec3 direction);
@@ -54,6 +83,12 @@ namespace cg1 {
 		void scale(glm::vec3 factors);
 		void setNormalMappingStatus(int status);
 		int getNormalMappingStatus() { return bumpMappingStatus; }
+		// whether the mesh and all textures are loaded, objects are not drawn before
+		bool isLoaded();
+		// whether the object has a mesh at all, objects without one are never drawn
+		bool hasMesh() { return m_pMesh != nullptr; }
+		// whether the mesh uses a packed vertex format the shader has to decode
+		bool hasPackedVertices();
 
 		virtual void setTransformation(glm::vec3 T, glm::vec3 RAxis, float angle, glm::vec3 S);
 
@@ -68,13 +103,19 @@ namespace cg1 {
 		void setShaderMode(tShaderMode mode){m_shaderMode = mode;}
 		tShaderMode getShaderMode(){return m_shaderMode;}
 	protected:
-		std::unique_ptr<Mesh> m_pMesh;
-		std::vector<std::unique_ptr<Texture> > m_Textures;
+		// shared with all objects using the same files
+		std::shared_ptr<MeshAsset> m_pMesh;
+		std::vector<std::shared_ptr<TextureAsset> > m_Textures;
 
 		glm::mat4 m_ModelMatrix;
 		tShaderMode m_shaderMode;
 
 		int bumpMappingStatus = 1;
+
+		// the hierarchy the object is registered in, its leaf (-1 while the mesh is not loaded) and the index it reports
+		BoundingVolumeHierarchy* m_pBvh = nullptr;
+		int m_bvhLeaf = -1;
+		std::uint32_t m_bvhIndex = 0;
 	};
 
 }
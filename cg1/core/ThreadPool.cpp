@@ -0,0 +1,110 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+
+namespace cg1 {
+
+    /**
+     *  Constructor, starts the worker threads.
+     *  @param numThreads the number of worker threads.
+     */
+    ThreadPool::ThreadPool(unsigned int numThreads) :
+        stop_{ false }
+    {
+        for (unsigned int i = 0; i < std::max(numThreads, 1u); ++i) workers_.emplace_back([this]() { workerLoop(); });
+    }
+
+    /** Destructor, finishes all queued tasks and joins the worker threads. */
+    ThreadPool::~ThreadPool() noexcept
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        condition_.notify_all();
+        for (auto& worker : workers_) worker.join();
+    }
+
+    /**
+     *  Returns the thread pool shared by all resource loaders, one thread per hardware thread.
+     *  @return the shared thread pool.
+     */
+    ThreadPool& ThreadPool::getShared()
+    {
+        static ThreadPool sharedPool(std::thread::hardware_concurrency());
+        return sharedPool;
+    }
+
+    /**
+     *  Runs a function over a range of items split into blocks. The calling thread works on blocks, too, so it
+     *  is safe to call this from inside a task of the same pool.
+     *  @param count the number of items.
+     *  @param grainSize the minimum number of items per block.
+     *  @param body the function called with the begin and end of each block.
+     */
+    void ThreadPool::parallelFor(std::size_t count, std::size_t grainSize,
+        const std::function<void(std::size_t, std::size_t)>& body)
+    {
+        if (count == 0) return;
+        auto blockSize = std::max(grainSize, (count + 4 * getNumThreads() - 1) / (4 * getNumThreads()));
+        auto numBlocks = (count + blockSize - 1) / blockSize;
+        if (numBlocks == 1) {
+            body(0, count);
+            return;
+        }
+
+        struct SharedState
+        {
+            std::atomic<std::size_t> nextBlock{ 0 };
+            std::size_t finishedBlocks = 0;
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        auto state = std::make_shared<SharedState>();
+
+        // helpers that start after all blocks are taken return immediately, so nobody waits for them.
+        auto work = [state, &body, count, blockSize, numBlocks]() {
+            std::size_t block;
+            while ((block = state->nextBlock++) < numBlocks) {
+                body(block * blockSize, std::min(count, (block + 1) * blockSize));
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (++state->finishedBlocks == numBlocks) state->finished.notify_all();
+            }
+        };
+        auto numHelpers = std::min(static_cast<std::size_t>(getNumThreads()), numBlocks - 1);
+        for (std::size_t i = 0; i < numHelpers; ++i) post(work);
+        work();
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->finished.wait(lock, [&state, numBlocks]() { return state->finishedBlocks == numBlocks; });
+    }
+
+    /**
+     *  Adds a task to the queue.
+     *  @param task the task to add.
+     */
+    void ThreadPool::post(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push_back(std::move(task));
+        }
+        condition_.notify_one();
+    }
+
+    /** Executes queued tasks until the pool is destroyed. */
+    void ThreadPool::workerLoop()
+    {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                condition_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+                if (tasks_.empty()) return;
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "cg1.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+
+namespace cg1 {
+
+    /**
+     * Fixed set of worker threads executing queued tasks.
+     */
+    class ThreadPool final
+    {
+    public:
+        explicit ThreadPool(unsigned int numThreads);
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+        ThreadPool(ThreadPool&&) = delete;
+        ThreadPool& operator=(ThreadPool&&) = delete;
+        ~ThreadPool() noexcept;
+
+        static ThreadPool& getShared();
+
+        /** Returns the number of worker threads. */
+        unsigned int getNumThreads() const noexcept { return static_cast<unsigned int>(workers_.size()); }
+
+        /**
+         *  Queues a task for execution on a worker thread.
+         *  @param task the task to execute.
+         *  @return future holding the result of the task.
+         */
+        template<typename F> auto enqueue(F&& task) -> std::future<decltype(task())>
+        {
+            using Result = decltype(task());
+            auto packagedTask = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+            auto result = packagedTask->get_future();
+            post([packagedTask]() { (*packagedTask)(); });
+            return result;
+        }
+
+        void parallelFor(std::size_t count, std::size_t grainSize, const std::function<void(std::size_t, std::size_t)>& body);
+
+    private:
+        void post(std::function<void()> task);
+        void workerLoop();
+
+        /** Holds the worker threads. */
+        std::vector<std::thread> workers_;
+        /** Holds the queued tasks. */
+        std::deque<std::function<void()>> tasks_;
+        /** Holds the mutex guarding the task queue. */
+        std::mutex mutex_;
+        /** Holds the condition variable signaling new tasks. */
+        std::condition_variable condition_;
+        /** Holds whether the workers should stop. */
+        bool stop_;
+    };
+}
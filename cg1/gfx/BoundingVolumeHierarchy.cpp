@@ -0,0 +1,442 @@
+#include "BoundingVolumeHierarchy.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+namespace cg1 {
+
+    namespace {
+        /** The position of a volume relative to a frustum. */
+        enum class Containment { Outside, Intersecting, Inside };
+
+        /**
+         *  Tests a volume against the planes of a frustum. The volume reaches the smaller of the projected box and
+         *  the sphere from its center.
+         *  @param frustum the frustum.
+         *  @param center the center of the volume.
+         *  @param extent the half size of the box.
+         *  @param radius the radius of the sphere.
+         *  @return the position of the volume.
+         */
+        Containment classify(const Frustum& frustum, const glm::vec3& center, const glm::vec3& extent, float radius)
+        {
+            auto result = Containment::Inside;
+            for (const auto& plane : frustum.planes) {
+                auto distance = glm::dot(glm::vec3(plane), center) + plane.w;
+                auto reach = std::min(glm::dot(glm::abs(glm::vec3(plane)), extent), radius);
+                if (distance + reach < 0.0f) return Containment::Outside;
+                if (distance - reach < 0.0f) result = Containment::Intersecting;
+            }
+            return result;
+        }
+
+        /**
+         *  Returns the surface area of a box, the cost of a node when inserting leaves.
+         *  @param boxMin the minimum of the box.
+         *  @param boxMax the maximum of the box.
+         *  @return the surface area.
+         */
+        float surfaceArea(const glm::vec3& boxMin, const glm::vec3& boxMax)
+        {
+            auto size = boxMax - boxMin;
+            return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+        }
+
+        /**
+         *  Intersects a ray with a box (slab test).
+         *  @param origin the origin of the ray.
+         *  @param inverseDirection the component-wise inverse of the ray direction.
+         *  @param boxMin the minimum of the box.
+         *  @param boxMax the maximum of the box.
+         *  @param maxDistance the length of the ray.
+         *  @param surface whether the ray hits the surface of the box, a box containing the origin is then hit where
+         *      the ray leaves it instead of at the origin.
+         *  @return the distance to the box, infinity if the ray misses it.
+         */
+        float intersectBox(const glm::vec3& origin, const glm::vec3& inverseDirection, const glm::vec3& boxMin,
+            const glm::vec3& boxMax, float maxDistance, bool surface = false)
+        {
+            auto t0 = (boxMin - origin) * inverseDirection;
+            auto t1 = (boxMax - origin) * inverseDirection;
+            auto tNear = glm::min(t0, t1), tFar = glm::max(t0, t1);
+            auto enter = std::max(std::max(tNear.x, tNear.y), tNear.z);
+            auto leave = std::min(std::min(tFar.x, tFar.y), tFar.z);
+            if (enter > leave || leave < 0.0f) return std::numeric_limits<float>::infinity();
+            auto distance = enter >= 0.0f ? enter : surface ? leave : 0.0f;
+            return distance <= maxDistance ? distance : std::numeric_limits<float>::infinity();
+        }
+
+        /**
+         *  Returns the distance of a point to a box.
+         *  @param point the point.
+         *  @param boxMin the minimum of the box.
+         *  @param boxMax the maximum of the box.
+         *  @return the distance, 0 if the point is inside.
+         */
+        float distanceToBox(const glm::vec3& point, const glm::vec3& boxMin, const glm::vec3& boxMax)
+        {
+            return glm::length(glm::max(glm::max(boxMin - point, point - boxMax), glm::vec3(0.0f)));
+        }
+    }
+
+    /**
+     *  Constructor.
+     *  @param margin the distance the boxes of leaves are enlarged by, a volume moving less than it keeps its leaf.
+     */
+    BoundingVolumeHierarchy::BoundingVolumeHierarchy(float margin) :
+        root_{ -1 },
+        freeList_{ -1 },
+        numLeaves_{ 0 },
+        margin_{ margin }
+    {
+    }
+
+    /**
+     *  Adds a volume.
+     *  @param volume the volume, must not be empty.
+     *  @param index the index reported by queries.
+     *  @return the leaf, used to update and remove the volume.
+     */
+    int BoundingVolumeHierarchy::insert(const BoundingVolume& volume, std::uint32_t index)
+    {
+        assert(!volume.isEmpty());
+        auto leaf = allocateNode();
+        auto& node = nodes_[leaf];
+        node.boxMin = volume.center - volume.extent - glm::vec3(margin_);
+        node.boxMax = volume.center + volume.extent + glm::vec3(margin_);
+        node.volume = volume;
+        node.height = 0;
+        node.index = index;
+        insertLeaf(leaf);
+        ++numLeaves_;
+        return leaf;
+    }
+
+    /**
+     *  Changes the volume of a leaf. The tree only changes if the volume leaves the enlarged box of the leaf.
+     *  @param leaf the leaf returned by insert.
+     *  @param volume the new volume, must not be empty.
+     */
+    void BoundingVolumeHierarchy::update(int leaf, const BoundingVolume& volume)
+    {
+        assert(nodes_[leaf].isLeaf() && nodes_[leaf].height == 0 && !volume.isEmpty());
+        auto& node = nodes_[leaf];
+        node.volume = volume;
+        auto boxMin = volume.center - volume.extent, boxMax = volume.center + volume.extent;
+        if (glm::all(glm::greaterThanEqual(boxMin, node.boxMin)) && glm::all(glm::lessThanEqual(boxMax, node.boxMax))) return;
+
+        removeLeaf(leaf);
+        node.boxMin = boxMin - glm::vec3(margin_);
+        node.boxMax = boxMax + glm::vec3(margin_);
+        insertLeaf(leaf);
+    }
+
+    /**
+     *  Removes a volume.
+     *  @param leaf the leaf returned by insert.
+     */
+    void BoundingVolumeHierarchy::remove(int leaf)
+    {
+        assert(nodes_[leaf].isLeaf() && nodes_[leaf].height == 0);
+        removeLeaf(leaf);
+        freeNode(leaf);
+        --numLeaves_;
+    }
+
+    /**
+     *  Collects the volumes inside of a frustum. Nodes completely inside add all of their leaves without further
+     *  tests, nodes completely outside are skipped with all of their leaves.
+     *  @param frustum the frustum in the space of the volumes.
+     *  @param visible the list the visible leaves are appended to.
+     *  @return the number of visible leaves.
+     */
+    std::size_t BoundingVolumeHierarchy::cull(const Frustum& frustum, std::vector<VisibleLeaf>& visible) const
+    {
+        auto numVisible = visible.size();
+        if (root_ < 0) return 0;
+
+        // the sign of a stack entry tells whether the node is known to be inside.
+        stack_.clear();
+        stack_.push_back(root_ + 1);
+        while (!stack_.empty()) {
+            auto entry = stack_.back();
+            stack_.pop_back();
+            const auto& node = nodes_[std::abs(entry) - 1];
+            auto containment = Containment::Inside;
+            if (entry > 0) {
+                if (node.isLeaf()) containment = classify(frustum, node.volume.center, node.volume.extent, node.volume.radius);
+                else containment = classify(frustum, 0.5f * (node.boxMin + node.boxMax), 0.5f * (node.boxMax - node.boxMin),
+                    std::numeric_limits<float>::infinity());
+            }
+            if (containment == Containment::Outside) continue;
+
+            if (node.isLeaf()) visible.push_back(VisibleLeaf{ node.index, containment == Containment::Inside });
+            else {
+                auto sign = containment == Containment::Inside ? -1 : 1;
+                stack_.push_back(sign * (node.children[1] + 1));
+                stack_.push_back(sign * (node.children[0] + 1));
+            }
+        }
+        return visible.size() - numVisible;
+    }
+
+    /**
+     *  Finds the closest volume hit by a ray. The surfaces of the boxes of the leaves are intersected, so a volume
+     *  around the origin is hit where the ray leaves it and does not hide the volumes inside of it. The closer
+     *  child is visited first and nodes farther away than the closest hit are skipped.
+     *  @param origin the origin of the ray.
+     *  @param direction the normalized direction of the ray.
+     *  @param maxDistance the length of the ray.
+     *  @return the closest hit.
+     */
+    BoundingVolumeHierarchy::RayHit BoundingVolumeHierarchy::intersectRay(const glm::vec3& origin,
+        const glm::vec3& direction, float maxDistance) const
+    {
+        RayHit result;
+        if (root_ < 0) return result;
+
+        // a zero component gives an infinite inverse, the slab test handles it.
+        auto inverseDirection = 1.0f / direction;
+        auto closest = maxDistance;
+        stack_.clear();
+        stack_.push_back(root_);
+        while (!stack_.empty()) {
+            const auto& node = nodes_[stack_.back()];
+            stack_.pop_back();
+            if (node.isLeaf()) {
+                auto distance = intersectBox(origin, inverseDirection, node.volume.center - node.volume.extent,
+                    node.volume.center + node.volume.extent, closest, true);
+                if (distance <= closest) {
+                    closest = distance;
+                    result.index = node.index;
+                    result.distance = distance;
+                }
+                continue;
+            }
+
+            float distances[2];
+            for (int i = 0; i < 2; ++i) {
+                const auto& child = nodes_[node.children[i]];
+                distances[i] = intersectBox(origin, inverseDirection, child.boxMin, child.boxMax, closest);
+            }
+            auto nearChild = distances[1] < distances[0] ? 1 : 0;
+            if (distances[1 - nearChild] <= closest) stack_.push_back(node.children[1 - nearChild]);
+            if (distances[nearChild] <= closest) stack_.push_back(node.children[nearChild]);
+        }
+        return result;
+    }
+
+    /**
+     *  Finds the volume closest to a point, measured to the boxes of the leaves.
+     *  @param point the point.
+     *  @param maxDistance the largest distance searched.
+     *  @return the closest volume, with its index set to invalidIndex if none is within the distance.
+     */
+    BoundingVolumeHierarchy::RayHit BoundingVolumeHierarchy::findNearest(const glm::vec3& point, float maxDistance) const
+    {
+        RayHit result;
+        if (root_ < 0) return result;
+
+        auto closest = maxDistance;
+        stack_.clear();
+        stack_.push_back(root_);
+        while (!stack_.empty()) {
+            const auto& node = nodes_[stack_.back()];
+            stack_.pop_back();
+            if (node.isLeaf()) {
+                auto distance = distanceToBox(point, node.volume.center - node.volume.extent,
+                    node.volume.center + node.volume.extent);
+                if (distance <= closest) {
+                    closest = distance;
+                    result.index = node.index;
+                    result.distance = distance;
+                }
+                continue;
+            }
+
+            float distances[2];
+            for (int i = 0; i < 2; ++i) {
+                const auto& child = nodes_[node.children[i]];
+                distances[i] = distanceToBox(point, child.boxMin, child.boxMax);
+            }
+            auto nearChild = distances[1] < distances[0] ? 1 : 0;
+            if (distances[1 - nearChild] <= closest) stack_.push_back(node.children[1 - nearChild]);
+            if (distances[nearChild] <= closest) stack_.push_back(node.children[nearChild]);
+        }
+        return result;
+    }
+
+    /**
+     *  Takes a node from the free list or adds a new one.
+     *  @return the node, without parent or children.
+     */
+    int BoundingVolumeHierarchy::allocateNode()
+    {
+        int node = freeList_;
+        if (node >= 0) freeList_ = nodes_[node].parent;
+        else {
+            node = static_cast<int>(nodes_.size());
+            nodes_.emplace_back();
+        }
+        nodes_[node].parent = -1;
+        nodes_[node].children[0] = nodes_[node].children[1] = -1;
+        nodes_[node].height = 0;
+        return node;
+    }
+
+    /**
+     *  Puts a node on the free list.
+     *  @param node the node.
+     */
+    void BoundingVolumeHierarchy::freeNode(int node)
+    {
+        nodes_[node].parent = freeList_;
+        nodes_[node].height = -1;
+        freeList_ = node;
+    }
+
+    /**
+     *  Links a leaf into the tree. Descends to the sibling whose box grows the least in surface area, counting the
+     *  growth of all boxes above it, and rebalances the path back to the root.
+     *  @param leaf the leaf with its box set.
+     */
+    void BoundingVolumeHierarchy::insertLeaf(int leaf)
+    {
+        if (root_ < 0) {
+            root_ = leaf;
+            nodes_[leaf].parent = -1;
+            return;
+        }
+
+        auto leafMin = nodes_[leaf].boxMin, leafMax = nodes_[leaf].boxMax;
+        auto sibling = root_;
+        while (!nodes_[sibling].isLeaf()) {
+            const auto& node = nodes_[sibling];
+            auto area = surfaceArea(node.boxMin, node.boxMax);
+            auto combinedArea = surfaceArea(glm::min(node.boxMin, leafMin), glm::max(node.boxMax, leafMax));
+            // pairing with this node creates a parent with the combined box, going deeper enlarges this node.
+            auto cost = 2.0f * combinedArea;
+            auto inheritedCost = 2.0f * (combinedArea - area);
+
+            float childCosts[2];
+            for (int i = 0; i < 2; ++i) {
+                const auto& child = nodes_[node.children[i]];
+                childCosts[i] = surfaceArea(glm::min(child.boxMin, leafMin), glm::max(child.boxMax, leafMax)) + inheritedCost;
+                if (!child.isLeaf()) childCosts[i] -= surfaceArea(child.boxMin, child.boxMax);
+            }
+            if (cost < childCosts[0] && cost < childCosts[1]) break;
+            sibling = node.children[childCosts[1] < childCosts[0] ? 1 : 0];
+        }
+
+        auto oldParent = nodes_[sibling].parent;
+        auto newParent = allocateNode();
+        auto& parent = nodes_[newParent];
+        parent.parent = oldParent;
+        parent.children[0] = sibling;
+        parent.children[1] = leaf;
+        parent.boxMin = glm::min(nodes_[sibling].boxMin, leafMin);
+        parent.boxMax = glm::max(nodes_[sibling].boxMax, leafMax);
+        parent.height = nodes_[sibling].height + 1;
+        nodes_[sibling].parent = newParent;
+        nodes_[leaf].parent = newParent;
+
+        if (oldParent < 0) root_ = newParent;
+        else {
+            auto& children = nodes_[oldParent].children;
+            children[children[0] == sibling ? 0 : 1] = newParent;
+        }
+        refitAncestors(newParent);
+    }
+
+    /**
+     *  Unlinks a leaf from the tree, its sibling takes the place of their parent. The leaf is not freed.
+     *  @param leaf the leaf.
+     */
+    void BoundingVolumeHierarchy::removeLeaf(int leaf)
+    {
+        if (leaf == root_) {
+            root_ = -1;
+            return;
+        }
+
+        auto parent = nodes_[leaf].parent;
+        auto grandParent = nodes_[parent].parent;
+        auto sibling = nodes_[parent].children[nodes_[parent].children[0] == leaf ? 1 : 0];
+        nodes_[sibling].parent = grandParent;
+        nodes_[leaf].parent = -1;
+        freeNode(parent);
+
+        if (grandParent < 0) root_ = sibling;
+        else {
+            auto& children = nodes_[grandParent].children;
+            children[children[0] == parent ? 0 : 1] = sibling;
+            refitAncestors(grandParent);
+        }
+    }
+
+    /**
+     *  Balances a node and all of its ancestors and fits their boxes and heights to their children.
+     *  @param node the lowest node changed.
+     */
+    void BoundingVolumeHierarchy::refitAncestors(int node)
+    {
+        while (node >= 0) {
+            node = balance(node);
+            fitChildren(node);
+            node = nodes_[node].parent;
+        }
+    }
+
+    /**
+     *  Rotates the higher child of a node up if the heights of its children differ by more than one.
+     *  @param node the node, its children need to be balanced.
+     *  @return the node now at the position of the given node.
+     */
+    int BoundingVolumeHierarchy::balance(int node)
+    {
+        if (nodes_[node].isLeaf() || nodes_[node].height < 2) return node;
+
+        auto difference = nodes_[nodes_[node].children[1]].height - nodes_[nodes_[node].children[0]].height;
+        if (difference >= -1 && difference <= 1) return node;
+
+        // the higher child becomes the parent, the node keeps the lower child and the lower grandchild.
+        auto higherSide = difference > 1 ? 1 : 0;
+        auto higher = nodes_[node].children[higherSide];
+        auto grandChildren = nodes_[higher].children;
+        auto keptSide = nodes_[grandChildren[0]].height > nodes_[grandChildren[1]].height ? 0 : 1;
+        auto kept = grandChildren[keptSide], moved = grandChildren[1 - keptSide];
+
+        auto parent = nodes_[node].parent;
+        nodes_[higher].parent = parent;
+        if (parent < 0) root_ = higher;
+        else {
+            auto& children = nodes_[parent].children;
+            children[children[0] == node ? 0 : 1] = higher;
+        }
+
+        nodes_[higher].children[0] = node;
+        nodes_[higher].children[1] = kept;
+        nodes_[node].parent = higher;
+        nodes_[node].children[higherSide] = moved;
+        nodes_[moved].parent = node;
+
+        fitChildren(node);
+        fitChildren(higher);
+        return higher;
+    }
+
+    /**
+     *  Sets the box and the height of an inner node from its children.
+     *  @param node the node.
+     */
+    void BoundingVolumeHierarchy::fitChildren(int node)
+    {
+        auto& inner = nodes_[node];
+        const auto& first = nodes_[inner.children[0]];
+        const auto& second = nodes_[inner.children[1]];
+        inner.boxMin = glm::min(first.boxMin, second.boxMin);
+        inner.boxMax = glm::max(first.boxMax, second.boxMax);
+        inner.height = 1 + std::max(first.height, second.height);
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "cg1.h"
+#include "gfx/FrustumCuller.h"
+#include <glm/glm.hpp>
+
+namespace cg1 {
+
+    /**
+     * Dynamic bounding volume hierarchy over the bounding volumes of many objects. Leaves are inserted next to the
+     * sibling that enlarges the surface area the least and the tree is kept balanced by rotations, so changing a
+     * volume only touches the path to the root. Leaves store a slightly enlarged box, small movements inside of it
+     * do not change the tree at all.
+     */
+    class BoundingVolumeHierarchy final
+    {
+    public:
+        /** The index reported if a query finds nothing. */
+        static constexpr std::uint32_t invalidIndex = 0xffffffffu;
+
+        /** A leaf inside of a frustum. */
+        struct VisibleLeaf
+        {
+            /** Holds the index of the leaf. */
+            std::uint32_t index;
+            /** Holds whether the volume is completely inside of the frustum. */
+            bool contained;
+        };
+
+        /** The closest leaf hit by a ray. */
+        struct RayHit
+        {
+            /** Holds the index of the leaf or invalidIndex if nothing was hit. */
+            std::uint32_t index = invalidIndex;
+            /** Holds the distance along the ray to the surface of the box of the leaf. */
+            float distance = 0.0f;
+        };
+
+        explicit BoundingVolumeHierarchy(float margin = 0.1f);
+
+        int insert(const BoundingVolume& volume, std::uint32_t index);
+        void update(int leaf, const BoundingVolume& volume);
+        void remove(int leaf);
+
+        std::size_t cull(const Frustum& frustum, std::vector<VisibleLeaf>& visible) const;
+        RayHit intersectRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const;
+        RayHit findNearest(const glm::vec3& point, float maxDistance) const;
+
+        /** Returns the number of leaves. */
+        std::size_t size() const noexcept { return numLeaves_; }
+        /** Returns the number of levels, 0 for an empty hierarchy. */
+        int getHeight() const noexcept { return root_ < 0 ? 0 : nodes_[root_].height + 1; }
+
+    private:
+        /** A leaf or an inner node with two children. */
+        struct Node
+        {
+            /** Holds the minimum of the box, enlarged by the margin for leaves. */
+            glm::vec3 boxMin;
+            /** Holds the maximum of the box, enlarged by the margin for leaves. */
+            glm::vec3 boxMax;
+            /** Holds the exact volume of a leaf. */
+            BoundingVolume volume;
+            /** Holds the parent node, -1 for the root. Free nodes use it for the next free node. */
+            int parent;
+            /** Holds the child nodes, -1 for leaves. */
+            int children[2];
+            /** Holds the height above the leaves, 0 for leaves and -1 for free nodes. */
+            int height;
+            /** Holds the index of a leaf. */
+            std::uint32_t index;
+
+            /** Returns whether the node is a leaf. */
+            bool isLeaf() const noexcept { return children[0] < 0; }
+        };
+
+        int allocateNode();
+        void freeNode(int node);
+        void insertLeaf(int leaf);
+        void removeLeaf(int leaf);
+        void refitAncestors(int node);
+        int balance(int node);
+        void fitChildren(int node);
+
+        /** Holds all nodes, free nodes included. */
+        std::vector<Node> nodes_;
+        /** Holds the root node, -1 if the hierarchy is empty. */
+        int root_;
+        /** Holds the first free node, -1 if all nodes are in use. */
+        int freeList_;
+        /** Holds the number of leaves. */
+        std::size_t numLeaves_;
+        /** Holds the distance the boxes of leaves are enlarged by. */
+        float margin_;
+        /** Holds the nodes still to be visited by a query. */
+        mutable std::vector<int> stack_;
+    };
+}
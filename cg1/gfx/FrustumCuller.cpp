@@ -0,0 +1,147 @@
+#include "FrustumCuller.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CG1_CULLING_SSE
+#include <emmintrin.h>
+#endif
+
+namespace cg1 {
+
+    namespace {
+        /** The number of volumes tested at a time. */
+        constexpr std::size_t cullingBatchSize = 4;
+    }
+
+    /**
+     *  Transforms the volume, the box is enlarged to stay axis-aligned.
+     *  @param matrix the affine transformation.
+     *  @return the transformed volume.
+     */
+    BoundingVolume BoundingVolume::transform(const glm::mat4& matrix) const
+    {
+        if (isEmpty()) return *this;
+        BoundingVolume result;
+        result.center = glm::vec3(matrix * glm::vec4(center, 1.0f));
+        glm::mat3 absolute(matrix);
+        for (int i = 0; i < 3; ++i) absolute[i] = glm::abs(absolute[i]);
+        result.extent = absolute * extent;
+        auto scale = std::max(glm::length(glm::vec3(matrix[0])),
+            std::max(glm::length(glm::vec3(matrix[1])), glm::length(glm::vec3(matrix[2]))));
+        result.radius = radius * scale;
+        return result;
+    }
+
+    /**
+     *  Combines two volumes. The sphere is centered on the combined box and encloses both spheres, but is never
+     *  larger than the sphere around the box.
+     *  @param other the volume to combine with.
+     *  @return the volume enclosing both.
+     */
+    BoundingVolume BoundingVolume::merge(const BoundingVolume& other) const
+    {
+        if (other.isEmpty()) return *this;
+        if (isEmpty()) return other;
+        auto boxMin = glm::min(center - extent, other.center - other.extent);
+        auto boxMax = glm::max(center + extent, other.center + other.extent);
+        BoundingVolume result;
+        result.center = 0.5f * (boxMin + boxMax);
+        result.extent = 0.5f * (boxMax - boxMin);
+        result.radius = std::min(glm::length(result.extent), std::max(glm::length(center - result.center) + radius,
+            glm::length(other.center - result.center) + other.radius));
+        return result;
+    }
+
+    /**
+     *  Constructor, extracts the planes from a view-projection matrix (Gribb and Hartmann). With a
+     *  model-view-projection matrix the planes are in object space.
+     *  @param viewProjection the view-projection matrix.
+     */
+    Frustum::Frustum(const glm::mat4& viewProjection)
+    {
+        glm::vec4 w(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+        for (int i = 0; i < 3; ++i) {
+            glm::vec4 row(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+            planes[2 * i] = w + row;
+            planes[2 * i + 1] = w - row;
+        }
+        for (auto& plane : planes) plane /= glm::length(glm::vec3(plane));
+    }
+
+    /** Removes all volumes. */
+    void FrustumCuller::clear() noexcept
+    {
+        numVolumes_ = 0;
+        for (auto* values : { &centerX_, &centerY_, &centerZ_, &extentX_, &extentY_, &extentZ_, &radius_ }) values->clear();
+    }
+
+    /**
+     *  Adds a volume, its index is the number of volumes added before.
+     *  @param volume the volume, empty volumes are never visible.
+     */
+    void FrustumCuller::add(const BoundingVolume& volume)
+    {
+        if (numVolumes_ % cullingBatchSize == 0) {
+            for (auto* values : { &centerX_, &centerY_, &centerZ_, &extentX_, &extentY_, &extentZ_, &radius_ })
+                values->resize(numVolumes_ + cullingBatchSize, 0.0f);
+        }
+        centerX_[numVolumes_] = volume.center.x;
+        centerY_[numVolumes_] = volume.center.y;
+        centerZ_[numVolumes_] = volume.center.z;
+        extentX_[numVolumes_] = volume.extent.x;
+        extentY_[numVolumes_] = volume.extent.y;
+        extentZ_[numVolumes_] = volume.extent.z;
+        // an empty volume gets a radius that cannot reach any plane.
+        radius_[numVolumes_] = volume.isEmpty() ? -std::numeric_limits<float>::infinity() : volume.radius;
+        ++numVolumes_;
+    }
+
+    /**
+     *  Tests all volumes against the planes of a frustum. The volumes are projected onto each plane normal: the box
+     *  reaches |n.x| * e.x + |n.y| * e.y + |n.z| * e.z from the center, the sphere its radius, the smaller of both
+     *  decides.
+     *  @param frustum the frustum in the space of the volumes.
+     *  @param visible the list the indices of the visible volumes are appended to in ascending order.
+     *  @return the number of visible volumes.
+     */
+    std::size_t FrustumCuller::cull(const Frustum& frustum, std::vector<std::uint32_t>& visible) const
+    {
+        auto numVisible = visible.size();
+        for (std::size_t i = 0; i < numVolumes_; i += cullingBatchSize) {
+#ifdef CG1_CULLING_SSE
+            auto cx = _mm_loadu_ps(&centerX_[i]), cy = _mm_loadu_ps(&centerY_[i]), cz = _mm_loadu_ps(&centerZ_[i]);
+            auto ex = _mm_loadu_ps(&extentX_[i]), ey = _mm_loadu_ps(&extentY_[i]), ez = _mm_loadu_ps(&extentZ_[i]);
+            auto radius = _mm_loadu_ps(&radius_[i]);
+            auto inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (const auto& plane : frustum.planes) {
+                auto distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), cx), _mm_mul_ps(_mm_set1_ps(plane.y), cy)),
+                    _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), cz), _mm_set1_ps(plane.w)));
+                auto boxRadius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::abs(plane.x)), ex),
+                    _mm_mul_ps(_mm_set1_ps(std::abs(plane.y)), ey)), _mm_mul_ps(_mm_set1_ps(std::abs(plane.z)), ez));
+                auto reach = _mm_min_ps(boxRadius, radius);
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+            }
+            auto mask = _mm_movemask_ps(inside);
+#else
+            int mask = 0;
+            for (std::size_t k = 0; k < cullingBatchSize; ++k) {
+                auto j = i + k;
+                bool isInside = true;
+                for (const auto& plane : frustum.planes) {
+                    auto distance = plane.x * centerX_[j] + plane.y * centerY_[j] + plane.z * centerZ_[j] + plane.w;
+                    auto boxRadius = std::abs(plane.x) * extentX_[j] + std::abs(plane.y) * extentY_[j]
+                        + std::abs(plane.z) * extentZ_[j];
+                    isInside = isInside && distance + std::min(boxRadius, radius_[j]) >= 0.0f;
+                }
+                if (isInside) mask |= 1 << k;
+            }
+#endif
+            for (std::size_t k = 0; k < cullingBatchSize && i + k < numVolumes_; ++k) {
+                if (mask & (1 << k)) visible.push_back(static_cast<std::uint32_t>(i + k));
+            }
+        }
+        return visible.size() - numVisible;
+    }
+}
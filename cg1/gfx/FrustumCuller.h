@@ -0,0 +1,65 @@
+#pragma once
+
+#include "cg1.h"
+#include <glm/glm.hpp>
+
+namespace cg1 {
+
+    /** An axis-aligned bounding box and a bounding sphere around the center of the box. */
+    struct BoundingVolume
+    {
+        /** Holds the center of the box and the sphere. */
+        glm::vec3 center{ 0.0f };
+        /** Holds the half size of the box along each axis. */
+        glm::vec3 extent{ 0.0f };
+        /** Holds the radius of the sphere, negative if the volume is empty. */
+        float radius = -1.0f;
+
+        /** Returns whether the volume encloses nothing. */
+        bool isEmpty() const noexcept { return radius < 0.0f; }
+        BoundingVolume transform(const glm::mat4& matrix) const;
+        BoundingVolume merge(const BoundingVolume& other) const;
+    };
+
+    /** The planes of a view frustum, normalized and facing inwards. */
+    struct Frustum
+    {
+        explicit Frustum(const glm::mat4& viewProjection);
+
+        /** Holds the left, right, bottom, top, near and far plane. */
+        glm::vec4 planes[6];
+    };
+
+    /**
+     * Bounding volumes stored as structure of arrays, so they are tested against the planes of a frustum four at a
+     * time with SSE where available. A volume is culled if its box or its sphere is outside of one of the planes.
+     */
+    class FrustumCuller final
+    {
+    public:
+        void clear() noexcept;
+        void add(const BoundingVolume& volume);
+        std::size_t cull(const Frustum& frustum, std::vector<std::uint32_t>& visible) const;
+
+        /** Returns the number of volumes. */
+        std::size_t size() const noexcept { return numVolumes_; }
+
+    private:
+        /** Holds the number of volumes, the arrays are padded to a multiple of four. */
+        std::size_t numVolumes_ = 0;
+        /** Holds the x coordinates of the centers. */
+        std::vector<float> centerX_;
+        /** Holds the y coordinates of the centers. */
+        std::vector<float> centerY_;
+        /** Holds the z coordinates of the centers. */
+        std::vector<float> centerZ_;
+        /** Holds the half sizes of the boxes along x. */
+        std::vector<float> extentX_;
+        /** Holds the half sizes of the boxes along y. */
+        std::vector<float> extentY_;
+        /** Holds the half sizes of the boxes along z. */
+        std::vector<float> extentZ_;
+        /** Holds the radii of the spheres. */
+        std::vector<float> radius_;
+    };
+}
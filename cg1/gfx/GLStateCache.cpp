@@ -0,0 +1,198 @@
+#include "GLStateCache.h"
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+namespace cg1 {
+
+    GLStateCache* GLStateCache::instance_ = nullptr;
+
+    namespace {
+        /** The number of texture targets cached per unit, see getTargetIndex. */
+        constexpr int numCachedTargets = 2;
+        /** Marks a binding changed outside of the cache, no texture uses this name. */
+        constexpr GLuint unknownTexture = std::numeric_limits<GLuint>::max();
+    }
+
+    /** Constructor, makes this the cache used by the renderer. Needs a current OpenGL context in its default state. */
+    GLStateCache::GLStateCache() :
+        program_(0),
+        vertexArray_(0),
+        framebuffer_(0),
+        activeUnit_(0),
+        textures_(),
+        viewport_{ 0, 0, 0, 0 }
+    {
+        assert(instance_ == nullptr);
+        instance_ = this;
+        GLint numUnits = 0;
+        glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &numUnits);
+        textures_.resize(static_cast<std::size_t>(numUnits) * numCachedTargets, 0);
+    }
+
+    /** Destructor. */
+    GLStateCache::~GLStateCache() noexcept
+    {
+        instance_ = nullptr;
+    }
+
+    /**
+     *  Returns the cache used by the renderer.
+     *  @return the current state cache.
+     */
+    GLStateCache& GLStateCache::getInstance()
+    {
+        assert(instance_ != nullptr);
+        return *instance_;
+    }
+
+    /**
+     *  Uses a program unless it is in use already.
+     *  @param program the program.
+     */
+    void GLStateCache::useProgram(GLuint program)
+    {
+        countCall(program_ == program);
+        if (program_ == program) return;
+        glUseProgram(program);
+        program_ = program;
+    }
+
+    /**
+     *  Binds a vertex array object unless it is bound already.
+     *  @param vertexArray the vertex array object.
+     */
+    void GLStateCache::bindVertexArray(GLuint vertexArray)
+    {
+        countCall(vertexArray_ == vertexArray);
+        if (vertexArray_ == vertexArray) return;
+        glBindVertexArray(vertexArray);
+        vertexArray_ = vertexArray;
+    }
+
+    /**
+     *  Binds a framebuffer for drawing and reading unless it is bound already.
+     *  @param framebuffer the framebuffer, 0 for the default framebuffer.
+     */
+    void GLStateCache::bindFramebuffer(GLuint framebuffer)
+    {
+        countCall(framebuffer_ == framebuffer);
+        if (framebuffer_ == framebuffer) return;
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        framebuffer_ = framebuffer;
+    }
+
+    /**
+     *  Makes a texture unit active unless it is active already. Only needed to change a texture through its binding.
+     *  @param unit the texture unit.
+     */
+    void GLStateCache::activeTexture(unsigned int unit)
+    {
+        countCall(activeUnit_ == static_cast<int>(unit));
+        if (activeUnit_ == static_cast<int>(unit)) return;
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit_ = static_cast<int>(unit);
+    }
+
+    /**
+     *  Binds a texture to a texture unit unless it is bound already. The unit is only made active if the binding
+     *  changes, so code changing the texture afterwards has to call activeTexture itself.
+     *  @param unit the texture unit.
+     *  @param target the target, only GL_TEXTURE_2D and GL_TEXTURE_2D_ARRAY are cached.
+     *  @param texture the texture.
+     */
+    void GLStateCache::bindTexture(unsigned int unit, GLenum target, GLuint texture)
+    {
+        assert(unit * numCachedTargets < textures_.size());
+        auto targetIndex = getTargetIndex(target);
+        auto bound = targetIndex >= 0 ? &textures_[unit * numCachedTargets + targetIndex] : nullptr;
+        countCall(bound && *bound == texture);
+        if (bound && *bound == texture) return;
+        activeTexture(unit);
+        glBindTexture(target, texture);
+        if (bound) *bound = texture;
+    }
+
+    /**
+     *  Sets the viewport unless it is set already.
+     *  @param x the left border.
+     *  @param y the lower border.
+     *  @param width the width.
+     *  @param height the height.
+     */
+    void GLStateCache::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+    {
+        auto unchanged = viewport_[0] == x && viewport_[1] == y && viewport_[2] == width && viewport_[3] == height;
+        countCall(unchanged);
+        if (unchanged) return;
+        glViewport(x, y, width, height);
+        viewport_[0] = x; viewport_[1] = y; viewport_[2] = width; viewport_[3] = height;
+    }
+
+    /**
+     *  Forgets a program that is deleted, so a new program reusing its name is bound again.
+     *  @param program the deleted program.
+     */
+    void GLStateCache::forgetProgram(GLuint program) noexcept
+    {
+        // deleting the program in use keeps it in use, but it is unused by the time its name is reused.
+        if (program_ == program) program_ = 0;
+    }
+
+    /**
+     *  Forgets a vertex array object that is deleted, deleting it binds vertex array 0.
+     *  @param vertexArray the deleted vertex array object.
+     */
+    void GLStateCache::forgetVertexArray(GLuint vertexArray) noexcept
+    {
+        if (vertexArray_ == vertexArray) vertexArray_ = 0;
+    }
+
+    /**
+     *  Forgets a texture that is deleted, deleting it binds texture 0 to all units it was bound to.
+     *  @param texture the deleted texture.
+     */
+    void GLStateCache::forgetTexture(GLuint texture) noexcept
+    {
+        std::replace(textures_.begin(), textures_.end(), texture, GLuint(0));
+    }
+
+    /** Forgets the active texture unit, used after code outside the cache changed it. */
+    void GLStateCache::invalidateActiveTexture() noexcept
+    {
+        activeUnit_ = -1;
+    }
+
+    /**
+     *  Forgets the texture bound to a target of a unit, used after code outside the cache changed it.
+     *  @param unit the texture unit.
+     *  @param target the target, only GL_TEXTURE_2D and GL_TEXTURE_2D_ARRAY are cached.
+     */
+    void GLStateCache::invalidateTexture(unsigned int unit, GLenum target) noexcept
+    {
+        assert(unit * numCachedTargets < textures_.size());
+        auto targetIndex = getTargetIndex(target);
+        if (targetIndex >= 0) textures_[unit * numCachedTargets + targetIndex] = unknownTexture;
+    }
+
+    /** Finishes a frame, its calls are returned by getLastFrameStatistics. */
+    void GLStateCache::endFrame() noexcept
+    {
+        lastFrame_ = current_;
+        current_ = Statistics();
+    }
+
+    /**
+     *  Returns the index of a texture target inside the bindings of a unit.
+     *  @param target the texture target.
+     *  @return the index or -1 if bindings of the target are not cached.
+     */
+    int GLStateCache::getTargetIndex(GLenum target) noexcept
+    {
+        switch (target) {
+        case GL_TEXTURE_2D: return 0;
+        case GL_TEXTURE_2D_ARRAY: return 1;
+        default: return -1;
+        }
+    }
+}
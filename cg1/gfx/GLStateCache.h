@@ -0,0 +1,75 @@
+#pragma once
+
+#include "cg1.h"
+
+namespace cg1 {
+
+    /**
+     * Shadow copy of the OpenGL bindings the renderer changes most often: the program in use, the vertex array, the
+     * framebuffer, the textures of each texture unit and the viewport. Calls that would not change anything are
+     * skipped. All code changing these bindings needs to go through the cache, everything else has to tell it.
+     */
+    class GLStateCache final
+    {
+    public:
+        /** The number of calls issued to and skipped by the cache. */
+        struct Statistics
+        {
+            /** Holds the number of calls passed to OpenGL. */
+            unsigned int numIssuedCalls = 0;
+            /** Holds the number of calls skipped because they would not change anything. */
+            unsigned int numSkippedCalls = 0;
+        };
+
+        GLStateCache();
+        GLStateCache(const GLStateCache&) = delete;
+        GLStateCache& operator=(const GLStateCache&) = delete;
+        GLStateCache(GLStateCache&&) = delete;
+        GLStateCache& operator=(GLStateCache&&) = delete;
+        ~GLStateCache() noexcept;
+
+        static GLStateCache& getInstance();
+
+        void useProgram(GLuint program);
+        void bindVertexArray(GLuint vertexArray);
+        void bindFramebuffer(GLuint framebuffer);
+        void activeTexture(unsigned int unit);
+        void bindTexture(unsigned int unit, GLenum target, GLuint texture);
+        void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+        void forgetProgram(GLuint program) noexcept;
+        void forgetVertexArray(GLuint vertexArray) noexcept;
+        void forgetTexture(GLuint texture) noexcept;
+        void invalidateActiveTexture() noexcept;
+        void invalidateTexture(unsigned int unit, GLenum target) noexcept;
+        void endFrame() noexcept;
+
+        /** Counts a call of code that caches its own state, like the uniform values of a program. */
+        void countCall(bool skipped) noexcept { ++(skipped ? current_.numSkippedCalls : current_.numIssuedCalls); }
+        /** Returns the calls of the last finished frame. */
+        const Statistics& getLastFrameStatistics() const noexcept { return lastFrame_; }
+
+    private:
+        static int getTargetIndex(GLenum target) noexcept;
+
+        /** Holds the program in use. */
+        GLuint program_;
+        /** Holds the bound vertex array object. */
+        GLuint vertexArray_;
+        /** Holds the framebuffer bound to GL_FRAMEBUFFER. */
+        GLuint framebuffer_;
+        /** Holds the active texture unit, -1 if unknown. */
+        int activeUnit_;
+        /** Holds the texture bound to each cached target of each unit, unknownTexture if unknown. */
+        std::vector<GLuint> textures_;
+        /** Holds the viewport, all zero if unknown. */
+        GLint viewport_[4];
+        /** Holds the calls of the current frame. */
+        Statistics current_;
+        /** Holds the calls of the last finished frame. */
+        Statistics lastFrame_;
+
+        /** Holds the cache used by the renderer. */
+        static GLStateCache* instance_;
+    };
+}
@@ -1,23 +1,45 @@
 #include "GPUProgram.h"
+#include "GLStateCache.h"
+#include "ProgramCache.h"
 #include "Shader.h"
 #include <iostream>
 
 namespace cg1 {
 
+    /**
+     * Constructor. The program is loaded from the program cache if the sources and the driver did not change,
+     * otherwise it is compiled and the binary is stored in the cache.
+     * @param theProgramName the name of the program used to identify during logging.
+     * @param theShaderNames the filenames of all shaders to use in this program.
+     * @param theDefines preprocessor definitions inserted into all shaders, selects a variant of the program.
+     */
+    GPUProgram::GPUProgram(const std::string& theProgramName, std::initializer_list<std::string> theShaderNames,
+        const std::string& theDefines) :
+        GPUProgram(theProgramName, std::vector<std::string>(theShaderNames), theDefines)
+    {
+    }
+
     /**
      * Constructor.
      * @param theProgramName the name of the program used to identify during logging.
      * @param theShaderNames the filenames of all shaders to use in this program.
+     * @param theDefines preprocessor definitions inserted into all shaders, selects a variant of the program.
      */
-    GPUProgram::GPUProgram(const std::string& theProgramName, std::initializer_list<std::string> theShaderNames) :
+    GPUProgram::GPUProgram(const std::string& theProgramName, const std::vector<std::string>& theShaderNames,
+        const std::string& theDefines) :
         programName_(theProgramName),
         shaderNames_(theShaderNames),
+        defines_(theDefines),
         program_(0)
     {
-        for (const auto& shaderName : shaderNames_) {
-            shaders_.push_back(std::make_unique<Shader>(shaderName));
+        if (!loadProgramBinary()) {
+            for (const auto& shaderName : shaderNames_) {
+                shaders_.push_back(std::make_unique<Shader>(shaderName, defines_));
+            }
+            program_ = linkNewProgram(programName_, shaders_, [](const std::unique_ptr<Shader>& shdr) noexcept { return shdr->getShaderId(); });
+            storeProgramBinary();
         }
-        program_ = linkNewProgram(programName_, shaders_, [](const std::unique_ptr<Shader>& shdr) noexcept { return shdr->getShaderId(); });
+        reflectUniforms();
     }
 
     /**
@@ -27,8 +49,14 @@ namespace cg1 {
     GPUProgram::GPUProgram(GPUProgram&& rhs) noexcept :
         programName_(std::move(rhs.programName_)),
         shaderNames_(std::move(rhs.shaderNames_)),
+        defines_(std::move(rhs.defines_)),
         program_(std::move(rhs.program_)),
-        shaders_(std::move(rhs.shaders_))
+        shaders_(std::move(rhs.shaders_)),
+        activeUniforms_(std::move(rhs.activeUniforms_)),
+        uniformBlocks_(std::move(rhs.uniformBlocks_)),
+        uniformBlockBindings_(std::move(rhs.uniformBlockBindings_)),
+        handleSlots_(std::move(rhs.handleSlots_)),
+        handleUniforms_(std::move(rhs.handleUniforms_))
     {
         rhs.program_ = 0;
     }
@@ -44,9 +72,15 @@ namespace cg1 {
             this->~GPUProgram();
             programName_ = std::move(rhs.programName_);
             shaderNames_ = std::move(rhs.shaderNames_);
+            defines_ = std::move(rhs.defines_);
             program_ = rhs.program_;
             rhs.program_ = 0;
             shaders_ = std::move(rhs.shaders_);
+            activeUniforms_ = std::move(rhs.activeUniforms_);
+            uniformBlocks_ = std::move(rhs.uniformBlocks_);
+            uniformBlockBindings_ = std::move(rhs.uniformBlockBindings_);
+            handleSlots_ = std::move(rhs.handleSlots_);
+            handleUniforms_ = std::move(rhs.handleUniforms_);
         }
         return *this;
     }
@@ -60,6 +94,7 @@ namespace cg1 {
     void GPUProgram::unload() noexcept
     {
         if (this->program_ != 0) {
+            GLStateCache::getInstance().forgetProgram(this->program_);
             glDeleteProgram(this->program_);
             this->program_ = 0;
         }
@@ -84,6 +119,7 @@ namespace cg1 {
         for (const auto& shader : shaders) {
             glAttachShader(program, shaderAccessor(shader));
         }
+        if (glProgramParameteri) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         glLinkProgram(program);
 
         GLint status;
@@ -115,6 +151,21 @@ namespace cg1 {
      */
     void GPUProgram::recompileProgram()
     {
+        if (shaders_.empty()) {
+            // the program was loaded from a binary, so there are no shaders to recompile yet.
+            ShaderList newShaders;
+            for (const auto& shaderName : shaderNames_) {
+                newShaders.push_back(std::make_unique<Shader>(shaderName, defines_));
+            }
+            GLuint tempProgram = linkNewProgram(programName_, newShaders, [](const std::unique_ptr<Shader>& shdr) noexcept { return shdr->getShaderId(); });
+            unload();
+            shaders_ = std::move(newShaders);
+            program_ = tempProgram;
+            storeProgramBinary();
+            reflectUniforms();
+            return;
+        }
+
         std::vector<GLuint> newOGLShaders(shaderNames_.size(), 0);
 
         for (unsigned int i = 0; i < shaderNames_.size(); ++i) {
@@ -139,6 +190,159 @@ namespace cg1 {
             shaders_[i]->resetShader(newOGLShaders[i]);
         }
         program_ = tempProgram;
+        storeProgramBinary();
+        reflectUniforms();
+    }
+
+    /**
+     *  Returns the index of an active uniform block.
+     *  @param name the name of the block.
+     *  @return the index or GL_INVALID_INDEX if the block is not active.
+     */
+    GLuint GPUProgram::getUniformBlockIndex(const std::string& name) const
+    {
+        auto block = uniformBlocks_.find(name);
+        return block != uniformBlocks_.end() ? block->second : GL_INVALID_INDEX;
+    }
+
+    /**
+     *  Binds a uniform block to a binding point. The binding is kept when the program is recompiled.
+     *  @param name the name of the block.
+     *  @param binding the uniform buffer binding point.
+     */
+    void GPUProgram::setUniformBlockBinding(const std::string& name, GLuint binding)
+    {
+        uniformBlockBindings_[name] = binding;
+        auto index = getUniformBlockIndex(name);
+        if (index != GL_INVALID_INDEX) glUniformBlockBinding(program_, index, binding);
+    }
+
+    /**
+     *  Queries the active uniforms and uniform blocks of the linked program, then resolves the locations of all
+     *  handles and the uniform block bindings again. Linking resets all uniforms, so the cached values are dropped.
+     */
+    void GPUProgram::reflectUniforms()
+    {
+        activeUniforms_.clear();
+        uniformBlocks_.clear();
+
+        GLint numUniforms = 0, maxNameLength = 0;
+        glGetProgramiv(program_, GL_ACTIVE_UNIFORMS, &numUniforms);
+        glGetProgramiv(program_, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+        std::vector<GLchar> nameBuffer(maxNameLength + 1);
+        for (GLint i = 0; i < numUniforms; ++i) {
+            GLsizei nameLength = 0;
+            GLint size = 0;
+            GLenum type = GL_NONE;
+            glGetActiveUniform(program_, i, static_cast<GLsizei>(nameBuffer.size()), &nameLength, &size, &type,
+                nameBuffer.data());
+            std::string name(nameBuffer.data(), nameLength);
+            // members of uniform blocks have no location.
+            auto location = glGetUniformLocation(program_, name.c_str());
+            if (location < 0) continue;
+
+            // arrays are reported once as "name[0]", each element gets its own entry.
+            auto arrayStart = name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0 ? name.size() - 3 : name.size();
+            if (arrayStart == name.size()) {
+                activeUniforms_[name] = ActiveUniform{ location, type };
+                continue;
+            }
+            auto arrayName = name.substr(0, arrayStart);
+            activeUniforms_[arrayName] = ActiveUniform{ location, type };
+            activeUniforms_[name] = ActiveUniform{ location, type };
+            for (GLint element = 1; element < size; ++element) {
+                auto elementName = arrayName + "[" + std::to_string(element) + "]";
+                activeUniforms_[elementName] = ActiveUniform{ glGetUniformLocation(program_, elementName.c_str()), type };
+            }
+        }
+
+        GLint numBlocks = 0, maxBlockNameLength = 0;
+        glGetProgramiv(program_, GL_ACTIVE_UNIFORM_BLOCKS, &numBlocks);
+        glGetProgramiv(program_, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxBlockNameLength);
+        nameBuffer.resize(maxBlockNameLength + 1);
+        for (GLint i = 0; i < numBlocks; ++i) {
+            GLsizei nameLength = 0;
+            glGetActiveUniformBlockName(program_, i, static_cast<GLsizei>(nameBuffer.size()), &nameLength, nameBuffer.data());
+            uniformBlocks_[std::string(nameBuffer.data(), nameLength)] = i;
+        }
+        for (const auto& binding : uniformBlockBindings_) {
+            auto index = getUniformBlockIndex(binding.first);
+            if (index != GL_INVALID_INDEX) glUniformBlockBinding(program_, index, binding.second);
+        }
+
+        for (const auto& slot : handleSlots_) {
+            auto uniform = activeUniforms_.find(slot.first);
+            auto& handleUniform = handleUniforms_[slot.second];
+            handleUniform.location = uniform != activeUniforms_.end() ? uniform->second.location : -1;
+            handleUniform.hasValue = false;
+        }
+    }
+
+    /**
+     *  Returns the location and value a handle refers to, adds them if no handle of the uniform was requested before.
+     *  @param name the name of the uniform.
+     *  @param matchesType checks the GLSL type of the uniform against the type of the handle.
+     *  @return the location and value owned by the program.
+     */
+    uniform::Slot* GPUProgram::getHandleSlot(const std::string& name, bool(*matchesType)(GLenum))
+    {
+        auto uniform = activeUniforms_.find(name);
+        if (uniform != activeUniforms_.end() && !matchesType(uniform->second.type)) {
+            std::cerr << "Uniform " << name << " of " << programName_ << " is accessed with a different type." << std::endl;
+        }
+
+        auto slot = handleSlots_.find(name);
+        if (slot == handleSlots_.end()) {
+            slot = handleSlots_.emplace(name, handleUniforms_.size()).first;
+            handleUniforms_.emplace_back();
+            handleUniforms_.back().location = uniform != activeUniforms_.end() ? uniform->second.location : -1;
+        }
+        return &handleUniforms_[slot->second];
+    }
+
+    /**
+     *  Hashes the sources of all shaders of the program.
+     *  @return the hash of the definitions, shader names and sources.
+     */
+    std::uint64_t GPUProgram::getSourceKey() const
+    {
+        auto key = filecache::hash(defines_);
+        for (const auto& shaderName : shaderNames_) {
+            key = filecache::hash(shaderName, key);
+            key = filecache::hash(Shader::loadSource(config::shaderBasePath + shaderName), key);
+        }
+        return key;
+    }
+
+    /**
+     *  Loads the program from the program cache.
+     *  @return whether the driver accepted the cached binary.
+     */
+    bool GPUProgram::loadProgramBinary()
+    {
+        if (!ProgramCache::isSupported()) return false;
+        ProgramCache cache(programName_, getSourceKey());
+        if (!cache.load()) return false;
+
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, cache.getFormat(), cache.getBinary(), cache.getBinarySize());
+        GLint status;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        if (status == GL_FALSE) {
+            std::cerr << "Program binary of " << programName_ << " was rejected, compiling from source." << std::endl;
+            glDeleteProgram(program);
+            return false;
+        }
+        program_ = program;
+        return true;
+    }
+
+    /**
+     *  Stores the binary of the linked program in the program cache.
+     */
+    void GPUProgram::storeProgramBinary() const
+    {
+        if (ProgramCache::isSupported()) ProgramCache(programName_, getSourceKey()).store(program_);
     }
 
     void GPUProgram::releaseShaders(const std::vector<GLuint>& shaders) noexcept
@@ -1,18 +1,26 @@
 #pragma once
 
 #include "cg1.h"
+#include "gfx/Uniform.h"
+#include <deque>
+#include <unordered_map>
 
 namespace cg1 {
 
     class Shader;
 
     /**
-     * Complete GPU program with multiple Shader objects working together.
+     * Complete GPU program with multiple Shader objects working together. The active uniforms and uniform blocks are
+     * reflected once after linking, uniforms are accessed through typed handles that stay valid when the program is
+     * recompiled.
      */
     class GPUProgram final
     {
     public:
-        GPUProgram(const std::string& programName, std::initializer_list<std::string> shaderNames);
+        GPUProgram(const std::string& programName, std::initializer_list<std::string> shaderNames,
+            const std::string& defines = std::string());
+        GPUProgram(const std::string& programName, const std::vector<std::string>& shaderNames,
+            const std::string& defines);
         GPUProgram(const GPUProgram& orig) = delete;
         GPUProgram& operator=(const GPUProgram&) = delete;
         GPUProgram(GPUProgram&&) noexcept;
@@ -23,21 +31,78 @@ namespace cg1 {
         /** Returns the OpenGL program id. */
         GLuint getProgramId() const noexcept { return program_; }
 
+        template<typename T> Uniform<T> getUniform(const std::string& name);
+        template<typename T> Uniform<T> getUniform(const std::string& name, std::size_t index);
+        GLuint getUniformBlockIndex(const std::string& name) const;
+        void setUniformBlockBinding(const std::string& name, GLuint binding);
+
     private:
         using ShaderList = std::vector<std::unique_ptr<Shader>>;
 
+        /** An active uniform found by reflection. */
+        struct ActiveUniform
+        {
+            /** Holds the location. */
+            GLint location;
+            /** Holds the GLSL type. */
+            GLenum type;
+        };
+
         /** Holds the program name. */
         std::string programName_;
         /** Holds the shader names. */
         std::vector<std::string> shaderNames_;
+        /** Holds the preprocessor definitions inserted into all shaders. */
+        std::string defines_;
         /** Holds the program. */
         GLuint program_;
         /** Holds a list of shaders used internally. */
         ShaderList shaders_;
+        /** Holds the active uniforms by name, array elements are listed separately. */
+        std::unordered_map<std::string, ActiveUniform> activeUniforms_;
+        /** Holds the active uniform blocks by name. */
+        std::unordered_map<std::string, GLuint> uniformBlocks_;
+        /** Holds the binding points requested for uniform blocks, applied again after every link. */
+        std::unordered_map<std::string, GLuint> uniformBlockBindings_;
+        /** Holds the slot of each uniform a handle was requested for. */
+        std::unordered_map<std::string, std::size_t> handleSlots_;
+        /** Holds the locations and values referenced by the handles, a deque keeps them in place when it grows. */
+        std::deque<uniform::Slot> handleUniforms_;
 
         void unload() noexcept;
+        void reflectUniforms();
+        uniform::Slot* getHandleSlot(const std::string& name, bool(*matchesType)(GLenum));
+        std::uint64_t getSourceKey() const;
+        bool loadProgramBinary();
+        void storeProgramBinary() const;
         template<typename T, typename SHAcc> static GLuint linkNewProgram(const std::string& name,
             const std::vector<T>& shaders, SHAcc shaderAccessor);
         static void releaseShaders(const std::vector<GLuint>& shaders) noexcept;
     };
+
+    /**
+     *  Returns a handle of a uniform. Names follow glGetUniformLocation, e.g. "allLights[2].position". Handles are
+     *  meant to be requested once, setting them does not look up anything.
+     *  @param T the C++ type of the uniform, int for samplers.
+     *  @param name the name of the uniform.
+     *  @return the handle, it is valid as long as the program exists.
+     */
+    template<typename T>
+    Uniform<T> GPUProgram::getUniform(const std::string& name)
+    {
+        return Uniform<T>(getHandleSlot(name, &uniform::TypeTraits<T>::matches));
+    }
+
+    /**
+     *  Returns a handle of an array element.
+     *  @param T the C++ type of the array elements.
+     *  @param name the name of the array.
+     *  @param index the index of the element.
+     *  @return the handle, it is valid as long as the program exists.
+     */
+    template<typename T>
+    Uniform<T> GPUProgram::getUniform(const std::string& name, std::size_t index)
+    {
+        return getUniform<T>(name + "[" + std::to_string(index) + "]");
+    }
 }
@@ -0,0 +1,64 @@
+#include "GPUProgramVariants.h"
+#include "GPUProgram.h"
+#include <cassert>
+
+namespace cg1 {
+
+    /**
+     * Constructor. No program is compiled until it is requested.
+     * @param theProgramName the name of the program used to identify during logging.
+     * @param theShaderNames the filenames of all shaders to use in the programs.
+     * @param theFeatures the preprocessor defines selecting between variants.
+     * @param theDefines preprocessor definitions shared by all variants.
+     */
+    GPUProgramVariants::GPUProgramVariants(const std::string& theProgramName, std::vector<std::string> theShaderNames,
+        std::vector<Feature> theFeatures, const std::string& theDefines) :
+        programName_(theProgramName),
+        shaderNames_(std::move(theShaderNames)),
+        features_(std::move(theFeatures)),
+        defines_(theDefines)
+    {
+    }
+
+    /** Move constructor. */
+    GPUProgramVariants::GPUProgramVariants(GPUProgramVariants&&) noexcept = default;
+    /** Move assignment operator. */
+    GPUProgramVariants& GPUProgramVariants::operator=(GPUProgramVariants&&) noexcept = default;
+    /** Destructor. */
+    GPUProgramVariants::~GPUProgramVariants() noexcept = default;
+
+    /**
+     *  Returns the variant for a combination of feature values, compiles it if it is requested for the first time.
+     *  @param values the value of each feature in the order of the features passed to the constructor.
+     *  @return the program of the variant.
+     */
+    GPUProgram& GPUProgramVariants::getProgram(std::initializer_list<unsigned int> values)
+    {
+        assert(values.size() == features_.size());
+        std::uint64_t key = 0;
+        auto value = values.begin();
+        for (const auto& feature : features_) {
+            assert(*value < feature.numValues);
+            key = key * feature.numValues + *value++;
+        }
+
+        auto& program = programs_[key];
+        if (!program) {
+            auto name = programName_;
+            auto defines = defines_;
+            value = values.begin();
+            for (const auto& feature : features_) {
+                name += "_" + std::to_string(*value);
+                defines += "#define " + feature.name + " " + std::to_string(*value++) + "\n";
+            }
+            program = std::make_unique<GPUProgram>(name, shaderNames_, defines);
+        }
+        return *program;
+    }
+
+    /** Recompiles all variants compiled so far. */
+    void GPUProgramVariants::recompilePrograms()
+    {
+        for (auto& program : programs_) program.second->recompileProgram();
+    }
+}
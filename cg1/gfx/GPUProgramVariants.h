@@ -0,0 +1,51 @@
+#pragma once
+
+#include "cg1.h"
+#include <unordered_map>
+
+namespace cg1 {
+
+    class GPUProgram;
+
+    /**
+     * Compile-time permutations of a GPU program. Every feature is a preprocessor define with a small number of
+     * values, each combination of values is compiled into its own program the first time it is requested.
+     */
+    class GPUProgramVariants final
+    {
+    public:
+        /** A preprocessor define selecting between variants. */
+        struct Feature
+        {
+            /** Holds the name of the define. */
+            std::string name;
+            /** Holds the number of values, the define takes the values 0 to numValues - 1. */
+            unsigned int numValues;
+        };
+
+        GPUProgramVariants(const std::string& programName, std::vector<std::string> shaderNames,
+            std::vector<Feature> features, const std::string& defines = std::string());
+        GPUProgramVariants(const GPUProgramVariants&) = delete;
+        GPUProgramVariants& operator=(const GPUProgramVariants&) = delete;
+        GPUProgramVariants(GPUProgramVariants&&) noexcept;
+        GPUProgramVariants& operator=(GPUProgramVariants&&) noexcept;
+        ~GPUProgramVariants() noexcept;
+
+        GPUProgram& getProgram(std::initializer_list<unsigned int> values);
+        void recompilePrograms();
+        /** Returns the number of variants compiled so far. */
+        std::size_t getNumPrograms() const noexcept { return programs_.size(); }
+
+    private:
+        /** Holds the program name. */
+        std::string programName_;
+        /** Holds the shader names. */
+        std::vector<std::string> shaderNames_;
+        /** Holds the features in the order their values are passed to getProgram. */
+        std::vector<Feature> features_;
+        /** Holds the preprocessor definitions shared by all variants. */
+        std::string defines_;
+        /** Holds the compiled variants by the combined feature values. */
+        std::unordered_map<std::uint64_t, std::unique_ptr<GPUProgram>> programs_;
+    };
+}
@@ -0,0 +1,450 @@
+#include "GeometryArena.h"
+#include "GLStateCache.h"
+#include "Mesh.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <glm/gtc/packing.hpp>
+#include <iterator>
+#include <limits>
+
+namespace cg1 {
+
+    GeometryArena* GeometryArena::instance_ = nullptr;
+
+    namespace {
+        /** The initial capacity of a pools vertex buffer in vertices. */
+        constexpr std::size_t initialVertexCapacity = 1 << 16;
+        /** The initial capacity of a pools index buffer in indices. */
+        constexpr std::size_t initialIndexCapacity = 1 << 18;
+
+        /** The smallest magnitude of a signed normalized short except zero. */
+        constexpr float snorm16Step = 1.0f / 32767.0f;
+
+        /**
+         *  Maps a direction to the octahedron and unfolds it to the square [-1, 1]^2.
+         *  @param direction the direction to map, does not need to be normalized.
+         *  @return the position on the square.
+         */
+        glm::vec2 mapOctahedral(const glm::vec3& direction)
+        {
+            auto length = std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z);
+            if (length == 0.0f) return glm::vec2(0.0f);
+            glm::vec2 result = glm::vec2(direction) / length;
+            if (direction.z < 0.0f) {
+                result = (1.0f - glm::abs(glm::vec2(result.y, result.x)))
+                    * glm::vec2(result.x >= 0.0f ? 1.0f : -1.0f, result.y >= 0.0f ? 1.0f : -1.0f);
+            }
+            return result;
+        }
+
+        /**
+         *  Encodes a direction with octahedral mapping to two signed normalized shorts.
+         *  @param direction the direction to encode, does not need to be normalized.
+         *  @return the encoded direction.
+         */
+        glm::i16vec2 encodeOctahedral(const glm::vec3& direction)
+        {
+            auto result = mapOctahedral(direction);
+            return glm::i16vec2(glm::packSnorm1x16(result.x), glm::packSnorm1x16(result.y));
+        }
+
+        /**
+         *  Encodes a tangent with octahedral mapping to two signed normalized shorts. y is remapped to
+         *  [step, 1] and negated for a negative handedness, so the handedness costs one bit of y precision.
+         *  @param tangent the tangent, w holds the handedness.
+         *  @return the encoded tangent.
+         */
+        glm::i16vec2 encodeOctahedralTangent(const glm::vec4& tangent)
+        {
+            auto result = mapOctahedral(glm::vec3(tangent));
+            result.y = snorm16Step + (1.0f - snorm16Step) * (0.5f * result.y + 0.5f);
+            if (tangent.w < 0.0f) result.y = -result.y;
+            return glm::i16vec2(glm::packSnorm1x16(result.x), glm::packSnorm1x16(result.y));
+        }
+
+        /**
+         *  Converts a vertex to a packed layout.
+         *  @param vertex the vertex to convert.
+         *  @param result the packed vertex.
+         */
+        void packVertex(const MeshVertex& vertex, PackedMeshVertex& result)
+        {
+            result.position = glm::vec3(vertex.position);
+            result.normal = encodeOctahedral(vertex.normal);
+            result.tangent = encodeOctahedralTangent(vertex.tangent);
+            result.textureCoordinate = glm::u16vec2(glm::packHalf1x16(vertex.textureCoordinate.x),
+                glm::packHalf1x16(vertex.textureCoordinate.y));
+        }
+
+        /**
+         *  Converts a vertex to a packed layout with half-float positions.
+         *  @param vertex the vertex to convert.
+         *  @param result the packed vertex.
+         */
+        void packVertex(const MeshVertex& vertex, PackedHalfMeshVertex& result)
+        {
+            result.position = glm::u16vec4(glm::packHalf1x16(vertex.position.x), glm::packHalf1x16(vertex.position.y),
+                glm::packHalf1x16(vertex.position.z), glm::packHalf1x16(1.0f));
+            result.normal = encodeOctahedral(vertex.normal);
+            result.tangent = encodeOctahedralTangent(vertex.tangent);
+            result.textureCoordinate = glm::u16vec2(glm::packHalf1x16(vertex.textureCoordinate.x),
+                glm::packHalf1x16(vertex.textureCoordinate.y));
+        }
+
+        /**
+         *  Uploads vertices converted to a packed layout to the buffer bound to GL_COPY_WRITE_BUFFER.
+         *  @param vertices the vertices to upload.
+         *  @param numVertices the number of vertices.
+         *  @param firstVertex the position of the first vertex inside the buffer.
+         */
+        template<typename PackedVertex>
+        void uploadPackedVertices(const MeshVertex* vertices, std::size_t numVertices, std::size_t firstVertex)
+        {
+            std::vector<PackedVertex> packedVertices(numVertices);
+            for (std::size_t i = 0; i < numVertices; ++i) packVertex(vertices[i], packedVertices[i]);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, firstVertex * sizeof(PackedVertex),
+                numVertices * sizeof(PackedVertex), packedVertices.data());
+        }
+
+        /**
+         *  Sets the vertex attributes for a packed layout using the buffer bound to GL_ARRAY_BUFFER.
+         *  @param positionSize the number of position components.
+         *  @param positionType the type of the position components.
+         */
+        template<typename PackedVertex>
+        void setPackedVertexAttributes(GLint positionSize, GLenum positionType)
+        {
+            glVertexAttribPointer(0, positionSize, positionType, GL_FALSE, sizeof(PackedVertex), reinterpret_cast<GLvoid*>(offsetof(PackedVertex, position)));
+            glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), reinterpret_cast<GLvoid*>(offsetof(PackedVertex, normal)));
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), reinterpret_cast<GLvoid*>(offsetof(PackedVertex, textureCoordinate)));
+            glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), reinterpret_cast<GLvoid*>(offsetof(PackedVertex, tangent)));
+        }
+
+        /**
+         *  Returns the size of a vertex in the given layout.
+         *  @param vertexFormat the vertex layout.
+         */
+        std::size_t getVertexSize(VertexFormat vertexFormat)
+        {
+            switch (vertexFormat) {
+            case VertexFormat::Packed: return sizeof(PackedMeshVertex);
+            case VertexFormat::PackedHalfPosition: return sizeof(PackedHalfMeshVertex);
+            default: return sizeof(MeshVertex);
+            }
+        }
+
+        /**
+         *  Sets the vertex attributes for the given layout using the buffer bound to GL_ARRAY_BUFFER.
+         *  @param vertexFormat the vertex layout.
+         */
+        void setVertexAttributes(VertexFormat vertexFormat)
+        {
+            switch (vertexFormat) {
+            case VertexFormat::Packed:
+                setPackedVertexAttributes<PackedMeshVertex>(3, GL_FLOAT);
+                break;
+            case VertexFormat::PackedHalfPosition:
+                setPackedVertexAttributes<PackedHalfMeshVertex>(4, GL_HALF_FLOAT);
+                break;
+            default:
+                glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), reinterpret_cast<GLvoid*>(offsetof(MeshVertex, position)));
+                glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), reinterpret_cast<GLvoid*>(offsetof(MeshVertex, normal)));
+                glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), reinterpret_cast<GLvoid*>(offsetof(MeshVertex, textureCoordinate)));
+                glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), reinterpret_cast<GLvoid*>(offsetof(MeshVertex, tangent)));
+                break;
+            }
+            glEnableVertexAttribArray(0); // Vertex Positions
+            glEnableVertexAttribArray(1); // Vertex Normals
+            glEnableVertexAttribArray(2); // Vertex UVs
+            glEnableVertexAttribArray(3); // tangent
+        }
+    }
+
+    /** Constructor, makes this the arena used by all meshes. Needs a current OpenGL context. */
+    GeometryArena::GeometryArena()
+    {
+        assert(instance_ == nullptr);
+        instance_ = this;
+    }
+
+    /** Destructor, deletes all buffers. All meshes need to be destroyed before. */
+    GeometryArena::~GeometryArena() noexcept
+    {
+        for (auto& pool : pools_) {
+            glDeleteBuffers(1, &pool.indices.id);
+            glDeleteBuffers(1, &pool.vertices.id);
+            GLStateCache::getInstance().forgetVertexArray(pool.vertexArray);
+            glDeleteVertexArrays(1, &pool.vertexArray);
+        }
+        instance_ = nullptr;
+    }
+
+    /**
+     *  Returns the arena used by all meshes.
+     *  @return the current geometry arena.
+     */
+    GeometryArena& GeometryArena::getInstance()
+    {
+        assert(instance_ != nullptr);
+        return *instance_;
+    }
+
+    /**
+     *  Copies the vertices and indices of a mesh into the arena.
+     *  @param vertices the vertices of the mesh.
+     *  @param numVertices the number of vertices.
+     *  @param indices the triangle indices of the mesh.
+     *  @param numIndices the number of indices.
+     *  @param vertexFormat the vertex layout used on the GPU.
+     *  @return the range the mesh was copied to.
+     */
+    GeometryArena::Allocation GeometryArena::allocate(const MeshVertex* vertices, std::size_t numVertices,
+        const GLuint* indices, std::size_t numIndices, VertexFormat vertexFormat)
+    {
+        Allocation result;
+        if (numVertices == 0 || numIndices == 0) return result;
+
+        // meshes with less than 65536 vertices use 16-bit indices.
+        auto indexType = numVertices <= std::numeric_limits<GLushort>::max() + 1u ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        result.pool = getPool(vertexFormat, indexType);
+        auto& pool = pools_[result.pool];
+        result.baseVertex = static_cast<GLint>(allocateRange(pool, pool.vertices, numVertices));
+        result.numVertices = static_cast<GLsizei>(numVertices);
+        result.firstIndex = allocateRange(pool, pool.indices, numIndices);
+        result.numIndices = static_cast<GLsizei>(numIndices);
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, pool.vertices.id);
+        switch (vertexFormat) {
+        case VertexFormat::Packed:
+            uploadPackedVertices<PackedMeshVertex>(vertices, numVertices, result.baseVertex);
+            break;
+        case VertexFormat::PackedHalfPosition:
+            uploadPackedVertices<PackedHalfMeshVertex>(vertices, numVertices, result.baseVertex);
+            break;
+        default:
+            glBufferSubData(GL_COPY_WRITE_BUFFER, result.baseVertex * sizeof(MeshVertex), numVertices * sizeof(MeshVertex),
+                vertices);
+            break;
+        }
+
+        uploadIndices(pool, result.firstIndex, indices, numIndices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return result;
+    }
+
+    /**
+     *  Copies additional indices referencing the vertices of an existing allocation into the arena, e.g. for
+     *  levels of detail. The returned range does not own any vertices.
+     *  @param vertexAllocation the allocation holding the vertices.
+     *  @param indices the triangle indices.
+     *  @param numIndices the number of indices.
+     *  @return the range the indices were copied to.
+     */
+    GeometryArena::Allocation GeometryArena::allocateIndices(const Allocation& vertexAllocation, const GLuint* indices,
+        std::size_t numIndices)
+    {
+        Allocation result;
+        if (vertexAllocation.pool < 0 || numIndices == 0) return result;
+
+        result.pool = vertexAllocation.pool;
+        result.baseVertex = vertexAllocation.baseVertex;
+        auto& pool = pools_[result.pool];
+        result.firstIndex = allocateRange(pool, pool.indices, numIndices);
+        result.numIndices = static_cast<GLsizei>(numIndices);
+        uploadIndices(pool, result.firstIndex, indices, numIndices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return result;
+    }
+
+    /**
+     *  Returns the size of the buffer ranges owned by an allocation.
+     *  @param allocation the allocation.
+     *  @return the size of its vertices and indices in bytes.
+     */
+    std::size_t GeometryArena::getMemorySize(const Allocation& allocation) const noexcept
+    {
+        if (allocation.pool < 0) return 0;
+        const auto& pool = pools_[allocation.pool];
+        return allocation.numVertices * pool.vertices.elementSize + allocation.numIndices * pool.indices.elementSize;
+    }
+
+    /**
+     *  Returns the ranges of a mesh to the arena.
+     *  @param allocation the ranges of the mesh, will be reset.
+     */
+    void GeometryArena::release(Allocation& allocation) noexcept
+    {
+        if (allocation.pool < 0) return;
+        auto& pool = pools_[allocation.pool];
+        if (allocation.numVertices > 0) releaseRange(pool.vertices, allocation.baseVertex, allocation.numVertices);
+        releaseRange(pool.indices, allocation.firstIndex, allocation.numIndices);
+        allocation = Allocation();
+    }
+
+    /**
+     *  Draws a single mesh.
+     *  @param allocation the ranges of the mesh.
+     */
+    void GeometryArena::draw(const Allocation& allocation)
+    {
+        if (allocation.pool < 0) return;
+        const auto& pool = pools_[allocation.pool];
+        GLStateCache::getInstance().bindVertexArray(pool.vertexArray);
+        glDrawElementsBaseVertex(GL_TRIANGLES, allocation.numIndices, pool.indexType,
+            reinterpret_cast<GLvoid*>(allocation.firstIndex * pool.indices.elementSize), allocation.baseVertex);
+    }
+
+    /**
+     *  Draws a list of meshes. Consecutive meshes of the same pool are combined into one multi-draw.
+     *  @param allocations the ranges of the meshes.
+     *  @param numAllocations the number of meshes.
+     */
+    void GeometryArena::draw(const Allocation* const* allocations, std::size_t numAllocations)
+    {
+        std::size_t first = 0;
+        while (first < numAllocations) {
+            auto poolIndex = allocations[first]->pool;
+            drawCounts_.clear();
+            drawOffsets_.clear();
+            drawBaseVertices_.clear();
+            for (; first < numAllocations && allocations[first]->pool == poolIndex; ++first) {
+                if (poolIndex < 0) continue;
+                drawCounts_.push_back(allocations[first]->numIndices);
+                drawOffsets_.push_back(reinterpret_cast<const GLvoid*>(allocations[first]->firstIndex * pools_[poolIndex].indices.elementSize));
+                drawBaseVertices_.push_back(allocations[first]->baseVertex);
+            }
+            if (drawCounts_.empty()) continue;
+
+            const auto& pool = pools_[poolIndex];
+            GLStateCache::getInstance().bindVertexArray(pool.vertexArray);
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, drawCounts_.data(), pool.indexType, drawOffsets_.data(),
+                static_cast<GLsizei>(drawCounts_.size()), drawBaseVertices_.data());
+        }
+    }
+
+    /**
+     *  Returns the pool for a vertex format and index type, creates the pool if needed.
+     *  @param vertexFormat the vertex layout.
+     *  @param indexType the type of the indices.
+     *  @return the index of the pool.
+     */
+    int GeometryArena::getPool(VertexFormat vertexFormat, GLenum indexType)
+    {
+        for (std::size_t i = 0; i < pools_.size(); ++i) {
+            if (pools_[i].vertexFormat == vertexFormat && pools_[i].indexType == indexType) return static_cast<int>(i);
+        }
+
+        Pool pool;
+        pool.vertexFormat = vertexFormat;
+        pool.indexType = indexType;
+        pool.vertices.elementSize = getVertexSize(vertexFormat);
+        pool.indices.elementSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+        glGenVertexArrays(1, &pool.vertexArray);
+        grow(pool, pool.vertices, initialVertexCapacity);
+        grow(pool, pool.indices, initialIndexCapacity);
+        pools_.push_back(std::move(pool));
+        return static_cast<int>(pools_.size() - 1);
+    }
+
+    /**
+     *  Uploads indices to a pools index buffer, converts them to the pools index type.
+     *  @param pool the pool.
+     *  @param firstIndex the position of the first index inside the index buffer.
+     *  @param indices the indices.
+     *  @param numIndices the number of indices.
+     */
+    void GeometryArena::uploadIndices(const Pool& pool, std::size_t firstIndex, const GLuint* indices,
+        std::size_t numIndices)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, pool.indices.id);
+        if (pool.indexType == GL_UNSIGNED_SHORT) {
+            std::vector<GLushort> shortIndices(indices, indices + numIndices);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, firstIndex * sizeof(GLushort), numIndices * sizeof(GLushort),
+                shortIndices.data());
+        } else {
+            glBufferSubData(GL_COPY_WRITE_BUFFER, firstIndex * sizeof(GLuint), numIndices * sizeof(GLuint), indices);
+        }
+    }
+
+    /**
+     *  Finds a free range inside a buffer (first fit), grows the buffer if there is none.
+     *  @param pool the pool the buffer belongs to.
+     *  @param buffer the buffer.
+     *  @param count the number of elements.
+     *  @return the first element of the range.
+     */
+    std::size_t GeometryArena::allocateRange(Pool& pool, Buffer& buffer, std::size_t count)
+    {
+        auto range = std::find_if(buffer.freeRanges.begin(), buffer.freeRanges.end(),
+            [count](const std::pair<const std::size_t, std::size_t>& r) { return r.second >= count; });
+        if (range == buffer.freeRanges.end()) {
+            grow(pool, buffer, std::max(2 * buffer.capacity, buffer.capacity + count));
+            range = std::prev(buffer.freeRanges.end());
+        }
+
+        auto first = range->first;
+        auto remaining = range->second - count;
+        buffer.freeRanges.erase(range);
+        if (remaining > 0) buffer.freeRanges.emplace(first + count, remaining);
+        return first;
+    }
+
+    /**
+     *  Marks a range of a buffer as unused and merges it with its neighbors.
+     *  @param buffer the buffer.
+     *  @param first the first element of the range.
+     *  @param count the number of elements.
+     */
+    void GeometryArena::releaseRange(Buffer& buffer, std::size_t first, std::size_t count)
+    {
+        if (count == 0) return;
+        auto next = buffer.freeRanges.lower_bound(first);
+        if (next != buffer.freeRanges.end() && first + count == next->first) {
+            count += next->second;
+            next = buffer.freeRanges.erase(next);
+        }
+        if (next != buffer.freeRanges.begin()) {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == first) {
+                previous->second += count;
+                return;
+            }
+        }
+        buffer.freeRanges.emplace(first, count);
+    }
+
+    /**
+     *  Replaces a buffer by a larger one and copies the old content.
+     *  @param pool the pool the buffer belongs to.
+     *  @param buffer the buffer.
+     *  @param minCapacity the new capacity in elements.
+     */
+    void GeometryArena::grow(Pool& pool, Buffer& buffer, std::size_t minCapacity)
+    {
+        GLuint newBuffer = 0;
+        glGenBuffers(1, &newBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, minCapacity * buffer.elementSize, nullptr, GL_STATIC_DRAW);
+        if (buffer.id != 0) {
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer.id);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, buffer.capacity * buffer.elementSize);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            glDeleteBuffers(1, &buffer.id);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        buffer.id = newBuffer;
+        releaseRange(buffer, buffer.capacity, minCapacity - buffer.capacity);
+        buffer.capacity = minCapacity;
+
+        // the vertex array references the buffers, so it needs to be updated.
+        GLStateCache::getInstance().bindVertexArray(pool.vertexArray);
+        if (&buffer == &pool.vertices) {
+            glBindBuffer(GL_ARRAY_BUFFER, buffer.id);
+            setVertexAttributes(pool.vertexFormat);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        } else {
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer.id);
+        }
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "cg1.h"
+#include <map>
+
+namespace cg1 {
+
+    struct MeshVertex;
+    enum class VertexFormat;
+
+    /**
+     * Shared vertex and index buffers all static meshes are sub-allocated from. There is one pool per vertex
+     * format and index type, each with a single vertex array object, so meshes of the same pool are drawn
+     * without switching vertex arrays and can be combined into multi-draws.
+     */
+    class GeometryArena final
+    {
+    public:
+        /** A range of vertices and indices inside one of the arenas pools. */
+        struct Allocation
+        {
+            /** Holds the index of the pool or -1 if nothing is allocated. */
+            int pool = -1;
+            /** Holds the first vertex inside the pools vertex buffer. */
+            GLint baseVertex = 0;
+            /** Holds the number of vertices owned by the allocation, 0 for additional index ranges. */
+            GLsizei numVertices = 0;
+            /** Holds the first index inside the pools index buffer. */
+            std::size_t firstIndex = 0;
+            /** Holds the number of indices. */
+            GLsizei numIndices = 0;
+        };
+
+        GeometryArena();
+        GeometryArena(const GeometryArena&) = delete;
+        GeometryArena& operator=(const GeometryArena&) = delete;
+        GeometryArena(GeometryArena&&) = delete;
+        GeometryArena& operator=(GeometryArena&&) = delete;
+        ~GeometryArena() noexcept;
+
+        static GeometryArena& getInstance();
+
+        Allocation allocate(const MeshVertex* vertices, std::size_t numVertices, const GLuint* indices,
+            std::size_t numIndices, VertexFormat vertexFormat);
+        Allocation allocateIndices(const Allocation& vertexAllocation, const GLuint* indices, std::size_t numIndices);
+        void release(Allocation& allocation) noexcept;
+        std::size_t getMemorySize(const Allocation& allocation) const noexcept;
+
+        void draw(const Allocation& allocation);
+        void draw(const Allocation* const* allocations, std::size_t numAllocations);
+
+    private:
+        /** A GPU buffer sub-allocated in units of elements. */
+        struct Buffer
+        {
+            /** Holds the OpenGL buffer. */
+            GLuint id = 0;
+            /** Holds the size of an element in bytes. */
+            std::size_t elementSize = 0;
+            /** Holds the capacity in elements. */
+            std::size_t capacity = 0;
+            /** Holds the unused ranges as first element and number of elements. */
+            std::map<std::size_t, std::size_t> freeRanges;
+        };
+
+        /** The buffers and vertex array of one vertex format and index type. */
+        struct Pool
+        {
+            /** Holds the vertex layout. */
+            VertexFormat vertexFormat;
+            /** Holds the type of the indices. */
+            GLenum indexType;
+            /** Holds the OpenGL vertex array object. */
+            GLuint vertexArray = 0;
+            /** Holds the vertex buffer. */
+            Buffer vertices;
+            /** Holds the index buffer. */
+            Buffer indices;
+        };
+
+        int getPool(VertexFormat vertexFormat, GLenum indexType);
+        std::size_t allocateRange(Pool& pool, Buffer& buffer, std::size_t count);
+        static void uploadIndices(const Pool& pool, std::size_t firstIndex, const GLuint* indices, std::size_t numIndices);
+        static void releaseRange(Buffer& buffer, std::size_t first, std::size_t count);
+        void grow(Pool& pool, Buffer& buffer, std::size_t minCapacity);
+
+        /** Holds all pools. */
+        std::vector<Pool> pools_;
+        /** Holds the draw parameters of multi-draws. */
+        std::vector<GLsizei> drawCounts_;
+        /** Holds the index offsets of multi-draws. */
+        std::vector<const GLvoid*> drawOffsets_;
+        /** Holds the base vertices of multi-draws. */
+        std::vector<GLint> drawBaseVertices_;
+
+        /** Holds the arena used by all meshes. */
+        static GeometryArena* instance_;
+    };
+}
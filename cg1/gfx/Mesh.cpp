@@ -1,31 +1,115 @@
 ﻿#include "Mesh.h"
+#include "GeometryArena.h"
+#include "MeshCache.h"
+#include "MeshClusterizer.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "MeshTangentGenerator.h"
+#include "ObjLoader.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <deque>
+#include <iostream>
 
 namespace cg1 {
 
+    /** The Assimp post-processing flags used for all meshes. */
+    static constexpr unsigned int meshImportFlags = aiProcessPreset_TargetRealtime_MaxQuality |
+        aiProcess_OptimizeGraph | aiProcess_FlipUVs;
+    /** Distinguishes meshes loaded by the native OBJ loader from Assimp imports in the cache. */
+    static constexpr std::uint64_t objImportKey = 1ull << 32;
+    /** Distinguishes displaced meshes, which are stored without clusters, in the cache. */
+    static constexpr std::uint64_t displacedImportKey = 1ull << 33;
+    /** The factor the screen-space error of a coarser level of detail needs to be below the limit to switch to it. */
+    static constexpr float lodHysteresis = 0.75f;
+    /** Holds the merged ranges of visible clusters of the current draw, the deque keeps their addresses stable. */
+    static std::deque<GeometryArena::Allocation> visibleClusterRanges;
+    /** Holds the indices of the visible sub-meshes of the current draw. */
+    static std::vector<std::uint32_t> visibleSubMeshes;
+
+    /** Constructor. */
+    MeshFileData::MeshFileData() = default;
+    /** Move constructor. */
+    MeshFileData::MeshFileData(MeshFileData&&) noexcept = default;
+    /** Move assignment operator. */
+    MeshFileData& MeshFileData::operator=(MeshFileData&&) noexcept = default;
+    /** Destructor. */
+    MeshFileData::~MeshFileData() noexcept = default;
+
     /**
      * Constructor, creates a mesh from file.
+     * The imported geometry is stored in the mesh cache so later runs can skip the import.
      * @param meshFilename the filename of the mesh file.
+     * @param vertexFormat the vertex layout used on the GPU.
+     */
+    Mesh::Mesh(const std::string& meshFilename, VertexFormat vertexFormat) :
+        Mesh(LoadFile(meshFilename), vertexFormat)
+    {
+    }
+
+    /**
+     * Constructor, uploads the geometry of a loaded mesh file.
+     * @param fileData the loaded mesh file.
+     * @param vertexFormat the vertex layout used on the GPU.
      */
-    Mesh::Mesh(const std::string& meshFilename) :
+    Mesh::Mesh(const MeshFileData& fileData, VertexFormat vertexFormat) :
         subMeshes_(),
-        indices_(),
-        vertices_(),
-        vertexArray_(0),
-        vertexBuffer_(0),
-        indexBuffer_(0)
+        vertexFormat_(vertexFormat),
+        allocation_(),
+        boundsCenter_(0.0f),
+        boundsRadius_(0.0f),
+        boundsExtent_(0.0f),
+        currentLods_()
     {
-        std::string fullFilename = config::resourceBasePath + meshFilename;
-        // Load a Model from File
-        Assimp::Importer loader;
-        aiScene const * scene = loader.ReadFile(fullFilename,
-            aiProcessPreset_TargetRealtime_MaxQuality |
-            aiProcess_OptimizeGraph |
-            aiProcess_FlipUVs);
+        if (fileData.cache) {
+            for (const auto& subMesh : fileData.cache->getSubMeshes()) {
+                subMeshes_.emplace_back(std::make_unique<Mesh>(subMesh.vertices, subMesh.numVertices,
+                    subMesh.indices, subMesh.numIndices, vertexFormat));
+                for (const auto& lod : subMesh.lods) subMeshes_.back()->addLod(lod.indices, lod.numIndices, lod.error);
+                subMeshes_.back()->setClusters(subMesh.clusters, subMesh.numClusters);
+            }
+        } else {
+            for (const auto& subMesh : fileData.subMeshes) {
+                subMeshes_.emplace_back(std::make_unique<Mesh>(subMesh.vertices.data(), subMesh.vertices.size(),
+                    subMesh.indices.data(), subMesh.indices.size(), vertexFormat));
+                for (const auto& lod : subMesh.lods)
+                    subMeshes_.back()->addLod(lod.indices.data(), lod.indices.size(), lod.error);
+                subMeshes_.back()->setClusters(subMesh.clusters.data(), subMesh.clusters.size());
+            }
+        }
+        for (const auto& subMesh : subMeshes_) subMeshVolumes_.add(subMesh->GetBoundingVolume());
+    }
 
-        // Walk the Tree of Scene Nodes
-        auto index = meshFilename.find_last_of("/");
-        if (!scene) fprintf(stderr, "%s\n", loader.GetErrorString());
-        else parse(meshFilename.substr(0, index), scene->mRootNode, scene);
+    /**
+     *  Constructor, copies the geometry of a single sub-mesh into the geometry arena. Meshes with less than
+     *  65536 vertices use 16-bit indices.
+     *  @param vertices the vertices of the mesh.
+     *  @param numVertices the number of vertices.
+     *  @param indices the triangle indices of the mesh.
+     *  @param numIndices the number of indices.
+     *  @param vertexFormat the vertex layout used on the GPU.
+     */
+    Mesh::Mesh(const MeshVertex* vertices, std::size_t numVertices, const GLuint* indices, std::size_t numIndices,
+        VertexFormat vertexFormat) :
+        subMeshes_(),
+        vertexFormat_(vertexFormat),
+        allocation_(GeometryArena::getInstance().allocate(vertices, numVertices, indices, numIndices, vertexFormat)),
+        boundsCenter_(0.0f),
+        boundsRadius_(0.0f),
+        boundsExtent_(0.0f),
+        currentLods_()
+    {
+        if (numVertices == 0) return;
+        glm::vec3 boundsMin(vertices[0].position), boundsMax(vertices[0].position);
+        for (std::size_t i = 1; i < numVertices; ++i) {
+            boundsMin = glm::min(boundsMin, glm::vec3(vertices[i].position));
+            boundsMax = glm::max(boundsMax, glm::vec3(vertices[i].position));
+        }
+        boundsCenter_ = 0.5f * (boundsMin + boundsMax);
+        boundsExtent_ = 0.5f * (boundsMax - boundsMin);
+        for (std::size_t i = 0; i < numVertices; ++i)
+            boundsRadius_ = std::max(boundsRadius_, glm::length(glm::vec3(vertices[i].position) - boundsCenter_));
     }
 
     /**
@@ -33,15 +117,19 @@ namespace cg1 {
      */
     Mesh::Mesh(Mesh&& rhs) noexcept :
         subMeshes_(std::move(rhs.subMeshes_)),
-        indices_(std::move(rhs.indices_)),
-        vertices_(std::move(rhs.vertices_)),
-        vertexArray_(std::move(rhs.vertexArray_)),
-        vertexBuffer_(std::move(rhs.vertexBuffer_)),
-        indexBuffer_(std::move(rhs.indexBuffer_))
+        vertexFormat_(rhs.vertexFormat_),
+        allocation_(rhs.allocation_),
+        lodAllocations_(std::move(rhs.lodAllocations_)),
+        lodErrors_(std::move(rhs.lodErrors_)),
+        clusters_(std::move(rhs.clusters_)),
+        boundsCenter_(rhs.boundsCenter_),
+        boundsRadius_(rhs.boundsRadius_),
+        boundsExtent_(rhs.boundsExtent_),
+        subMeshVolumes_(std::move(rhs.subMeshVolumes_)),
+        currentLods_()
     {
-        rhs.vertexArray_ = 0;
-        rhs.vertexBuffer_ = 0;
-        rhs.indexBuffer_ = 0;
+        rhs.allocation_ = GeometryArena::Allocation();
+        rhs.lodAllocations_.clear();
     }
 
     /**
@@ -52,14 +140,18 @@ namespace cg1 {
         if (this != &rhs) {
             this->~Mesh();
             subMeshes_ = std::move(rhs.subMeshes_);
-            indices_ = std::move(rhs.indices_);
-            vertices_ = std::move(rhs.vertices_);
-            vertexArray_ = std::move(rhs.vertexArray_);
-            vertexBuffer_ = std::move(rhs.vertexBuffer_);
-            indexBuffer_ = std::move(rhs.indexBuffer_);
-            rhs.vertexArray_ = 0;
-            rhs.vertexBuffer_ = 0;
-            rhs.indexBuffer_ = 0;
+            vertexFormat_ = rhs.vertexFormat_;
+            allocation_ = rhs.allocation_;
+            lodAllocations_ = std::move(rhs.lodAllocations_);
+            lodErrors_ = std::move(rhs.lodErrors_);
+            clusters_ = std::move(rhs.clusters_);
+            boundsCenter_ = rhs.boundsCenter_;
+            boundsRadius_ = rhs.boundsRadius_;
+            boundsExtent_ = rhs.boundsExtent_;
+            subMeshVolumes_ = std::move(rhs.subMeshVolumes_);
+            std::fill(std::begin(currentLods_), std::end(currentLods_), 0);
+            rhs.allocation_ = GeometryArena::Allocation();
+            rhs.lodAllocations_.clear();
         }
         return *this;
     }
@@ -67,118 +159,391 @@ namespace cg1 {
     /** Destructor. */
     Mesh::~Mesh() noexcept
     {
-        if (indexBuffer_ != 0) {
-            glDeleteBuffers(1, &indexBuffer_);
-            indexBuffer_ = 0;
-        }
+        for (auto& lodAllocation : lodAllocations_) GeometryArena::getInstance().release(lodAllocation);
+        lodAllocations_.clear();
+        if (allocation_.pool >= 0) GeometryArena::getInstance().release(allocation_);
+    }
 
-        if (vertexBuffer_ != 0) {
-            glDeleteBuffers(1, &vertexBuffer_);
-            vertexBuffer_ = 0;
-        }
+    /**
+     *  Loads the geometry of a mesh file from the mesh cache or imports it and stores it in the cache. This does
+     *  not use OpenGL, so it can run on any thread.
+     *  @param meshFilename the filename of the mesh file.
+     *  @param usage how the mesh is drawn.
+     *  @return the loaded geometry, empty if the file could not be imported.
+     */
+    MeshFileData Mesh::LoadFile(const std::string& meshFilename, MeshUsage usage)
+    {
+        std::string fullFilename = config::resourceBasePath + meshFilename;
+#ifdef CG1_BENCHMARK_MESH_IMPORT
+        benchmarkImport(fullFilename);
+#endif
+        MeshFileData result;
+        std::uint64_t importKey = isObjFile(fullFilename) ? objImportKey : meshImportFlags;
+        if (usage == MeshUsage::Displaced) importKey |= displacedImportKey;
+        result.cache = std::make_unique<MeshCache>(fullFilename, importKey);
+        if (result.cache->load()) return result;
+
+        auto cache = std::move(result.cache);
+        if (!importMesh(fullFilename, result.subMeshes, usage)) result.subMeshes.clear();
+        else cache->store(result.subMeshes);
+        return result;
+    }
 
-        if (vertexArray_ != 0) {
-            glDeleteBuffers(1, &vertexArray_);
-            vertexArray_ = 0;
+    /**
+     *  Imports a mesh file. OBJ files are read by the native loader, everything else (and OBJ files the native
+     *  loader cannot handle) by Assimp. The sub-meshes are optimized for vertex cache, overdraw and vertex fetch
+     *  and get simplified levels of detail. Large sub-meshes of static meshes are split into clusters for culling.
+     *  @param fullFilename the full name of the mesh file.
+     *  @param subMeshes the imported sub-meshes.
+     *  @param usage how the mesh is drawn.
+     *  @return whether the import was successful.
+     */
+    bool Mesh::importMesh(const std::string& fullFilename, std::vector<SubMeshData>& subMeshes, MeshUsage usage)
+    {
+        if (!isObjFile(fullFilename) || !ObjLoader::load(fullFilename, subMeshes)) {
+            subMeshes.clear();
+            if (!importAssimp(fullFilename, subMeshes)) return false;
         }
+        for (std::size_t i = 0; i < subMeshes.size(); ++i) {
+            auto name = fullFilename + "[" + std::to_string(i) + "]";
+            MeshTangentGenerator::generate(subMeshes[i]);
+            MeshOptimizer::optimize(subMeshes[i], name);
+            MeshSimplifier::generateLods(subMeshes[i], name);
+            if (usage == MeshUsage::Static) MeshClusterizer::buildClusters(subMeshes[i], name);
+        }
+        return true;
     }
 
+    /**
+     *  Checks whether a file is a Wavefront OBJ file.
+     *  @param filename the name of the file.
+     */
+    bool Mesh::isObjFile(const std::string& filename)
+    {
+        std::string extension = filename.substr(std::min(filename.size(), filename.find_last_of('.')));
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return extension == ".obj";
+    }
 
-    Mesh::Mesh(const std::string& path, const aiMesh* mesh, const aiScene* scene) :
-        subMeshes_(),
-        indices_(),
-        vertices_(),
-        vertexArray_(0),
-        vertexBuffer_(0),
-        indexBuffer_(0)
+    /**
+     *  Imports a mesh file with Assimp.
+     *  @param fullFilename the full name of the mesh file.
+     *  @param subMeshes the imported sub-meshes.
+     *  @return whether the import was successful.
+     */
+    bool Mesh::importAssimp(const std::string& fullFilename, std::vector<SubMeshData>& subMeshes)
     {
+        // Load a Model from File
+        Assimp::Importer loader;
+        aiScene const * scene = loader.ReadFile(fullFilename, meshImportFlags);
+
+        // Walk the Tree of Scene Nodes
+        if (!scene) {
+            fprintf(stderr, "%s\n", loader.GetErrorString());
+            return false;
+        }
+        parse(scene->mRootNode, scene, subMeshes);
+        return true;
+    }
+
+    /**
+     *  Converts an Assimp mesh to the vertex and index layout used for rendering.
+     *  @param mesh the Assimp mesh.
+     *  @return the converted sub-mesh.
+     */
+    SubMeshData Mesh::convert(const aiMesh* mesh)
+    {
+        SubMeshData result;
+        std::vector<MeshVertex>& vertices = result.vertices;
+        std::vector<GLuint>& indices = result.indices;
+
         // Create Vertex Data from Mesh Node
-        MeshVertex vertex;
+        MeshVertex vertex{};
+        vertices.reserve(mesh->mNumVertices);
         for (unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
             if (mesh->mTextureCoords[0])
                 vertex.textureCoordinate = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
             vertex.position = glm::vec4(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z, 1.0f);
             vertex.normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
-            vertices_.push_back(vertex);
+            vertices.push_back(vertex);
         }
 
         // Create Mesh Indices for Indexed Drawing
+        indices.reserve(mesh->mNumFaces * 3);
         for (unsigned int i = 0; i < mesh->mNumFaces; i++)
             for (unsigned int j = 0; j < mesh->mFaces[i].mNumIndices; j++)
-                indices_.push_back(mesh->mFaces[i].mIndices[j]);
+                indices.push_back(mesh->mFaces[i].mIndices[j]);
+        return result;
+    }
+
+#ifdef CG1_BENCHMARK_MESH_IMPORT
+    /**
+     *  Imports a mesh with the native OBJ loader and with Assimp and prints the import times.
+     *  @param fullFilename the full name of the mesh file.
+     */
+    void Mesh::benchmarkImport(const std::string& fullFilename)
+    {
+        if (!isObjFile(fullFilename)) return;
+        auto countData = [](const std::vector<SubMeshData>& subMeshes, std::size_t& numVertices, std::size_t& numIndices) {
+            numVertices = numIndices = 0;
+            for (const auto& subMesh : subMeshes) {
+                numVertices += subMesh.vertices.size();
+                numIndices += subMesh.indices.size();
+            }
+        };
+
+        std::vector<SubMeshData> objSubMeshes, assimpSubMeshes;
+        auto start = std::chrono::high_resolution_clock::now();
+        bool objLoaded = ObjLoader::load(fullFilename, objSubMeshes);
+        auto objEnd = std::chrono::high_resolution_clock::now();
+        bool assimpLoaded = importAssimp(fullFilename, assimpSubMeshes);
+        auto assimpEnd = std::chrono::high_resolution_clock::now();
+
+        std::size_t numVertices, numIndices;
+        std::cout << "Import benchmark (" << fullFilename << "):" << std::endl;
+        countData(objSubMeshes, numVertices, numIndices);
+        std::cout << "  native OBJ: " << std::chrono::duration<double, std::milli>(objEnd - start).count() << "ms, "
+            << (objLoaded ? "" : "failed, ") << objSubMeshes.size() << " sub-meshes, " << numVertices << " vertices, "
+            << numIndices / 3 << " triangles" << std::endl;
+        countData(assimpSubMeshes, numVertices, numIndices);
+        std::cout << "  Assimp:     " << std::chrono::duration<double, std::milli>(assimpEnd - objEnd).count() << "ms, "
+            << (assimpLoaded ? "" : "failed, ") << assimpSubMeshes.size() << " sub-meshes, " << numVertices
+            << " vertices, " << numIndices / 3 << " triangles" << std::endl;
+    }
+#endif
 
-		MeshVertex *v0, *v1, *v2;
-		float r;
-		for (unsigned int i = 0; i < indices_.size(); i+=3) {
-			v0 = &vertices_.at(indices_.at(i));
-			v1 = &vertices_.at(indices_.at(i+1));
-			v2 = &vertices_.at(indices_.at(i+2));
+    /**
+     *  Returns the GPU memory used by the mesh, its levels of detail and its sub-meshes.
+     *  @return the size of all vertices and indices in bytes.
+     */
+    std::size_t Mesh::GetMemorySize() const
+    {
+        auto& arena = GeometryArena::getInstance();
+        auto result = arena.getMemorySize(allocation_);
+        for (const auto& lodAllocation : lodAllocations_) result += arena.getMemorySize(lodAllocation);
+        for (const auto& subMesh : subMeshes_) result += subMesh->GetMemorySize();
+        return result;
+    }
 
-			glm::vec3 deltaPos1 = glm::vec3(v1->position - v0->position);
-			glm::vec3 deltaPos2 = glm::vec3(v2->position - v0->position);
+    /**
+     *  Returns a sphere enclosing the mesh and all its sub-meshes. Meshes loaded from file only hold geometry in
+     *  their sub-meshes, so the spheres of the hierarchy are merged.
+     *  @return the center (xyz) and radius (w) of the sphere in model space, the radius is 0 for an empty mesh.
+     */
+    glm::vec4 Mesh::GetBoundingSphere() const
+    {
+        auto result = glm::vec4(boundsCenter_, boundsRadius_);
+        for (const auto& subMesh : subMeshes_) {
+            auto sphere = subMesh->GetBoundingSphere();
+            if (sphere.w <= 0.0f) continue;
+            if (result.w <= 0.0f) {
+                result = sphere;
+                continue;
+            }
+            auto offset = glm::vec3(sphere) - glm::vec3(result);
+            auto distance = glm::length(offset);
+            if (distance + sphere.w <= result.w) continue;
+            if (distance + result.w <= sphere.w) {
+                result = sphere;
+                continue;
+            }
+            auto radius = 0.5f * (distance + result.w + sphere.w);
+            result = glm::vec4(glm::vec3(result) + offset * ((radius - result.w) / distance), radius);
+        }
+        return result;
+    }
 
-			glm::vec2 deltaUV1 = glm::vec2(v1->textureCoordinate - v0->textureCoordinate);
-			glm::vec2 deltaUV2 = glm::vec2(v2->textureCoordinate - v0->textureCoordinate);
+    /**
+     *  Returns the bounding box and sphere of the mesh and all its sub-meshes.
+     *  @return the volume in model space, empty for an empty mesh.
+     */
+    BoundingVolume Mesh::GetBoundingVolume() const
+    {
+        BoundingVolume result;
+        if (boundsRadius_ > 0.0f) {
+            result.center = boundsCenter_;
+            result.extent = boundsExtent_;
+            result.radius = boundsRadius_;
+        }
+        for (const auto& subMesh : subMeshes_) result = result.merge(subMesh->GetBoundingVolume());
+        return result;
+    }
+
+    /**
+     *  Draws the current mesh without rendering its sub-meshes.
+     */
+    void Mesh::Draw() const
+    {
+        GeometryArena::getInstance().draw(allocation_);
+    }
+
+    /**
+     *  Draws the whole hierarchy of this mesh with sub-meshes in one go. Sub-meshes sharing a pool of the
+     *  geometry arena are submitted as a single multi-draw.
+     */
+    void Mesh::DrawComplete() const
+    {
+        static std::vector<const GeometryArena::Allocation*> allocations;
+        allocations.clear();
+        collectAllocations(allocations, nullptr, nullptr, nullptr, nullptr);
+        GeometryArena::getInstance().draw(allocations.data(), allocations.size());
+    }
 
-			r = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x);
-			v0->tangent = (deltaPos1 * deltaUV2.y - deltaPos2 * deltaUV1.y)*r;
-			v1->tangent = v0->tangent;
-			v2->tangent = v0->tangent;
-		}
+    /**
+     *  Draws the whole hierarchy of this mesh, each sub-mesh with the coarsest level of detail whose projected
+     *  error stays below the limit of the selection. Clustered sub-meshes drawn at full detail only draw the
+     *  clusters passing the culling test. Sub-meshes outside of the view frustum are skipped.
+     *  @param modelMatrix the model matrix of the mesh.
+     *  @param lodSelection the parameters of the level of detail selection.
+     *  @param clusterCulling the view to cull clusters against or nullptr to draw all clusters.
+     *  @param subMeshCulling the view to cull sub-meshes against or nullptr to draw all sub-meshes.
+     */
+    void Mesh::DrawComplete(const glm::mat4& modelMatrix, const LodSelection& lodSelection,
+        ClusterCulling* clusterCulling, SubMeshCulling* subMeshCulling) const
+    {
+        static std::vector<const GeometryArena::Allocation*> allocations;
+        allocations.clear();
+        visibleClusterRanges.clear();
+        collectAllocations(allocations, &modelMatrix, &lodSelection, clusterCulling, subMeshCulling);
+        GeometryArena::getInstance().draw(allocations.data(), allocations.size());
+    }
 
-        // Bind a Vertex Array Object
-        glGenVertexArrays(1, &vertexArray_);
-        glBindVertexArray(vertexArray_);
+    /**
+     *  Adds a coarser level of detail.
+     *  @param indices the triangle indices of the level of detail.
+     *  @param numIndices the number of indices.
+     *  @param error the geometric error in object space units.
+     */
+    void Mesh::addLod(const GLuint* indices, std::size_t numIndices, float error)
+    {
+        lodAllocations_.push_back(GeometryArena::getInstance().allocateIndices(allocation_, indices, numIndices));
+        lodErrors_.push_back(error);
+    }
 
-        // Copy Vertex Buffer Data
-        glGenBuffers(1, &vertexBuffer_);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer_);
-        glBufferData(GL_ARRAY_BUFFER, vertices_.size() * sizeof(MeshVertex), vertices_.data(), GL_STATIC_DRAW);
+    /**
+     *  Sets the clusters of the full mesh.
+     *  @param clusters the clusters.
+     *  @param numClusters the number of clusters.
+     */
+    void Mesh::setClusters(const MeshClusterData* clusters, std::size_t numClusters)
+    {
+        clusters_.assign(clusters, clusters + numClusters);
+    }
 
-        // Copy Index Buffer Data
-        glGenBuffers(1, &indexBuffer_);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer_);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_.size() * sizeof(GLuint), indices_.data(), GL_STATIC_DRAW);
+    /**
+     *  Selects the level of detail from the projected screen-space error. Switching to a coarser level needs the
+     *  error to be clearly below the limit, so levels do not flicker around the threshold.
+     *  @param modelMatrix the model matrix of the mesh.
+     *  @param lodSelection the parameters of the level of detail selection.
+     *  @return the level of detail, 0 is the full mesh.
+     */
+    unsigned int Mesh::selectLod(const glm::mat4& modelMatrix, const LodSelection& lodSelection) const
+    {
+        auto& currentLod = currentLods_[lodSelection.pass];
+        if (lodErrors_.empty()) return currentLod = 0;
 
-        // Set Shader Attributes
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), reinterpret_cast<GLvoid*>(offsetof(MeshVertex, position)));
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), reinterpret_cast<GLvoid*>(offsetof(MeshVertex, normal)));
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), reinterpret_cast<GLvoid*>(offsetof(MeshVertex, textureCoordinate)));
-		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), reinterpret_cast<GLvoid*>(offsetof(MeshVertex, tangent)));
-        glEnableVertexAttribArray(0); // Vertex Positions
-        glEnableVertexAttribArray(1); // Vertex Normals
-        glEnableVertexAttribArray(2); // Vertex UVs
-		glEnableVertexAttribArray(3); // tangent
+        auto scale = std::max(glm::length(glm::vec3(modelMatrix[0])),
+            std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+        auto center = glm::vec3(modelMatrix * glm::vec4(boundsCenter_, 1.0f));
+        auto distance = std::max(glm::length(center - lodSelection.cameraPosition) - scale * boundsRadius_, 1e-3f);
+        auto projectedError = [&](unsigned int lod) { return lod == 0 ? 0.0f : lodErrors_[lod - 1] * scale * lodSelection.pixelScale / distance; };
 
-        glBindVertexArray(0);
-        glDeleteBuffers(1, &vertexBuffer_);
-        glDeleteBuffers(1, &indexBuffer_);
+        unsigned int lod = 0;
+        while (lod < lodErrors_.size() && projectedError(lod + 1) <= lodSelection.maxPixelError) ++lod;
+        while (lod > currentLod && projectedError(lod) > lodHysteresis * lodSelection.maxPixelError) --lod;
+        return currentLod = lod;
     }
 
     /**
-     *  Draws the current mesh without rendering its sub-meshes.
+     *  Collects the arena ranges of the whole hierarchy in drawing order.
+     *  @param allocations the list to add the ranges to.
+     *  @param modelMatrix the model matrix of the mesh or nullptr to use the full meshes.
+     *  @param lodSelection the parameters of the level of detail selection or nullptr to use the full meshes.
+     *  @param clusterCulling the view to cull clusters against or nullptr to draw all clusters.
+     *  @param subMeshCulling the view to cull sub-meshes against or nullptr to draw all sub-meshes.
      */
-    void Mesh::Draw() const
+    void Mesh::collectAllocations(std::vector<const GeometryArena::Allocation*>& allocations,
+        const glm::mat4* modelMatrix, const LodSelection* lodSelection, ClusterCulling* clusterCulling,
+        SubMeshCulling* subMeshCulling) const
     {
-        if (vertexArray_ != 0) {
-            glBindVertexArray(vertexArray_);
-            glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices_.size()), GL_UNSIGNED_INT, nullptr);
+        if (subMeshCulling && modelMatrix && !subMeshes_.empty()) {
+            // the sub-mesh volumes are tested in object space, against the planes of the model-view-projection matrix.
+            visibleSubMeshes.clear();
+            subMeshCulling->numSubMeshes += static_cast<unsigned int>(subMeshes_.size());
+            subMeshCulling->numVisibleSubMeshes += static_cast<unsigned int>(
+                subMeshVolumes_.cull(Frustum(subMeshCulling->viewProjection * *modelMatrix), visibleSubMeshes));
+            for (auto i : visibleSubMeshes)
+                subMeshes_[i]->collectAllocations(allocations, modelMatrix, lodSelection, clusterCulling, nullptr);
+        } else {
+            for (auto &i : subMeshes_) i->collectAllocations(allocations, modelMatrix, lodSelection, clusterCulling, subMeshCulling);
         }
+        if (allocation_.pool < 0) return;
+        auto lod = lodSelection ? selectLod(*modelMatrix, *lodSelection) : 0;
+        if (lod == 0 && clusterCulling && modelMatrix && !clusters_.empty())
+            collectVisibleClusters(allocations, *modelMatrix, *clusterCulling);
+        else
+            allocations.push_back(lod == 0 ? &allocation_ : &lodAllocations_[lod - 1]);
     }
 
-    /** Draws the whole hierarchy of this mesh with sub-meshes in one go. */
-    void Mesh::DrawComplete() const
+    /**
+     *  Culls the clusters against the view frustum and their normal cones. Consecutive visible clusters are
+     *  merged into one draw.
+     *  @param allocations the list to add the ranges of the visible clusters to.
+     *  @param modelMatrix the model matrix of the mesh.
+     *  @param clusterCulling the view to cull the clusters against, its statistics are updated.
+     */
+    void Mesh::collectVisibleClusters(std::vector<const GeometryArena::Allocation*>& allocations,
+        const glm::mat4& modelMatrix, ClusterCulling& clusterCulling) const
     {
-        for (auto &i : subMeshes_) i->DrawComplete();
-        Draw();
+        // test in object space: frustum planes of the model-view-projection matrix.
+        Frustum frustum(clusterCulling.viewProjection * modelMatrix);
+        auto inverseModel = glm::inverse(modelMatrix);
+        auto viewOrigin = inverseModel * clusterCulling.viewOrigin;
+        if (clusterCulling.viewOrigin.w == 0.0f) viewOrigin = glm::vec4(glm::normalize(glm::vec3(viewOrigin)), 0.0f);
+
+        GeometryArena::Allocation* current = nullptr;
+        for (const auto& cluster : clusters_) {
+            ++clusterCulling.numClusters;
+            bool visible = true;
+            for (const auto& plane : frustum.planes) {
+                if (glm::dot(glm::vec3(plane), cluster.center) + plane.w < -cluster.radius) {
+                    visible = false;
+                    break;
+                }
+            }
+            if (visible && cluster.coneCutoff < 1.0f) {
+                if (viewOrigin.w == 0.0f) {
+                    visible = glm::dot(glm::vec3(viewOrigin), cluster.coneAxis) < cluster.coneCutoff;
+                } else {
+                    auto toCenter = cluster.center - glm::vec3(viewOrigin);
+                    visible = glm::dot(toCenter, cluster.coneAxis) < cluster.coneCutoff * glm::length(toCenter) + cluster.radius;
+                }
+            }
+            if (!visible) {
+                current = nullptr;
+                continue;
+            }
+
+            ++clusterCulling.numVisibleClusters;
+            if (current) {
+                current->numIndices += static_cast<GLsizei>(cluster.numIndices);
+                continue;
+            }
+            visibleClusterRanges.push_back(allocation_);
+            current = &visibleClusterRanges.back();
+            current->numVertices = 0;
+            current->firstIndex = allocation_.firstIndex + cluster.firstIndex;
+            current->numIndices = static_cast<GLsizei>(cluster.numIndices);
+            allocations.push_back(current);
+        }
     }
 
-    void Mesh::parse(const std::string& path, const aiNode* node, const aiScene* scene)
+    void Mesh::parse(const aiNode* node, const aiScene* scene, std::vector<SubMeshData>& subMeshes)
     {
         for (unsigned int i = 0; i < node->mNumMeshes; i++)
-            subMeshes_.emplace_back(std::move(std::make_unique<Mesh>(path, scene->mMeshes[node->mMeshes[i]], scene)));
+            subMeshes.emplace_back(convert(scene->mMeshes[node->mMeshes[i]]));
         for (unsigned int i = 0; i < node->mNumChildren; i++)
-            parse(path, node->mChildren[i], scene);
+            parse(node->mChildren[i], scene, subMeshes);
     }
-}
\ No newline at end of file
+}
@@ -1,16 +1,21 @@
 #pragma once
 
 #include "cg1.h"
+#include "FrustumCuller.h"
+#include "GeometryArena.h"
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
 #include <map>
 #include "Texture.h"
 
 namespace cg1 {
 
+    class MeshCache;
+
     /** The vertex object used in these examples. */
     struct MeshVertex {
         /** The vertex position. */
@@ -19,8 +24,139 @@ namespace cg1 {
         glm::vec3 normal;
         /** The vertex texture coordinate. */
         glm::vec2 textureCoordinate;
+        /** The vertex tangent, w holds the handedness of the tangent frame (bitangent = cross(tangent, normal) * w). */
+        glm::vec4 tangent;
+    };
+
+    /** The vertex layouts a mesh can be uploaded to the GPU with. */
+    enum class VertexFormat {
+        /** Full-float vertices as in MeshVertex (52 bytes). */
+        Float,
+        /** Float positions, octahedral normals and tangents, half-float texture coordinates (24 bytes). */
+        Packed,
+        /** Half-float positions, octahedral normals and tangents, half-float texture coordinates (20 bytes). */
+        PackedHalfPosition
+    };
+
+    /** How a mesh is drawn, selects the import steps it needs. */
+    enum class MeshUsage {
+        /** Drawn as stored, large sub-meshes are split into clusters for culling. */
+        Static,
+        /** Displaced by the vertex shader, the stored positions cannot be used to cull clusters. */
+        Displaced
+    };
+
+    /** The vertex uploaded for VertexFormat::Packed. */
+    struct PackedMeshVertex {
+        /** The vertex position. */
+        glm::vec3 position;
+        /** The octahedral-encoded vertex normal as signed normalized shorts. */
+        glm::i16vec2 normal;
+        /** The octahedral-encoded vertex tangent as signed normalized shorts, the sign of y holds the handedness. */
+        glm::i16vec2 tangent;
+        /** The vertex texture coordinate as half-floats. */
+        glm::u16vec2 textureCoordinate;
+    };
+
+    /** The vertex uploaded for VertexFormat::PackedHalfPosition. */
+    struct PackedHalfMeshVertex {
+        /** The vertex position as half-floats, w is always 1. */
+        glm::u16vec4 position;
+        /** The octahedral-encoded vertex normal as signed normalized shorts. */
+        glm::i16vec2 normal;
+        /** The octahedral-encoded vertex tangent as signed normalized shorts, the sign of y holds the handedness. */
+        glm::i16vec2 tangent;
+        /** The vertex texture coordinate as half-floats. */
+        glm::u16vec2 textureCoordinate;
+    };
+
+    /** A simplified version of a sub-mesh using a subset of its vertices. */
+    struct MeshLodData {
+        /** Holds the triangle indices. */
+        std::vector<GLuint> indices;
+        /** Holds the geometric error compared to the full mesh in object space units. */
+        float error;
+    };
+
+    /** A cluster of neighboring triangles forming a contiguous range of the index buffer. */
+    struct MeshClusterData {
+        /** Holds the first index of the cluster. */
+        std::uint32_t firstIndex;
+        /** Holds the number of indices of the cluster. */
+        std::uint32_t numIndices;
+        /** Holds the center of the bounding sphere. */
+        glm::vec3 center;
+        /** Holds the radius of the bounding sphere. */
+        float radius;
+        /** Holds the average normal of the triangles. */
+        glm::vec3 coneAxis;
+        /** Holds the sine of the angle of the cone containing all normals, 1 if the cluster cannot be culled. */
+        float coneCutoff;
+    };
+
+    /** The CPU-side geometry of a single sub-mesh as it is uploaded to the GPU. */
+    struct SubMeshData {
+        /** Holds the vertices. */
+        std::vector<MeshVertex> vertices;
+        /** Holds the triangle indices. */
+        std::vector<GLuint> indices;
+        /** Holds the coarser levels of detail, ordered from fine to coarse. */
+        std::vector<MeshLodData> lods;
+        /** Holds the clusters of the full mesh, empty for small meshes. */
+        std::vector<MeshClusterData> clusters;
+    };
+
+    /**
+     * The CPU-side geometry of a mesh file. It can be loaded on any thread, but only be uploaded to the GPU on the
+     * thread owning the OpenGL context.
+     */
+    struct MeshFileData {
+        MeshFileData();
+        MeshFileData(MeshFileData&&) noexcept;
+        MeshFileData& operator=(MeshFileData&&) noexcept;
+        ~MeshFileData() noexcept;
+
+        /** Holds the mapped cache file if the mesh was found in the mesh cache. */
+        std::unique_ptr<MeshCache> cache;
+        /** Holds the imported sub-meshes if the mesh was not found in the mesh cache. */
+        std::vector<SubMeshData> subMeshes;
+    };
 
-		glm::vec3 tangent;
+    /** Parameters of the level of detail selection of one render pass. */
+    struct LodSelection {
+        /** The passes that keep separate level of detail states for hysteresis. */
+        enum Pass { Camera, Shadow, NumPasses };
+
+        /** Holds the camera position in world space. */
+        glm::vec3 cameraPosition;
+        /** Holds the size in pixels of one world space unit at distance one from the camera. */
+        float pixelScale;
+        /** Holds the largest allowed screen-space error in pixels. */
+        float maxPixelError;
+        /** Holds the pass the selection is made for. */
+        Pass pass;
+    };
+
+    /** The view the clusters of meshes are culled against. */
+    struct ClusterCulling {
+        /** Holds the view-projection matrix of the pass. */
+        glm::mat4 viewProjection;
+        /** Holds the camera position (w = 1) or the viewing direction of an orthographic projection (w = 0). */
+        glm::vec4 viewOrigin;
+        /** Holds the number of clusters tested. */
+        unsigned int numClusters = 0;
+        /** Holds the number of clusters drawn. */
+        unsigned int numVisibleClusters = 0;
+    };
+
+    /** The view the sub-meshes of meshes are culled against. */
+    struct SubMeshCulling {
+        /** Holds the view-projection matrix of the pass. */
+        glm::mat4 viewProjection;
+        /** Holds the number of sub-meshes tested. */
+        unsigned int numSubMeshes = 0;
+        /** Holds the number of sub-meshes drawn. */
+        unsigned int numVisibleSubMeshes = 0;
     };
 
     /**
@@ -29,14 +165,18 @@ namespace cg1 {
     class Mesh final
     {
     public:
-        explicit Mesh(const std::string& meshFilename);
-        Mesh(const std::string& path, const aiMesh* mesh, const aiScene* scene);
+        explicit Mesh(const std::string& meshFilename, VertexFormat vertexFormat = VertexFormat::Packed);
+        explicit Mesh(const MeshFileData& fileData, VertexFormat vertexFormat = VertexFormat::Packed);
+        Mesh(const MeshVertex* vertices, std::size_t numVertices, const GLuint* indices, std::size_t numIndices,
+            VertexFormat vertexFormat = VertexFormat::Float);
         Mesh(const Mesh&) = delete;
         Mesh& operator=(const Mesh&) = delete;
         Mesh(Mesh&&) noexcept;
         Mesh& operator=(Mesh&&) noexcept;
         ~Mesh() noexcept;
 
+        static MeshFileData LoadFile(const std::string& meshFilename, MeshUsage usage = MeshUsage::Static);
+
         /**
          *  Accessor to the meshes sub-meshes. This can be used to render more complicated meshes (with multiple sets
          *  of texture coordinates).
@@ -45,25 +185,59 @@ namespace cg1 {
         /** Const accessor to the meshes sub-meshes. */
         const std::vector<std::unique_ptr<Mesh>>& GetSubMeshes() const { return subMeshes_; }
 
+        /** Returns the vertex layout of the mesh. */
+        VertexFormat GetVertexFormat() const { return vertexFormat_; }
+        /** Returns whether normals and tangents are octahedral-encoded and need to be decoded by the shader. */
+        bool HasPackedVertices() const { return vertexFormat_ != VertexFormat::Float; }
+        std::size_t GetMemorySize() const;
+        glm::vec4 GetBoundingSphere() const;
+        BoundingVolume GetBoundingVolume() const;
+
         void Draw() const;
         void DrawComplete() const;
+        void DrawComplete(const glm::mat4& modelMatrix, const LodSelection& lodSelection,
+            ClusterCulling* clusterCulling = nullptr, SubMeshCulling* subMeshCulling = nullptr) const;
 
     private:
 
-        void parse(const std::string& path, const aiNode* node, const aiScene* scene);
+        static bool importMesh(const std::string& fullFilename, std::vector<SubMeshData>& subMeshes, MeshUsage usage);
+        static bool importAssimp(const std::string& fullFilename, std::vector<SubMeshData>& subMeshes);
+        static bool isObjFile(const std::string& filename);
+#ifdef CG1_BENCHMARK_MESH_IMPORT
+        static void benchmarkImport(const std::string& fullFilename);
+#endif
+        static void parse(const aiNode* node, const aiScene* scene, std::vector<SubMeshData>& subMeshes);
+        static SubMeshData convert(const aiMesh* mesh);
+        void addLod(const GLuint* indices, std::size_t numIndices, float error);
+        void setClusters(const MeshClusterData* clusters, std::size_t numClusters);
+        unsigned int selectLod(const glm::mat4& modelMatrix, const LodSelection& lodSelection) const;
+        void collectAllocations(std::vector<const GeometryArena::Allocation*>& allocations,
+            const glm::mat4* modelMatrix, const LodSelection* lodSelection, ClusterCulling* clusterCulling,
+            SubMeshCulling* subMeshCulling) const;
+        void collectVisibleClusters(std::vector<const GeometryArena::Allocation*>& allocations,
+            const glm::mat4& modelMatrix, ClusterCulling& clusterCulling) const;
 
         /** Holds all the meshes sub-meshes. */
         std::vector<std::unique_ptr<Mesh>> subMeshes_;
-        /** Holds the meshes indices. */
-        std::vector<GLuint> indices_;
-        /** Holds the meshes vertices. */
-        std::vector<MeshVertex> vertices_;
-
-        /** Holds the OpenGL vertex array object. */
-        GLuint vertexArray_;
-        /** Holds the OpenGL vertex buffer. */
-        GLuint vertexBuffer_;
-        /** Holds the OpenGL index buffer. */
-        GLuint indexBuffer_;
+        /** Holds the vertex layout of the mesh. */
+        VertexFormat vertexFormat_;
+        /** Holds the range of the mesh inside the geometry arena. */
+        GeometryArena::Allocation allocation_;
+        /** Holds the index ranges of the coarser levels of detail. */
+        std::vector<GeometryArena::Allocation> lodAllocations_;
+        /** Holds the geometric errors of the coarser levels of detail. */
+        std::vector<float> lodErrors_;
+        /** Holds the clusters of the full mesh. */
+        std::vector<MeshClusterData> clusters_;
+        /** Holds the center of the bounding sphere. */
+        glm::vec3 boundsCenter_;
+        /** Holds the radius of the bounding sphere. */
+        float boundsRadius_;
+        /** Holds the half size of the bounding box, which shares its center with the bounding sphere. */
+        glm::vec3 boundsExtent_;
+        /** Holds the bounding volumes of the sub-meshes in model space. */
+        FrustumCuller subMeshVolumes_;
+        /** Holds the level of detail last selected for each pass. */
+        mutable unsigned int currentLods_[LodSelection::NumPasses];
     };
 }
@@ -0,0 +1,208 @@
+#include "MeshCache.h"
+#include <cstring>
+#include <iostream>
+
+namespace cg1 {
+
+    namespace {
+        /** The identifier at the start of each mesh cache file. */
+        constexpr char cacheMagic[4] = { 'C', 'G', '1', 'M' };
+        /** The version of the cache format, needs to be increased on every change of the stored data. */
+        constexpr std::uint32_t cacheVersion = 7;
+        /** The alignment of the data blocks inside the cache file. */
+        constexpr std::size_t cacheAlignment = 16;
+
+        /** The header of a mesh cache file. */
+        struct CacheHeader
+        {
+            char magic[4];
+            std::uint32_t version;
+            std::uint32_t vertexSize;
+            std::uint32_t numSubMeshes;
+            std::uint32_t numLods;
+            std::uint32_t numClusters;
+            std::uint64_t importKey;
+            std::uint64_t sourceSize;
+            std::int64_t sourceModificationTime;
+        };
+
+        /** Describes where the data of a single sub-mesh is stored in the cache file. */
+        struct SubMeshRecord
+        {
+            std::uint64_t vertexOffset;
+            std::uint64_t indexOffset;
+            std::uint32_t numVertices;
+            std::uint32_t numIndices;
+            std::uint32_t firstLod;
+            std::uint32_t numLods;
+            std::uint32_t firstCluster;
+            std::uint32_t numClusters;
+        };
+
+        /** Describes where the indices of a single level of detail are stored in the cache file. */
+        struct LodRecord
+        {
+            std::uint64_t indexOffset;
+            std::uint32_t numIndices;
+            float error;
+        };
+    }
+
+    /**
+     *  Constructor.
+     *  @param sourceFilename the full name of the mesh file.
+     *  @param importKey identifies the importer and its options, part of the cache key.
+     */
+    MeshCache::MeshCache(const std::string& sourceFilename, std::uint64_t importKey) :
+        cacheFilename_(),
+        importKey_(importKey),
+        sourceStamp_(),
+        hasSource_(filecache::getFileStamp(sourceFilename, sourceStamp_))
+    {
+        auto key = filecache::hash(sourceFilename);
+        key = filecache::hash(&importKey, sizeof(importKey), key);
+        key = filecache::hash(&cacheVersion, sizeof(cacheVersion), key);
+        cacheFilename_ = filecache::getCacheFilename(sourceFilename, key, ".mesh");
+    }
+
+    /**
+     *  Maps the cache file and checks whether it is still valid for the source file.
+     *  @return whether the cache file can be used.
+     */
+    bool MeshCache::load()
+    {
+        subMeshes_.clear();
+        if (!hasSource_) return false;
+        file_ = MappedFile(cacheFilename_);
+        if (!file_.isOpen() || file_.size() < sizeof(CacheHeader)) return false;
+
+        CacheHeader header;
+        std::memcpy(&header, file_.data(), sizeof(CacheHeader));
+        if (std::memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 || header.version != cacheVersion
+            || header.importKey != importKey_ || header.vertexSize != sizeof(MeshVertex)
+            || header.sourceSize != sourceStamp_.size
+            || header.sourceModificationTime != sourceStamp_.modificationTime) {
+            file_ = MappedFile();
+            return false;
+        }
+
+        auto lodRecordsBegin = sizeof(CacheHeader) + header.numSubMeshes * sizeof(SubMeshRecord);
+        auto clustersBegin = lodRecordsBegin + header.numLods * sizeof(LodRecord);
+        auto recordsEnd = clustersBegin + header.numClusters * sizeof(MeshClusterData);
+        if (recordsEnd > file_.size()) {
+            file_ = MappedFile();
+            return false;
+        }
+
+        auto records = reinterpret_cast<const SubMeshRecord*>(file_.data() + sizeof(CacheHeader));
+        auto lodRecords = reinterpret_cast<const LodRecord*>(file_.data() + lodRecordsBegin);
+        auto clusters = reinterpret_cast<const MeshClusterData*>(file_.data() + clustersBegin);
+        for (std::uint32_t i = 0; i < header.numSubMeshes; ++i) {
+            const auto& record = records[i];
+            bool valid = record.vertexOffset + record.numVertices * sizeof(MeshVertex) <= file_.size()
+                && record.indexOffset + record.numIndices * sizeof(GLuint) <= file_.size()
+                && static_cast<std::uint64_t>(record.firstLod) + record.numLods <= header.numLods
+                && static_cast<std::uint64_t>(record.firstCluster) + record.numClusters <= header.numClusters;
+            for (std::uint32_t j = 0; valid && j < record.numLods; ++j) {
+                const auto& lodRecord = lodRecords[record.firstLod + j];
+                valid = lodRecord.indexOffset + lodRecord.numIndices * sizeof(GLuint) <= file_.size();
+            }
+            for (std::uint32_t j = 0; valid && j < record.numClusters; ++j) {
+                const auto& cluster = clusters[record.firstCluster + j];
+                valid = static_cast<std::uint64_t>(cluster.firstIndex) + cluster.numIndices <= record.numIndices;
+            }
+            if (!valid) {
+                subMeshes_.clear();
+                file_ = MappedFile();
+                return false;
+            }
+
+            CachedSubMesh subMesh{
+                reinterpret_cast<const MeshVertex*>(file_.data() + record.vertexOffset), record.numVertices,
+                reinterpret_cast<const GLuint*>(file_.data() + record.indexOffset), record.numIndices, {},
+                clusters + record.firstCluster, record.numClusters };
+            for (std::uint32_t j = 0; j < record.numLods; ++j) {
+                const auto& lodRecord = lodRecords[record.firstLod + j];
+                subMesh.lods.push_back(CachedMeshLod{ reinterpret_cast<const GLuint*>(file_.data() + lodRecord.indexOffset),
+                    lodRecord.numIndices, lodRecord.error });
+            }
+            subMeshes_.push_back(std::move(subMesh));
+        }
+        return true;
+    }
+
+    /**
+     *  Writes the imported sub-meshes to the cache file.
+     *  @param subMeshes the sub-meshes to store.
+     *  @return whether the cache file was written.
+     */
+    bool MeshCache::store(const std::vector<SubMeshData>& subMeshes) const
+    {
+        if (!hasSource_) return false;
+
+        CacheHeader header;
+        std::memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+        header.version = cacheVersion;
+        header.importKey = importKey_;
+        header.vertexSize = sizeof(MeshVertex);
+        header.sourceSize = sourceStamp_.size;
+        header.sourceModificationTime = sourceStamp_.modificationTime;
+        header.numSubMeshes = static_cast<std::uint32_t>(subMeshes.size());
+        header.numLods = 0;
+        header.numClusters = 0;
+        for (const auto& subMesh : subMeshes) {
+            header.numLods += static_cast<std::uint32_t>(subMesh.lods.size());
+            header.numClusters += static_cast<std::uint32_t>(subMesh.clusters.size());
+        }
+
+        std::vector<SubMeshRecord> records(subMeshes.size());
+        std::vector<LodRecord> lodRecords;
+        std::vector<MeshClusterData> clusters;
+        std::size_t offset = sizeof(CacheHeader) + records.size() * sizeof(SubMeshRecord) + header.numLods * sizeof(LodRecord)
+            + header.numClusters * sizeof(MeshClusterData);
+        auto alignOffset = [](std::size_t o) { return (o + cacheAlignment - 1) / cacheAlignment * cacheAlignment; };
+        for (std::size_t i = 0; i < subMeshes.size(); ++i) {
+            records[i].numVertices = static_cast<std::uint32_t>(subMeshes[i].vertices.size());
+            records[i].numIndices = static_cast<std::uint32_t>(subMeshes[i].indices.size());
+            offset = alignOffset(offset);
+            records[i].vertexOffset = offset;
+            offset += subMeshes[i].vertices.size() * sizeof(MeshVertex);
+            offset = alignOffset(offset);
+            records[i].indexOffset = offset;
+            offset += subMeshes[i].indices.size() * sizeof(GLuint);
+            records[i].firstLod = static_cast<std::uint32_t>(lodRecords.size());
+            records[i].numLods = static_cast<std::uint32_t>(subMeshes[i].lods.size());
+            records[i].firstCluster = static_cast<std::uint32_t>(clusters.size());
+            records[i].numClusters = static_cast<std::uint32_t>(subMeshes[i].clusters.size());
+            clusters.insert(clusters.end(), subMeshes[i].clusters.begin(), subMeshes[i].clusters.end());
+            for (const auto& lod : subMeshes[i].lods) {
+                offset = alignOffset(offset);
+                lodRecords.push_back(LodRecord{ offset, static_cast<std::uint32_t>(lod.indices.size()), lod.error });
+                offset += lod.indices.size() * sizeof(GLuint);
+            }
+        }
+
+        std::vector<char> contents;
+        contents.reserve(offset);
+        filecache::append(contents, header);
+        filecache::append(contents, records.data(), records.size());
+        filecache::append(contents, lodRecords.data(), lodRecords.size());
+        filecache::append(contents, clusters.data(), clusters.size());
+        for (const auto& subMesh : subMeshes) {
+            filecache::align(contents, cacheAlignment);
+            filecache::append(contents, subMesh.vertices.data(), subMesh.vertices.size());
+            filecache::align(contents, cacheAlignment);
+            filecache::append(contents, subMesh.indices.data(), subMesh.indices.size());
+            for (const auto& lod : subMesh.lods) {
+                filecache::align(contents, cacheAlignment);
+                filecache::append(contents, lod.indices.data(), lod.indices.size());
+            }
+        }
+
+        if (!filecache::replaceFile(cacheFilename_, contents)) {
+            std::cerr << "Could not write mesh cache file (" << cacheFilename_ << ")." << std::endl;
+            return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "cg1.h"
+#include "core/FileCache.h"
+#include "core/MappedFile.h"
+#include "gfx/Mesh.h"
+
+namespace cg1 {
+
+    /** A level of detail whose indices live inside a mapped cache file. */
+    struct CachedMeshLod
+    {
+        /** Holds the first index. */
+        const GLuint* indices;
+        /** Holds the number of indices. */
+        std::uint32_t numIndices;
+        /** Holds the geometric error in object space units. */
+        float error;
+    };
+
+    /** A sub-mesh whose vertices and indices live inside a mapped cache file. */
+    struct CachedSubMesh
+    {
+        /** Holds the first vertex. */
+        const MeshVertex* vertices;
+        /** Holds the number of vertices. */
+        std::uint32_t numVertices;
+        /** Holds the first index. */
+        const GLuint* indices;
+        /** Holds the number of indices. */
+        std::uint32_t numIndices;
+        /** Holds the coarser levels of detail. */
+        std::vector<CachedMeshLod> lods;
+        /** Holds the first cluster of the full mesh. */
+        const MeshClusterData* clusters;
+        /** Holds the number of clusters. */
+        std::uint32_t numClusters;
+    };
+
+    /**
+     * On-disk cache of imported meshes. The cache file holds the final vertex and index arrays of all sub-meshes
+     * in the layout they are uploaded to the GPU, so a cache hit needs neither Assimp nor any post-processing.
+     */
+    class MeshCache final
+    {
+    public:
+        MeshCache(const std::string& sourceFilename, std::uint64_t importKey);
+
+        bool load();
+        bool store(const std::vector<SubMeshData>& subMeshes) const;
+
+        /** Returns the sub-meshes of a successfully loaded cache file. */
+        const std::vector<CachedSubMesh>& getSubMeshes() const noexcept { return subMeshes_; }
+
+    private:
+        /** Holds the name of the cache file. */
+        std::string cacheFilename_;
+        /** Holds the key identifying the importer and its options. */
+        std::uint64_t importKey_;
+        /** Holds the stamp of the source file. */
+        filecache::FileStamp sourceStamp_;
+        /** Holds whether the source file exists. */
+        bool hasSource_;
+        /** Holds the mapped cache file. */
+        MappedFile file_;
+        /** Holds the sub-meshes inside the mapped file. */
+        std::vector<CachedSubMesh> subMeshes_;
+    };
+}
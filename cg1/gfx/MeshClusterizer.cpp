@@ -0,0 +1,174 @@
+#include "MeshClusterizer.h"
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <numeric>
+
+namespace cg1 {
+
+    constexpr std::size_t MeshClusterizer::maxClusterTriangles;
+    constexpr std::size_t MeshClusterizer::minClusteredTriangles;
+
+    namespace {
+        /** The minimal cosine between a triangle normal and the cluster normal to add the triangle. */
+        constexpr float minNormalCosine = 0.5f;
+    }
+
+    /**
+     *  Reorders the triangles of a sub-mesh into clusters grown over shared vertices. The triangles of each
+     *  cluster are optimized for the vertex cache again and the clusters are sorted to reduce overdraw, the
+     *  vertex cache efficiency after clustering is reported.
+     *  @param subMesh the sub-mesh, its indices are reordered and the clusters are added to it.
+     *  @param name the name of the sub-mesh used for logging.
+     */
+    void MeshClusterizer::buildClusters(SubMeshData& subMesh, const std::string& name)
+    {
+        subMesh.clusters.clear();
+        const auto& vertices = subMesh.vertices;
+        const auto& indices = subMesh.indices;
+        auto numTriangles = indices.size() / 3;
+        if (numTriangles < minClusteredTriangles) return;
+
+        // triangles adjacent to each vertex.
+        std::vector<GLuint> adjacencyOffsets(vertices.size() + 1, 0);
+        for (std::size_t i = 0; i < 3 * numTriangles; ++i) ++adjacencyOffsets[indices[i] + 1];
+        std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(), adjacencyOffsets.begin());
+        std::vector<GLuint> adjacency(3 * numTriangles);
+        {
+            auto fill = adjacencyOffsets;
+            for (std::size_t i = 0; i < 3 * numTriangles; ++i) adjacency[fill[indices[i]]++] = static_cast<GLuint>(i / 3);
+        }
+
+        std::vector<glm::vec3> normals(numTriangles);
+        for (std::size_t t = 0; t < numTriangles; ++t) {
+            glm::vec3 p0(vertices[indices[3 * t]].position);
+            glm::vec3 p1(vertices[indices[3 * t + 1]].position);
+            glm::vec3 p2(vertices[indices[3 * t + 2]].position);
+            auto normal = glm::cross(p1 - p0, p2 - p0);
+            auto length = glm::length(normal);
+            normals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+        }
+
+        std::vector<char> assigned(numTriangles, 0);
+        std::vector<GLuint> visited(numTriangles, 0);
+        std::vector<GLuint> cluster, frontier;
+        // local vertex numbering of the current cluster, so optimizing it does not touch all vertices.
+        std::vector<GLuint> localIndex(vertices.size()), localCluster(vertices.size(), 0);
+        std::vector<GLuint> localIndices, localVertices;
+        std::vector<GLuint> result;
+        result.reserve(indices.size());
+        std::vector<std::size_t> clusterStarts;
+        GLuint clusterId = 0;
+        for (std::size_t seed = 0; seed < numTriangles; ++seed) {
+            if (assigned[seed]) continue;
+
+            // grow the cluster breadth-first over shared vertices, skipping triangles bending away too far.
+            ++clusterId;
+            cluster.clear();
+            frontier.assign(1, static_cast<GLuint>(seed));
+            visited[seed] = clusterId;
+            glm::vec3 clusterNormal(0.0f);
+            for (std::size_t next = 0; next < frontier.size() && cluster.size() < maxClusterTriangles; ++next) {
+                auto t = frontier[next];
+                auto normalLength = glm::length(clusterNormal);
+                if (!cluster.empty() && normalLength > 0.0f
+                    && glm::dot(normals[t], clusterNormal / normalLength) < minNormalCosine) continue;
+
+                cluster.push_back(t);
+                assigned[t] = 1;
+                clusterNormal += normals[t];
+                for (std::size_t i = 0; i < 3; ++i) {
+                    auto v = indices[3 * t + i];
+                    for (auto a = adjacencyOffsets[v]; a < adjacencyOffsets[v + 1]; ++a) {
+                        auto neighbor = adjacency[a];
+                        if (assigned[neighbor] || visited[neighbor] == clusterId) continue;
+                        visited[neighbor] = clusterId;
+                        frontier.push_back(neighbor);
+                    }
+                }
+            }
+
+            localIndices.clear();
+            localVertices.clear();
+            for (auto t : cluster) {
+                for (std::size_t i = 0; i < 3; ++i) {
+                    auto v = indices[3 * t + i];
+                    if (localCluster[v] != clusterId) {
+                        localCluster[v] = clusterId;
+                        localIndex[v] = static_cast<GLuint>(localVertices.size());
+                        localVertices.push_back(v);
+                    }
+                    localIndices.push_back(localIndex[v]);
+                }
+            }
+            MeshOptimizer::optimizeVertexCache(localIndices, localVertices.size());
+            clusterStarts.push_back(result.size() / 3);
+            for (auto l : localIndices) result.push_back(localVertices[l]);
+        }
+        clusterStarts.push_back(numTriangles);
+
+        auto before = MeshOptimizer::analyzeVertexCache(indices, vertices.size());
+        subMesh.indices.clear();
+        for (auto c : MeshOptimizer::sortClustersByOverdraw(result, vertices, clusterStarts)) {
+            auto firstIndex = subMesh.indices.size();
+            subMesh.indices.insert(subMesh.indices.end(), result.begin() + 3 * clusterStarts[c],
+                result.begin() + 3 * clusterStarts[c + 1]);
+            auto bounds = computeBounds(vertices, subMesh.indices.data() + firstIndex, subMesh.indices.size() - firstIndex);
+            bounds.firstIndex = static_cast<std::uint32_t>(firstIndex);
+            subMesh.clusters.push_back(bounds);
+        }
+        auto after = MeshOptimizer::analyzeVertexCache(subMesh.indices, vertices.size());
+
+        std::cout << "Clustered " << name << ": " << subMesh.clusters.size() << " clusters, ACMR " << std::fixed
+            << std::setprecision(3) << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> "
+            << after.atvr << std::defaultfloat << std::endl;
+    }
+
+    /**
+     *  Computes the bounding sphere and normal cone of a set of triangles.
+     *  @param vertices the vertices.
+     *  @param indices the triangle indices.
+     *  @param numIndices the number of indices.
+     *  @return the cluster bounds, covering all given indices starting at 0.
+     */
+    MeshClusterData MeshClusterizer::computeBounds(const std::vector<MeshVertex>& vertices, const GLuint* indices,
+        std::size_t numIndices)
+    {
+        MeshClusterData result;
+        result.firstIndex = 0;
+        result.numIndices = static_cast<std::uint32_t>(numIndices);
+
+        glm::vec3 boundsMin(std::numeric_limits<float>::max()), boundsMax(-std::numeric_limits<float>::max());
+        for (std::size_t i = 0; i < numIndices; ++i) {
+            boundsMin = glm::min(boundsMin, glm::vec3(vertices[indices[i]].position));
+            boundsMax = glm::max(boundsMax, glm::vec3(vertices[indices[i]].position));
+        }
+        result.center = 0.5f * (boundsMin + boundsMax);
+        result.radius = 0.0f;
+        for (std::size_t i = 0; i < numIndices; ++i)
+            result.radius = std::max(result.radius, glm::length(glm::vec3(vertices[indices[i]].position) - result.center));
+
+        std::vector<glm::vec3> normals;
+        normals.reserve(numIndices / 3);
+        glm::vec3 axis(0.0f);
+        for (std::size_t i = 0; i + 2 < numIndices; i += 3) {
+            glm::vec3 p0(vertices[indices[i]].position);
+            auto normal = glm::cross(glm::vec3(vertices[indices[i + 1]].position) - p0, glm::vec3(vertices[indices[i + 2]].position) - p0);
+            auto length = glm::length(normal);
+            if (length == 0.0f) continue;
+            normals.push_back(normal / length);
+            axis += normals.back();
+        }
+
+        // the cone can only be used to cull the cluster if all normals lie in the same half-space.
+        auto axisLength = glm::length(axis);
+        result.coneAxis = axisLength > 0.0f ? axis / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+        auto minCosine = 1.0f;
+        for (const auto& normal : normals) minCosine = std::min(minCosine, glm::dot(normal, result.coneAxis));
+        result.coneCutoff = axisLength > 0.0f && minCosine > 0.0f ? std::sqrt(1.0f - minCosine * minCosine) : 1.0f;
+        return result;
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "cg1.h"
+#include "gfx/Mesh.h"
+
+namespace cg1 {
+
+    /**
+     * Splits the index buffer of large sub-meshes into clusters of neighboring triangles with similar normals.
+     * Each cluster stores a bounding sphere and a normal cone, so it can be culled against the view frustum and
+     * rejected if all its triangles face away from the viewer.
+     */
+    class MeshClusterizer final
+    {
+    public:
+        /** The maximum number of triangles per cluster. */
+        static constexpr std::size_t maxClusterTriangles = 128;
+        /** The minimum number of triangles of a sub-mesh to be split into clusters. */
+        static constexpr std::size_t minClusteredTriangles = 1024;
+
+        static void buildClusters(SubMeshData& subMesh, const std::string& name);
+        static MeshClusterData computeBounds(const std::vector<MeshVertex>& vertices, const GLuint* indices,
+            std::size_t numIndices);
+    };
+}
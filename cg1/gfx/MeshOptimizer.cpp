@@ -0,0 +1,303 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <numeric>
+
+namespace cg1 {
+
+    constexpr unsigned int MeshOptimizer::fifoCacheSize;
+
+    namespace {
+        /** The size of the LRU cache modeled by the vertex cache optimization. */
+        constexpr int lruCacheSize = 32;
+        /** The minimal number of triangles of a cluster for overdraw sorting. */
+        constexpr std::size_t minClusterSize = 8;
+
+        /** The Forsyth score of a vertex from its cache position and number of remaining triangles. */
+        float forsythScore(int cachePosition, unsigned int remainingTriangles)
+        {
+            if (remainingTriangles == 0) return -1.0f;
+
+            float score = 0.0f;
+            if (cachePosition >= 3) {
+                score = std::pow(1.0f - static_cast<float>(cachePosition - 3) / (lruCacheSize - 3), 1.5f);
+            } else if (cachePosition >= 0) {
+                // the vertices of the last triangle get a fixed score to avoid using them again right away.
+                score = 0.75f;
+            }
+            return score + 2.0f / std::sqrt(static_cast<float>(remainingTriangles));
+        }
+    }
+
+    /**
+     *  Simulates a FIFO post-transform cache for an index buffer.
+     *  @param indices the triangle indices.
+     *  @param numVertices the number of vertices.
+     *  @return the cache statistics.
+     */
+    VertexCacheStatistics MeshOptimizer::analyzeVertexCache(const std::vector<GLuint>& indices, std::size_t numVertices)
+    {
+        VertexCacheStatistics result;
+        if (indices.empty()) return result;
+
+        // a vertex is in the cache if it was loaded within the last fifoCacheSize misses.
+        std::vector<unsigned int> loadTime(numVertices, 0);
+        std::vector<char> referenced(numVertices, 0);
+        unsigned int time = fifoCacheSize + 1;
+        std::size_t misses = 0, numReferenced = 0;
+        for (auto index : indices) {
+            if (time - loadTime[index] > fifoCacheSize) {
+                loadTime[index] = time++;
+                ++misses;
+            }
+            if (!referenced[index]) {
+                referenced[index] = 1;
+                ++numReferenced;
+            }
+        }
+        result.acmr = static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+        result.atvr = static_cast<float>(misses) / static_cast<float>(numReferenced);
+        return result;
+    }
+
+    /**
+     *  Reorders triangles to improve post-transform vertex cache hits (Tom Forsyth, "Linear-Speed Vertex Cache
+     *  Optimisation").
+     *  @param indices the triangle indices to reorder.
+     *  @param numVertices the number of vertices.
+     */
+    void MeshOptimizer::optimizeVertexCache(std::vector<GLuint>& indices, std::size_t numVertices)
+    {
+        auto numTriangles = indices.size() / 3;
+        if (numTriangles == 0) return;
+
+        // triangles adjacent to each vertex, the first remainingTriangles entries are the ones not emitted yet.
+        std::vector<unsigned int> remainingTriangles(numVertices, 0);
+        for (auto index : indices) ++remainingTriangles[index];
+        std::vector<unsigned int> adjacencyOffsets(numVertices + 1, 0);
+        std::partial_sum(remainingTriangles.begin(), remainingTriangles.end(), adjacencyOffsets.begin() + 1);
+        std::vector<unsigned int> adjacency(indices.size());
+        {
+            auto fill = adjacencyOffsets;
+            for (std::size_t i = 0; i < indices.size(); ++i) adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+        }
+
+        std::vector<int> cachePosition(numVertices, -1);
+        std::vector<float> vertexScore(numVertices);
+        for (std::size_t v = 0; v < numVertices; ++v) vertexScore[v] = forsythScore(-1, remainingTriangles[v]);
+        std::vector<float> triangleScore(numTriangles);
+        for (std::size_t t = 0; t < numTriangles; ++t)
+            triangleScore[t] = vertexScore[indices[3 * t]] + vertexScore[indices[3 * t + 1]] + vertexScore[indices[3 * t + 2]];
+        std::vector<char> emitted(numTriangles, 0);
+
+        std::vector<GLuint> result;
+        result.reserve(indices.size());
+        std::vector<GLuint> cache, newCache;
+        cache.reserve(lruCacheSize + 3);
+        newCache.reserve(lruCacheSize + 3);
+
+        auto bestTriangle = static_cast<std::size_t>(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+        std::size_t searchStart = 0;
+        while (result.size() < indices.size()) {
+            if (bestTriangle == numTriangles) {
+                // no triangle touches the cache, continue with the next one not emitted.
+                while (emitted[searchStart]) ++searchStart;
+                bestTriangle = searchStart;
+            }
+
+            emitted[bestTriangle] = 1;
+            newCache.clear();
+            for (std::size_t i = 0; i < 3; ++i) {
+                auto v = indices[3 * bestTriangle + i];
+                result.push_back(v);
+                newCache.push_back(v);
+                auto begin = adjacency.begin() + adjacencyOffsets[v];
+                auto end = begin + remainingTriangles[v];
+                std::iter_swap(std::find(begin, end, static_cast<unsigned int>(bestTriangle)), end - 1);
+                --remainingTriangles[v];
+            }
+            for (auto v : cache) {
+                if (v != newCache[0] && v != newCache[1] && v != newCache[2]) newCache.push_back(v);
+            }
+            for (std::size_t i = lruCacheSize; i < newCache.size(); ++i) {
+                cachePosition[newCache[i]] = -1;
+                vertexScore[newCache[i]] = forsythScore(-1, remainingTriangles[newCache[i]]);
+            }
+            newCache.resize(std::min<std::size_t>(newCache.size(), lruCacheSize));
+            std::swap(cache, newCache);
+
+            for (std::size_t i = 0; i < cache.size(); ++i) {
+                cachePosition[cache[i]] = static_cast<int>(i);
+                vertexScore[cache[i]] = forsythScore(static_cast<int>(i), remainingTriangles[cache[i]]);
+            }
+
+            // only triangles around cached vertices changed their score.
+            bestTriangle = numTriangles;
+            float bestScore = -std::numeric_limits<float>::max();
+            for (auto v : cache) {
+                for (auto a = adjacencyOffsets[v]; a < adjacencyOffsets[v] + remainingTriangles[v]; ++a) {
+                    auto t = adjacency[a];
+                    triangleScore[t] = vertexScore[indices[3 * t]] + vertexScore[indices[3 * t + 1]]
+                        + vertexScore[indices[3 * t + 2]];
+                    if (triangleScore[t] > bestScore) {
+                        bestScore = triangleScore[t];
+                        bestTriangle = t;
+                    }
+                }
+            }
+        }
+        indices = std::move(result);
+    }
+
+    /**
+     *  Reorders clusters of triangles so that triangles facing outwards are drawn first, which reduces overdraw
+     *  (Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"). Clusters are split
+     *  only where the vertex cache efficiency drops by less than the given threshold.
+     *  @param indices the triangle indices, should be optimized for the vertex cache already.
+     *  @param vertices the vertices.
+     *  @param threshold the maximal allowed increase of the ACMR.
+     */
+    void MeshOptimizer::optimizeOverdraw(std::vector<GLuint>& indices, const std::vector<MeshVertex>& vertices,
+        float threshold)
+    {
+        auto numTriangles = indices.size() / 3;
+        if (numTriangles < 2 * minClusterSize) return;
+
+        // hard boundaries: the vertex cache optimizer restarted, all vertices of the triangle missed the cache.
+        std::vector<unsigned int> loadTime(vertices.size(), 0);
+        unsigned int time = fifoCacheSize + 1;
+        auto countMisses = [&](std::size_t t) {
+            unsigned int misses = 0;
+            for (std::size_t i = 0; i < 3; ++i) {
+                auto v = indices[3 * t + i];
+                if (time - loadTime[v] > fifoCacheSize) {
+                    loadTime[v] = time++;
+                    ++misses;
+                }
+            }
+            return misses;
+        };
+        std::vector<std::size_t> hardBoundaries;
+        for (std::size_t t = 0; t < numTriangles; ++t) {
+            if (countMisses(t) == 3) hardBoundaries.push_back(t);
+        }
+        hardBoundaries.push_back(numTriangles);
+
+        // soft boundaries: split a hard cluster once the part before has an ACMR within the threshold.
+        std::vector<std::size_t> clusters;
+        for (std::size_t h = 0; h + 1 < hardBoundaries.size(); ++h) {
+            auto begin = hardBoundaries[h], end = hardBoundaries[h + 1];
+            time += fifoCacheSize + 1;
+            std::size_t clusterMisses = 0;
+            for (auto t = begin; t < end; ++t) clusterMisses += countMisses(t);
+            auto maxAcmr = threshold * static_cast<float>(clusterMisses) / static_cast<float>(end - begin);
+
+            clusters.push_back(begin);
+            time += fifoCacheSize + 1;
+            std::size_t misses = 0;
+            for (auto t = begin; t < end; ++t) {
+                misses += countMisses(t);
+                auto size = t + 1 - clusters.back();
+                if (size >= minClusterSize && end - t - 1 >= minClusterSize
+                    && static_cast<float>(misses) / static_cast<float>(size) <= maxAcmr) {
+                    clusters.push_back(t + 1);
+                    time += fifoCacheSize + 1;
+                    misses = 0;
+                }
+            }
+        }
+        clusters.push_back(numTriangles);
+        if (clusters.size() < 3) return;
+
+        auto order = sortClustersByOverdraw(indices, vertices, clusters);
+        std::vector<GLuint> result;
+        result.reserve(indices.size());
+        for (auto c : order) result.insert(result.end(), indices.begin() + 3 * clusters[c], indices.begin() + 3 * clusters[c + 1]);
+        indices = std::move(result);
+    }
+
+    /**
+     *  Sorts clusters of triangles by how much they face away from the mesh center, drawing them in this order
+     *  lets the outer triangles occlude the inner ones.
+     *  @param indices the triangle indices.
+     *  @param vertices the vertices.
+     *  @param clusters the first triangle of each cluster followed by the number of triangles.
+     *  @return the clusters in drawing order.
+     */
+    std::vector<std::size_t> MeshOptimizer::sortClustersByOverdraw(const std::vector<GLuint>& indices,
+        const std::vector<MeshVertex>& vertices, const std::vector<std::size_t>& clusters)
+    {
+        auto numClusters = clusters.size() - 1;
+        std::vector<glm::vec3> clusterCentroids(numClusters, glm::vec3(0.0f)), clusterNormals(numClusters, glm::vec3(0.0f));
+        std::vector<float> clusterAreas(numClusters, 0.0f);
+        glm::vec3 meshCentroid(0.0f);
+        float meshArea = 0.0f;
+        for (std::size_t c = 0; c < numClusters; ++c) {
+            for (auto t = clusters[c]; t < clusters[c + 1]; ++t) {
+                glm::vec3 p0(vertices[indices[3 * t]].position);
+                glm::vec3 p1(vertices[indices[3 * t + 1]].position);
+                glm::vec3 p2(vertices[indices[3 * t + 2]].position);
+                auto normal = glm::cross(p1 - p0, p2 - p0);
+                auto area = glm::length(normal);
+                clusterCentroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+                clusterNormals[c] += normal;
+                clusterAreas[c] += area;
+            }
+            meshCentroid += clusterCentroids[c];
+            meshArea += clusterAreas[c];
+        }
+        if (meshArea > 0.0f) meshCentroid /= meshArea;
+
+        std::vector<float> sortKeys(numClusters, 0.0f);
+        for (std::size_t c = 0; c < numClusters; ++c) {
+            auto normalLength = glm::length(clusterNormals[c]);
+            if (clusterAreas[c] <= 0.0f || normalLength <= 0.0f) continue;
+            auto centroid = clusterCentroids[c] / clusterAreas[c];
+            sortKeys[c] = glm::dot(centroid - meshCentroid, clusterNormals[c] / normalLength);
+        }
+        std::vector<std::size_t> order(numClusters);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&sortKeys](std::size_t a, std::size_t b) { return sortKeys[a] > sortKeys[b]; });
+        return order;
+    }
+
+    /**
+     *  Reorders the vertices in the order they are first used by the index buffer and drops unused vertices.
+     *  @param subMesh the sub-mesh to reorder.
+     */
+    void MeshOptimizer::optimizeVertexFetch(SubMeshData& subMesh)
+    {
+        constexpr GLuint unused = std::numeric_limits<GLuint>::max();
+        std::vector<GLuint> remap(subMesh.vertices.size(), unused);
+        std::vector<MeshVertex> vertices;
+        vertices.reserve(subMesh.vertices.size());
+        for (auto& index : subMesh.indices) {
+            if (remap[index] == unused) {
+                remap[index] = static_cast<GLuint>(vertices.size());
+                vertices.push_back(subMesh.vertices[index]);
+            }
+            index = remap[index];
+        }
+        subMesh.vertices = std::move(vertices);
+    }
+
+    /**
+     *  Runs all optimizations on a sub-mesh and reports the vertex cache efficiency before and after.
+     *  @param subMesh the sub-mesh to optimize.
+     *  @param name the name of the sub-mesh used for logging.
+     */
+    void MeshOptimizer::optimize(SubMeshData& subMesh, const std::string& name)
+    {
+        auto before = analyzeVertexCache(subMesh.indices, subMesh.vertices.size());
+        optimizeVertexCache(subMesh.indices, subMesh.vertices.size());
+        optimizeOverdraw(subMesh.indices, subMesh.vertices);
+        optimizeVertexFetch(subMesh);
+        auto after = analyzeVertexCache(subMesh.indices, subMesh.vertices.size());
+
+        std::cout << "Optimized " << name << ": ACMR " << std::fixed << std::setprecision(3) << before.acmr << " -> "
+            << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr << std::defaultfloat << std::endl;
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "cg1.h"
+#include "gfx/Mesh.h"
+
+namespace cg1 {
+
+    /** Efficiency of an index buffer for a simulated post-transform vertex cache. */
+    struct VertexCacheStatistics
+    {
+        /** Holds the average number of vertex shader invocations per triangle. */
+        float acmr = 0.0f;
+        /** Holds the average number of vertex shader invocations per referenced vertex. */
+        float atvr = 0.0f;
+    };
+
+    /**
+     * Import-time optimizations of the triangle and vertex order of sub-meshes.
+     */
+    class MeshOptimizer final
+    {
+    public:
+        /** The size of the FIFO cache used for analysis and cluster splitting. */
+        static constexpr unsigned int fifoCacheSize = 16;
+
+        static VertexCacheStatistics analyzeVertexCache(const std::vector<GLuint>& indices, std::size_t numVertices);
+        static void optimizeVertexCache(std::vector<GLuint>& indices, std::size_t numVertices);
+        static void optimizeOverdraw(std::vector<GLuint>& indices, const std::vector<MeshVertex>& vertices,
+            float threshold = 1.05f);
+        static std::vector<std::size_t> sortClustersByOverdraw(const std::vector<GLuint>& indices,
+            const std::vector<MeshVertex>& vertices, const std::vector<std::size_t>& clusters);
+        static void optimizeVertexFetch(SubMeshData& subMesh);
+        static void optimize(SubMeshData& subMesh, const std::string& name);
+    };
+}
@@ -0,0 +1,285 @@
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <queue>
+#include <tuple>
+#include <unordered_map>
+
+namespace cg1 {
+
+    constexpr unsigned int MeshSimplifier::maxLods;
+
+    namespace {
+        /** The weight of the planes keeping open borders in place relative to the surface planes. */
+        constexpr double borderWeight = 10.0;
+        /** The minimal number of triangles of a level of detail. */
+        constexpr std::size_t minLodTriangles = 32;
+        /** The minimal reduction of the triangle count between two levels of detail. */
+        constexpr double minLodReduction = 0.8;
+
+        /** A symmetric 4x4 matrix measuring the squared distance to a set of planes. */
+        struct Quadric
+        {
+            double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+            /** Holds the summed weight of all planes. */
+            double weight = 0;
+
+            /**
+             *  Adds the plane dot(n, p) + d = 0 with the given weight.
+             *  @param n the plane normal (normalized).
+             *  @param d the plane distance.
+             *  @param w the weight of the plane.
+             */
+            void addPlane(const glm::dvec3& n, double d, double w)
+            {
+                a2 += w * n.x * n.x; ab += w * n.x * n.y; ac += w * n.x * n.z; ad += w * n.x * d;
+                b2 += w * n.y * n.y; bc += w * n.y * n.z; bd += w * n.y * d;
+                c2 += w * n.z * n.z; cd += w * n.z * d;
+                d2 += w * d * d;
+                weight += w;
+            }
+
+            /** Adds another quadric. */
+            Quadric& operator+=(const Quadric& q)
+            {
+                a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad; b2 += q.b2; bc += q.bc; bd += q.bd;
+                c2 += q.c2; cd += q.cd; d2 += q.d2; weight += q.weight;
+                return *this;
+            }
+
+            /** Returns the weighted sum of squared distances of a point to all planes. */
+            double evaluate(const glm::dvec3& p) const
+            {
+                return a2 * p.x * p.x + 2 * ab * p.x * p.y + 2 * ac * p.x * p.z + 2 * ad * p.x
+                    + b2 * p.y * p.y + 2 * bc * p.y * p.z + 2 * bd * p.y
+                    + c2 * p.z * p.z + 2 * cd * p.z + d2;
+            }
+        };
+
+        /** A candidate collapse of one position onto another. */
+        struct Collapse
+        {
+            /** Holds the mean squared distance introduced by the collapse. */
+            double cost;
+            /** Holds the position that is removed. */
+            GLuint from;
+            /** Holds the position that is kept. */
+            GLuint to;
+            /** Holds the versions of both positions when the collapse was computed. */
+            unsigned int fromVersion, toVersion;
+
+            bool operator>(const Collapse& other) const { return cost > other.cost; }
+        };
+    }
+
+    /**
+     *  Simplifies a triangle mesh by collapsing edges in order of their quadric error until the target number
+     *  of indices is reached. Vertices sharing a position (e.g. along texture seams) are collapsed together.
+     *  @param vertices the vertices of the mesh.
+     *  @param indices the triangle indices to simplify.
+     *  @param targetNumIndices the number of indices to reduce the mesh to.
+     *  @param result the indices of the simplified mesh referencing the same vertices.
+     *  @return the estimated geometric error of the simplified mesh in object space units.
+     */
+    float MeshSimplifier::simplify(const std::vector<MeshVertex>& vertices, const std::vector<GLuint>& indices,
+        std::size_t targetNumIndices, std::vector<GLuint>& result)
+    {
+        // weld vertices with equal positions.
+        std::vector<GLuint> sortedVertices(vertices.size());
+        std::iota(sortedVertices.begin(), sortedVertices.end(), 0);
+        auto positionLess = [&vertices](GLuint a, GLuint b) {
+            const auto& pa = vertices[a].position;
+            const auto& pb = vertices[b].position;
+            return std::tie(pa.x, pa.y, pa.z) < std::tie(pb.x, pb.y, pb.z);
+        };
+        std::sort(sortedVertices.begin(), sortedVertices.end(), positionLess);
+        std::vector<GLuint> positionOf(vertices.size());
+        std::vector<glm::dvec3> positions;
+        std::vector<GLuint> positionVertexOffsets;
+        for (std::size_t i = 0; i < sortedVertices.size(); ++i) {
+            if (i == 0 || positionLess(sortedVertices[i - 1], sortedVertices[i])) {
+                positions.emplace_back(glm::vec3(vertices[sortedVertices[i]].position));
+                positionVertexOffsets.push_back(static_cast<GLuint>(i));
+            }
+            positionOf[sortedVertices[i]] = static_cast<GLuint>(positions.size() - 1);
+        }
+        positionVertexOffsets.push_back(static_cast<GLuint>(sortedVertices.size()));
+        auto numPositions = positions.size();
+
+        // triangles around each position and the quadrics of the surface and its borders.
+        auto numTriangles = indices.size() / 3;
+        std::vector<GLuint> triangles(indices.begin(), indices.begin() + 3 * numTriangles);
+        std::vector<char> triangleAlive(numTriangles, 1);
+        std::vector<std::vector<GLuint>> positionTriangles(numPositions);
+        std::vector<Quadric> quadrics(numPositions);
+        std::unordered_map<std::uint64_t, std::pair<unsigned int, GLuint>> edges;
+        auto edgeKey = [](GLuint a, GLuint b) { return (static_cast<std::uint64_t>(std::min(a, b)) << 32) | std::max(a, b); };
+        for (std::size_t t = 0; t < numTriangles; ++t) {
+            GLuint p[3] = { positionOf[triangles[3 * t]], positionOf[triangles[3 * t + 1]], positionOf[triangles[3 * t + 2]] };
+            if (p[0] == p[1] || p[1] == p[2] || p[2] == p[0]) {
+                triangleAlive[t] = 0;
+                continue;
+            }
+            auto normal = glm::cross(positions[p[1]] - positions[p[0]], positions[p[2]] - positions[p[0]]);
+            auto area = glm::length(normal);
+            if (area > 0.0) normal /= area;
+            for (std::size_t i = 0; i < 3; ++i) {
+                positionTriangles[p[i]].push_back(static_cast<GLuint>(t));
+                quadrics[p[i]].addPlane(normal, -glm::dot(normal, positions[p[0]]), 0.5 * area);
+                auto& edge = edges[edgeKey(p[i], p[(i + 1) % 3])];
+                ++edge.first;
+                edge.second = static_cast<GLuint>(t);
+            }
+        }
+        for (const auto& edge : edges) {
+            if (edge.second.first != 1) continue;
+            auto a = static_cast<GLuint>(edge.first >> 32), b = static_cast<GLuint>(edge.first & 0xffffffffu);
+            auto t = edge.second.second;
+            auto p0 = positions[positionOf[triangles[3 * t]]];
+            auto faceNormal = glm::cross(positions[positionOf[triangles[3 * t + 1]]] - p0, positions[positionOf[triangles[3 * t + 2]]] - p0);
+            auto edgeVector = positions[b] - positions[a];
+            auto borderNormal = glm::cross(edgeVector, faceNormal);
+            auto length = glm::length(borderNormal);
+            if (length == 0.0) continue;
+            borderNormal /= length;
+            auto w = borderWeight * glm::dot(edgeVector, edgeVector);
+            quadrics[a].addPlane(borderNormal, -glm::dot(borderNormal, positions[a]), w);
+            quadrics[b].addPlane(borderNormal, -glm::dot(borderNormal, positions[a]), w);
+        }
+
+        std::vector<char> positionAlive(numPositions, 1);
+        std::vector<unsigned int> versions(numPositions, 0);
+        std::vector<GLuint> vertexRemap(vertices.size());
+        std::iota(vertexRemap.begin(), vertexRemap.end(), 0);
+        std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> collapses;
+        auto pushCollapse = [&](GLuint from, GLuint to) {
+            auto q = quadrics[from];
+            q += quadrics[to];
+            auto cost = std::max(0.0, q.evaluate(positions[to])) / std::max(q.weight, 1e-20);
+            collapses.push(Collapse{ cost, from, to, versions[from], versions[to] });
+        };
+        auto pushNeighbors = [&](GLuint p) {
+            for (auto t : positionTriangles[p]) {
+                if (!triangleAlive[t]) continue;
+                for (std::size_t i = 0; i < 3; ++i) {
+                    auto other = positionOf[triangles[3 * t + i]];
+                    if (other == p) continue;
+                    pushCollapse(p, other);
+                    pushCollapse(other, p);
+                }
+            }
+        };
+        for (GLuint p = 0; p < numPositions; ++p) {
+            for (auto t : positionTriangles[p]) {
+                for (std::size_t i = 0; i < 3; ++i) {
+                    auto other = positionOf[triangles[3 * t + i]];
+                    if (other > p) pushCollapse(p, other);
+                    if (other > p) pushCollapse(other, p);
+                }
+            }
+        }
+
+        auto numAliveTriangles = static_cast<std::size_t>(std::count(triangleAlive.begin(), triangleAlive.end(), 1));
+        double maxCost = 0.0;
+        while (3 * numAliveTriangles > targetNumIndices && !collapses.empty()) {
+            auto collapse = collapses.top();
+            collapses.pop();
+            auto from = collapse.from, to = collapse.to;
+            if (!positionAlive[from] || !positionAlive[to] || versions[from] != collapse.fromVersion
+                || versions[to] != collapse.toVersion) continue;
+
+            // reject collapses flipping a remaining triangle.
+            bool flips = false;
+            for (auto t : positionTriangles[from]) {
+                if (!triangleAlive[t]) continue;
+                GLuint p[3] = { positionOf[triangles[3 * t]], positionOf[triangles[3 * t + 1]], positionOf[triangles[3 * t + 2]] };
+                if (p[0] == to || p[1] == to || p[2] == to) continue;
+                auto before = glm::cross(positions[p[1]] - positions[p[0]], positions[p[2]] - positions[p[0]]);
+                for (auto& position : p) if (position == from) position = to;
+                auto after = glm::cross(positions[p[1]] - positions[p[0]], positions[p[2]] - positions[p[0]]);
+                if (glm::dot(before, after) <= 0.0) {
+                    flips = true;
+                    break;
+                }
+            }
+            if (flips) continue;
+
+            // move each vertex at the removed position to the vertex at the kept position with the closest attributes.
+            for (auto i = positionVertexOffsets[from]; i < positionVertexOffsets[from + 1]; ++i) {
+                const auto& vertex = vertices[sortedVertices[i]];
+                auto bestDistance = std::numeric_limits<float>::max();
+                for (auto j = positionVertexOffsets[to]; j < positionVertexOffsets[to + 1]; ++j) {
+                    const auto& candidate = vertices[sortedVertices[j]];
+                    auto uv = candidate.textureCoordinate - vertex.textureCoordinate;
+                    auto distance = glm::dot(uv, uv) + (1.0f - glm::dot(candidate.normal, vertex.normal));
+                    if (distance < bestDistance) {
+                        bestDistance = distance;
+                        vertexRemap[sortedVertices[i]] = sortedVertices[j];
+                    }
+                }
+            }
+            for (auto t : positionTriangles[from]) {
+                if (!triangleAlive[t]) continue;
+                bool degenerate = false;
+                for (std::size_t i = 0; i < 3; ++i) {
+                    auto& v = triangles[3 * t + i];
+                    if (positionOf[v] == to) degenerate = true;
+                    if (positionOf[v] == from) v = vertexRemap[v];
+                }
+                if (degenerate) {
+                    triangleAlive[t] = 0;
+                    --numAliveTriangles;
+                } else {
+                    positionTriangles[to].push_back(t);
+                }
+            }
+
+            positionAlive[from] = 0;
+            positionTriangles[from].clear();
+            quadrics[to] += quadrics[from];
+            ++versions[to];
+            maxCost = std::max(maxCost, collapse.cost);
+            auto& toTriangles = positionTriangles[to];
+            toTriangles.erase(std::remove_if(toTriangles.begin(), toTriangles.end(), [&triangleAlive](GLuint t) { return !triangleAlive[t]; }), toTriangles.end());
+            pushNeighbors(to);
+        }
+
+        result.clear();
+        result.reserve(3 * numAliveTriangles);
+        for (std::size_t t = 0; t < numTriangles; ++t) {
+            if (triangleAlive[t]) result.insert(result.end(), triangles.begin() + 3 * t, triangles.begin() + 3 * t + 3);
+        }
+        return static_cast<float>(std::sqrt(maxCost));
+    }
+
+    /**
+     *  Generates coarser levels of detail of a sub-mesh, each with about half the triangles of the previous one.
+     *  @param subMesh the sub-mesh, the levels of detail are added to it.
+     *  @param name the name of the sub-mesh used for logging.
+     */
+    void MeshSimplifier::generateLods(SubMeshData& subMesh, const std::string& name)
+    {
+        subMesh.lods.clear();
+        float error = 0.0f;
+        std::cout << "LODs of " << name << ": " << subMesh.indices.size() / 3;
+        for (unsigned int i = 1; i < maxLods; ++i) {
+            const auto& previous = i == 1 ? subMesh.indices : subMesh.lods.back().indices;
+            auto targetNumIndices = previous.size() / 6 * 3;
+            if (targetNumIndices < 3 * minLodTriangles) break;
+
+            MeshLodData lod;
+            // errors of consecutive simplifications add up at most.
+            error += simplify(subMesh.vertices, previous, targetNumIndices, lod.indices);
+            if (lod.indices.size() > minLodReduction * previous.size()) break;
+            MeshOptimizer::optimizeVertexCache(lod.indices, subMesh.vertices.size());
+            lod.error = error;
+            std::cout << " / " << lod.indices.size() / 3 << " (error " << lod.error << ")";
+            subMesh.lods.push_back(std::move(lod));
+        }
+        std::cout << " triangles" << std::endl;
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "cg1.h"
+#include "gfx/Mesh.h"
+
+namespace cg1 {
+
+    /**
+     * Import-time mesh simplification with quadric error metrics (Garland and Heckbert, "Surface Simplification
+     * Using Quadric Error Metrics"). Vertices are only collapsed onto existing vertices, so all levels of detail
+     * share the vertex buffer of the full mesh and only need their own index buffer.
+     */
+    class MeshSimplifier final
+    {
+    public:
+        /** The maximum number of levels of detail per sub-mesh including the full mesh. */
+        static constexpr unsigned int maxLods = 4;
+
+        static float simplify(const std::vector<MeshVertex>& vertices, const std::vector<GLuint>& indices,
+            std::size_t targetNumIndices, std::vector<GLuint>& result);
+        static void generateLods(SubMeshData& subMesh, const std::string& name);
+    };
+}
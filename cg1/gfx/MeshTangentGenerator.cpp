@@ -0,0 +1,193 @@
+#include "MeshTangentGenerator.h"
+#include "core/ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CG1_TANGENTS_SSE
+#include <emmintrin.h>
+#endif
+
+namespace cg1 {
+
+    namespace {
+        /** The minimal number of triangles or vertices processed by one task. */
+        constexpr std::size_t parallelGrainSize = 4096;
+        /** Faces whose texture coordinate determinant is below this do not contribute to the tangents. */
+        constexpr float minUvDeterminant = 1e-12f;
+
+        /** The number of triangles whose edges are gathered into one batch. */
+        constexpr std::size_t batchSize = 256;
+
+        /** The edges of a batch of triangles in structure-of-arrays layout. */
+        struct FaceEdges
+        {
+            float e1x[batchSize], e1y[batchSize], e1z[batchSize], e2x[batchSize], e2y[batchSize], e2z[batchSize];
+            float du1[batchSize], dv1[batchSize], du2[batchSize], dv2[batchSize];
+        };
+
+        /** The tangents and bitangents of a batch of triangles in structure-of-arrays layout. */
+        struct FaceFrames
+        {
+            float tx[batchSize], ty[batchSize], tz[batchSize], bx[batchSize], by[batchSize], bz[batchSize];
+        };
+
+        /** The sums of the unnormalized tangents and bitangents of the faces adjacent to a vertex. */
+        struct VertexFrame
+        {
+            glm::vec3 tangent;
+            glm::vec3 bitangent;
+        };
+
+        /**
+         *  Computes the tangent and bitangent of a single face.
+         *  @param edges the face edges.
+         *  @param frames the face frames.
+         *  @param i the index of the face inside the batch.
+         */
+        void computeFaceFrame(const FaceEdges& edges, FaceFrames& frames, std::size_t i)
+        {
+            auto determinant = edges.du1[i] * edges.dv2[i] - edges.du2[i] * edges.dv1[i];
+            auto r = std::abs(determinant) > minUvDeterminant ? 1.0f / determinant : 0.0f;
+            frames.tx[i] = (edges.e1x[i] * edges.dv2[i] - edges.e2x[i] * edges.dv1[i]) * r;
+            frames.ty[i] = (edges.e1y[i] * edges.dv2[i] - edges.e2y[i] * edges.dv1[i]) * r;
+            frames.tz[i] = (edges.e1z[i] * edges.dv2[i] - edges.e2z[i] * edges.dv1[i]) * r;
+            frames.bx[i] = (edges.e2x[i] * edges.du1[i] - edges.e1x[i] * edges.du2[i]) * r;
+            frames.by[i] = (edges.e2y[i] * edges.du1[i] - edges.e1y[i] * edges.du2[i]) * r;
+            frames.bz[i] = (edges.e2z[i] * edges.du1[i] - edges.e1z[i] * edges.du2[i]) * r;
+        }
+
+        /**
+         *  Computes the tangents and bitangents of a batch of faces, four at a time where SSE is available.
+         *  @param edges the edges of the batch.
+         *  @param count the number of faces in the batch.
+         *  @param frames the face frames.
+         */
+        void computeFaceFrames(const FaceEdges& edges, std::size_t count, FaceFrames& frames)
+        {
+            std::size_t i = 0;
+#ifdef CG1_TANGENTS_SSE
+            const auto signMask = _mm_set1_ps(-0.0f);
+            const auto minDeterminant = _mm_set1_ps(minUvDeterminant);
+            const auto one = _mm_set1_ps(1.0f);
+            for (; i + 4 <= count; i += 4) {
+                auto e1x = _mm_loadu_ps(edges.e1x + i), e1y = _mm_loadu_ps(edges.e1y + i), e1z = _mm_loadu_ps(edges.e1z + i);
+                auto e2x = _mm_loadu_ps(edges.e2x + i), e2y = _mm_loadu_ps(edges.e2y + i), e2z = _mm_loadu_ps(edges.e2z + i);
+                auto du1 = _mm_loadu_ps(edges.du1 + i), dv1 = _mm_loadu_ps(edges.dv1 + i);
+                auto du2 = _mm_loadu_ps(edges.du2 + i), dv2 = _mm_loadu_ps(edges.dv2 + i);
+
+                // degenerate texture coordinates give an infinite reciprocal, which is masked to zero.
+                auto determinant = _mm_sub_ps(_mm_mul_ps(du1, dv2), _mm_mul_ps(du2, dv1));
+                auto valid = _mm_cmpgt_ps(_mm_andnot_ps(signMask, determinant), minDeterminant);
+                auto r = _mm_and_ps(valid, _mm_div_ps(one, determinant));
+
+                _mm_storeu_ps(frames.tx + i, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e1x, dv2), _mm_mul_ps(e2x, dv1)), r));
+                _mm_storeu_ps(frames.ty + i, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e1y, dv2), _mm_mul_ps(e2y, dv1)), r));
+                _mm_storeu_ps(frames.tz + i, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e1z, dv2), _mm_mul_ps(e2z, dv1)), r));
+                _mm_storeu_ps(frames.bx + i, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e2x, du1), _mm_mul_ps(e1x, du2)), r));
+                _mm_storeu_ps(frames.by + i, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e2y, du1), _mm_mul_ps(e1y, du2)), r));
+                _mm_storeu_ps(frames.bz + i, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e2z, du1), _mm_mul_ps(e1z, du2)), r));
+            }
+#endif
+            for (; i < count; ++i) computeFaceFrame(edges, frames, i);
+        }
+
+        /**
+         *  Returns a unit vector perpendicular to the given one.
+         *  @param normal the unit vector.
+         */
+        glm::vec3 perpendicular(const glm::vec3& normal)
+        {
+            auto axis = std::abs(normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+            return glm::normalize(glm::cross(normal, axis));
+        }
+    }
+
+    /**
+     *  Calculates the vertex tangents of a sub-mesh. The faces are split into one part per thread, each part adds
+     *  the frames of its faces to its own partial sums of the vertex frames, so no two threads write the same data.
+     *  The partial sums are combined when the tangents are orthogonalized.
+     *  @param subMesh the sub-mesh, the tangents of its vertices are overwritten.
+     */
+    void MeshTangentGenerator::generate(SubMeshData& subMesh)
+    {
+        auto& vertices = subMesh.vertices;
+        const auto& indices = subMesh.indices;
+        auto numTriangles = indices.size() / 3;
+        auto numVertices = vertices.size();
+        auto& threadPool = ThreadPool::getShared();
+
+        // the calling thread works on a part as well.
+        auto numParts = std::max<std::size_t>(1, std::min<std::size_t>(threadPool.getNumThreads() + 1,
+            numTriangles / parallelGrainSize));
+        std::vector<VertexFrame> partialFrames(numParts * numVertices);
+        threadPool.parallelFor(numParts, 1, [&](std::size_t beginPart, std::size_t endPart) {
+            FaceEdges edges;
+            FaceFrames frames;
+            for (auto part = beginPart; part < endPart; ++part) {
+                auto* vertexFrames = partialFrames.data() + part * numVertices;
+                std::fill(vertexFrames, vertexFrames + numVertices, VertexFrame{ glm::vec3(0.0f), glm::vec3(0.0f) });
+                auto begin = part * numTriangles / numParts;
+                auto end = (part + 1) * numTriangles / numParts;
+                for (auto first = begin; first < end; first += batchSize) {
+                    auto count = std::min(batchSize, end - first);
+                    for (std::size_t i = 0; i < count; ++i) {
+                        const auto* triangle = &indices[3 * (first + i)];
+                        const auto& v0 = vertices[triangle[0]];
+                        const auto& v1 = vertices[triangle[1]];
+                        const auto& v2 = vertices[triangle[2]];
+                        edges.e1x[i] = v1.position.x - v0.position.x;
+                        edges.e1y[i] = v1.position.y - v0.position.y;
+                        edges.e1z[i] = v1.position.z - v0.position.z;
+                        edges.e2x[i] = v2.position.x - v0.position.x;
+                        edges.e2y[i] = v2.position.y - v0.position.y;
+                        edges.e2z[i] = v2.position.z - v0.position.z;
+                        edges.du1[i] = v1.textureCoordinate.x - v0.textureCoordinate.x;
+                        edges.dv1[i] = v1.textureCoordinate.y - v0.textureCoordinate.y;
+                        edges.du2[i] = v2.textureCoordinate.x - v0.textureCoordinate.x;
+                        edges.dv2[i] = v2.textureCoordinate.y - v0.textureCoordinate.y;
+                    }
+                    computeFaceFrames(edges, count, frames);
+                    for (std::size_t i = 0; i < count; ++i) {
+                        glm::vec3 tangent(frames.tx[i], frames.ty[i], frames.tz[i]);
+                        glm::vec3 bitangent(frames.bx[i], frames.by[i], frames.bz[i]);
+                        const auto* triangle = &indices[3 * (first + i)];
+                        for (std::size_t j = 0; j < 3; ++j) {
+                            vertexFrames[triangle[j]].tangent += tangent;
+                            vertexFrames[triangle[j]].bitangent += bitangent;
+                        }
+                    }
+                }
+            }
+        });
+
+        threadPool.parallelFor(numVertices, parallelGrainSize, [&](std::size_t begin, std::size_t end) {
+            for (auto v = begin; v < end; ++v) {
+                glm::vec3 tangent(0.0f), bitangent(0.0f);
+                for (std::size_t part = 0; part < numParts; ++part) {
+                    const auto& frame = partialFrames[part * numVertices + v];
+                    tangent += frame.tangent;
+                    bitangent += frame.bitangent;
+                }
+
+                auto& vertex = vertices[v];
+                // the projection divides by the squared normal length, so the normal does not need to be normalized.
+                auto normal = vertex.normal;
+                auto normalLength2 = glm::dot(normal, normal);
+                if (normalLength2 <= 0.0f) {
+                    normal = glm::vec3(0.0f, 0.0f, 1.0f);
+                    normalLength2 = 1.0f;
+                }
+                // tangents (almost) parallel to the normal carry no usable direction after the projection.
+                auto accumulatedLength2 = glm::dot(tangent, tangent);
+                tangent -= normal * (glm::dot(normal, tangent) / normalLength2);
+                auto tangentLength2 = glm::dot(tangent, tangent);
+                tangent = tangentLength2 > 1e-6f * accumulatedLength2 && tangentLength2 > 0.0f
+                    ? tangent / std::sqrt(tangentLength2) : perpendicular(normal / std::sqrt(normalLength2));
+                // the shaders reconstruct the bitangent as cross(tangent, normal) * handedness.
+                auto handedness = glm::dot(glm::cross(tangent, normal), bitangent) < 0.0f ? -1.0f : 1.0f;
+                vertex.tangent = glm::vec4(tangent, handedness);
+            }
+        });
+    }
+}
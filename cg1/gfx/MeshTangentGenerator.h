@@ -0,0 +1,19 @@
+#pragma once
+
+#include "cg1.h"
+#include "gfx/Mesh.h"
+
+namespace cg1 {
+
+    /**
+     * Generates per-vertex tangent frames for normal mapping. The tangents and bitangents of all faces sharing a
+     * vertex are accumulated, the tangent is orthogonalized against the vertex normal (Gram-Schmidt) and the
+     * handedness of the frame is stored in its w component (Lengyel, "Computing Tangent Space Basis Vectors for
+     * an Arbitrary Mesh").
+     */
+    class MeshTangentGenerator final
+    {
+    public:
+        static void generate(SubMeshData& subMesh);
+    };
+}
@@ -0,0 +1,228 @@
+#include "MipGenerator.h"
+#include "core/ThreadPool.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CG1_MIPS_SSE
+#include <emmintrin.h>
+#endif
+
+namespace cg1 {
+
+    namespace {
+        /** The minimal number of rows processed by one task. */
+        constexpr std::size_t parallelGrainSize = 16;
+        /** The largest number of source pixels contributing to a destination pixel along one axis. */
+        constexpr int maxTaps = 12;
+        /** The radius of the Kaiser filter in destination pixels. */
+        constexpr float kaiserRadius = 1.5f;
+        /** The shape parameter of the Kaiser window. */
+        constexpr float kaiserAlpha = 4.0f;
+
+        /** The source pixels and weights of one destination pixel along one axis. */
+        struct FilterTaps
+        {
+            int count;
+            unsigned int indices[maxTaps];
+            float weights[maxTaps];
+        };
+
+        /**
+         *  Evaluates the zeroth order modified Bessel function of the first kind.
+         *  @param x the argument.
+         */
+        float besselI0(float x)
+        {
+            float result = 1.0f, term = 1.0f;
+            for (int k = 1; k < 20; ++k) {
+                term *= (x * 0.5f / k) * (x * 0.5f / k);
+                result += term;
+            }
+            return result;
+        }
+
+        /**
+         *  Evaluates the filter kernel.
+         *  @param x the distance to the destination pixel center in destination pixels.
+         *  @param filter the filter.
+         */
+        float evaluateFilter(float x, MipFilter filter)
+        {
+            x = std::abs(x);
+            if (filter == MipFilter::Box) return x < 0.5f ? 1.0f : x == 0.5f ? 0.5f : 0.0f;
+            if (x >= kaiserRadius) return 0.0f;
+            auto sinc = x < 1e-5f ? 1.0f : std::sin(glm::pi<float>() * x) / (glm::pi<float>() * x);
+            auto t = x / kaiserRadius;
+            return sinc * besselI0(kaiserAlpha * std::sqrt(1.0f - t * t)) / besselI0(kaiserAlpha);
+        }
+
+        /**
+         *  Computes the normalized filter taps of all destination pixels along one axis, source pixels outside the
+         *  image are clamped to the border.
+         *  @param sourceSize the number of source pixels.
+         *  @param destinationSize the number of destination pixels.
+         *  @param filter the filter.
+         */
+        std::vector<FilterTaps> computeTaps(unsigned int sourceSize, unsigned int destinationSize, MipFilter filter)
+        {
+            std::vector<FilterTaps> result(destinationSize);
+            auto scale = static_cast<float>(sourceSize) / destinationSize;
+            auto support = (filter == MipFilter::Box ? 0.5f : kaiserRadius) * scale;
+            for (unsigned int i = 0; i < destinationSize; ++i) {
+                auto& taps = result[i];
+                taps.count = 0;
+                auto center = (i + 0.5f) * scale;
+                float sum = 0.0f;
+                for (auto j = static_cast<int>(std::floor(center - support)); j <= static_cast<int>(std::ceil(center + support)); ++j) {
+                    auto weight = sourceSize == destinationSize ? (j == static_cast<int>(i) ? 1.0f : 0.0f)
+                        : evaluateFilter((j + 0.5f - center) / scale, filter);
+                    if (weight == 0.0f) continue;
+                    assert(taps.count < maxTaps);
+                    taps.indices[taps.count] = static_cast<unsigned int>(glm::clamp(j, 0, static_cast<int>(sourceSize) - 1));
+                    taps.weights[taps.count++] = weight;
+                    sum += weight;
+                }
+                for (int k = 0; k < taps.count; ++k) taps.weights[k] /= sum;
+            }
+            return result;
+        }
+
+        /**
+         *  Computes the weighted sum of RGBA pixels.
+         *  @param source the first pixel.
+         *  @param stride the distance between two pixels indexed by the taps in floats.
+         *  @param taps the pixel indices and weights.
+         *  @param destination the RGBA result.
+         */
+        void applyTaps(const float* source, std::size_t stride, const FilterTaps& taps, float* destination)
+        {
+#ifdef CG1_MIPS_SSE
+            auto sum = _mm_setzero_ps();
+            for (int k = 0; k < taps.count; ++k) {
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(taps.weights[k]), _mm_loadu_ps(source + taps.indices[k] * stride)));
+            }
+            _mm_storeu_ps(destination, sum);
+#else
+            glm::vec4 sum(0.0f);
+            for (int k = 0; k < taps.count; ++k) {
+                const auto* pixel = source + taps.indices[k] * stride;
+                sum += taps.weights[k] * glm::vec4(pixel[0], pixel[1], pixel[2], pixel[3]);
+            }
+            for (int c = 0; c < 4; ++c) destination[c] = sum[c];
+#endif
+        }
+
+        /**
+         *  Converts an sRGB encoded value to linear space.
+         *  @param value the encoded value in [0, 1].
+         */
+        float decodeSrgb(float value)
+        {
+            return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+        }
+
+        /**
+         *  Converts a linear value to sRGB encoding.
+         *  @param value the linear value in [0, 1].
+         */
+        float encodeSrgb(float value)
+        {
+            return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+        }
+    }
+
+    /**
+     *  Constructor, converts the full image to the filtering space.
+     *  @param pixels the image in RGBA8.
+     *  @param width the image width.
+     *  @param height the image height.
+     *  @param usage the texture usage.
+     *  @param filter the filter used for all levels.
+     */
+    MipGenerator::MipGenerator(const unsigned char* pixels, unsigned int width, unsigned int height, TextureUsage usage,
+        MipFilter filter) :
+        usage_(usage),
+        filter_(filter),
+        width_(width),
+        height_(height),
+        pixels_(std::size_t(width) * height * 4)
+    {
+        float decoded[256];
+        for (int i = 0; i < 256; ++i) {
+            decoded[i] = usage_ == TextureUsage::NormalMap ? i / 127.5f - 1.0f : decodeSrgb(i / 255.0f);
+        }
+        for (std::size_t i = 0; i < pixels_.size(); i += 4) {
+            for (int c = 0; c < 3; ++c) pixels_[i + c] = decoded[pixels[i + c]];
+            pixels_[i + 3] = pixels[i + 3] / 255.0f;
+        }
+    }
+
+    /**
+     *  Filters the current level down to the next one.
+     *  @return whether there was a next level, false if the current level is 1x1.
+     */
+    bool MipGenerator::next()
+    {
+        if (width_ == 1 && height_ == 1) return false;
+        auto levelWidth = std::max(1u, width_ / 2), levelHeight = std::max(1u, height_ / 2);
+        auto horizontalTaps = computeTaps(width_, levelWidth, filter_);
+        auto verticalTaps = computeTaps(height_, levelHeight, filter_);
+        auto& threadPool = ThreadPool::getShared();
+
+        std::vector<float> rows(std::size_t(levelWidth) * height_ * 4);
+        threadPool.parallelFor(height_, parallelGrainSize, [&](std::size_t begin, std::size_t end) {
+            for (auto y = begin; y < end; ++y) {
+                for (std::size_t x = 0; x < levelWidth; ++x) {
+                    applyTaps(&pixels_[y * width_ * 4], 4, horizontalTaps[x], &rows[(y * levelWidth + x) * 4]);
+                }
+            }
+        });
+
+        std::vector<float> result(std::size_t(levelWidth) * levelHeight * 4);
+        threadPool.parallelFor(levelHeight, parallelGrainSize, [&](std::size_t begin, std::size_t end) {
+            for (auto y = begin; y < end; ++y) {
+                for (std::size_t x = 0; x < levelWidth; ++x) {
+                    auto pixel = &result[(y * levelWidth + x) * 4];
+                    applyTaps(&rows[x * 4], std::size_t(levelWidth) * 4, verticalTaps[y], pixel);
+                    // the negative lobes of the kernel can overshoot.
+                    if (usage_ == TextureUsage::NormalMap) {
+                        auto normal = glm::vec3(pixel[0], pixel[1], pixel[2]);
+                        auto length = glm::length(normal);
+                        normal = length > 0.0f ? normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+                        for (int c = 0; c < 3; ++c) pixel[c] = normal[c];
+                    } else {
+                        for (int c = 0; c < 3; ++c) pixel[c] = glm::clamp(pixel[c], 0.0f, 1.0f);
+                    }
+                    pixel[3] = glm::clamp(pixel[3], 0.0f, 1.0f);
+                }
+            }
+        });
+
+        pixels_ = std::move(result);
+        width_ = levelWidth;
+        height_ = levelHeight;
+        return true;
+    }
+
+    /**
+     *  Converts the current level back to RGBA8.
+     *  @return the pixels of the current level.
+     */
+    std::vector<unsigned char> MipGenerator::getPixels() const
+    {
+        std::vector<unsigned char> result(pixels_.size());
+        for (std::size_t i = 0; i < pixels_.size(); i += 4) {
+            for (int c = 0; c < 3; ++c) {
+                auto value = usage_ == TextureUsage::NormalMap ? pixels_[i + c] * 127.5f + 127.5f
+                    : encodeSrgb(pixels_[i + c]) * 255.0f;
+                result[i + c] = static_cast<unsigned char>(glm::clamp(value + 0.5f, 0.0f, 255.0f));
+            }
+            result[i + 3] = static_cast<unsigned char>(pixels_[i + 3] * 255.0f + 0.5f);
+        }
+        return result;
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "cg1.h"
+#include "gfx/TextureCompressor.h"
+
+namespace cg1 {
+
+    /** The filters the mip levels can be generated with. */
+    enum class MipFilter {
+        /** Averages 2x2 pixels. */
+        Box,
+        /** Kaiser-windowed sinc over 6x6 pixels, keeps the levels sharper than the box filter. */
+        Kaiser
+    };
+
+    /**
+     * Generates the mip chain of an RGBA8 image on the CPU. The levels are filtered in floating point with SSE
+     * where available: color textures in linear space (the pixels are treated as sRGB), normal maps as vectors that
+     * are renormalized on every level. The filter is separable, the rows of each pass run on the shared thread pool.
+     */
+    class MipGenerator final
+    {
+    public:
+        MipGenerator(const unsigned char* pixels, unsigned int width, unsigned int height, TextureUsage usage,
+            MipFilter filter = MipFilter::Kaiser);
+
+        /** Returns the width of the current level. */
+        unsigned int getWidth() const noexcept { return width_; }
+        /** Returns the height of the current level. */
+        unsigned int getHeight() const noexcept { return height_; }
+
+        bool next();
+        std::vector<unsigned char> getPixels() const;
+
+    private:
+        /** Holds the texture usage. */
+        TextureUsage usage_;
+        /** Holds the filter. */
+        MipFilter filter_;
+        /** Holds the width of the current level. */
+        unsigned int width_;
+        /** Holds the height of the current level. */
+        unsigned int height_;
+        /** Holds the pixels of the current level as linear RGBA floats. */
+        std::vector<float> pixels_;
+    };
+}
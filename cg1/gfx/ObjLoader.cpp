@@ -0,0 +1,419 @@
+#include "ObjLoader.h"
+#include "core/MappedFile.h"
+#include "core/ThreadPool.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <unordered_map>
+
+namespace cg1 {
+
+    namespace {
+        /** Marks a missing texture coordinate or normal reference. */
+        constexpr int missingIndex = std::numeric_limits<int>::min();
+        /** Marks the end of a vertex chain. */
+        constexpr GLuint invalidVertex = std::numeric_limits<GLuint>::max();
+        /** The minimal number of bytes parsed by one task. */
+        constexpr std::size_t minChunkSize = 64 * 1024;
+
+        /** A face corner referencing position, texture coordinate and normal (0-based). */
+        struct ObjCorner
+        {
+            int position;
+            int texCoord;
+            int normal;
+        };
+
+        /** Holds everything parsed from one line-aligned chunk of the file. */
+        struct ObjChunk
+        {
+            /** Holds the first character of the chunk. */
+            const char* begin = nullptr;
+            /** Holds the end of the chunk. */
+            const char* end = nullptr;
+            /** Holds the vertex positions. */
+            std::vector<glm::vec3> positions;
+            /** Holds the texture coordinates. */
+            std::vector<glm::vec2> texCoords;
+            /** Holds the vertex normals. */
+            std::vector<glm::vec3> normals;
+            /** Holds the corners of all faces. */
+            std::vector<ObjCorner> corners;
+            /** Holds the first corner of each face. */
+            std::vector<std::uint32_t> faceStarts;
+            /** Holds the material switches as first face and material name. */
+            std::vector<std::pair<std::uint32_t, std::string>> materials;
+            /** Holds corner components (corner * 3 + component) using negative, chunk-relative references. */
+            std::vector<std::uint32_t> relativeReferences;
+            /** Holds the number of the first line with a syntax error (0 if none). */
+            std::size_t errorLine = 0;
+        };
+
+        /** A run of consecutive faces of a chunk using the same material. */
+        struct FaceRun
+        {
+            std::size_t chunk;
+            std::uint32_t firstFace;
+            std::uint32_t endFace;
+        };
+
+        inline bool isSpace(char c) noexcept { return c == ' ' || c == '\t' || c == '\r'; }
+
+        inline const char* skipSpace(const char* p, const char* end) noexcept
+        {
+            while (p < end && isSpace(*p)) ++p;
+            return p;
+        }
+
+        /**
+         *  Parses a floating point number without locale lookups.
+         *  @return the position after the number or nullptr on errors.
+         */
+        const char* parseFloat(const char* p, const char* end, float& value) noexcept
+        {
+            static const double powersOf10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+            p = skipSpace(p, end);
+            bool negative = false;
+            if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+            std::uint64_t mantissa = 0;
+            int exponent = 0;
+            bool hasDigits = false;
+            for (; p < end && *p >= '0' && *p <= '9'; ++p, hasDigits = true) {
+                if (mantissa < 100000000000000000ull) mantissa = mantissa * 10 + static_cast<std::uint64_t>(*p - '0');
+                else ++exponent;
+            }
+            if (p < end && *p == '.') {
+                for (++p; p < end && *p >= '0' && *p <= '9'; ++p, hasDigits = true) {
+                    if (mantissa < 100000000000000000ull) {
+                        mantissa = mantissa * 10 + static_cast<std::uint64_t>(*p - '0');
+                        --exponent;
+                    }
+                }
+            }
+            if (!hasDigits) return nullptr;
+            if (p < end && (*p == 'e' || *p == 'E')) {
+                ++p;
+                bool negativeExponent = false;
+                if (p < end && (*p == '-' || *p == '+')) negativeExponent = *p++ == '-';
+                int explicitExponent = 0;
+                for (; p < end && *p >= '0' && *p <= '9'; ++p)
+                    explicitExponent = std::min(explicitExponent * 10 + (*p - '0'), 1000);
+                exponent += negativeExponent ? -explicitExponent : explicitExponent;
+            }
+
+            auto result = static_cast<double>(mantissa);
+            for (; exponent > 22; exponent -= 22) result *= 1e22;
+            for (; exponent < -22; exponent += 22) result /= 1e22;
+            result = exponent < 0 ? result / powersOf10[-exponent] : result * powersOf10[exponent];
+            value = static_cast<float>(negative ? -result : result);
+            return p;
+        }
+
+        /**
+         *  Parses a face index and converts it to a 0-based index.
+         *  @param count the number of elements of this type parsed in the chunk so far.
+         *  @param relative set if the index is relative to the chunk.
+         *  @return the position after the index or nullptr on errors.
+         */
+        const char* parseIndex(const char* p, const char* end, std::size_t count, int& index, bool& relative) noexcept
+        {
+            bool negative = false;
+            if (p < end && *p == '-') {
+                negative = true;
+                ++p;
+            }
+            if (p >= end || *p < '0' || *p > '9') return nullptr;
+            long long value = 0;
+            for (; p < end && *p >= '0' && *p <= '9'; ++p) value = std::min(value * 10 + (*p - '0'), 1ll << 31);
+            if (value == 0 || value >= (1ll << 31)) return nullptr;
+            relative = negative;
+            index = negative ? static_cast<int>(static_cast<long long>(count) - value) : static_cast<int>(value - 1);
+            return p;
+        }
+
+        /**
+         *  Parses a face definition.
+         *  @return whether the face could be parsed.
+         */
+        bool parseFace(const char* p, const char* end, ObjChunk& chunk)
+        {
+            auto firstCorner = static_cast<std::uint32_t>(chunk.corners.size());
+            while (true) {
+                p = skipSpace(p, end);
+                if (p >= end || *p == '#') break;
+
+                auto cornerId = static_cast<std::uint32_t>(chunk.corners.size());
+                ObjCorner corner{ missingIndex, missingIndex, missingIndex };
+                bool relative = false;
+                p = parseIndex(p, end, chunk.positions.size(), corner.position, relative);
+                if (!p) return false;
+                if (relative) chunk.relativeReferences.push_back(cornerId * 3);
+                if (p < end && *p == '/') {
+                    ++p;
+                    if (p < end && *p != '/') {
+                        p = parseIndex(p, end, chunk.texCoords.size(), corner.texCoord, relative);
+                        if (!p) return false;
+                        if (relative) chunk.relativeReferences.push_back(cornerId * 3 + 1);
+                    }
+                    if (p < end && *p == '/') {
+                        p = parseIndex(p + 1, end, chunk.normals.size(), corner.normal, relative);
+                        if (!p) return false;
+                        if (relative) chunk.relativeReferences.push_back(cornerId * 3 + 2);
+                    }
+                }
+                if (p < end && !isSpace(*p)) return false;
+                chunk.corners.push_back(corner);
+            }
+
+            if (chunk.corners.size() - firstCorner < 3) {
+                chunk.corners.resize(firstCorner);
+                while (!chunk.relativeReferences.empty() && chunk.relativeReferences.back() >= firstCorner * 3)
+                    chunk.relativeReferences.pop_back();
+            } else chunk.faceStarts.push_back(firstCorner);
+            return true;
+        }
+
+        /**
+         *  Parses a single line of the file. Unsupported statements are ignored.
+         *  @return whether the line could be parsed.
+         */
+        bool parseLine(const char* p, const char* end, ObjChunk& chunk)
+        {
+            p = skipSpace(p, end);
+            if (end - p < 2) return true;
+
+            if (p[0] == 'v') {
+                if (isSpace(p[1])) {
+                    glm::vec3 position;
+                    if (!(p = parseFloat(p + 1, end, position.x)) || !(p = parseFloat(p, end, position.y))
+                        || !(p = parseFloat(p, end, position.z))) return false;
+                    chunk.positions.push_back(position);
+                } else if (p[1] == 't' && end - p > 2 && isSpace(p[2])) {
+                    glm::vec2 texCoord;
+                    if (!(p = parseFloat(p + 2, end, texCoord.x)) || !(p = parseFloat(p, end, texCoord.y))) return false;
+                    chunk.texCoords.push_back(texCoord);
+                } else if (p[1] == 'n' && end - p > 2 && isSpace(p[2])) {
+                    glm::vec3 normal;
+                    if (!(p = parseFloat(p + 2, end, normal.x)) || !(p = parseFloat(p, end, normal.y))
+                        || !(p = parseFloat(p, end, normal.z))) return false;
+                    chunk.normals.push_back(normal);
+                }
+            } else if (p[0] == 'f' && isSpace(p[1])) {
+                return parseFace(p + 1, end, chunk);
+            } else if (end - p > 6 && std::strncmp(p, "usemtl", 6) == 0 && isSpace(p[6])) {
+                auto nameBegin = skipSpace(p + 6, end);
+                auto nameEnd = end;
+                while (nameEnd > nameBegin && isSpace(nameEnd[-1])) --nameEnd;
+                chunk.materials.emplace_back(static_cast<std::uint32_t>(chunk.faceStarts.size()),
+                    std::string(nameBegin, nameEnd));
+            }
+            return true;
+        }
+
+        /** Parses all lines of a chunk. */
+        void parseChunk(ObjChunk& chunk)
+        {
+            std::size_t line = 1;
+            for (auto p = chunk.begin; p < chunk.end; ++line) {
+                auto lineEnd = static_cast<const char*>(std::memchr(p, '\n', static_cast<std::size_t>(chunk.end - p)));
+                if (!lineEnd) lineEnd = chunk.end;
+                if (!parseLine(p, lineEnd, chunk)) {
+                    chunk.errorLine = line;
+                    return;
+                }
+                p = lineEnd + 1;
+            }
+        }
+
+        /**
+         *  Triangulates the faces of one material and deduplicates their vertices.
+         *  @return whether all references were valid.
+         */
+        bool buildSubMesh(const std::vector<ObjChunk>& chunks, const std::vector<FaceRun>& runs,
+            const std::vector<glm::vec3>& positions, const std::vector<glm::vec2>& texCoords,
+            const std::vector<glm::vec3>& normals, SubMeshData& subMesh)
+        {
+            // vertices sharing a position are chained, so lookups only compare the few vertices of that position.
+            std::vector<GLuint> firstVertex(positions.size(), invalidVertex);
+            std::vector<GLuint> nextVertex;
+            std::vector<ObjCorner> vertexCorners;
+            bool needsNormals = false;
+
+            auto getVertex = [&](const ObjCorner& corner) {
+                for (auto v = firstVertex[corner.position]; v != invalidVertex; v = nextVertex[v]) {
+                    if (vertexCorners[v].texCoord == corner.texCoord && vertexCorners[v].normal == corner.normal) return v;
+                }
+                MeshVertex vertex{};
+                vertex.position = glm::vec4(positions[corner.position], 1.0f);
+                if (corner.texCoord != missingIndex) {
+                    // same as aiProcess_FlipUVs.
+                    vertex.textureCoordinate = glm::vec2(texCoords[corner.texCoord].x, 1.0f - texCoords[corner.texCoord].y);
+                }
+                if (corner.normal != missingIndex) vertex.normal = normals[corner.normal];
+                else needsNormals = true;
+
+                auto v = static_cast<GLuint>(subMesh.vertices.size());
+                subMesh.vertices.push_back(vertex);
+                vertexCorners.push_back(corner);
+                nextVertex.push_back(firstVertex[corner.position]);
+                firstVertex[corner.position] = v;
+                return v;
+            };
+            auto isValid = [&](const ObjCorner& corner) {
+                return corner.position >= 0 && static_cast<std::size_t>(corner.position) < positions.size()
+                    && (corner.texCoord == missingIndex || (corner.texCoord >= 0
+                        && static_cast<std::size_t>(corner.texCoord) < texCoords.size()))
+                    && (corner.normal == missingIndex || (corner.normal >= 0
+                        && static_cast<std::size_t>(corner.normal) < normals.size()));
+            };
+
+            std::vector<GLuint> faceVertices;
+            for (const auto& run : runs) {
+                const auto& chunk = chunks[run.chunk];
+                for (auto f = run.firstFace; f < run.endFace; ++f) {
+                    auto cornerEnd = f + 1 < chunk.faceStarts.size() ? chunk.faceStarts[f + 1]
+                        : static_cast<std::uint32_t>(chunk.corners.size());
+                    faceVertices.clear();
+                    for (auto c = chunk.faceStarts[f]; c < cornerEnd; ++c) {
+                        if (!isValid(chunk.corners[c])) return false;
+                        faceVertices.push_back(getVertex(chunk.corners[c]));
+                    }
+                    // triangle fan, triangles without area are dropped.
+                    for (std::size_t i = 1; i + 1 < faceVertices.size(); ++i) {
+                        GLuint triangle[3] = { faceVertices[0], faceVertices[i], faceVertices[i + 1] };
+                        glm::vec3 p0(subMesh.vertices[triangle[0]].position);
+                        glm::vec3 p1(subMesh.vertices[triangle[1]].position);
+                        glm::vec3 p2(subMesh.vertices[triangle[2]].position);
+                        if (glm::cross(p1 - p0, p2 - p0) == glm::vec3(0.0f)) continue;
+                        subMesh.indices.insert(subMesh.indices.end(), triangle, triangle + 3);
+                    }
+                }
+            }
+
+            if (needsNormals) {
+                // smooth normals from area weighted face normals of all faces sharing a position.
+                std::vector<glm::vec3> smoothNormals(positions.size(), glm::vec3(0.0f));
+                for (std::size_t i = 0; i + 2 < subMesh.indices.size(); i += 3) {
+                    const auto& p0 = positions[vertexCorners[subMesh.indices[i]].position];
+                    const auto& p1 = positions[vertexCorners[subMesh.indices[i + 1]].position];
+                    const auto& p2 = positions[vertexCorners[subMesh.indices[i + 2]].position];
+                    auto faceNormal = glm::cross(p1 - p0, p2 - p0);
+                    for (std::size_t j = 0; j < 3; ++j)
+                        smoothNormals[vertexCorners[subMesh.indices[i + j]].position] += faceNormal;
+                }
+                for (std::size_t v = 0; v < subMesh.vertices.size(); ++v) {
+                    if (vertexCorners[v].normal != missingIndex) continue;
+                    auto normal = smoothNormals[vertexCorners[v].position];
+                    auto length = glm::length(normal);
+                    subMesh.vertices[v].normal = length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+                }
+            }
+            return true;
+        }
+    }
+
+    /**
+     *  Loads an OBJ file.
+     *  @param fullFilename the full name of the OBJ file.
+     *  @param subMeshes the loaded sub-meshes, one per material.
+     *  @return whether the file could be loaded.
+     */
+    bool ObjLoader::load(const std::string& fullFilename, std::vector<SubMeshData>& subMeshes)
+    {
+        MappedFile file(fullFilename);
+        if (!file.isOpen()) {
+            std::cerr << "Could not open OBJ file (" << fullFilename << ")." << std::endl;
+            return false;
+        }
+
+        // Split the file into line-aligned chunks and parse them in parallel.
+        auto& threadPool = ThreadPool::getShared();
+        auto numChunks = std::max<std::size_t>(1, std::min<std::size_t>(file.size() / minChunkSize,
+            4 * threadPool.getNumThreads()));
+        std::vector<ObjChunk> chunks(numChunks);
+        auto fileEnd = file.data() + file.size();
+        for (std::size_t i = 0; i < numChunks; ++i) {
+            chunks[i].begin = i == 0 ? file.data() : chunks[i - 1].end;
+            auto chunkEnd = file.data() + file.size() * (i + 1) / numChunks;
+            if (chunkEnd < chunks[i].begin) chunkEnd = chunks[i].begin;
+            auto lineEnd = static_cast<const char*>(std::memchr(chunkEnd, '\n', static_cast<std::size_t>(fileEnd - chunkEnd)));
+            chunks[i].end = (i + 1 == numChunks || !lineEnd) ? fileEnd : lineEnd + 1;
+        }
+        threadPool.parallelFor(numChunks, 1, [&chunks](std::size_t begin, std::size_t end) {
+            for (auto i = begin; i < end; ++i) parseChunk(chunks[i]);
+        });
+
+        std::size_t numPositions = 0, numTexCoords = 0, numNormals = 0;
+        for (const auto& chunk : chunks) {
+            if (chunk.errorLine != 0) {
+                std::size_t line = chunk.errorLine;
+                for (auto c = &chunks[0]; c != &chunk; ++c) line += static_cast<std::size_t>(std::count(c->begin, c->end, '\n'));
+                std::cerr << "Syntax error in OBJ file (" << fullFilename << ") in line " << line << "." << std::endl;
+                return false;
+            }
+            numPositions += chunk.positions.size();
+            numTexCoords += chunk.texCoords.size();
+            numNormals += chunk.normals.size();
+        }
+
+        // Merge the vertex attributes and rebase chunk-relative references.
+        std::vector<glm::vec3> positions, normals;
+        std::vector<glm::vec2> texCoords;
+        positions.reserve(numPositions);
+        texCoords.reserve(numTexCoords);
+        normals.reserve(numNormals);
+        for (auto& chunk : chunks) {
+            int base[3] = { static_cast<int>(positions.size()), static_cast<int>(texCoords.size()),
+                static_cast<int>(normals.size()) };
+            for (auto reference : chunk.relativeReferences) {
+                auto& corner = chunk.corners[reference / 3];
+                int* components[3] = { &corner.position, &corner.texCoord, &corner.normal };
+                *components[reference % 3] += base[reference % 3];
+            }
+            positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+            texCoords.insert(texCoords.end(), chunk.texCoords.begin(), chunk.texCoords.end());
+            normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+        }
+
+        // Group the faces by material, materials keep the order of their first use.
+        std::vector<std::vector<FaceRun>> materialRuns(1);
+        std::unordered_map<std::string, std::size_t> materialIds;
+        std::size_t currentMaterial = 0;
+        for (std::size_t c = 0; c < chunks.size(); ++c) {
+            auto numFaces = static_cast<std::uint32_t>(chunks[c].faceStarts.size());
+            std::uint32_t runStart = 0;
+            for (std::size_t m = 0; m <= chunks[c].materials.size(); ++m) {
+                auto runEnd = m < chunks[c].materials.size() ? chunks[c].materials[m].first : numFaces;
+                if (runEnd > runStart) materialRuns[currentMaterial].push_back(FaceRun{ c, runStart, runEnd });
+                runStart = runEnd;
+                if (m == chunks[c].materials.size()) break;
+                auto id = materialIds.emplace(chunks[c].materials[m].second, materialRuns.size());
+                if (id.second) materialRuns.emplace_back();
+                currentMaterial = id.first->second;
+            }
+        }
+
+        std::vector<SubMeshData> materialMeshes(materialRuns.size());
+        std::vector<char> valid(materialRuns.size(), 1);
+        threadPool.parallelFor(materialRuns.size(), 1, [&](std::size_t begin, std::size_t end) {
+            for (auto m = begin; m < end; ++m) {
+                if (materialRuns[m].empty()) continue;
+                valid[m] = buildSubMesh(chunks, materialRuns[m], positions, texCoords, normals, materialMeshes[m]) ? 1 : 0;
+            }
+        });
+        if (std::find(valid.begin(), valid.end(), 0) != valid.end()) {
+            std::cerr << "Invalid face reference in OBJ file (" << fullFilename << ")." << std::endl;
+            return false;
+        }
+
+        subMeshes.clear();
+        for (auto& subMesh : materialMeshes) {
+            if (!subMesh.indices.empty()) subMeshes.emplace_back(std::move(subMesh));
+        }
+        return true;
+    }
+}
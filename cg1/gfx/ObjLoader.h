@@ -0,0 +1,18 @@
+#pragma once
+
+#include "cg1.h"
+#include "gfx/Mesh.h"
+
+namespace cg1 {
+
+    /**
+     * Native loader for Wavefront OBJ files. The file is memory-mapped and split into line-aligned chunks that
+     * are parsed in parallel, then the faces are triangulated and their vertices deduplicated into one sub-mesh
+     * per material.
+     */
+    class ObjLoader final
+    {
+    public:
+        static bool load(const std::string& fullFilename, std::vector<SubMeshData>& subMeshes);
+    };
+}
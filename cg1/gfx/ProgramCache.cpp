@@ -0,0 +1,124 @@
+#include "ProgramCache.h"
+#include <cstring>
+#include <iostream>
+
+namespace cg1 {
+
+    namespace {
+        /** The identifier at the start of each program cache file. */
+        constexpr char cacheMagic[4] = { 'C', 'G', '1', 'P' };
+        /** The version of the cache format, needs to be increased on every change of the stored data. */
+        constexpr std::uint32_t cacheVersion = 1;
+
+        /** The header of a program cache file. */
+        struct CacheHeader
+        {
+            char magic[4];
+            std::uint32_t version;
+            std::uint64_t key;
+            std::uint32_t format;
+            std::uint32_t binarySize;
+        };
+
+        /**
+         *  Returns an OpenGL string, empty if the query fails.
+         *  @param name the string to query.
+         *  @return the string.
+         */
+        std::string getGLString(GLenum name)
+        {
+            auto str = glGetString(name);
+            return str ? reinterpret_cast<const char*>(str) : "";
+        }
+    }
+
+    /**
+     *  Constructor.
+     *  @param programName the name of the program, used for the cache file name.
+     *  @param sourceKey the hash of all shader sources of the program.
+     */
+    ProgramCache::ProgramCache(const std::string& programName, std::uint64_t sourceKey) :
+        cacheFilename_(),
+        key_(sourceKey),
+        format_(0),
+        binary_(nullptr),
+        binarySize_(0)
+    {
+        key_ = filecache::hash(getGLString(GL_VENDOR), key_);
+        key_ = filecache::hash(getGLString(GL_RENDERER), key_);
+        key_ = filecache::hash(getGLString(GL_VERSION), key_);
+        key_ = filecache::hash(&cacheVersion, sizeof(cacheVersion), key_);
+        cacheFilename_ = filecache::getCacheFilename(programName, key_, ".prog");
+    }
+
+    /**
+     *  Returns whether the driver can retrieve and load program binaries (OpenGL 4.1 or ARB_get_program_binary).
+     *  @return whether program binaries are supported.
+     */
+    bool ProgramCache::isSupported()
+    {
+        if (glGetProgramBinary == nullptr || glProgramBinary == nullptr) return false;
+        GLint numFormats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+        return numFormats > 0;
+    }
+
+    /**
+     *  Maps the cache file and checks whether it belongs to the sources and driver.
+     *  @return whether the cache file can be used.
+     */
+    bool ProgramCache::load()
+    {
+        binary_ = nullptr;
+        binarySize_ = 0;
+        file_ = MappedFile(cacheFilename_);
+        if (!file_.isOpen() || file_.size() < sizeof(CacheHeader)) return false;
+
+        CacheHeader header;
+        std::memcpy(&header, file_.data(), sizeof(CacheHeader));
+        if (std::memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 || header.version != cacheVersion
+            || header.key != key_ || header.binarySize == 0
+            || sizeof(CacheHeader) + header.binarySize > file_.size()) {
+            file_ = MappedFile();
+            return false;
+        }
+        format_ = header.format;
+        binary_ = file_.data() + sizeof(CacheHeader);
+        binarySize_ = static_cast<GLsizei>(header.binarySize);
+        return true;
+    }
+
+    /**
+     *  Retrieves the binary of a linked program and writes it to the cache file.
+     *  @param program the linked program.
+     *  @return whether the cache file was written.
+     */
+    bool ProgramCache::store(GLuint program) const
+    {
+        GLint binaryLength = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+        if (binaryLength <= 0) return false;
+
+        std::vector<char> binary(binaryLength);
+        GLenum format = 0;
+        glGetProgramBinary(program, binaryLength, &binaryLength, &format, binary.data());
+        if (binaryLength <= 0) return false;
+
+        CacheHeader header;
+        std::memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+        header.version = cacheVersion;
+        header.key = key_;
+        header.format = format;
+        header.binarySize = static_cast<std::uint32_t>(binaryLength);
+
+        std::vector<char> contents;
+        contents.reserve(sizeof(CacheHeader) + binaryLength);
+        filecache::append(contents, header);
+        filecache::append(contents, binary.data(), static_cast<std::size_t>(binaryLength));
+        if (!filecache::replaceFile(cacheFilename_, contents)) {
+            std::cerr << "Could not write program cache file (" << cacheFilename_ << ")." << std::endl;
+            return false;
+        }
+        return true;
+    }
+}
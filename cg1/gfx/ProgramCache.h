@@ -0,0 +1,45 @@
+#pragma once
+
+#include "cg1.h"
+#include "core/FileCache.h"
+#include "core/MappedFile.h"
+
+namespace cg1 {
+
+    /**
+     * On-disk cache of linked GPU program binaries. The key covers the shader sources and the driver, so a binary
+     * is only offered to the driver that produced it. Drivers may still reject a binary (e.g. after an update that
+     * kept the version string), the program then needs to be compiled from source.
+     */
+    class ProgramCache final
+    {
+    public:
+        ProgramCache(const std::string& programName, std::uint64_t sourceKey);
+
+        static bool isSupported();
+
+        bool load();
+        bool store(GLuint program) const;
+
+        /** Returns the binary format of a successfully loaded cache file. */
+        GLenum getFormat() const noexcept { return format_; }
+        /** Returns the program binary of a successfully loaded cache file. */
+        const char* getBinary() const noexcept { return binary_; }
+        /** Returns the size of the program binary in bytes. */
+        GLsizei getBinarySize() const noexcept { return binarySize_; }
+
+    private:
+        /** Holds the name of the cache file. */
+        std::string cacheFilename_;
+        /** Holds the key identifying the shader sources and the driver. */
+        std::uint64_t key_;
+        /** Holds the mapped cache file. */
+        MappedFile file_;
+        /** Holds the binary format. */
+        GLenum format_;
+        /** Holds the program binary inside the mapped file. */
+        const char* binary_;
+        /** Holds the size of the program binary in bytes. */
+        GLsizei binarySize_;
+    };
+}
@@ -0,0 +1,76 @@
+#include "RenderQueue.h"
+#include <array>
+#include <cstring>
+
+namespace cg1 {
+
+    static_assert(RenderQueue::passBits + RenderQueue::variantBits + RenderQueue::textureBits
+        + RenderQueue::materialBits + RenderQueue::depthBits == 64, "The sort key fields need to fill 64 bits.");
+
+    namespace {
+        /** The number of key bits sorted per radix sort pass. */
+        constexpr unsigned int radixBits = 8;
+        /** The number of buckets of a radix sort pass. */
+        constexpr std::size_t numBuckets = std::size_t(1) << radixBits;
+
+        /**
+         *  Keeps the lowest bits of a key field.
+         *  @param value the field value.
+         *  @param bits the number of bits of the field.
+         *  @return the lowest bits of the value.
+         */
+        std::uint64_t maskField(std::uint64_t value, unsigned int bits) noexcept
+        {
+            return value & ((std::uint64_t(1) << bits) - 1);
+        }
+    }
+
+    /**
+     *  Combines the state of a draw into a sort key. Fields wider than their bits are truncated, which only makes
+     *  draws with different state share a group.
+     *  @param pass the pass.
+     *  @param variant the program variant.
+     *  @param textureSet the texture set, draws of a set are drawn without changing texture bindings.
+     *  @param material the material.
+     *  @param depth the view depth, smaller values are drawn first. Any float is allowed.
+     *  @return the sort key.
+     */
+    std::uint64_t RenderQueue::makeKey(unsigned int pass, unsigned int variant, unsigned int textureSet,
+        unsigned int material, float depth) noexcept
+    {
+        // flipping the sign bit of positive floats and all bits of negative floats makes them sort like integers.
+        std::uint32_t depthKey;
+        std::memcpy(&depthKey, &depth, sizeof(depthKey));
+        depthKey = (depthKey & 0x80000000u) ? ~depthKey : (depthKey | 0x80000000u);
+
+        auto key = maskField(pass, passBits);
+        key = (key << variantBits) | maskField(variant, variantBits);
+        key = (key << textureBits) | maskField(textureSet, textureBits);
+        key = (key << materialBits) | maskField(material, materialBits);
+        key = (key << depthBits) | (depthKey >> (32 - depthBits));
+        return key;
+    }
+
+    /**
+     *  Sorts the draws by their keys with a least significant digit radix sort. Digits all keys share are skipped,
+     *  so the cost depends on how many fields actually differ. The order of draws with equal keys is kept.
+     */
+    void RenderQueue::sort()
+    {
+        sortBuffer_.resize(items_.size());
+        for (unsigned int shift = 0; shift < 64; shift += radixBits) {
+            std::array<std::size_t, numBuckets> offsets{};
+            for (const auto& item : items_) ++offsets[(item.key >> shift) & (numBuckets - 1)];
+            if (items_.empty() || offsets[(items_[0].key >> shift) & (numBuckets - 1)] == items_.size()) continue;
+
+            std::size_t offset = 0;
+            for (auto& bucket : offsets) {
+                auto count = bucket;
+                bucket = offset;
+                offset += count;
+            }
+            for (const auto& item : items_) sortBuffer_[offsets[(item.key >> shift) & (numBuckets - 1)]++] = item;
+            items_.swap(sortBuffer_);
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "cg1.h"
+
+namespace cg1 {
+
+    /**
+     * Draws of a pass ordered by 64-bit sort keys. The key holds, from the most to the least significant bits, the
+     * pass, the program variant, the texture set, the material and the quantized view depth, so sorting it groups the
+     * draws sharing state and orders each group front to back. The draws are sorted with a radix sort every frame.
+     */
+    class RenderQueue final
+    {
+    public:
+        /** A draw and its sort key. */
+        struct Item
+        {
+            /** Holds the sort key. */
+            std::uint64_t key;
+            /** Holds the index of the draw, e.g. the object. */
+            std::uint32_t index;
+        };
+
+        /** The number of bits of the pass. */
+        static constexpr unsigned int passBits = 2;
+        /** The number of bits of the program variant. */
+        static constexpr unsigned int variantBits = 6;
+        /** The number of bits of the texture set. */
+        static constexpr unsigned int textureBits = 16;
+        /** The number of bits of the material. */
+        static constexpr unsigned int materialBits = 12;
+        /** The number of bits of the view depth. */
+        static constexpr unsigned int depthBits = 28;
+
+        static std::uint64_t makeKey(unsigned int pass, unsigned int variant, unsigned int textureSet,
+            unsigned int material, float depth) noexcept;
+
+        /** Removes all draws. */
+        void clear() noexcept { items_.clear(); }
+        /**
+         *  Adds a draw.
+         *  @param key the sort key, see makeKey.
+         *  @param index the index of the draw.
+         */
+        void push(std::uint64_t key, std::uint32_t index) { items_.push_back(Item{ key, index }); }
+        void sort();
+
+        /** Returns the draws, ordered by their keys after sort. */
+        const std::vector<Item>& getItems() const noexcept { return items_; }
+
+    private:
+        /** Holds the draws. */
+        std::vector<Item> items_;
+        /** Holds the draws while they are sorted. */
+        std::vector<Item> sortBuffer_;
+    };
+}
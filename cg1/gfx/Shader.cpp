@@ -85,9 +85,11 @@ namespace cg1 {
     /**
      * Constructor.
      * @param shaderFilename the shader file name
+     * @param defines preprocessor definitions inserted after the version directive
      */
-    Shader::Shader(const std::string& shaderFilename) :
+    Shader::Shader(const std::string& shaderFilename, const std::string& defines) :
         filename_{ config::shaderBasePath + shaderFilename },
+        defines_{ defines },
         shader_{ 0 },
         type_{ GL_VERTEX_SHADER },
         strType_{ "vertex" }
@@ -108,7 +110,7 @@ namespace cg1 {
             type_ = GL_COMPUTE_SHADER;
             strType_ = "compute";
         }
-        shader_ = compileShader(filename_, type_, strType_);
+        shader_ = compileShader(filename_, defines_, type_, strType_);
     }
 
     /**
@@ -117,6 +119,7 @@ namespace cg1 {
      */
     Shader::Shader(Shader&& rhs) noexcept :
         filename_{ std::move(rhs.filename_) },
+        defines_{ std::move(rhs.defines_) },
         shader_{ std::move(rhs.shader_) },
         type_{ std::move(rhs.type_) },
         strType_{ std::move(rhs.strType_) }
@@ -134,6 +137,7 @@ namespace cg1 {
         if (this != &rhs) {
             this->~Shader();
             filename_ = std::move(rhs.filename_);
+            defines_ = std::move(rhs.defines_);
             shader_ = rhs.shader_;
             rhs.shader_ = 0;
             type_ = std::move(rhs.type_);
@@ -178,17 +182,15 @@ namespace cg1 {
      */
     GLuint Shader::recompileShader()
     {
-        return compileShader(filename_, type_, strType_);
+        return compileShader(filename_, defines_, type_, strType_);
     }
 
     /**
-     * Loads a shader from file and compiles it.
-     * @param filename the shader file name
-     * @param type the shader type
-     * @param strType the shader type as string
-     * @return the compiled shader if successful
+     * Loads the source of a shader from file.
+     * @param filename the full shader file name
+     * @return the shader source
      */
-    GLuint Shader::compileShader(const std::string& filename, GLenum type, const std::string& strType)
+    std::string Shader::loadSource(const std::string& filename)
     {
         std::ifstream file(filename.c_str(), std::ifstream::in);
         if (!file) {
@@ -201,8 +203,26 @@ namespace cg1 {
             std::getline(file, line);
             content << line << std::endl;
         }
-        file.close();
-        std::string shaderText = content.str();
+        return content.str();
+    }
+
+    /**
+     * Loads a shader from file and compiles it.
+     * @param filename the shader file name
+     * @param defines preprocessor definitions inserted after the version directive
+     * @param type the shader type
+     * @param strType the shader type as string
+     * @return the compiled shader if successful
+     */
+    GLuint Shader::compileShader(const std::string& filename, const std::string& defines, GLenum type,
+        const std::string& strType)
+    {
+        std::string shaderText = loadSource(filename);
+        if (!defines.empty()) {
+            // the version directive has to stay the first statement of the shader.
+            auto versionEnd = shaderText.compare(0, 8, "#version") == 0 ? shaderText.find('\n') + 1 : 0;
+            shaderText.insert(versionEnd, defines);
+        }
         GLuint shader = glCreateShader(type);
         if (shader == 0) {
             std::cerr << "Could not create shader!";
@@ -33,7 +33,7 @@ namespace cg1 {
     class Shader final
     {
     public:
-        Shader(const std::string& shaderFilename);
+        Shader(const std::string& shaderFilename, const std::string& defines = std::string());
         Shader(const Shader& orig) = delete;
         Shader& operator=(const Shader&) = delete;
         Shader(Shader&& orig) noexcept;
@@ -45,9 +45,13 @@ namespace cg1 {
         void resetShader(GLuint newShader);
         GLuint recompileShader();
 
+        static std::string loadSource(const std::string& filename);
+
     private:
         /** Holds the shader file name. */
         std::string filename_;
+        /** Holds the preprocessor definitions of the shader variant. */
+        std::string defines_;
         /** Holds the compiled shader. */
         GLuint shader_;
         /** Holds the shader type. */
@@ -55,7 +59,8 @@ namespace cg1 {
         /** Holds the shader type as a string. */
         std::string strType_;
 
-        static GLuint compileShader(const std::string& filename, GLenum type, const std::string& strType);
+        static GLuint compileShader(const std::string& filename, const std::string& defines, GLenum type,
+            const std::string& strType);
         void unload() noexcept;
     };
 }
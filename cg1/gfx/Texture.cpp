@@ -1,6 +1,11 @@
 ﻿#define STB_IMAGE_IMPLEMENTATION
 
 #include "Texture.h"
+#include "TextureArena.h"
+#include "TextureCache.h"
+#include "TextureStreamer.h"
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 
 #undef min
@@ -8,53 +13,173 @@
 
 namespace cg1 {
 
+    /** Constructor. */
+    TextureFileData::TextureFileData() = default;
+    /** Move constructor. */
+    TextureFileData::TextureFileData(TextureFileData&&) noexcept = default;
+    /** Move assignment operator. */
+    TextureFileData& TextureFileData::operator=(TextureFileData&&) noexcept = default;
+    /** Destructor. */
+    TextureFileData::~TextureFileData() noexcept = default;
+
     /**
      * Constructor, creates a texture from file.
      * @param texFilename the filename of the texture file.
      */
     Texture::Texture(const std::string& texFilename) :
-        textureId_{ 0 },
-        descriptor_{ 0, GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE },
-        width_{ 0 },
-        height_{ 0 }
+        Texture(loadFile(texFilename))
+    {
+    }
+
+    /**
+     * Constructor, creates a texture from a decoded image file. Compressed textures keep their mip levels and are
+     * streamed, starting with the coarse levels only. Uncompressed textures get their mip levels generated on the
+     * GPU. The data is staged in pixel buffer objects, so the copy to the GPU does not block.
+     * @param fileData the decoded image file.
+     */
+    Texture::Texture(TextureFileData&& fileData) :
+        allocation_(),
+        descriptor_{ 4, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE },
+        width_{ static_cast<unsigned int>(fileData.width) },
+        height_{ static_cast<unsigned int>(fileData.height) },
+        numLevels_{ 1 },
+        residentLevel_{ 0 },
+        memorySize_{ 0 },
+        source_(),
+        streamed_{ false }
+    {
+        if (fileData.compressedFormat != 0) {
+            descriptor_.internalFormat_ = fileData.compressedFormat;
+            numLevels_ = static_cast<unsigned int>(fileData.cache ? fileData.cache->getLevels().size() : fileData.levels.size());
+            source_ = std::move(fileData);
+            auto& streamer = TextureStreamer::getInstance();
+            streamed_ = true;
+            setResidentLevel(streamer.getInitialLevel(*this));
+            streamer.add(this);
+            return;
+        }
+
+        if (!fileData.pixels) return;
+        // the arena stores uncompressed textures as RGBA8 with a full mip chain.
+        while ((std::max(width_, height_) >> numLevels_) > 0) ++numLevels_;
+        auto& arena = TextureArena::getInstance();
+        allocation_ = arena.allocate(descriptor_.internalFormat_, width_, height_, numLevels_);
+        arena.upload(allocation_, 0, fileData.pixels.get(), std::size_t(width_) * height_ * descriptor_.bytesPP_);
+        arena.generateMipmaps(allocation_);
+        memorySize_ = arena.getMemorySize(allocation_);
+    }
+
+    /**
+     *  Loads the compressed mip levels of an image file from the texture cache or decodes and compresses the image
+     *  and stores it in the cache. Color textures are only compressed if the driver supports S3TC, otherwise the
+     *  pixels are kept as RGBA8. This does not use OpenGL, so it can run on any thread.
+     *  @param texFilename the filename of the texture file.
+     *  @param usage what the texture is used for, selects the compression format.
+     *  @return the loaded image, without pixels or levels if the file could not be loaded.
+     */
+    TextureFileData Texture::loadFile(const std::string& texFilename, TextureUsage usage)
     {
         std::string fullFilename = config::resourceBasePath + texFilename;
-        int width = 0, height = 0, channels = 0;
-        unsigned char * image = stbi_load(fullFilename.c_str(), &width, &height, &channels, 0);
-        if (!image) std::cerr << "Failed to Load Texture (" << fullFilename << ")." << std::endl;
+        TextureFileData result;
+        bool compress = usage == TextureUsage::NormalMap || GLAD_GL_EXT_texture_compression_s3tc;
+        if (compress) {
+            result.cache = std::make_unique<TextureCache>(fullFilename, static_cast<std::uint64_t>(usage));
+            if (result.cache->load()) {
+                result.compressedFormat = result.cache->getFormat();
+                result.width = static_cast<int>(result.cache->getLevels()[0].width);
+                result.height = static_cast<int>(result.cache->getLevels()[0].height);
+                result.channels = 4;
+                return result;
+            }
+        }
+
+        auto cache = std::move(result.cache);
+        auto decodeStart = std::chrono::high_resolution_clock::now();
+        result.pixels.reset(stbi_load(fullFilename.c_str(), &result.width, &result.height, &result.channels, 4));
+        auto decodeEnd = std::chrono::high_resolution_clock::now();
+        result.decodeTime = std::chrono::duration<double>(decodeEnd - decodeStart).count();
+        if (!result.pixels) {
+            std::cerr << "Failed to Load Texture (" << fullFilename << ")." << std::endl;
+            return result;
+        }
+        result.channels = 4;
+        if (compress) {
+            auto width = static_cast<unsigned int>(result.width), height = static_cast<unsigned int>(result.height);
+            result.compressedFormat = TextureCompressor::selectFormat(result.pixels.get(), width, height, usage);
+            result.levels = TextureCompressor::compress(result.pixels.get(), width, height, result.compressedFormat, usage);
+            result.compressTime = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - decodeEnd).count();
+            result.pixels.reset();
+            cache->store(result.compressedFormat, result.levels);
+        }
+        return result;
+    }
 
-        // Set the Correct Channel Format
-        switch (channels)
-        {
-        case 1:
-            descriptor_.internalFormat_ = GL_R8;
-            descriptor_.format_ = GL_RED;
-            break;
-        case 2:
-            descriptor_.internalFormat_ = GL_RG8;
-            descriptor_.format_ = GL_RG;
-            break;
-        case 3:
-            descriptor_.internalFormat_ = GL_RGB8;
-            descriptor_.format_ = GL_RGB;
-            break;
-        case 4:
-            descriptor_.internalFormat_ = GL_RGBA8;
-            descriptor_.format_ = GL_RGBA;
-            break;
+    /**
+     *  Returns the GPU memory the texture would use with the given finest resident level.
+     *  @param residentLevel the finest resident mip level.
+     *  @return the size of the resident levels in bytes.
+     */
+    std::size_t Texture::getMemorySize(unsigned int residentLevel) const
+    {
+        if (!streamed_) return memorySize_;
+        std::size_t result = 0;
+        for (auto level = residentLevel; level < numLevels_; ++level) {
+            result += source_.cache ? source_.cache->getLevels()[level].size : source_.levels[level].data.size();
         }
+        return result;
+    }
 
-        // Bind Texture and Set Filtering Levels
-        glGenTextures(1, &textureId_);
-        glBindTexture(GL_TEXTURE_2D, textureId_);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexImage2D(GL_TEXTURE_2D, 0, descriptor_.internalFormat_, width, height, 0, descriptor_.format_, descriptor_.type_, image);
+    /**
+     *  Returns how much the texture arena grows if the finest resident level of a streamed texture changes. The
+     *  layer released by the current level is not counted, it only returns memory if it empties its pool.
+     *  @param residentLevel the new finest resident mip level.
+     *  @return the additional GPU memory of the arena in bytes.
+     */
+    std::size_t Texture::getArenaGrowth(unsigned int residentLevel) const
+    {
+        if (!streamed_) return 0;
+        residentLevel = std::min(residentLevel, numLevels_ - 1);
+        unsigned int width, height;
+        if (source_.cache) {
+            const auto& cachedLevel = source_.cache->getLevels()[residentLevel];
+            width = cachedLevel.width; height = cachedLevel.height;
+        } else {
+            width = source_.levels[residentLevel].width; height = source_.levels[residentLevel].height;
+        }
+        return TextureArena::getInstance().getGrowth(descriptor_.internalFormat_, width, height,
+            numLevels_ - residentLevel);
+    }
 
-        // Release Image Pointer and Store the Texture
-        stbi_image_free(image);
+    /**
+     *  Changes the mip levels resident on the GPU of a streamed texture. The levels from the given one to the
+     *  coarsest move to a layer of the arena pool matching their size, so evicted levels release their layer.
+     *  @param residentLevel the new finest resident mip level.
+     */
+    void Texture::setResidentLevel(unsigned int residentLevel)
+    {
+        auto& arena = TextureArena::getInstance();
+        residentLevel_ = std::min(residentLevel, numLevels_ - 1);
+        TextureArena::Allocation allocation;
+        for (auto level = residentLevel_; level < numLevels_; ++level) {
+            unsigned int width, height;
+            std::size_t size;
+            const void* data;
+            if (source_.cache) {
+                const auto& cachedLevel = source_.cache->getLevels()[level];
+                width = cachedLevel.width; height = cachedLevel.height; size = cachedLevel.size; data = cachedLevel.data;
+            } else {
+                const auto& sourceLevel = source_.levels[level];
+                width = sourceLevel.width; height = sourceLevel.height;
+                size = sourceLevel.data.size(); data = sourceLevel.data.data();
+            }
+            if (level == residentLevel_) {
+                allocation = arena.allocate(descriptor_.internalFormat_, width, height, numLevels_ - residentLevel_);
+            }
+            arena.upload(allocation, level - residentLevel_, data, size);
+        }
+        arena.release(allocation_);
+        allocation_ = allocation;
+        memorySize_ = getMemorySize(residentLevel_);
     }
 
     /**
@@ -62,12 +187,19 @@ namespace cg1 {
      *  @param rhs the object to copy.
      */
     Texture::Texture(Texture&& rhs) noexcept :
-        textureId_{ std::move(rhs.textureId_) },
+        allocation_{ std::move(rhs.allocation_) },
         descriptor_{ std::move(rhs.descriptor_) },
         width_{ std::move(rhs.width_) },
-        height_{ std::move(rhs.height_) }
+        height_{ std::move(rhs.height_) },
+        numLevels_{ std::move(rhs.numLevels_) },
+        residentLevel_{ std::move(rhs.residentLevel_) },
+        memorySize_{ std::move(rhs.memorySize_) },
+        source_{ std::move(rhs.source_) },
+        streamed_{ std::move(rhs.streamed_) }
     {
-        rhs.textureId_ = 0;
+        rhs.allocation_ = TextureArena::Allocation();
+        if (streamed_) TextureStreamer::getInstance().replace(&rhs, this);
+        rhs.streamed_ = false;
     }
 
     /**
@@ -79,11 +211,18 @@ namespace cg1 {
     {
         if (this != &rhs) {
             this->~Texture();
-            textureId_ = std::move(rhs.textureId_);
+            allocation_ = std::move(rhs.allocation_);
             descriptor_ = std::move(rhs.descriptor_);
             width_ = std::move(rhs.width_);
             height_ = std::move(rhs.height_);
-            rhs.textureId_ = 0;
+            numLevels_ = std::move(rhs.numLevels_);
+            residentLevel_ = std::move(rhs.residentLevel_);
+            memorySize_ = std::move(rhs.memorySize_);
+            source_ = std::move(rhs.source_);
+            streamed_ = std::move(rhs.streamed_);
+            rhs.allocation_ = TextureArena::Allocation();
+            if (streamed_) TextureStreamer::getInstance().replace(&rhs, this);
+            rhs.streamed_ = false;
         }
         return *this;
     }
@@ -91,10 +230,10 @@ namespace cg1 {
     /** Destructor. */
     Texture::~Texture() noexcept
     {
-        if (textureId_ != 0) {
-            glBindTexture(GL_TEXTURE_2D, 0);
-            glDeleteTextures(1, &textureId_);
-            textureId_ = 0;
+        if (streamed_) {
+            TextureStreamer::getInstance().remove(this);
+            streamed_ = false;
         }
+        if (allocation_.pool >= 0) TextureArena::getInstance().release(allocation_);
     }
 }
\ No newline at end of file
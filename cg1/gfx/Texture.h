@@ -1,10 +1,14 @@
 #pragma once
 
 #include "cg1.h"
+#include "gfx/TextureArena.h"
+#include "gfx/TextureCompressor.h"
 #include <glm/glm.hpp>
 
 namespace cg1 {
 
+    class TextureCache;
+
     /** Describes the format of a texture. */
     struct TextureDescriptor
     {
@@ -21,26 +25,73 @@ namespace cg1 {
     };
 
     /**
-    * Helper class for loading an OpenGL texture from file.
+     * The decoded pixels or compressed mip levels of an image file. It can be loaded on any thread, but only be
+     * uploaded to the GPU on the thread owning the OpenGL context.
+     */
+    struct TextureFileData
+    {
+        TextureFileData();
+        TextureFileData(TextureFileData&&) noexcept;
+        TextureFileData& operator=(TextureFileData&&) noexcept;
+        ~TextureFileData() noexcept;
+
+        /** Holds the pixels as returned by stb_image if the texture is not compressed. */
+        std::unique_ptr<unsigned char, void(*)(void*)> pixels{ nullptr, stbi_image_free };
+        /** Holds the width. */
+        int width = 0;
+        /** Holds the height. */
+        int height = 0;
+        /** Holds the number of channels. */
+        int channels = 0;
+        /** Holds the compressed format, 0 if the texture is not compressed. */
+        GLenum compressedFormat = 0;
+        /** Holds the compressed mip levels if the texture was not found in the texture cache. */
+        std::vector<CompressedTextureLevel> levels;
+        /** Holds the mapped cache file if the texture was found in the texture cache. */
+        std::unique_ptr<TextureCache> cache;
+        /** Holds the time spent decoding the image file in seconds, 0 if it was found in the texture cache. */
+        double decodeTime = 0.0;
+        /** Holds the time spent compressing the pixels in seconds, 0 if it was found in the texture cache. */
+        double compressTime = 0.0;
+    };
+
+    /**
+    * Helper class for loading an OpenGL texture from file. The texture occupies a layer of an array texture in the
+    * texture arena.
     */
     class Texture final
     {
     public:
         Texture(const std::string& texFilename);
+        explicit Texture(TextureFileData&& fileData);
         Texture(const Texture&) = delete;
         Texture& operator=(const Texture&) = delete;
         Texture(Texture&&) noexcept;
         Texture& operator=(Texture&&) noexcept;
         ~Texture() noexcept;
 
+        static TextureFileData loadFile(const std::string& texFilename, TextureUsage usage = TextureUsage::Color);
+
         /** Returns the size of the texture. */
         glm::uvec2 getDimensions() const noexcept { return glm::uvec2(width_, height_); }
-        /** Returns the OpenGL texture id. */
-        GLuint getTextureId() const noexcept { return textureId_; }
+        /** Returns the layer of the texture inside the texture arena. */
+        const TextureArena::Allocation& getAllocation() const noexcept { return allocation_; }
+        /** Returns the GPU memory used by the resident mip levels in bytes. */
+        std::size_t getMemorySize() const noexcept { return memorySize_; }
+
+        /** Returns whether the mip levels are streamed, i.e. the finer levels can be loaded and evicted. */
+        bool isStreamed() const noexcept { return streamed_; }
+        /** Returns the number of mip levels of the full texture. */
+        unsigned int getNumLevels() const noexcept { return numLevels_; }
+        /** Returns the finest mip level resident on the GPU. */
+        unsigned int getResidentLevel() const noexcept { return residentLevel_; }
+        std::size_t getMemorySize(unsigned int residentLevel) const;
+        std::size_t getArenaGrowth(unsigned int residentLevel) const;
+        void setResidentLevel(unsigned int residentLevel);
 
     private:
-        /** Holds the OpenGL texture id. */
-        GLuint textureId_;
+        /** Holds the layer of the texture inside the texture arena. */
+        TextureArena::Allocation allocation_;
         /** Holds the texture descriptor. */
         TextureDescriptor descriptor_;
 
@@ -48,5 +99,15 @@ namespace cg1 {
         unsigned int width_;
         /** Holds the height. */
         unsigned int height_;
+        /** Holds the number of mip levels. */
+        unsigned int numLevels_;
+        /** Holds the finest mip level resident on the GPU. */
+        unsigned int residentLevel_;
+        /** Holds the GPU memory used by the texture in bytes. */
+        std::size_t memorySize_;
+        /** Holds the compressed mip levels of a streamed texture. */
+        TextureFileData source_;
+        /** Holds whether the texture is registered with the texture streamer. */
+        bool streamed_;
     };
 }
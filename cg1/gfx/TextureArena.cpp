@@ -0,0 +1,344 @@
+#include "TextureArena.h"
+#include "GLStateCache.h"
+#include "TextureCompressor.h"
+#include "TextureUploader.h"
+#include <algorithm>
+#include <cassert>
+#include <functional>
+
+namespace cg1 {
+
+    TextureArena* TextureArena::instance_ = nullptr;
+
+    namespace {
+        /** The initial capacity of a pools array texture in layers. */
+        constexpr GLsizei initialLayerCapacity = 4;
+    }
+
+    /** Constructor, makes this the arena used by all textures. Needs a current OpenGL context. */
+    TextureArena::TextureArena()
+    {
+        assert(instance_ == nullptr);
+        instance_ = this;
+    }
+
+    /** Destructor, deletes all array textures. All textures need to be destroyed before. */
+    TextureArena::~TextureArena() noexcept
+    {
+        for (auto& pool : pools_) destroy(pool);
+        instance_ = nullptr;
+    }
+
+    /**
+     *  Returns the arena used by all textures.
+     *  @return the current texture arena.
+     */
+    TextureArena& TextureArena::getInstance()
+    {
+        assert(instance_ != nullptr);
+        return *instance_;
+    }
+
+    /**
+     *  Allocates a layer for a texture. The content is undefined until the levels are uploaded.
+     *  @param internalFormat the internal format, GL_RGBA8 or one of the block compression formats.
+     *  @param width the width of the first level.
+     *  @param height the height of the first level.
+     *  @param numLevels the number of mip levels.
+     *  @return the allocated layer.
+     */
+    TextureArena::Allocation TextureArena::allocate(GLenum internalFormat, unsigned int width, unsigned int height,
+        unsigned int numLevels)
+    {
+        Allocation result;
+        result.pool = getPool(internalFormat, width, height, numLevels);
+        auto& pool = pools_[result.pool];
+        if (pool.freeLayers.empty()) grow(pool, std::max(initialLayerCapacity, 2 * pool.capacity));
+        // the free layers are kept in descending order, so the lowest layer is used first.
+        result.layer = pool.freeLayers.back();
+        pool.freeLayers.pop_back();
+        return result;
+    }
+
+    /**
+     *  Uploads a mip level of a layer. The data is staged through the texture uploader.
+     *  @param allocation the layer.
+     *  @param level the mip level.
+     *  @param data the compressed blocks or RGBA8 pixels of the level.
+     *  @param size the size of the data in bytes.
+     */
+    void TextureArena::upload(const Allocation& allocation, unsigned int level, const void* data, std::size_t size)
+    {
+        if (allocation.pool < 0) return;
+        const auto& pool = pools_[allocation.pool];
+        auto width = static_cast<GLsizei>(std::max(1u, pool.width >> level));
+        auto height = static_cast<GLsizei>(std::max(1u, pool.height >> level));
+        auto& uploader = TextureUploader::getInstance();
+        bindForUpdate(pool.id);
+        if (isCompressed(pool.internalFormat)) {
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, allocation.layer, width, height, 1,
+                pool.internalFormat, static_cast<GLsizei>(size), uploader.stage(data, size));
+        } else {
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, allocation.layer, width, height, 1, GL_RGBA,
+                GL_UNSIGNED_BYTE, uploader.stage(data, size));
+        }
+        uploader.finishStaging();
+    }
+
+    /**
+     *  Generates the mip levels of an uncompressed layer from its first level. This regenerates all layers of the
+     *  pool, so it is only used for the (rare) textures that could not be compressed.
+     *  @param allocation the layer.
+     */
+    void TextureArena::generateMipmaps(const Allocation& allocation)
+    {
+        if (allocation.pool < 0) return;
+        bindForUpdate(pools_[allocation.pool].id);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    }
+
+    /**
+     *  Returns the layer of a texture to the arena. The array texture of the pool is deleted if this was its last
+     *  used layer.
+     *  @param allocation the layer of the texture, will be reset.
+     */
+    void TextureArena::release(Allocation& allocation) noexcept
+    {
+        if (allocation.pool < 0) return;
+        auto& pool = pools_[allocation.pool];
+        auto& freeLayers = pool.freeLayers;
+        freeLayers.insert(std::upper_bound(freeLayers.begin(), freeLayers.end(), allocation.layer, std::greater<GLint>()),
+            allocation.layer);
+        if (static_cast<GLsizei>(freeLayers.size()) == pool.capacity) destroy(pool);
+        allocation = Allocation();
+    }
+
+    /**
+     *  Returns the size of the layer owned by an allocation.
+     *  @param allocation the allocation.
+     *  @return the size of all mip levels of the layer in bytes.
+     */
+    std::size_t TextureArena::getMemorySize(const Allocation& allocation) const noexcept
+    {
+        if (allocation.pool < 0) return 0;
+        return getLayerSize(pools_[allocation.pool]);
+    }
+
+    /**
+     *  Returns how much the array textures grow if a layer is allocated.
+     *  @param internalFormat the internal format.
+     *  @param width the width of the first level.
+     *  @param height the height of the first level.
+     *  @param numLevels the number of mip levels.
+     *  @return the additional GPU memory in bytes, 0 if the matching pool has a free layer.
+     */
+    std::size_t TextureArena::getGrowth(GLenum internalFormat, unsigned int width, unsigned int height,
+        unsigned int numLevels) const
+    {
+        auto index = findPool(internalFormat, width, height, numLevels);
+        if (index >= 0 && !pools_[index].freeLayers.empty()) return 0;
+
+        // a full pool grows like in allocate.
+        Pool pool;
+        pool.internalFormat = internalFormat;
+        pool.width = width;
+        pool.height = height;
+        pool.numLevels = numLevels;
+        if (index >= 0) pool.capacity = pools_[index].capacity;
+        auto newCapacity = std::max(initialLayerCapacity, 2 * pool.capacity);
+        return static_cast<std::size_t>(newCapacity - pool.capacity) * getLayerSize(pool);
+    }
+
+    /**
+     *  Binds the array texture of an allocation to a texture unit unless it is bound already.
+     *  @param unit the texture unit.
+     *  @param allocation the allocation.
+     */
+    void TextureArena::bind(unsigned int unit, const Allocation& allocation)
+    {
+        if (allocation.pool < 0) return;
+        GLStateCache::getInstance().bindTexture(unit, GL_TEXTURE_2D_ARRAY, pools_[allocation.pool].id);
+    }
+
+    /**
+     *  Returns the number of array textures.
+     *  @return the number of pools that have layers.
+     */
+    std::size_t TextureArena::getNumPools() const noexcept
+    {
+        return static_cast<std::size_t>(std::count_if(pools_.begin(), pools_.end(),
+            [](const Pool& pool) { return pool.id != 0; }));
+    }
+
+    /**
+     *  Returns the pool for a format, size and number of mip levels.
+     *  @param internalFormat the internal format.
+     *  @param width the width of the first level.
+     *  @param height the height of the first level.
+     *  @param numLevels the number of mip levels.
+     *  @return the index of the pool, -1 if there is none.
+     */
+    int TextureArena::findPool(GLenum internalFormat, unsigned int width, unsigned int height,
+        unsigned int numLevels) const
+    {
+        for (std::size_t i = 0; i < pools_.size(); ++i) {
+            const auto& pool = pools_[i];
+            if (pool.internalFormat == internalFormat && pool.width == width && pool.height == height
+                && pool.numLevels == numLevels) return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    /**
+     *  Returns the pool for a format, size and number of mip levels, creates the pool if needed.
+     *  @param internalFormat the internal format.
+     *  @param width the width of the first level.
+     *  @param height the height of the first level.
+     *  @param numLevels the number of mip levels.
+     *  @return the index of the pool.
+     */
+    int TextureArena::getPool(GLenum internalFormat, unsigned int width, unsigned int height, unsigned int numLevels)
+    {
+        auto index = findPool(internalFormat, width, height, numLevels);
+        if (index >= 0) return index;
+
+        Pool pool;
+        pool.internalFormat = internalFormat;
+        pool.width = width;
+        pool.height = height;
+        pool.numLevels = numLevels;
+        pools_.push_back(std::move(pool));
+        return static_cast<int>(pools_.size() - 1);
+    }
+
+    /**
+     *  Replaces the array texture of a pool by one with more layers and copies the old layers. The copy goes
+     *  through a pixel buffer object, so the data stays on the GPU.
+     *  @param pool the pool.
+     *  @param minCapacity the new capacity in layers.
+     */
+    void TextureArena::grow(Pool& pool, GLsizei minCapacity)
+    {
+        GLuint newTexture = 0;
+        glGenTextures(1, &newTexture);
+        bindForUpdate(newTexture);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, pool.numLevels - 1);
+        auto compressed = isCompressed(pool.internalFormat);
+        for (unsigned int level = 0; level < pool.numLevels; ++level) {
+            auto width = static_cast<GLsizei>(std::max(1u, pool.width >> level));
+            auto height = static_cast<GLsizei>(std::max(1u, pool.height >> level));
+            if (compressed) {
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, pool.internalFormat, width, height, minCapacity, 0,
+                    static_cast<GLsizei>(getLevelSize(pool, level) * minCapacity), nullptr);
+            } else {
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, level, pool.internalFormat, width, height, minCapacity, 0, GL_RGBA,
+                    GL_UNSIGNED_BYTE, nullptr);
+            }
+        }
+
+        if (pool.id != 0) {
+            GLuint copyBuffer = 0;
+            glGenBuffers(1, &copyBuffer);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, copyBuffer);
+            glBufferData(GL_PIXEL_PACK_BUFFER, getLevelSize(pool, 0) * pool.capacity, nullptr, GL_STREAM_COPY);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, copyBuffer);
+            for (unsigned int level = 0; level < pool.numLevels; ++level) {
+                auto width = static_cast<GLsizei>(std::max(1u, pool.width >> level));
+                auto height = static_cast<GLsizei>(std::max(1u, pool.height >> level));
+                bindForUpdate(pool.id);
+                if (compressed) glGetCompressedTexImage(GL_TEXTURE_2D_ARRAY, level, nullptr);
+                else glGetTexImage(GL_TEXTURE_2D_ARRAY, level, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                bindForUpdate(newTexture);
+                if (compressed) {
+                    glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, width, height, pool.capacity,
+                        pool.internalFormat, static_cast<GLsizei>(getLevelSize(pool, level) * pool.capacity), nullptr);
+                } else {
+                    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, width, height, pool.capacity, GL_RGBA,
+                        GL_UNSIGNED_BYTE, nullptr);
+                }
+            }
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            glDeleteBuffers(1, &copyBuffer);
+            GLStateCache::getInstance().forgetTexture(pool.id);
+            glDeleteTextures(1, &pool.id);
+        }
+        pool.id = newTexture;
+
+        for (auto layer = pool.capacity; layer < minCapacity; ++layer) pool.freeLayers.insert(pool.freeLayers.begin(), layer);
+        allocatedSize_ += static_cast<std::size_t>(minCapacity - pool.capacity) * getLayerSize(pool);
+        pool.capacity = minCapacity;
+    }
+
+    /**
+     *  Deletes the array texture of a pool, the pool starts over with no layers.
+     *  @param pool the pool, all of its layers need to be free.
+     */
+    void TextureArena::destroy(Pool& pool) noexcept
+    {
+        if (pool.id == 0) return;
+        GLStateCache::getInstance().forgetTexture(pool.id);
+        glDeleteTextures(1, &pool.id);
+        allocatedSize_ -= static_cast<std::size_t>(pool.capacity) * getLayerSize(pool);
+        pool.id = 0;
+        pool.capacity = 0;
+        pool.freeLayers.clear();
+    }
+
+    /**
+     *  Binds an array texture to the first texture unit to change it.
+     *  @param texture the array texture.
+     */
+    void TextureArena::bindForUpdate(GLuint texture)
+    {
+        auto& stateCache = GLStateCache::getInstance();
+        stateCache.activeTexture(0);
+        stateCache.bindTexture(0, GL_TEXTURE_2D_ARRAY, texture);
+    }
+
+    /**
+     *  Returns whether a format is one of the block compression formats.
+     *  @param internalFormat the internal format.
+     *  @return whether the levels are uploaded as compressed blocks.
+     */
+    bool TextureArena::isCompressed(GLenum internalFormat)
+    {
+        switch (internalFormat) {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        case GL_COMPRESSED_RG_RGTC2:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    /**
+     *  Returns the size of a single layer of a mip level.
+     *  @param pool the pool.
+     *  @param level the mip level.
+     *  @return the size in bytes.
+     */
+    std::size_t TextureArena::getLevelSize(const Pool& pool, unsigned int level)
+    {
+        std::size_t width = std::max(1u, pool.width >> level), height = std::max(1u, pool.height >> level);
+        if (!isCompressed(pool.internalFormat)) return width * height * 4;
+        return ((width + 3) / 4) * ((height + 3) / 4) * TextureCompressor::getBlockSize(pool.internalFormat);
+    }
+
+    /**
+     *  Returns the size of a single layer with all mip levels.
+     *  @param pool the pool.
+     *  @return the size in bytes.
+     */
+    std::size_t TextureArena::getLayerSize(const Pool& pool)
+    {
+        std::size_t result = 0;
+        for (unsigned int level = 0; level < pool.numLevels; ++level) result += getLevelSize(pool, level);
+        return result;
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "cg1.h"
+
+namespace cg1 {
+
+    /**
+     * Shared 2D array textures all scene textures are sub-allocated from. There is one pool per format, size and
+     * number of mip levels, each texture occupies one layer. Objects whose textures share a pool are drawn without
+     * changing texture bindings, only the layer index differs. The array texture of a pool is deleted once all of
+     * its layers are free.
+     */
+    class TextureArena final
+    {
+    public:
+        /** A layer inside one of the arenas pools. */
+        struct Allocation
+        {
+            /** Holds the index of the pool or -1 if nothing is allocated. */
+            int pool = -1;
+            /** Holds the layer inside the pools array texture. */
+            GLint layer = 0;
+        };
+
+        TextureArena();
+        TextureArena(const TextureArena&) = delete;
+        TextureArena& operator=(const TextureArena&) = delete;
+        TextureArena(TextureArena&&) = delete;
+        TextureArena& operator=(TextureArena&&) = delete;
+        ~TextureArena() noexcept;
+
+        static TextureArena& getInstance();
+
+        Allocation allocate(GLenum internalFormat, unsigned int width, unsigned int height, unsigned int numLevels);
+        void upload(const Allocation& allocation, unsigned int level, const void* data, std::size_t size);
+        void generateMipmaps(const Allocation& allocation);
+        void release(Allocation& allocation) noexcept;
+        std::size_t getMemorySize(const Allocation& allocation) const noexcept;
+        std::size_t getGrowth(GLenum internalFormat, unsigned int width, unsigned int height,
+            unsigned int numLevels) const;
+
+        void bind(unsigned int unit, const Allocation& allocation);
+
+        std::size_t getNumPools() const noexcept;
+        /** Returns the GPU memory of all array textures in bytes, free layers included. */
+        std::size_t getAllocatedSize() const noexcept { return allocatedSize_; }
+
+    private:
+        /** The array texture of one format, size and number of mip levels. */
+        struct Pool
+        {
+            /** Holds the internal format. */
+            GLenum internalFormat;
+            /** Holds the width of the first level. */
+            unsigned int width;
+            /** Holds the height of the first level. */
+            unsigned int height;
+            /** Holds the number of mip levels. */
+            unsigned int numLevels;
+            /** Holds the OpenGL texture, 0 while the pool has no layers. */
+            GLuint id = 0;
+            /** Holds the capacity in layers. */
+            GLsizei capacity = 0;
+            /** Holds the unused layers. */
+            std::vector<GLint> freeLayers;
+        };
+
+        int findPool(GLenum internalFormat, unsigned int width, unsigned int height, unsigned int numLevels) const;
+        int getPool(GLenum internalFormat, unsigned int width, unsigned int height, unsigned int numLevels);
+        void grow(Pool& pool, GLsizei minCapacity);
+        void destroy(Pool& pool) noexcept;
+        void bindForUpdate(GLuint texture);
+        static bool isCompressed(GLenum internalFormat);
+        static std::size_t getLevelSize(const Pool& pool, unsigned int level);
+        static std::size_t getLayerSize(const Pool& pool);
+
+        /** Holds all pools, pools without layers are kept so the indices of the others stay valid. */
+        std::vector<Pool> pools_;
+        /** Holds the GPU memory of all array textures in bytes. */
+        std::size_t allocatedSize_ = 0;
+
+        /** Holds the arena used by all textures. */
+        static TextureArena* instance_;
+    };
+}
@@ -0,0 +1,138 @@
+#include "TextureCache.h"
+#include <cstring>
+#include <iostream>
+
+namespace cg1 {
+
+    namespace {
+        /** The identifier at the start of each texture cache file. */
+        constexpr char cacheMagic[4] = { 'C', 'G', '1', 'T' };
+        /** The version of the cache format, needs to be increased on every change of the stored data. */
+        constexpr std::uint32_t cacheVersion = 2;
+        /** The alignment of the data blocks inside the cache file. */
+        constexpr std::size_t cacheAlignment = 16;
+
+        /** The header of a texture cache file. */
+        struct CacheHeader
+        {
+            char magic[4];
+            std::uint32_t version;
+            std::uint32_t format;
+            std::uint32_t numLevels;
+            std::uint64_t importKey;
+            std::uint64_t sourceSize;
+            std::int64_t sourceModificationTime;
+        };
+
+        /** Describes where the blocks of a single mip level are stored in the cache file. */
+        struct LevelRecord
+        {
+            std::uint64_t offset;
+            std::uint32_t width;
+            std::uint32_t height;
+            std::uint32_t size;
+            std::uint32_t padding;
+        };
+    }
+
+    /**
+     *  Constructor.
+     *  @param sourceFilename the full name of the image file.
+     *  @param importKey identifies the texture usage and compressor, part of the cache key.
+     */
+    TextureCache::TextureCache(const std::string& sourceFilename, std::uint64_t importKey) :
+        cacheFilename_(),
+        importKey_(importKey),
+        sourceStamp_(),
+        hasSource_(filecache::getFileStamp(sourceFilename, sourceStamp_)),
+        format_(0)
+    {
+        auto key = filecache::hash(sourceFilename);
+        key = filecache::hash(&importKey, sizeof(importKey), key);
+        key = filecache::hash(&cacheVersion, sizeof(cacheVersion), key);
+        cacheFilename_ = filecache::getCacheFilename(sourceFilename, key, ".tex");
+    }
+
+    /**
+     *  Maps the cache file and checks whether it is still valid for the source file.
+     *  @return whether the cache file can be used.
+     */
+    bool TextureCache::load()
+    {
+        levels_.clear();
+        if (!hasSource_) return false;
+        file_ = MappedFile(cacheFilename_);
+        if (!file_.isOpen() || file_.size() < sizeof(CacheHeader)) return false;
+
+        CacheHeader header;
+        std::memcpy(&header, file_.data(), sizeof(CacheHeader));
+        if (std::memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 || header.version != cacheVersion
+            || header.importKey != importKey_ || header.numLevels == 0
+            || header.sourceSize != sourceStamp_.size
+            || header.sourceModificationTime != sourceStamp_.modificationTime
+            || sizeof(CacheHeader) + header.numLevels * sizeof(LevelRecord) > file_.size()) {
+            file_ = MappedFile();
+            return false;
+        }
+
+        auto blockSize = TextureCompressor::getBlockSize(header.format);
+        auto records = reinterpret_cast<const LevelRecord*>(file_.data() + sizeof(CacheHeader));
+        for (std::uint32_t i = 0; i < header.numLevels; ++i) {
+            const auto& record = records[i];
+            auto expectedSize = std::uint64_t((record.width + 3) / 4) * ((record.height + 3) / 4) * blockSize;
+            if (record.size != expectedSize || record.offset + record.size > file_.size()) {
+                levels_.clear();
+                file_ = MappedFile();
+                return false;
+            }
+            levels_.push_back(CachedTextureLevel{ record.width, record.height,
+                reinterpret_cast<const unsigned char*>(file_.data() + record.offset), record.size });
+        }
+        format_ = header.format;
+        return true;
+    }
+
+    /**
+     *  Writes the compressed mip levels to the cache file.
+     *  @param format the compressed format.
+     *  @param levels the mip levels to store.
+     *  @return whether the cache file was written.
+     */
+    bool TextureCache::store(GLenum format, const std::vector<CompressedTextureLevel>& levels) const
+    {
+        if (!hasSource_) return false;
+
+        CacheHeader header;
+        std::memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+        header.version = cacheVersion;
+        header.format = format;
+        header.numLevels = static_cast<std::uint32_t>(levels.size());
+        header.importKey = importKey_;
+        header.sourceSize = sourceStamp_.size;
+        header.sourceModificationTime = sourceStamp_.modificationTime;
+
+        std::vector<LevelRecord> records(levels.size());
+        std::size_t offset = sizeof(CacheHeader) + records.size() * sizeof(LevelRecord);
+        for (std::size_t i = 0; i < levels.size(); ++i) {
+            offset = (offset + cacheAlignment - 1) / cacheAlignment * cacheAlignment;
+            records[i] = LevelRecord{ offset, levels[i].width, levels[i].height,
+                static_cast<std::uint32_t>(levels[i].data.size()), 0 };
+            offset += levels[i].data.size();
+        }
+
+        std::vector<char> contents;
+        contents.reserve(offset);
+        filecache::append(contents, header);
+        filecache::append(contents, records.data(), records.size());
+        for (const auto& level : levels) {
+            filecache::align(contents, cacheAlignment);
+            filecache::append(contents, level.data.data(), level.data.size());
+        }
+
+        if (!filecache::replaceFile(cacheFilename_, contents)) {
+            std::cerr << "Could not write texture cache file (" << cacheFilename_ << ")." << std::endl;
+            return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "cg1.h"
+#include "core/FileCache.h"
+#include "core/MappedFile.h"
+#include "gfx/TextureCompressor.h"
+
+namespace cg1 {
+
+    /** A compressed mip level that lives inside a mapped cache file. */
+    struct CachedTextureLevel
+    {
+        /** Holds the width in pixels. */
+        std::uint32_t width;
+        /** Holds the height in pixels. */
+        std::uint32_t height;
+        /** Holds the compressed blocks. */
+        const unsigned char* data;
+        /** Holds the size of the compressed blocks in bytes. */
+        std::uint32_t size;
+    };
+
+    /**
+     * On-disk cache of block-compressed textures. The cache file holds the compressed blocks of all mip levels in
+     * the layout they are uploaded to the GPU, so a cache hit needs neither image decoding nor compression.
+     */
+    class TextureCache final
+    {
+    public:
+        TextureCache(const std::string& sourceFilename, std::uint64_t importKey);
+
+        bool load();
+        bool store(GLenum format, const std::vector<CompressedTextureLevel>& levels) const;
+
+        /** Returns the compressed format of a successfully loaded cache file. */
+        GLenum getFormat() const noexcept { return format_; }
+        /** Returns the mip levels of a successfully loaded cache file, from the full image down to 1x1. */
+        const std::vector<CachedTextureLevel>& getLevels() const noexcept { return levels_; }
+
+    private:
+        /** Holds the name of the cache file. */
+        std::string cacheFilename_;
+        /** Holds the key identifying the texture usage and compressor. */
+        std::uint64_t importKey_;
+        /** Holds the stamp of the source file. */
+        filecache::FileStamp sourceStamp_;
+        /** Holds whether the source file exists. */
+        bool hasSource_;
+        /** Holds the mapped cache file. */
+        MappedFile file_;
+        /** Holds the compressed format. */
+        GLenum format_;
+        /** Holds the mip levels inside the mapped file. */
+        std::vector<CachedTextureLevel> levels_;
+    };
+}
@@ -0,0 +1,364 @@
+#include "TextureCompressor.h"
+#include "MipGenerator.h"
+#include "core/ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CG1_TEXTURES_SSE
+#include <emmintrin.h>
+#endif
+
+namespace cg1 {
+
+    namespace {
+        /** The minimal number of blocks processed by one task. */
+        constexpr std::size_t parallelGrainSize = 64;
+        /** The number of power iterations used to find the principal axis of a blocks colors. */
+        constexpr int numPowerIterations = 8;
+
+        /** The pixels of a 4x4 block in structure-of-arrays layout, row by row. */
+        struct Block
+        {
+            alignas(16) std::uint8_t r[16];
+            alignas(16) std::uint8_t g[16];
+            alignas(16) std::uint8_t b[16];
+            alignas(16) std::uint8_t a[16];
+        };
+
+        /**
+         *  Reads a block from an RGBA8 image, pixels outside the image are clamped to the border.
+         *  @param pixels the image.
+         *  @param width the image width.
+         *  @param height the image height.
+         *  @param blockX the horizontal block index.
+         *  @param blockY the vertical block index.
+         *  @param block the block pixels.
+         */
+        void fetchBlock(const unsigned char* pixels, unsigned int width, unsigned int height, unsigned int blockX,
+            unsigned int blockY, Block& block)
+        {
+            for (unsigned int y = 0; y < 4; ++y) {
+                auto row = pixels + std::size_t(std::min(blockY * 4 + y, height - 1)) * width * 4;
+                for (unsigned int x = 0; x < 4; ++x) {
+                    auto pixel = row + std::size_t(std::min(blockX * 4 + x, width - 1)) * 4;
+                    block.r[y * 4 + x] = pixel[0];
+                    block.g[y * 4 + x] = pixel[1];
+                    block.b[y * 4 + x] = pixel[2];
+                    block.a[y * 4 + x] = pixel[3];
+                }
+            }
+        }
+
+        /**
+         *  Quantizes a color to 5:6:5 bits.
+         *  @param color the color.
+         *  @return the quantized color.
+         */
+        std::uint16_t packColor565(const glm::ivec3& color)
+        {
+            return static_cast<std::uint16_t>(((color.r * 31 + 127) / 255) << 11 | ((color.g * 63 + 127) / 255) << 5
+                | ((color.b * 31 + 127) / 255));
+        }
+
+        /**
+         *  Expands a 5:6:5 color to 8 bits per channel the way the hardware does.
+         *  @param color the quantized color.
+         *  @return the expanded color.
+         */
+        glm::ivec3 unpackColor565(std::uint16_t color)
+        {
+            auto r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+            return glm::ivec3((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2));
+        }
+
+        /**
+         *  Selects the palette entry closest to each pixel of a block by the sum of absolute channel differences.
+         *  @param block the block pixels.
+         *  @param palette the four palette colors.
+         *  @return the 2-bit indices of all pixels, the first pixel in the lowest bits.
+         */
+        std::uint32_t selectColorIndices(const Block& block, const glm::ivec3* palette)
+        {
+            alignas(16) std::uint16_t indices[16];
+#ifdef CG1_TEXTURES_SSE
+            const auto zero = _mm_setzero_si128();
+            auto r = _mm_load_si128(reinterpret_cast<const __m128i*>(block.r));
+            auto g = _mm_load_si128(reinterpret_cast<const __m128i*>(block.g));
+            auto b = _mm_load_si128(reinterpret_cast<const __m128i*>(block.b));
+            __m128i bestDistance[2], bestIndex[2];
+            for (int k = 0; k < 4; ++k) {
+                auto pr = _mm_set1_epi8(static_cast<char>(palette[k].r));
+                auto pg = _mm_set1_epi8(static_cast<char>(palette[k].g));
+                auto pb = _mm_set1_epi8(static_cast<char>(palette[k].b));
+                auto dr = _mm_or_si128(_mm_subs_epu8(r, pr), _mm_subs_epu8(pr, r));
+                auto dg = _mm_or_si128(_mm_subs_epu8(g, pg), _mm_subs_epu8(pg, g));
+                auto db = _mm_or_si128(_mm_subs_epu8(b, pb), _mm_subs_epu8(pb, b));
+                // the sum of three differences needs 10 bits, so the 16 pixels are widened to two registers.
+                __m128i distance[2] = {
+                    _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(dr, zero), _mm_unpacklo_epi8(dg, zero)), _mm_unpacklo_epi8(db, zero)),
+                    _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(dr, zero), _mm_unpackhi_epi8(dg, zero)), _mm_unpackhi_epi8(db, zero)) };
+                auto index = _mm_set1_epi16(static_cast<short>(k));
+                for (int h = 0; h < 2; ++h) {
+                    if (k == 0) {
+                        bestDistance[h] = distance[h];
+                        bestIndex[h] = index;
+                        continue;
+                    }
+                    auto closer = _mm_cmplt_epi16(distance[h], bestDistance[h]);
+                    bestDistance[h] = _mm_min_epi16(distance[h], bestDistance[h]);
+                    bestIndex[h] = _mm_or_si128(_mm_and_si128(closer, index), _mm_andnot_si128(closer, bestIndex[h]));
+                }
+            }
+            _mm_store_si128(reinterpret_cast<__m128i*>(indices), bestIndex[0]);
+            _mm_store_si128(reinterpret_cast<__m128i*>(indices + 8), bestIndex[1]);
+#else
+            for (int i = 0; i < 16; ++i) {
+                int bestDistance = 0;
+                for (int k = 0; k < 4; ++k) {
+                    auto distance = std::abs(block.r[i] - palette[k].r) + std::abs(block.g[i] - palette[k].g)
+                        + std::abs(block.b[i] - palette[k].b);
+                    if (k == 0 || distance < bestDistance) {
+                        bestDistance = distance;
+                        indices[i] = static_cast<std::uint16_t>(k);
+                    }
+                }
+            }
+#endif
+            std::uint32_t result = 0;
+            for (int i = 0; i < 16; ++i) result |= std::uint32_t(indices[i]) << (2 * i);
+            return result;
+        }
+
+        /**
+         *  Orders the endpoints for the four color mode and selects the palette entries of all pixels.
+         *  @param block the block pixels.
+         *  @param color0 the first endpoint, swapped with the second if it is smaller.
+         *  @param color1 the second endpoint.
+         *  @param indices the 2-bit indices of all pixels.
+         *  @return the squared error of the encoded block.
+         */
+        int encodeColorIndices(const Block& block, std::uint16_t& color0, std::uint16_t& color1, std::uint32_t& indices)
+        {
+            if (color0 < color1) std::swap(color0, color1);
+            glm::ivec3 palette[4] = { unpackColor565(color0), unpackColor565(color1) };
+            palette[2] = (2 * palette[0] + palette[1]) / 3;
+            palette[3] = (palette[0] + 2 * palette[1]) / 3;
+            // equal endpoints select the three color mode, where only the first entry matches the palette above.
+            indices = color0 == color1 ? 0 : selectColorIndices(block, palette);
+
+            int error = 0;
+            for (int i = 0; i < 16; ++i) {
+                auto d = glm::ivec3(block.r[i], block.g[i], block.b[i]) - palette[(indices >> (2 * i)) & 3];
+                error += d.r * d.r + d.g * d.g + d.b * d.b;
+            }
+            return error;
+        }
+
+        /**
+         *  Encodes the colors of a block to BC1. The endpoints are the extreme pixels along the principal axis of
+         *  the block colors, always in the four color mode.
+         *  @param block the block pixels.
+         *  @param output the 8 byte compressed block.
+         */
+        void encodeColorBlock(const Block& block, unsigned char* output)
+        {
+            glm::vec3 mean(0.0f);
+            for (int i = 0; i < 16; ++i) mean += glm::vec3(block.r[i], block.g[i], block.b[i]);
+            mean /= 16.0f;
+            float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+            for (int i = 0; i < 16; ++i) {
+                auto d = glm::vec3(block.r[i], block.g[i], block.b[i]) - mean;
+                covariance[0] += d.r * d.r; covariance[1] += d.r * d.g; covariance[2] += d.r * d.b;
+                covariance[3] += d.g * d.g; covariance[4] += d.g * d.b; covariance[5] += d.b * d.b;
+            }
+            glm::vec3 axis(1.0f, 1.0f, 1.0f);
+            for (int iteration = 0; iteration < numPowerIterations; ++iteration) {
+                axis = glm::vec3(covariance[0] * axis.r + covariance[1] * axis.g + covariance[2] * axis.b,
+                    covariance[1] * axis.r + covariance[3] * axis.g + covariance[4] * axis.b,
+                    covariance[2] * axis.r + covariance[4] * axis.g + covariance[5] * axis.b);
+                auto length = std::max(std::abs(axis.r), std::max(std::abs(axis.g), std::abs(axis.b)));
+                if (length == 0.0f) {
+                    axis = glm::vec3(1.0f, 1.0f, 1.0f);
+                    break;
+                }
+                axis /= length;
+            }
+
+            int minPixel = 0, maxPixel = 0;
+            float minProjection = 0.0f, maxProjection = 0.0f;
+            for (int i = 0; i < 16; ++i) {
+                auto projection = glm::dot(glm::vec3(block.r[i], block.g[i], block.b[i]), axis);
+                if (i == 0 || projection < minProjection) { minProjection = projection; minPixel = i; }
+                if (i == 0 || projection > maxProjection) { maxProjection = projection; maxPixel = i; }
+            }
+            auto color0 = packColor565(glm::ivec3(block.r[maxPixel], block.g[maxPixel], block.b[maxPixel]));
+            auto color1 = packColor565(glm::ivec3(block.r[minPixel], block.g[minPixel], block.b[minPixel]));
+            std::uint32_t indices = 0;
+            auto error = encodeColorIndices(block, color0, color1, indices);
+
+            // one least squares fit of the endpoints to the selected palette entries.
+            static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+            float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+            glm::vec3 ap(0.0f), bp(0.0f);
+            for (int i = 0; i < 16 && color0 != color1; ++i) {
+                auto a = weights[(indices >> (2 * i)) & 3], b = 1.0f - a;
+                auto pixel = glm::vec3(block.r[i], block.g[i], block.b[i]);
+                aa += a * a; ab += a * b; bb += b * b;
+                ap += a * pixel; bp += b * pixel;
+            }
+            auto determinant = aa * bb - ab * ab;
+            if (color0 != color1 && std::abs(determinant) > 1e-6f) {
+                auto end0 = glm::clamp((ap * bb - bp * ab) / determinant, 0.0f, 255.0f);
+                auto end1 = glm::clamp((bp * aa - ap * ab) / determinant, 0.0f, 255.0f);
+                auto fittedColor0 = packColor565(glm::ivec3(end0 + 0.5f)), fittedColor1 = packColor565(glm::ivec3(end1 + 0.5f));
+                std::uint32_t fittedIndices = 0;
+                if (encodeColorIndices(block, fittedColor0, fittedColor1, fittedIndices) < error) {
+                    color0 = fittedColor0;
+                    color1 = fittedColor1;
+                    indices = fittedIndices;
+                }
+            }
+
+            output[0] = static_cast<unsigned char>(color0 & 0xff);
+            output[1] = static_cast<unsigned char>(color0 >> 8);
+            output[2] = static_cast<unsigned char>(color1 & 0xff);
+            output[3] = static_cast<unsigned char>(color1 >> 8);
+            for (int i = 0; i < 4; ++i) output[4 + i] = static_cast<unsigned char>(indices >> (8 * i));
+        }
+
+        /**
+         *  Encodes a single channel of a block to BC4 in the eight value mode.
+         *  @param values the 16 channel values.
+         *  @param output the 8 byte compressed block.
+         */
+        void encodeChannelBlock(const std::uint8_t* values, unsigned char* output)
+        {
+            int minValue, maxValue;
+#ifdef CG1_TEXTURES_SSE
+            auto v = _mm_load_si128(reinterpret_cast<const __m128i*>(values));
+            // fold the upper half onto the lower half until the extremes are in the first byte.
+            auto vMin = _mm_min_epu8(v, _mm_srli_si128(v, 8)), vMax = _mm_max_epu8(v, _mm_srli_si128(v, 8));
+            vMin = _mm_min_epu8(vMin, _mm_srli_si128(vMin, 4));
+            vMax = _mm_max_epu8(vMax, _mm_srli_si128(vMax, 4));
+            vMin = _mm_min_epu8(vMin, _mm_srli_si128(vMin, 2));
+            vMax = _mm_max_epu8(vMax, _mm_srli_si128(vMax, 2));
+            vMin = _mm_min_epu8(vMin, _mm_srli_si128(vMin, 1));
+            vMax = _mm_max_epu8(vMax, _mm_srli_si128(vMax, 1));
+            minValue = _mm_cvtsi128_si32(vMin) & 0xff;
+            maxValue = _mm_cvtsi128_si32(vMax) & 0xff;
+#else
+            minValue = *std::min_element(values, values + 16);
+            maxValue = *std::max_element(values, values + 16);
+#endif
+            output[0] = static_cast<unsigned char>(maxValue);
+            output[1] = static_cast<unsigned char>(minValue);
+
+            std::uint64_t indices = 0;
+            if (maxValue > minValue) {
+                auto range = maxValue - minValue;
+                for (int i = 0; i < 16; ++i) {
+                    // position 0 is the maximum, position 7 the minimum, the interpolated values follow the endpoints.
+                    auto position = ((maxValue - values[i]) * 7 + range / 2) / range;
+                    std::uint64_t index = position == 0 ? 0 : position == 7 ? 1 : position + 1;
+                    indices |= index << (3 * i);
+                }
+            }
+            for (int i = 0; i < 6; ++i) output[2 + i] = static_cast<unsigned char>(indices >> (8 * i));
+        }
+
+        /**
+         *  Encodes a block in the given format.
+         *  @param block the block pixels.
+         *  @param format the compressed format.
+         *  @param output the compressed block.
+         */
+        void encodeBlock(const Block& block, GLenum format, unsigned char* output)
+        {
+            switch (format) {
+            case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+                encodeChannelBlock(block.a, output);
+                encodeColorBlock(block, output + 8);
+                break;
+            case GL_COMPRESSED_RG_RGTC2:
+                encodeChannelBlock(block.r, output);
+                encodeChannelBlock(block.g, output + 8);
+                break;
+            default:
+                encodeColorBlock(block, output);
+                break;
+            }
+        }
+    }
+
+    /**
+     *  Selects the compressed format for an image.
+     *  @param pixels the image in RGBA8.
+     *  @param width the image width.
+     *  @param height the image height.
+     *  @param usage the texture usage.
+     *  @return GL_COMPRESSED_RG_RGTC2 for normal maps, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT for images with
+     *          transparent pixels and GL_COMPRESSED_RGB_S3TC_DXT1_EXT otherwise.
+     */
+    GLenum TextureCompressor::selectFormat(const unsigned char* pixels, unsigned int width, unsigned int height,
+        TextureUsage usage)
+    {
+        if (usage == TextureUsage::NormalMap) return GL_COMPRESSED_RG_RGTC2;
+        auto numPixels = std::size_t(width) * height;
+        for (std::size_t i = 0; i < numPixels; ++i) {
+            if (pixels[4 * i + 3] != 255) return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        }
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    }
+
+    /**
+     *  Compresses an image and all its mip levels. This does not use OpenGL, so it can run on any thread.
+     *  @param pixels the image in RGBA8.
+     *  @param width the image width.
+     *  @param height the image height.
+     *  @param format the compressed format as returned by selectFormat.
+     *  @param usage the texture usage.
+     *  @return the compressed levels from the full image down to 1x1.
+     */
+    std::vector<CompressedTextureLevel> TextureCompressor::compress(const unsigned char* pixels, unsigned int width,
+        unsigned int height, GLenum format, TextureUsage usage)
+    {
+        auto blockSize = getBlockSize(format);
+        std::vector<CompressedTextureLevel> result;
+        MipGenerator mipGenerator(pixels, width, height, usage);
+        std::vector<unsigned char> levelPixels;
+        const unsigned char* levelData = pixels;
+        while (true) {
+            auto blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+            CompressedTextureLevel level{ width, height, std::vector<unsigned char>(std::size_t(blocksX) * blocksY * blockSize) };
+            ThreadPool::getShared().parallelFor(std::size_t(blocksX) * blocksY, parallelGrainSize, [&](std::size_t begin, std::size_t end) {
+                Block block;
+                for (auto i = begin; i < end; ++i) {
+                    fetchBlock(levelData, width, height, static_cast<unsigned int>(i % blocksX),
+                        static_cast<unsigned int>(i / blocksX), block);
+                    encodeBlock(block, format, level.data.data() + i * blockSize);
+                }
+            });
+            result.push_back(std::move(level));
+            if (!mipGenerator.next()) break;
+
+            levelPixels = mipGenerator.getPixels();
+            levelData = levelPixels.data();
+            width = mipGenerator.getWidth();
+            height = mipGenerator.getHeight();
+        }
+        return result;
+    }
+
+    /**
+     *  Returns the size of a compressed 4x4 block.
+     *  @param format the compressed format.
+     *  @return the block size in bytes.
+     */
+    std::size_t TextureCompressor::getBlockSize(GLenum format)
+    {
+        return format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+    }
+}
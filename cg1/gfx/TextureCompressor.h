@@ -0,0 +1,40 @@
+#pragma once
+
+#include "cg1.h"
+#include <glad/glad.h>
+
+namespace cg1 {
+
+    /** What the contents of a texture are used for, selects the compression format. */
+    enum class TextureUsage {
+        /** Colors, compressed to BC1 or to BC3 if the image has transparent pixels. */
+        Color,
+        /** Tangent space normals, the x and y components are compressed to BC5, z is reconstructed by the shader. */
+        NormalMap
+    };
+
+    /** A single mip level of a block-compressed texture. */
+    struct CompressedTextureLevel
+    {
+        /** Holds the width in pixels. */
+        unsigned int width;
+        /** Holds the height in pixels. */
+        unsigned int height;
+        /** Holds the compressed blocks. */
+        std::vector<unsigned char> data;
+    };
+
+    /**
+     * Encodes RGBA8 images to the BC1 (DXT1), BC3 (DXT5) and BC5 (RGTC2) block compression formats including a full
+     * mip chain generated by MipGenerator. Blocks are encoded in parallel on the shared thread pool, the color index selection uses SSE2
+     * where available.
+     */
+    class TextureCompressor final
+    {
+    public:
+        static GLenum selectFormat(const unsigned char* pixels, unsigned int width, unsigned int height, TextureUsage usage);
+        static std::vector<CompressedTextureLevel> compress(const unsigned char* pixels, unsigned int width,
+            unsigned int height, GLenum format, TextureUsage usage);
+        static std::size_t getBlockSize(GLenum format);
+    };
+}
@@ -0,0 +1,205 @@
+#include "TextureStreamer.h"
+#include "Texture.h"
+#include "TextureArena.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+namespace cg1 {
+
+    TextureStreamer* TextureStreamer::instance_ = nullptr;
+
+    namespace {
+        /** The largest size of the mip levels loaded before a texture is requested, never evicted. */
+        constexpr unsigned int initialResidentSize = 64;
+        /** The largest number of textures that get finer levels per frame. */
+        constexpr unsigned int maxStreamedPerFrame = 2;
+        /** Textures often tile over an object, so one level finer than the footprint of the object is requested. */
+        constexpr int footprintLevelBias = -1;
+        /** Marks a texture that was not requested since the last update. */
+        constexpr unsigned int notRequested = std::numeric_limits<unsigned int>::max();
+    }
+
+    /**
+     *  Constructor, makes this the streamer used by all textures.
+     *  @param memoryBudget the memory budget of the streamed textures in bytes.
+     */
+    TextureStreamer::TextureStreamer(std::size_t memoryBudget) :
+        memoryBudget_{ memoryBudget },
+        residentSize_{ 0 },
+        queueDepth_{ 0 },
+        frame_{ 0 }
+    {
+        assert(instance_ == nullptr);
+        instance_ = this;
+    }
+
+    /** Destructor. All textures need to be destroyed before. */
+    TextureStreamer::~TextureStreamer() noexcept
+    {
+        assert(textures_.empty());
+        instance_ = nullptr;
+    }
+
+    /**
+     *  Returns the streamer used by all textures.
+     *  @return the current texture streamer.
+     */
+    TextureStreamer& TextureStreamer::getInstance()
+    {
+        assert(instance_ != nullptr);
+        return *instance_;
+    }
+
+    /**
+     *  Adds a texture whose levels are streamed.
+     *  @param texture the texture.
+     */
+    void TextureStreamer::add(Texture* texture)
+    {
+        textures_[texture] = Entry{ notRequested, texture->getResidentLevel(), frame_, frame_ };
+    }
+
+    /**
+     *  Removes a texture that is destroyed.
+     *  @param texture the texture.
+     */
+    void TextureStreamer::remove(Texture* texture)
+    {
+        textures_.erase(texture);
+    }
+
+    /**
+     *  Moves the state of a texture to the object it was moved to.
+     *  @param oldTexture the moved-from texture.
+     *  @param newTexture the moved-to texture.
+     */
+    void TextureStreamer::replace(Texture* oldTexture, Texture* newTexture)
+    {
+        auto it = textures_.find(oldTexture);
+        if (it == textures_.end()) return;
+        auto entry = it->second;
+        textures_.erase(it);
+        textures_[newTexture] = entry;
+    }
+
+    /**
+     *  Returns the finest level uploaded with a new texture.
+     *  @param texture the texture.
+     *  @return the first level not larger than the initial resident size.
+     */
+    unsigned int TextureStreamer::getInitialLevel(const Texture& texture) const
+    {
+        auto size = glm::max(texture.getDimensions().x, texture.getDimensions().y);
+        unsigned int level = 0;
+        while (level + 1 < texture.getNumLevels() && (size >> level) > initialResidentSize) ++level;
+        return level;
+    }
+
+    /**
+     *  Requests the level of a texture matching the size of an object on screen for the current frame.
+     *  @param texture the texture of the object.
+     *  @param footprint the projected diameter of the object in pixels.
+     */
+    void TextureStreamer::request(const Texture& texture, float footprint)
+    {
+        auto it = textures_.find(const_cast<Texture*>(&texture));
+        if (it == textures_.end() || footprint <= 0.0f) return;
+        auto size = static_cast<float>(glm::max(texture.getDimensions().x, texture.getDimensions().y));
+        auto level = static_cast<int>(std::floor(std::log2(size / footprint))) + footprintLevelBias;
+        level = glm::clamp(level, 0, static_cast<int>(texture.getNumLevels()) - 1);
+        it->second.requestedLevel = std::min(it->second.requestedLevel, static_cast<unsigned int>(level));
+    }
+
+    /**
+     *  Evaluates the requests of the last frame. Evicts levels if the budget is exceeded and streams in the finer
+     *  levels of the textures with the largest deficit. The budget covers all array textures of the arena, so the
+     *  free layers of partially used pools count as well.
+     */
+    void TextureStreamer::update()
+    {
+        ++frame_;
+
+        auto& arena = TextureArena::getInstance();
+        std::vector<Texture*> queue;
+        residentSize_ = arena.getAllocatedSize();
+        for (auto& texture : textures_) {
+            auto& entry = texture.second;
+            if (entry.requestedLevel != notRequested) {
+                entry.neededLevel = entry.requestedLevel;
+                entry.lastRequestedFrame = frame_;
+                if (entry.neededLevel <= texture.first->getResidentLevel()) entry.lastNeededFrame = frame_;
+            }
+            entry.requestedLevel = notRequested;
+            if (entry.neededLevel < texture.first->getResidentLevel()) queue.push_back(texture.first);
+        }
+        queueDepth_ = queue.size();
+        makeRoom(0, nullptr);
+
+        std::sort(queue.begin(), queue.end(), [this](Texture* a, Texture* b) {
+            return a->getResidentLevel() - textures_[a].neededLevel > b->getResidentLevel() - textures_[b].neededLevel;
+        });
+        unsigned int numStreamed = 0;
+        for (auto texture : queue) {
+            if (numStreamed == maxStreamedPerFrame) break;
+            // stream in the finest needed level that fits into the budget.
+            auto level = textures_[texture].neededLevel;
+            for (; level < texture->getResidentLevel(); ++level) {
+                if (makeRoom(texture->getArenaGrowth(level), texture)) break;
+            }
+            if (level == texture->getResidentLevel()) continue;
+
+            texture->setResidentLevel(level);
+            residentSize_ = arena.getAllocatedSize();
+            textures_[texture].lastNeededFrame = frame_;
+            --queueDepth_;
+            ++numStreamed;
+        }
+    }
+
+    /**
+     *  Evicts the finest levels of the textures that were needed least recently until the given size fits into the
+     *  budget. Levels requested in the current frame and the initial levels are never evicted. The evicted levels
+     *  are estimated from the sizes of the layers, the memory actually returned is read back from the arena.
+     *  @param size the size to make room for in bytes.
+     *  @param keep a texture whose levels are not evicted or nullptr.
+     *  @return whether there is room for the size.
+     */
+    bool TextureStreamer::makeRoom(std::size_t size, const Texture* keep)
+    {
+        if (residentSize_ + size <= memoryBudget_) return true;
+
+        std::vector<std::pair<std::uint64_t, Texture*>> candidates;
+        for (auto& texture : textures_) {
+            if (texture.first != keep && texture.first->getResidentLevel() < getEvictionLimit(*texture.first)) {
+                candidates.emplace_back(texture.second.lastNeededFrame, texture.first);
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+
+        for (const auto& candidate : candidates) {
+            auto texture = candidate.second;
+            auto level = texture->getResidentLevel();
+            auto limit = getEvictionLimit(*texture);
+            auto excess = residentSize_ + size - memoryBudget_;
+            while (level < limit && texture->getMemorySize() - texture->getMemorySize(level) < excess) ++level;
+            texture->setResidentLevel(level);
+            residentSize_ = TextureArena::getInstance().getAllocatedSize();
+            if (residentSize_ + size <= memoryBudget_) return true;
+        }
+        return false;
+    }
+
+    /**
+     *  Returns the coarsest level a texture may be evicted to.
+     *  @param texture the texture.
+     *  @return the initial level, or the needed level if it is finer and was requested in the current frame.
+     */
+    unsigned int TextureStreamer::getEvictionLimit(const Texture& texture) const
+    {
+        const auto& entry = textures_.at(const_cast<Texture*>(&texture));
+        auto limit = getInitialLevel(texture);
+        return entry.lastRequestedFrame == frame_ ? std::min(limit, entry.neededLevel) : limit;
+    }
+}
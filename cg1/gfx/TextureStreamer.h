@@ -0,0 +1,78 @@
+#pragma once
+
+#include "cg1.h"
+#include <unordered_map>
+
+namespace cg1 {
+
+    class Texture;
+
+    /**
+     * Decides which mip levels of the streamed textures are resident on the GPU. Textures start with their coarse
+     * levels only. Every frame the objects request the level matching their projected size on screen, finer levels
+     * are streamed in a few textures per frame while the array textures of the texture arena stay within the memory
+     * budget. To make room, the levels that were needed least recently are evicted first.
+     */
+    class TextureStreamer final
+    {
+    public:
+        explicit TextureStreamer(std::size_t memoryBudget);
+        TextureStreamer(const TextureStreamer&) = delete;
+        TextureStreamer& operator=(const TextureStreamer&) = delete;
+        TextureStreamer(TextureStreamer&&) = delete;
+        TextureStreamer& operator=(TextureStreamer&&) = delete;
+        ~TextureStreamer() noexcept;
+
+        static TextureStreamer& getInstance();
+
+        void add(Texture* texture);
+        void remove(Texture* texture);
+        void replace(Texture* oldTexture, Texture* newTexture);
+        unsigned int getInitialLevel(const Texture& texture) const;
+
+        void request(const Texture& texture, float footprint);
+        void update();
+
+        /** Returns the memory budget of the texture arena in bytes. */
+        std::size_t getMemoryBudget() const noexcept { return memoryBudget_; }
+        /** Sets the memory budget of the texture arena in bytes. */
+        void setMemoryBudget(std::size_t memoryBudget) noexcept { memoryBudget_ = memoryBudget; }
+        /** Returns the GPU memory of the texture arena in bytes, measured at the last update. */
+        std::size_t getResidentSize() const noexcept { return residentSize_; }
+        /** Returns the number of textures waiting for finer levels. */
+        std::size_t getQueueDepth() const noexcept { return queueDepth_; }
+        /** Returns the number of streamed textures. */
+        std::size_t getNumTextures() const noexcept { return textures_.size(); }
+
+    private:
+        /** The streaming state of a single texture. */
+        struct Entry
+        {
+            /** Holds the finest level requested since the last update. */
+            unsigned int requestedLevel;
+            /** Holds the finest level requested in the last frame it was requested. */
+            unsigned int neededLevel;
+            /** Holds the last frame in which the finest resident level was needed. */
+            std::uint64_t lastNeededFrame;
+            /** Holds the last frame in which the texture was requested. */
+            std::uint64_t lastRequestedFrame;
+        };
+
+        bool makeRoom(std::size_t size, const Texture* keep);
+        unsigned int getEvictionLimit(const Texture& texture) const;
+
+        /** Holds the streamer used by all textures. */
+        static TextureStreamer* instance_;
+
+        /** Holds the streamed textures. */
+        std::unordered_map<Texture*, Entry> textures_;
+        /** Holds the memory budget in bytes. */
+        std::size_t memoryBudget_;
+        /** Holds the GPU memory of the texture arena in bytes. */
+        std::size_t residentSize_;
+        /** Holds the number of textures waiting for finer levels. */
+        std::size_t queueDepth_;
+        /** Holds the number of updates so far. */
+        std::uint64_t frame_;
+    };
+}
@@ -0,0 +1,114 @@
+#include "TextureUploader.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace cg1 {
+
+    TextureUploader* TextureUploader::instance_ = nullptr;
+
+    namespace {
+        /** The number of staging buffers in the ring. */
+        constexpr std::size_t numStagingBuffers = 4;
+        /** The initial size of each staging buffer in bytes. */
+        constexpr std::size_t stagingBufferSize = 8 << 20;
+        /** The alignment of staged data inside a buffer. */
+        constexpr std::size_t stagingAlignment = 16;
+    }
+
+    /** Constructor, makes this the uploader used by all textures. */
+    TextureUploader::TextureUploader() :
+        buffers_(numStagingBuffers),
+        current_{ 0 },
+        numStalls_{ 0 }
+    {
+        assert(instance_ == nullptr);
+        instance_ = this;
+        for (auto& buffer : buffers_) {
+            glGenBuffers(1, &buffer.id);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, stagingBufferSize, nullptr, GL_STREAM_DRAW);
+            buffer.capacity = stagingBufferSize;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    /** Destructor. */
+    TextureUploader::~TextureUploader() noexcept
+    {
+        for (auto& buffer : buffers_) {
+            if (buffer.fence) glDeleteSync(buffer.fence);
+            glDeleteBuffers(1, &buffer.id);
+        }
+        instance_ = nullptr;
+    }
+
+    /**
+     *  Returns the uploader used by all textures.
+     *  @return the current texture uploader.
+     */
+    TextureUploader& TextureUploader::getInstance()
+    {
+        assert(instance_ != nullptr);
+        return *instance_;
+    }
+
+    /**
+     *  Copies texture data into a staging buffer and binds it to GL_PIXEL_UNPACK_BUFFER. The returned offset is
+     *  passed as the data pointer of the next glTexImage2D or glCompressedTexImage2D call, finishStaging has to be
+     *  called after the texture is specified.
+     *  @param data the texture data.
+     *  @param size the size of the data in bytes.
+     *  @return the offset of the data inside the bound buffer.
+     */
+    const GLvoid* TextureUploader::stage(const void* data, std::size_t size)
+    {
+        auto offset = (buffers_[current_].used + stagingAlignment - 1) / stagingAlignment * stagingAlignment;
+        if (offset + size > buffers_[current_].capacity) {
+            advance(size);
+            offset = 0;
+        }
+
+        auto& buffer = buffers_[current_];
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+        // the range was not used since the buffers fence signaled, so no synchronization is needed.
+        auto mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, size,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        std::memcpy(mapped, data, size);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        buffer.used = offset + size;
+        return reinterpret_cast<const GLvoid*>(offset);
+    }
+
+    /** Unbinds the staging buffer, so later texture calls read from client memory again. */
+    void TextureUploader::finishStaging()
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    /**
+     *  Fences the current buffer and moves on to the next one, waiting for the GPU if that one is still in use.
+     *  @param size the size of the data that needs to fit into the next buffer.
+     */
+    void TextureUploader::advance(std::size_t size)
+    {
+        buffers_[current_].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        current_ = (current_ + 1) % buffers_.size();
+
+        auto& buffer = buffers_[current_];
+        if (buffer.fence) {
+            if (glClientWaitSync(buffer.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+                ++numStalls_;
+                while (glClientWaitSync(buffer.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+            }
+            glDeleteSync(buffer.fence);
+            buffer.fence = nullptr;
+        }
+        buffer.used = 0;
+        if (size > buffer.capacity) {
+            buffer.capacity = std::max(size, 2 * buffer.capacity);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, buffer.capacity, nullptr, GL_STREAM_DRAW);
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "cg1.h"
+
+namespace cg1 {
+
+    /**
+     * Ring of pixel buffer objects texture data is staged in before it is uploaded. The pixels are copied into a
+     * mapped buffer range and the texture is specified from the buffer, so the copy to GPU memory happens
+     * asynchronously instead of stalling the render thread. A buffer is only reused after a fence shows that the
+     * GPU has consumed all uploads from it.
+     */
+    class TextureUploader final
+    {
+    public:
+        TextureUploader();
+        TextureUploader(const TextureUploader&) = delete;
+        TextureUploader& operator=(const TextureUploader&) = delete;
+        TextureUploader(TextureUploader&&) = delete;
+        TextureUploader& operator=(TextureUploader&&) = delete;
+        ~TextureUploader() noexcept;
+
+        static TextureUploader& getInstance();
+
+        const GLvoid* stage(const void* data, std::size_t size);
+        void finishStaging();
+
+        /** Returns the number of times staging had to wait for the GPU to free a buffer. */
+        unsigned int getNumStalls() const noexcept { return numStalls_; }
+
+    private:
+        /** A pixel buffer object sub-allocated front to back. */
+        struct StagingBuffer
+        {
+            /** Holds the OpenGL buffer. */
+            GLuint id = 0;
+            /** Holds the capacity in bytes. */
+            std::size_t capacity = 0;
+            /** Holds the number of bytes used since the buffer was last recycled. */
+            std::size_t used = 0;
+            /** Holds the fence signaled when the GPU has consumed all uploads from the buffer. */
+            GLsync fence = nullptr;
+        };
+
+        void advance(std::size_t size);
+
+        /** Holds the uploader used by all textures. */
+        static TextureUploader* instance_;
+
+        /** Holds the ring of staging buffers. */
+        std::vector<StagingBuffer> buffers_;
+        /** Holds the index of the buffer currently staged into. */
+        std::size_t current_;
+        /** Holds the number of times staging waited for the GPU. */
+        unsigned int numStalls_;
+    };
+}
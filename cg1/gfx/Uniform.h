@@ -0,0 +1,129 @@
+#pragma once
+
+#include "cg1.h"
+#include "gfx/GLStateCache.h"
+#include <cstring>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+namespace cg1 {
+
+    class GPUProgram;
+
+    namespace uniform {
+        /** The location of a uniform and the value it was set to last, owned by the program. */
+        struct Slot
+        {
+            /** Holds the location, -1 if the uniform is not active. */
+            GLint location = -1;
+            /** Holds whether value is the current value, false until it is set after linking. */
+            bool hasValue = false;
+            /** Holds the bytes of the value set last. */
+            unsigned char value[sizeof(glm::mat4)];
+        };
+
+        /** Maps the C++ type of a uniform to the GLSL types it can be set to. */
+        template<typename T> struct TypeTraits;
+
+        template<> struct TypeTraits<float> {
+            static bool matches(GLenum type) noexcept { return type == GL_FLOAT; }
+            static void set(GLint location, float value) noexcept { glUniform1f(location, value); }
+        };
+
+        template<> struct TypeTraits<int> {
+            /** Samplers are set through their texture unit. */
+            static bool matches(GLenum type) noexcept
+            {
+                switch (type) {
+                case GL_INT: case GL_BOOL: case GL_SAMPLER_2D: case GL_SAMPLER_2D_ARRAY: case GL_SAMPLER_2D_SHADOW:
+                case GL_SAMPLER_2D_ARRAY_SHADOW: case GL_SAMPLER_CUBE: case GL_SAMPLER_3D:
+                    return true;
+                default:
+                    return false;
+                }
+            }
+            static void set(GLint location, int value) noexcept { glUniform1i(location, value); }
+        };
+
+        template<> struct TypeTraits<glm::ivec2> {
+            static bool matches(GLenum type) noexcept { return type == GL_INT_VEC2; }
+            static void set(GLint location, const glm::ivec2& value) noexcept { glUniform2iv(location, 1, glm::value_ptr(value)); }
+        };
+
+        template<> struct TypeTraits<glm::vec2> {
+            static bool matches(GLenum type) noexcept { return type == GL_FLOAT_VEC2; }
+            static void set(GLint location, const glm::vec2& value) noexcept { glUniform2fv(location, 1, glm::value_ptr(value)); }
+        };
+
+        template<> struct TypeTraits<glm::vec3> {
+            static bool matches(GLenum type) noexcept { return type == GL_FLOAT_VEC3; }
+            static void set(GLint location, const glm::vec3& value) noexcept { glUniform3fv(location, 1, glm::value_ptr(value)); }
+        };
+
+        template<> struct TypeTraits<glm::vec4> {
+            static bool matches(GLenum type) noexcept { return type == GL_FLOAT_VEC4; }
+            static void set(GLint location, const glm::vec4& value) noexcept { glUniform4fv(location, 1, glm::value_ptr(value)); }
+        };
+
+        template<> struct TypeTraits<glm::mat3> {
+            static bool matches(GLenum type) noexcept { return type == GL_FLOAT_MAT3; }
+            static void set(GLint location, const glm::mat3& value) noexcept
+            {
+                glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(value));
+            }
+        };
+
+        template<> struct TypeTraits<glm::mat4> {
+            static bool matches(GLenum type) noexcept { return type == GL_FLOAT_MAT4; }
+            static void set(GLint location, const glm::mat4& value) noexcept
+            {
+                glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+            }
+        };
+    }
+
+    /**
+     * Typed handle of a uniform of a GPUProgram. The location is owned by the program and resolved again when the
+     * program is relinked, so the handle stays valid across recompileProgram. Uniforms the linker removed have
+     * location -1 and setting them does nothing, like in OpenGL. The program also keeps the value set last, setting
+     * the same value again is skipped and counted by the GLStateCache.
+     */
+    template<typename T>
+    class Uniform final
+    {
+    public:
+        /** Constructor, creates a handle not bound to any uniform. */
+        Uniform() noexcept = default;
+
+        void set(const T& value) const;
+        /** Returns the location, -1 if the uniform is not active. */
+        GLint getLocation() const noexcept { return slot_ != nullptr ? slot_->location : -1; }
+        /** Returns whether the uniform is active in the current program. */
+        bool isActive() const noexcept { return getLocation() >= 0; }
+
+    private:
+        friend class GPUProgram;
+        /** Constructor, used by the program. */
+        explicit Uniform(uniform::Slot* slot) noexcept : slot_(slot) {}
+
+        /** Holds the location and value owned by the program. */
+        uniform::Slot* slot_ = nullptr;
+    };
+
+    /**
+     *  Sets the uniform of the program currently in use unless it has this value already.
+     *  @param value the new value.
+     */
+    template<typename T>
+    void Uniform<T>::set(const T& value) const
+    {
+        static_assert(sizeof(T) <= sizeof(uniform::Slot::value), "The uniform type is too large to be cached.");
+        if (slot_ == nullptr || slot_->location < 0) return;
+        auto unchanged = slot_->hasValue && std::memcmp(slot_->value, &value, sizeof(T)) == 0;
+        GLStateCache::getInstance().countCall(unchanged);
+        if (unchanged) return;
+        std::memcpy(slot_->value, &value, sizeof(T));
+        slot_->hasValue = true;
+        uniform::TypeTraits<T>::set(slot_->location, value);
+    }
+}
@@ -0,0 +1,63 @@
+#include "UniformBuffer.h"
+
+namespace cg1 {
+
+    /**
+     * Constructor, creates an empty buffer and binds it to a binding point.
+     * @param binding the uniform buffer binding point.
+     */
+    UniformBuffer::UniformBuffer(GLuint binding) :
+        buffer_(0),
+        binding_(binding)
+    {
+        glGenBuffers(1, &buffer_);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding_, buffer_);
+    }
+
+    /**
+     * Move-constructor.
+     * @param rhs the object to move.
+     */
+    UniformBuffer::UniformBuffer(UniformBuffer&& rhs) noexcept :
+        buffer_(rhs.buffer_),
+        binding_(rhs.binding_)
+    {
+        rhs.buffer_ = 0;
+    }
+
+    /**
+     * Move-assignment operator.
+     * @param rhs the object to move.
+     * @return reference to this object.
+     */
+    UniformBuffer& UniformBuffer::operator=(UniformBuffer&& rhs) noexcept
+    {
+        if (this != &rhs) {
+            this->~UniformBuffer();
+            buffer_ = rhs.buffer_;
+            binding_ = rhs.binding_;
+            rhs.buffer_ = 0;
+        }
+        return *this;
+    }
+
+    /** Destructor. */
+    UniformBuffer::~UniformBuffer() noexcept
+    {
+        if (buffer_ != 0) glDeleteBuffers(1, &buffer_);
+        buffer_ = 0;
+    }
+
+    /**
+     *  Replaces the content of the buffer. The binding point covers the whole buffer, so it does not need to be
+     *  bound again when the size changes.
+     *  @param data the new content in the std140 layout of the block.
+     *  @param size the size of the content in bytes.
+     */
+    void UniformBuffer::upload(const void* data, std::size_t size)
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer_);
+        glBufferData(GL_UNIFORM_BUFFER, size, data, GL_STREAM_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "cg1.h"
+
+namespace cg1 {
+
+    /**
+     * Uniform buffer object bound to a fixed binding point. Its whole content is replaced with a single upload,
+     * the driver orphans the old storage so an upload never waits for draws still reading it.
+     */
+    class UniformBuffer final
+    {
+    public:
+        explicit UniformBuffer(GLuint binding);
+        UniformBuffer(const UniformBuffer&) = delete;
+        UniformBuffer& operator=(const UniformBuffer&) = delete;
+        UniformBuffer(UniformBuffer&&) noexcept;
+        UniformBuffer& operator=(UniformBuffer&&) noexcept;
+        ~UniformBuffer() noexcept;
+
+        void upload(const void* data, std::size_t size);
+        /**
+         *  Uploads the elements of a vector, they need to have the std140 layout of the block.
+         *  @param data the elements.
+         */
+        template<typename T> void upload(const std::vector<T>& data) { upload(data.data(), data.size() * sizeof(T)); }
+        /** Returns the uniform buffer binding point. */
+        GLuint getBinding() const noexcept { return binding_; }
+
+    private:
+        /** Holds the OpenGL buffer. */
+        GLuint buffer_;
+        /** Holds the uniform buffer binding point. */
+        GLuint binding_;
+    };
+}
@@ -0,0 +1,114 @@
+#include "UniformBufferRing.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace cg1 {
+
+    namespace {
+        /** The number of segments, i.e. frames the CPU can be ahead of the GPU. */
+        constexpr std::size_t numSegments = 3;
+        /** The initial number of records per segment. */
+        constexpr std::size_t initialSegmentCapacity = 64;
+    }
+
+    /**
+     * Constructor.
+     * @param binding the uniform buffer binding point the records are bound to.
+     * @param recordSize the size of a record in bytes.
+     */
+    UniformBufferRing::UniformBufferRing(GLuint binding, std::size_t recordSize) :
+        buffer_(0),
+        binding_(binding),
+        recordSize_(recordSize),
+        stride_(recordSize),
+        segmentCapacity_(0),
+        fences_(numSegments, nullptr),
+        current_(0),
+        numStalls_(0)
+    {
+        GLint alignment = 1;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        stride_ = (recordSize_ + alignment - 1) / alignment * alignment;
+        glGenBuffers(1, &buffer_);
+        grow(initialSegmentCapacity);
+    }
+
+    /** Destructor. */
+    UniformBufferRing::~UniformBufferRing() noexcept
+    {
+        for (auto fence : fences_) {
+            if (fence) glDeleteSync(fence);
+        }
+        glDeleteBuffers(1, &buffer_);
+    }
+
+    /**
+     *  Copies the records of a frame into the next segment, waits for the GPU if the segment is still in use.
+     *  @param records the records in the std140 layout of the block, packed without padding.
+     *  @param numRecords the number of records.
+     */
+    void UniformBufferRing::upload(const void* records, std::size_t numRecords)
+    {
+        if (numRecords > segmentCapacity_) grow(std::max(numRecords, 2 * segmentCapacity_));
+        waitForSegment(current_);
+        if (numRecords == 0) return;
+
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer_);
+        // the segment is not read by the GPU anymore since its fence signaled, so no synchronization is needed.
+        auto mapped = static_cast<char*>(glMapBufferRange(GL_UNIFORM_BUFFER, current_ * segmentCapacity_ * stride_,
+            numRecords * stride_, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+        auto source = static_cast<const char*>(records);
+        for (std::size_t i = 0; i < numRecords; ++i) std::memcpy(mapped + i * stride_, source + i * recordSize_, recordSize_);
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    /**
+     *  Binds a record of the current frame for the next draw.
+     *  @param record the index of the record.
+     */
+    void UniformBufferRing::bind(std::size_t record)
+    {
+        assert(record < segmentCapacity_);
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding_, buffer_, (current_ * segmentCapacity_ + record) * stride_,
+            recordSize_);
+    }
+
+    /** Fences the segment of the current frame after its last draw and moves on to the next segment. */
+    void UniformBufferRing::endFrame()
+    {
+        if (fences_[current_]) glDeleteSync(fences_[current_]);
+        fences_[current_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        current_ = (current_ + 1) % fences_.size();
+    }
+
+    /**
+     *  Waits until the GPU finished the frame that last read a segment.
+     *  @param segment the segment.
+     */
+    void UniformBufferRing::waitForSegment(std::size_t segment)
+    {
+        auto& fence = fences_[segment];
+        if (!fence) return;
+        if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            ++numStalls_;
+            while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    /**
+     *  Reallocates the buffer with more records per segment. All segments are waited for, so none is in use.
+     *  @param numRecords the new number of records per segment.
+     */
+    void UniformBufferRing::grow(std::size_t numRecords)
+    {
+        for (std::size_t i = 0; i < fences_.size(); ++i) waitForSegment(i);
+        segmentCapacity_ = numRecords;
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer_);
+        glBufferData(GL_UNIFORM_BUFFER, fences_.size() * segmentCapacity_ * stride_, nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "cg1.h"
+
+namespace cg1 {
+
+    /**
+     * Ring of per-frame segments of a uniform buffer holding one std140 record per draw. All records of a frame are
+     * written with a single mapping and each draw selects its record by binding a range of the buffer. A segment is
+     * only rewritten after a fence shows that the GPU finished the frame that read it.
+     */
+    class UniformBufferRing final
+    {
+    public:
+        UniformBufferRing(GLuint binding, std::size_t recordSize);
+        UniformBufferRing(const UniformBufferRing&) = delete;
+        UniformBufferRing& operator=(const UniformBufferRing&) = delete;
+        UniformBufferRing(UniformBufferRing&&) = delete;
+        UniformBufferRing& operator=(UniformBufferRing&&) = delete;
+        ~UniformBufferRing() noexcept;
+
+        void upload(const void* records, std::size_t numRecords);
+        /**
+         *  Uploads the records of the next frame.
+         *  @param records the records, they need to have the std140 layout of the block.
+         */
+        template<typename T> void upload(const std::vector<T>& records) { upload(records.data(), records.size()); }
+        void bind(std::size_t record);
+        void endFrame();
+
+        /** Returns the uniform buffer binding point. */
+        GLuint getBinding() const noexcept { return binding_; }
+        /** Returns the number of times an upload had to wait for the GPU to finish a frame. */
+        unsigned int getNumStalls() const noexcept { return numStalls_; }
+
+    private:
+        void waitForSegment(std::size_t segment);
+        void grow(std::size_t numRecords);
+
+        /** Holds the OpenGL buffer. */
+        GLuint buffer_;
+        /** Holds the uniform buffer binding point. */
+        GLuint binding_;
+        /** Holds the size of a record in bytes. */
+        std::size_t recordSize_;
+        /** Holds the distance between records, a multiple of the uniform buffer offset alignment. */
+        std::size_t stride_;
+        /** Holds the number of records per segment. */
+        std::size_t segmentCapacity_;
+        /** Holds the fence of each segment, signaled when the GPU finished the frame reading it. */
+        std::vector<GLsync> fences_;
+        /** Holds the segment of the current frame. */
+        std::size_t current_;
+        /** Holds the number of times an upload waited for the GPU. */
+        unsigned int numStalls_;
+    };
+}
@@ -2,6 +2,9 @@
 #include <glm/glm.hpp>
 #include <type_traits>
 #include "../gfx/GPUProgram.h"
+#include "../gfx/GPUProgramVariants.h"
+#include "../gfx/UniformBuffer.h"
+#include "../gfx/UniformBufferRing.h"
 #include "../core/Camera.h"
 #include "../gfx/Texture.h"
 #include "../gfx/Mesh.h"
@@ -9,12 +12,19 @@
 
 #include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <limits>
 
 #include <glm/gtc/matrix_transform.hpp>
 #include "glm/ext.hpp"
 
 #include "core/SceneObject.h"
 #include "core/FlashLight.h"
+#include "core/AssetLoader.h"
+#include "core/AssetRegistry.h"
+#include "gfx/GLStateCache.h"
+#include "gfx/TextureArena.h"
+#include "gfx/TextureStreamer.h"
 
 #define printOpenGLError() printOglError(__FILE__, __LINE__)
 #define COMMA ,
@@ -38,13 +48,37 @@ int printOglError(const char *file, int line)
 
 namespace cg1 {
 
+    namespace {
+        /** The uniform buffer binding point of the FrameConstants block. */
+        constexpr GLuint frameConstantsBinding = 0;
+        /** The uniform buffer binding point of the Lights block. */
+        constexpr GLuint lightsBinding = 1;
+        /** The uniform buffer binding point of the DrawConstants block. */
+        constexpr GLuint drawConstantsBinding = 2;
+        /** The bit of a render queue index marking objects completely inside of the view frustum. */
+        constexpr std::uint32_t containedFlag = 0x80000000u;
+        /** Marks scene objects without a draw constants record in the current frame. */
+        constexpr std::uint32_t noRecord = 0xffffffffu;
+
+        /**
+         *  Combines the array textures of a draw into the texture set of its sort key.
+         *  @param pools the texture arena pools of the diffuse texture and the normal map, -1 if not loaded.
+         *  @return the texture set, equal for draws binding the same array textures.
+         */
+        unsigned int getTextureSet(const glm::ivec2& pools)
+        {
+            return (static_cast<unsigned int>(pools.x + 1) << 8) | static_cast<unsigned int>(pools.y + 1);
+        }
+    }
+
     /**
      *  Constructor.
      */
     Scene::Scene() :
-		program_{ std::make_unique<GPUProgram>("DefaultProgram",
-				std::initializer_list<std::string>{"sceneShader.vert", "sceneShader.frag"}) },
+		currentProgram_{nullptr},
+		uniforms_{nullptr},
         VPMatrix_{ 1.0f },
+		passVP_{1.0f},
 		viewMatrix_{1.0f},
 		currentTime_{0},
 		shadowMapSize_{1536},
@@ -61,36 +95,23 @@ namespace cg1 {
 		lastUpdate_{0},
 		lastFPS_{-1},
 		postProcMode_{1},
-		planeMesh_{std::make_unique<Mesh>("meshes/Plane.obj")}
+		planeMesh_{std::make_unique<Mesh>("meshes/Plane.obj")},
+		lodPixelScale_{1.0f},
+		lodPixelError_{1.0f},
+		shadowLodPixelError_{4.0f},
+		enableClusterCulling_{true},
+		numClusters_{0},
+		numVisibleClusters_{0},
+		enableDrawSorting_{true},
+		enableFrustumCulling_{true}
     {
     	m_sceneObjects.clear();
     	gLights.clear();
 
-    	std::cout << "Loading Uniform Locations ..." << std::endl;
-        matModelUniformLocation_ = glGetUniformLocation(program_->getProgramId(), "matModel");
-        matNormalUniformLocation_ = glGetUniformLocation(program_->getProgramId(), "matNormal");
-        matVPUniformLocation_ = glGetUniformLocation(program_->getProgramId(), "matVP");
-        matVUniformLocation_ = glGetUniformLocation(program_->getProgramId(), "matV");
-        tex0UniformLocation_ = glGetUniformLocation(program_->getProgramId(), "tex");
-		tex1UniformLocation_ = glGetUniformLocation(program_->getProgramId(), "normalTex");
-        shaderModeUniformLocation_ = glGetUniformLocation(program_->getProgramId(), "shaderMode");
-        timeUniformLocation_ = glGetUniformLocation(program_->getProgramId(), "time");
-        depthTextureArrayUniformLocation_ = glGetUniformLocation(program_->getProgramId(), "shadowTexArray");
-        enableShadowMappingUniformLocation_ = glGetUniformLocation(program_->getProgramId(), "enableShadowMapping");
-		enableNormalMappingUniformLocation_ = glGetUniformLocation(program_->getProgramId(), "enableNormalMapping");
-		hasNormalMapUniformLocation_ = glGetUniformLocation(program_->getProgramId(), "hasNormalMap");
-        enableLightingUniformLocation_ = glGetUniformLocation(program_->getProgramId(), "enableLighting");
-        waterModeUniformLocation_ = glGetUniformLocation(program_->getProgramId(), "waterMode");
-        materialSpecularColUniformLocation_ = glGetUniformLocation(program_->getProgramId(), "material.specularColor");
-        materialShininessUniformLocation_ = glGetUniformLocation(program_->getProgramId(), "material.shininess");
-        enableSmoothShadowsUniformLocation_ = glGetUniformLocation(program_->getProgramId(), "enableSmoothShadows");
-        texColorPostProcUniformLocation_ = glGetUniformLocation(program_->getProgramId(), "postProcTexColor");
-        enablePostProcUniformLocation_ = glGetUniformLocation(program_->getProgramId(), "enablePostProc");
-        postProcModeUniformLocation_ = glGetUniformLocation(program_->getProgramId(), "postProcMode");
-
     	std::cout << "Creating Scene Objects ..." << std::endl;
 #define ADD_SCENE_OBJECT(OBJ_FILE, TEX_LIST,T,R_AXIS,R_ANGLE,S, SHININESS, SPEC_COLOR, SHADER_MODE, HAS_NORMAL_MAP) {\
-			SceneObject* obj = new SceneObject(OBJ_FILE,TEX_LIST); \
+			SceneObject* obj = new SceneObject(OBJ_FILE,TEX_LIST, \
+				SHADER_MODE == SceneObject::WATER ? MeshUsage::Displaced : MeshUsage::Static); \
 			obj->setTransformation(T,R_AXIS,R_ANGLE,S);\
 			obj->setMaterialAttributes(SHININESS,SPEC_COLOR);\
 			obj->setShaderMode(SHADER_MODE);\
@@ -107,18 +128,18 @@ namespace cg1 {
     	}
 
         // Setup scene
-        ADD_SCENE_OBJECT("terrainSurface.obj",{"terrain_DIFFUSE.jpg" COMMA "terrain_NORMAL.jpg"},
+        ADD_SCENE_OBJECT("terrainSurface.obj",{"terrain_DIFFUSE.jpg" COMMA SceneObject::TextureFile("terrain_NORMAL.jpg", TextureUsage::NormalMap)},
         		glm::vec3(0,0,0),glm::vec3(0,1,0),glm::radians(0.0f),glm::vec3(1,1,1),
 				10,glm::vec3(1,1,1),
 				SceneObject::DEFAULT, 
 				1);
-        ADD_SCENE_OBJECT("waterSurface.obj",{"water_DIFFUSE.jpg" COMMA "water_NORMAL.jpg"},
+        ADD_SCENE_OBJECT("waterSurface.obj",{"water_DIFFUSE.jpg" COMMA SceneObject::TextureFile("water_NORMAL.jpg", TextureUsage::NormalMap)},
         		glm::vec3(0, -2.2, 0),glm::vec3(0,1,0),glm::radians(0.0f),glm::vec3(1,1,1),
 				50,glm::vec3(10,10,10),
 				SceneObject::WATER,
 				1);
 
-        ADD_SCENE_OBJECT("Stonehengebed.obj",{"192.JPG" COMMA "192_norm.JPG"},
+        ADD_SCENE_OBJECT("Stonehengebed.obj",{"192.JPG" COMMA SceneObject::TextureFile("192_norm.JPG", TextureUsage::NormalMap)},
         		glm::vec3(0, 1, 0),glm::vec3(0,1,0),glm::radians(0.0f),glm::vec3(1,1,1),
 				7,glm::vec3(1,1,1),
 				SceneObject::DEFAULT,
@@ -149,7 +170,7 @@ namespace cg1 {
 				SceneObject::DEFAULT,
 				0);
 
-        ADD_SCENE_OBJECT("bridge.obj",{"bridge.jpg" COMMA "bridge_normal.jpg"},
+        ADD_SCENE_OBJECT("bridge.obj",{"bridge.jpg" COMMA SceneObject::TextureFile("bridge_normal.jpg", TextureUsage::NormalMap)},
         		glm::vec3(7,0,0),glm::vec3(0,1,0),glm::radians(90.0f),glm::vec3(1,1,1),
 				10,glm::vec3(1,1,1),
 				SceneObject::DEFAULT,
@@ -210,8 +231,32 @@ namespace cg1 {
         std::cout << "Sceneobjects (meshes): " << m_sceneObjects.size() << std::endl;
         std::cout << "Light Sources: " << gLights.size() << std::endl;
 
+        // the variants are compiled the first time a pass uses them, the light loops are unrolled to the lights count
+        programVariants_ = std::make_unique<GPUProgramVariants>("DefaultProgram",
+            std::vector<std::string>{ "sceneShader.vert", "sceneShader.frag" },
+            std::vector<GPUProgramVariants::Feature>{ { "PASS", 3 }, { "WATER", 2 }, { "LIGHTING", 2 },
+                { "SHADOW_MAPPING", 2 }, { "SMOOTH_SHADOWS", 3 }, { "NORMAL_MAPPING", 2 }, { "POST_PROC_MODE", 6 } },
+            "#define NUM_LIGHTS " + std::to_string(gLights.size()) + "\n");
+        frameConstantsBuffer_ = std::make_unique<UniformBuffer>(frameConstantsBinding);
+        lightsBuffer_ = std::make_unique<UniformBuffer>(lightsBinding);
+        drawConstantsRing_ = std::make_unique<UniformBufferRing>(drawConstantsBinding, sizeof(DrawConstants));
+        lightConstants_.resize(gLights.size());
+
+        // the water waves move the vertices in the vertex shader, so water surfaces are never culled. The other
+        // objects get their leaves once their meshes are loaded.
+        for(size_t i = 0; i < m_sceneObjects.size(); ++i){
+            SceneObject* so = m_sceneObjects[i];
+            if (!so->hasMesh()) continue;
+            if (so->getShaderMode() == SceneObject::tShaderMode::WATER) {
+                unculledObjects_.push_back(static_cast<std::uint32_t>(i));
+                continue;
+            }
+            so->setBoundingVolumeHierarchy(&objectBvh_, static_cast<std::uint32_t>(i));
+            pendingBounds_.push_back(so);
+        }
+        lightLeaves_.assign(gLights.size(), -1);
+        drawRecords_.assign(m_sceneObjects.size(), noRecord);
 
-        getLightUniformLocations();
 		initShadowMapping();
 		initPostProcessing();
     }
@@ -243,6 +288,7 @@ namespace cg1 {
         VPMatrix_ = camera.getProjMatrix() * camera.getViewMatrix();
         viewMatrix_ = camera.getViewMatrix();
         camPos_ = camera.getPosition();
+        lodPixelScale_ = camera.getProjMatrix()[1][1] * 0.5f * config::windowHeight;
         lastUpdate_ = currentTime_;
         currentTime_ = currentTime;
     }
@@ -264,6 +310,16 @@ namespace cg1 {
 
             ss << "Framerate: " << (int)lastFPS_ << " FPS";
             ImGui::Text(ss.str().c_str());
+            unsigned int numPendingAssets = AssetLoader::getInstance().getNumPending();
+            if (numPendingAssets > 0)
+                ImGui::Text("Loading assets: %u", numPendingAssets);
+            else {
+                AssetLoadStatistics loadStatistics = AssetLoader::getInstance().getLastStatistics();
+                ImGui::Text("Assets loaded in %.2f s (load %.2f s, upload %.2f s)", loadStatistics.totalTime,
+                    loadStatistics.loadTime, loadStatistics.uploadTime);
+                ImGui::Text("Load time: decode %.2f s, compress %.2f s", loadStatistics.decodeTime,
+                    loadStatistics.compressTime);
+            }
             ImGui::Text("General Settings");
             ImGui::Checkbox("Enable Phong Lighting",&enableLighting_);
 			ImGui::Checkbox("Enable Normalmapping", &enableNormalMapping_);
@@ -285,16 +341,61 @@ namespace cg1 {
             ImGui::RadioButton("Sharp Filter",&postProcMode_,3);
             ImGui::RadioButton("RGB-Max Filter",&postProcMode_,4);
             ImGui::RadioButton("Intensity-Max Filter",&postProcMode_,5);
+            ImGui::Text("Level of Detail");
+            ImGui::SliderFloat("Max. error (px)", &lodPixelError_, 0.0f, 16.0f);
+            ImGui::SliderFloat("Max. shadow error (px)", &shadowLodPixelError_, 0.0f, 32.0f);
+            ImGui::Checkbox("Enable Cluster Culling", &enableClusterCulling_);
+            ImGui::Checkbox("Sort Draws", &enableDrawSorting_);
+            ImGui::Checkbox("Enable Frustum Culling", &enableFrustumCulling_);
+            ImGui::Text("Object hierarchy: %zu objects, height %d", objectBvh_.size(), objectBvh_.getHeight());
+            if (ImGui::CollapsingHeader("Hierarchy Queries")) {
+                // the view direction is the negated third row of the view matrix
+                glm::vec3 viewDirection = -glm::vec3(viewMatrix_[0][2], viewMatrix_[1][2], viewMatrix_[2][2]);
+                BoundingVolumeHierarchy::RayHit centerHit = objectBvh_.intersectRay(camPos_, viewDirection,
+                    std::numeric_limits<float>::max());
+                if (centerHit.index != BoundingVolumeHierarchy::invalidIndex)
+                    ImGui::Text("Object in view center: %u (%.1f)", centerHit.index, centerHit.distance);
+                BoundingVolumeHierarchy::RayHit nearestLight = lightBvh_.findNearest(camPos_, std::numeric_limits<float>::max());
+                if (nearestLight.index != BoundingVolumeHierarchy::invalidIndex)
+                    ImGui::Text("Nearest light: %u (%.1f)", nearestLight.index, nearestLight.distance);
+            }
+            for (size_t i = 0; i < passCulling_.size(); ++i) {
+                const CullingStatistics& culling = passCulling_[i];
+                if (i == 0) ImGui::Text("Camera pass:");
+                else ImGui::Text("Shadow pass %zu:", i - 1);
+                ImGui::SameLine();
+                ImGui::Text("objects %u / %u, sub-meshes %u / %u", culling.numVisibleObjects, culling.numObjects,
+                    culling.numVisibleSubMeshes, culling.numSubMeshes);
+            }
+            ImGui::Text("Clusters drawn: %u / %u", numVisibleClusters_, numClusters_);
+            ImGui::Text("Shader variants compiled: %zu", programVariants_->getNumPrograms());
+            const auto& stateStatistics = GLStateCache::getInstance().getLastFrameStatistics();
+            ImGui::Text("GL state calls skipped: %u / %u", stateStatistics.numSkippedCalls,
+                stateStatistics.numSkippedCalls + stateStatistics.numIssuedCalls);
+            if (ImGui::CollapsingHeader("Assets")) {
+                std::size_t totalMemorySize = 0;
+                for (const auto& info : AssetRegistry::getInstance().getAssetInfos()) {
+                    ImGui::Text("%s %s: %ld refs, %zu KB%s", info.type, info.name.c_str(), info.useCount,
+                        info.memorySize / 1024, info.loaded ? "" : " (loading)");
+                    totalMemorySize += info.memorySize;
+                }
+                ImGui::Text("Total: %zu KB", totalMemorySize / 1024);
+            }
             ImGui::End();
-        }
 
-        glUseProgram(program_->getProgramId());
-        printOpenGLError();
-        //////////////////////////////////////////////////////////////////////////////////////////////////////////
-        // Update general uniforms
-        //////////////////////////////////////////////////////////////////////////////////////////////////////////
-        glUniformMatrix4fv(matVUniformLocation_, 1, GL_FALSE, reinterpret_cast<GLfloat*>(&viewMatrix_));
-        printOpenGLError();
+            TextureStreamer& streamer = TextureStreamer::getInstance();
+            ImGui::SetNextWindowPos(ImVec2(520, 10), ImGuiSetCond_FirstUseEver);
+            ImGui::SetNextWindowSize(ImVec2(300, 120), ImGuiSetCond_FirstUseEver);
+            ImGui::Begin("Texture Streaming");
+            int memoryBudget = static_cast<int>(streamer.getMemoryBudget() / (1024 * 1024));
+            if (ImGui::SliderInt("Budget (MB)", &memoryBudget, 1, 512))
+                streamer.setMemoryBudget(static_cast<std::size_t>(memoryBudget) * 1024 * 1024);
+            ImGui::Text("Allocated: %zu KB", streamer.getResidentSize() / 1024);
+            ImGui::Text("Queue depth: %zu", streamer.getQueueDepth());
+            ImGui::Text("Streamed textures: %zu", streamer.getNumTextures());
+            ImGui::Text("Texture arrays: %zu", TextureArena::getInstance().getNumPools());
+            ImGui::End();
+        }
 
         // Rotate sun and moon
 		for(int i = 0; i < 2; i++){
@@ -304,7 +405,6 @@ namespace cg1 {
 				gLights.at(i)->position = glm::rotateZ(gLights.at(i)->position,(currentTime_-lastUpdate_)*0.1f);
 		}
 
-        enableLighting(enableLighting_);
         if(enableLighting_){
 
 			for(int i = 0; i < m_sceneObjects.size();i++){
@@ -318,25 +418,22 @@ namespace cg1 {
 			}
         }
 		// Update Light
-		updateLight(viewMatrix_);
-
-        //////////////////////////////////////////////////////////////////////////////////////////////////////////
-        // Update Scene properties
-        //////////////////////////////////////////////////////////////////////////////////////////////////////////
-        glUniform1f(timeUniformLocation_,currentTime_);
-        glUniform1i(waterModeUniformLocation_,waterMode_);
-        glUniform1i(tex0UniformLocation_,0);
-		glUniform1i(tex1UniformLocation_, 1);
-
-		glUniform1i(enablePostProcUniformLocation_,0);
+		updateFrameConstants();
+		updateBoundingVolumes();
+
+		// all passes are culled before drawing, so only the drawn objects get draw constants
+		passCulling_.assign(enableShadowMapping_ ? gLights.size() + 1 : 1, CullingStatistics());
+		passVisibleObjects_.resize(passCulling_.size());
+		for(std::uint32_t i : drawnObjects_) drawRecords_[i] = noRecord;
+		drawnObjects_.clear();
+		for(size_t i = 1; i < passVisibleObjects_.size(); ++i)
+			cullSceneObjects(calculateDepthVPMat(static_cast<int>(i - 1)), passVisibleObjects_[i]);
+		cullSceneObjects(VPMatrix_, passVisibleObjects_[0]);
+		updateDrawConstants();
 
         //////////////////////////////////////////////////////////////////////////////////////////////////////////
         // Render Scene
         //////////////////////////////////////////////////////////////////////////////////////////////////////////
-    	glUniform1i(depthTextureArrayUniformLocation_,depthTextureSlot);
-
-		enableNormalMapping(enableNormalMapping_);
-        enableShadowMapping(enableShadowMapping_, enableSmoothShadows_);
         if(enableShadowMapping_){
         	// Shadow mapping: Render to depth buffer
         	renderDepthImage();
@@ -344,101 +441,228 @@ namespace cg1 {
 
         renderRealImage();
 
-		glUniform1i(enablePostProcUniformLocation_,enablePostProc_?1:0);
-        printOpenGLError();
-
         if(enablePostProc_){
         	renderPostProcImage();
         }
 
-        glUseProgram(0);
+        // the program stays in use for the next frame, but its pass uniforms need to be set again.
+        currentProgram_ = nullptr;
+        drawConstantsRing_->endFrame();
     }
 
     /**
-     *  Updates uniforms for light calculations in the shader.
+     *  Binds the variant of the scenes GPU program for a pass and the current settings. When the variant changes,
+     *  the uniforms of the pass are set, the frame constants and lights come from the uniform buffers.
+     *  @param pass the pass to render.
+     *  @param water whether the object is an animated water surface.
      */
-    void Scene::updateLight(glm::mat4 viewMat)
+    void Scene::useProgram(Pass pass, bool water)
     {
-    	glUniform1i(numLightsUniformLocation_, (int)gLights.size());
+        // features a pass does not use are fixed to 0, so the passes share as few variants as possible
+        bool color = pass == Pass::Color;
+        bool shadows = color && enableLighting_ && enableShadowMapping_;
+        GPUProgram& program = programVariants_->getProgram({ static_cast<unsigned int>(pass),
+            pass != Pass::PostProcessing && water ? 1u : 0u,
+            color && enableLighting_ ? 1u : 0u,
+            shadows ? 1u : 0u,
+            shadows ? static_cast<unsigned int>(enableSmoothShadows_) : 0u,
+            color && enableNormalMapping_ ? 1u : 0u,
+            pass == Pass::PostProcessing ? static_cast<unsigned int>(postProcMode_) : 0u });
+        if (&program == currentProgram_) return;
+
+        currentProgram_ = &program;
+        GLStateCache::getInstance().useProgram(program.getProgramId());
+        printOpenGLError();
+        auto uniforms = programUniforms_.find(&program);
+        if (uniforms == programUniforms_.end()) {
+            uniforms = programUniforms_.emplace(&program, ProgramUniforms()).first;
+            loadUniforms(program, uniforms->second);
+        }
+        uniforms_ = &uniforms->second;
 
-    	for(size_t i = 0; i < gLights.size(); ++i){
-    		glm::vec4 posViewSpace = viewMat*gLights[i]->position;
-    		glm::vec3 dirViewSpace = glm::mat3(viewMat)*gLights[i]->coneDirection;
-    		glUniform4fv(gLights[i]->positionLoc, 1, reinterpret_cast<GLfloat*>(&posViewSpace));
-    		printOpenGLError();
-    		glUniform3fv(gLights[i]->intensitiesLoc ,1, reinterpret_cast<GLfloat*>(&gLights[i]->intensities));
-    		printOpenGLError();
-    		glUniform1f(gLights[i]->att_c1Loc, gLights[i]->att_c1);
-    		printOpenGLError();
-    		glUniform1f(gLights[i]->att_c2Loc, gLights[i]->att_c2);
-    		printOpenGLError();
-    		glUniform1f(gLights[i]->att_c3Loc, gLights[i]->att_c3);
-    		printOpenGLError();
-    		glUniform1f(gLights[i]->ambientCoefficientLoc, gLights[i]->ambientCoefficient);
-    		printOpenGLError();
-    		glUniform1f(gLights[i]->coneAngleLoc, gLights[i]->coneAngle);
-    		printOpenGLError();
-    		glUniform3fv(gLights[i]->coneDirectionLoc,1, reinterpret_cast<GLfloat*>(&dirViewSpace));
-    		printOpenGLError();
-    	}
+        uniforms_->matVP.set(passVP_);
+        uniforms_->tex0.set(0);
+        uniforms_->tex1.set(1);
+        uniforms_->depthTextureArray.set(depthTextureSlot);
+        uniforms_->texColorPostProc.set(textureSlotPostProc_);
+        printOpenGLError();
     }
 
-    std::string Scene::getLightUniformName(const char* propertyName, size_t lightIndex)
+    /**
+     *  Sets the view-projection matrix of the current pass.
+     *  @param vp the view-projection matrix.
+     */
+    void Scene::setPassVP(const glm::mat4& vp)
     {
-        std::ostringstream ss;
-        ss << "allLights[" << lightIndex << "]." << propertyName;
-        return ss.str();
+        passVP_ = vp;
+        if (currentProgram_ != nullptr)
+            uniforms_->matVP.set(passVP_);
     }
-    void Scene::updateMaterial(float shininess, glm::vec3 specularColor)
+
+    /**
+     *  Fills the frame constants and lights in their std140 layout and uploads each with a single buffer update.
+     */
+    void Scene::updateFrameConstants()
     {
-    	glUniform1f(materialShininessUniformLocation_,shininess);
-		printOpenGLError();
-    	glUniform3fv(materialSpecularColUniformLocation_,1, reinterpret_cast<GLfloat*>(&specularColor));
-		printOpenGLError();
+    	FrameConstants frameConstants;
+    	frameConstants.matV = viewMatrix_;
+    	frameConstants.time = currentTime_;
+    	frameConstants.waterMode = waterMode_;
+    	frameConstantsBuffer_->upload(&frameConstants, sizeof(frameConstants));
+
+    	// Shadow lookups use the light matrices biased to texture space
+		glm::mat4 biasMatrix(
+		 0.5, 0.0, 0.0, 0.0,
+		 0.0, 0.5, 0.0, 0.0,
+		 0.0, 0.0, 0.5, 0.0,
+		 0.5, 0.5, 0.5, 1.0
+		 );
+    	for(size_t i = 0; i < gLights.size(); ++i){
+    		LightConstants& light = lightConstants_[i];
+    		light.matDepthVP = enableShadowMapping_ ? biasMatrix*calculateDepthVPMat(i) : glm::mat4(1.0f);
+    		light.position = viewMatrix_*gLights[i]->position;
+    		light.intensities = gLights[i]->intensities;
+    		light.att_c1 = gLights[i]->att_c1;
+    		light.att_c2 = gLights[i]->att_c2;
+    		light.att_c3 = gLights[i]->att_c3;
+    		light.ambientCoefficient = gLights[i]->ambientCoefficient;
+    		light.coneAngle = gLights[i]->coneAngle;
+    		light.coneDirection = glm::mat3(viewMatrix_)*gLights[i]->coneDirection;
+    	}
+    	lightsBuffer_->upload(lightConstants_);
+    	printOpenGLError();
     }
 
-    void Scene::renderSceneObjects(bool onlyDepth)
+    /**
+     *  Fills the draw constants of the objects drawn in any pass of the frame and uploads them into the next
+     *  segment of the ring. All passes of the frame draw an object with the same record.
+     */
+    void Scene::updateDrawConstants()
     {
-    	for(int i = 0; i < m_sceneObjects.size();i++){
-//    		std::cout << "render mesh " << i << std::endl;
-    		SceneObject* so = m_sceneObjects.at(i);
-
-    		SceneObject::tShaderMode mode = so->getShaderMode();
-    		if(onlyDepth){
-    			switch (mode) {
-				case SceneObject::tShaderMode::DEFAULT:
-					mode = SceneObject::tShaderMode::DEFAULT_DEPTH;
-					break;
-				case SceneObject::tShaderMode::WATER:
-					mode = SceneObject::tShaderMode::WATER_DEPTH;
-					break;
-				default:break;
-				}
-    		}
+    	drawConstants_.resize(drawnObjects_.size());
+    	for(size_t i = 0; i < drawnObjects_.size(); ++i){
+    		SceneObject* so = m_sceneObjects[drawnObjects_[i]];
+    		DrawConstants& draw = drawConstants_[i];
+    		draw.matModel = so->getModelMatrix();
+    		draw.matNormal = glm::mat4(glm::mat3(draw.matModel));
+    		draw.materialSpecularColor = so->getSpecularColor();
+    		draw.materialShininess = so->getShininess();
+    		draw.textureLayers = so->getTextureLayers();
+    		draw.hasNormalMap = so->getNormalMappingStatus();
+    		draw.packedVertices = so->hasPackedVertices() ? 1 : 0;
+    	}
+    	drawConstantsRing_->upload(drawConstants_);
+    	printOpenGLError();
+    }
+
+    /**
+     *  Adds the objects whose meshes finished loading to the object hierarchy and moves the lights in the light
+     *  hierarchy. Moved objects update their leaves themselves.
+     */
+    void Scene::updateBoundingVolumes()
+    {
+    	pendingBounds_.erase(std::remove_if(pendingBounds_.begin(), pendingBounds_.end(),
+    			[](SceneObject* so) { return so->updateBounds(); }), pendingBounds_.end());
 
-    		if(!enableWater_){
-    			switch (mode) {
-				case SceneObject::tShaderMode::WATER:
-				case SceneObject::tShaderMode::WATER_DEPTH:
-					mode = SceneObject::tShaderMode::DEFAULT;
-					break;
-				default:break;
-				}
+    	for(size_t i = 0; i < gLights.size(); ++i){
+    		const glm::vec4& position = gLights[i]->position;
+    		int& leaf = lightLeaves_[i];
+    		if (position.w == 0.0f) {
+    			if (leaf >= 0) lightBvh_.remove(leaf);
+    			leaf = -1;
+    			continue;
     		}
+    		BoundingVolume volume;
+    		volume.center = glm::vec3(position) / position.w;
+    		volume.radius = 0.0f;
+    		if (leaf < 0) leaf = lightBvh_.insert(volume, static_cast<std::uint32_t>(i));
+    		else lightBvh_.update(leaf, volume);
+    	}
+    }
 
-			glUniform1i(hasNormalMapUniformLocation_, so->getNormalMappingStatus());
-            glUniform1i(shaderModeUniformLocation_, mode);
-    		printOpenGLError();
-            glm::mat4 mm = so->getModelMatrix();
-            glUniformMatrix4fv(matModelUniformLocation_, 1, GL_FALSE, reinterpret_cast<GLfloat*>(&mm));
-    		printOpenGLError();
-            glm::mat4 normalMatrix = glm::mat4(glm::mat3(mm));
-            glUniformMatrix4fv(matNormalUniformLocation_, 1, GL_FALSE, reinterpret_cast<GLfloat*>(&normalMatrix));
-    		printOpenGLError();
-            updateMaterial(so->getShininess(),so->getSpecularColor());
-            so->bindTexturesAndDrawMesh();
+    /**
+     *  Collects the objects inside of a view frustum and gives the ones not drawn yet in this frame the next draw
+     *  constants record.
+     *  @param viewProjection the view projection matrix of the pass.
+     *  @param visible the list the visible objects are written to.
+     */
+    void Scene::cullSceneObjects(const glm::mat4& viewProjection, std::vector<BoundingVolumeHierarchy::VisibleLeaf>& visible)
+    {
+    	// objects are culled in world space through the hierarchy, the sub-meshes of objects crossing the frustum
+    	// in object space while drawing them
+    	visible.clear();
+    	if (enableFrustumCulling_) {
+    		objectBvh_.cull(Frustum(viewProjection), visible);
+    		for(std::uint32_t i : unculledObjects_) visible.push_back(BoundingVolumeHierarchy::VisibleLeaf{ i, false });
+    	} else {
+    		for(size_t i = 0; i < m_sceneObjects.size(); ++i)
+    			visible.push_back(BoundingVolumeHierarchy::VisibleLeaf{ static_cast<std::uint32_t>(i), false });
+    	}
+    	for(const auto& leaf : visible){
+    		if (drawRecords_[leaf.index] != noRecord) continue;
+    		drawRecords_[leaf.index] = static_cast<std::uint32_t>(drawnObjects_.size());
+    		drawnObjects_.push_back(leaf.index);
     	}
     }
+
+    void Scene::renderSceneObjects(bool onlyDepth, ClusterCulling& view, std::size_t passIndex)
+    {
+    	// shadow passes may use coarser levels of detail than the camera pass
+    	LodSelection lodSelection;
+    	lodSelection.cameraPosition = camPos_;
+    	lodSelection.pixelScale = lodPixelScale_;
+    	lodSelection.maxPixelError = onlyDepth ? shadowLodPixelError_ : lodPixelError_;
+    	lodSelection.pass = onlyDepth ? LodSelection::Shadow : LodSelection::Camera;
+    	Pass pass = onlyDepth ? Pass::Depth : Pass::Color;
+    	const glm::vec4& viewOrigin = view.viewOrigin;
+
+    	const std::vector<BoundingVolumeHierarchy::VisibleLeaf>& visibleObjects = passVisibleObjects_.at(passIndex);
+    	CullingStatistics& culling = passCulling_.at(passIndex);
+    	culling.numObjects = static_cast<unsigned int>(m_sceneObjects.size());
+    	culling.numVisibleObjects = static_cast<unsigned int>(visibleObjects.size());
+    	SubMeshCulling subMeshCulling;
+    	subMeshCulling.viewProjection = view.viewProjection;
+
+    	// the draws are grouped by program variant and array textures, each group is drawn front to back. Materials
+    	// are part of the draw constants and cost no state change, so they do not split the groups.
+    	renderQueue_.clear();
+    	for(const auto& visible : visibleObjects){
+    		SceneObject* so = m_sceneObjects[visible.index];
+    		bool isWater = enableWater_ && so->getShaderMode() == SceneObject::tShaderMode::WATER;
+    		glm::vec3 position(so->getModelMatrix()[3]);
+    		// directional lights have no origin, their draws are ordered along the light direction
+    		float depth = viewOrigin.w == 0.0f ? glm::dot(position, glm::vec3(viewOrigin))
+    				: glm::distance(position, glm::vec3(viewOrigin));
+    		// the depth passes do not sample the textures, so their bindings do not matter
+    		unsigned int textureSet = onlyDepth ? 0 : getTextureSet(so->getTexturePools());
+    		// objects completely inside of the frustum skip the sub-mesh tests, the index is marked in the top bit
+    		std::uint32_t index = visible.contained ? (visible.index | containedFlag) : visible.index;
+    		renderQueue_.push(RenderQueue::makeKey(static_cast<unsigned int>(pass), isWater ? 1 : 0, textureSet, 0, depth), index);
+    	}
+    	if (enableDrawSorting_) renderQueue_.sort();
+
+    	for(const auto& item : renderQueue_.getItems()){
+    		std::uint32_t objectIndex = item.index & ~containedFlag;
+    		bool contained = (item.index & containedFlag) != 0;
+    		SceneObject* so = m_sceneObjects[objectIndex];
+
+    		// the water waves are evaluated per vertex, so the water always uses the full mesh and is never culled
+    		// against the bounds of its flat rest positions
+    		bool isWater = enableWater_ && so->getShaderMode() == SceneObject::tShaderMode::WATER;
+    		useProgram(pass, isWater);
+
+            drawConstantsRing_->bind(drawRecords_[objectIndex]);
+            // the depth passes do not sample the textures, so their bindings are left alone
+            if (!onlyDepth) {
+                so->requestTextureLevels(lodSelection);
+                so->bindTextures();
+            }
+            so->drawMesh(isWater ? nullptr : &lodSelection, enableClusterCulling_ && !isWater ? &view : nullptr,
+                enableFrustumCulling_ && !contained && !isWater ? &subMeshCulling : nullptr);
+    	}
+    	culling.numSubMeshes = subMeshCulling.numSubMeshes;
+    	culling.numVisibleSubMeshes = subMeshCulling.numVisibleSubMeshes;
+    }
     void Scene::initShadowMapping()
     {
     	std::cout << "Initialize shadow mapping ..." << std::endl;
@@ -448,9 +672,9 @@ namespace cg1 {
     	// Generate texture array
 		glGenTextures(1, &depthTextureArrayId_);
         printOpenGLError();
-        glActiveTexture(GL_TEXTURE0 + depthTextureSlot);
+        GLStateCache::getInstance().activeTexture(depthTextureSlot);
         printOpenGLError();
-		glBindTexture(GL_TEXTURE_2D_ARRAY, depthTextureArrayId_);
+		GLStateCache::getInstance().bindTexture(depthTextureSlot, GL_TEXTURE_2D_ARRAY, depthTextureArrayId_);
         printOpenGLError();
 		glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT24, shadowMapSize_, shadowMapSize_, gLights.size());
         printOpenGLError();
@@ -473,7 +697,7 @@ namespace cg1 {
 	        printOpenGLError();
 
 			// Attach a depth buffer (our texture) to the framebuffer
-			glBindFramebuffer(GL_FRAMEBUFFER, fbId);
+			GLStateCache::getInstance().bindFramebuffer(fbId);
 	        printOpenGLError();
 			glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTextureArrayId_, 0, i);		// Attach texture i of texture array to framebuffer
 	        printOpenGLError();
@@ -491,7 +715,7 @@ namespace cg1 {
     	}
         std::cout << "Done." << std::endl;
 
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		GLStateCache::getInstance().bindFramebuffer(0);
         printOpenGLError();
 
 		std::cout << "shadowMapping initialized: " << frameBufferId_.size() << " Buffers created!" << std::endl;
@@ -502,83 +726,51 @@ namespace cg1 {
 		for(int i = 0; i < gLights.size(); i++){
 
 			glm::mat4 depthVPMatrix = calculateDepthVPMat(i);
-			std::ostringstream ss;
-			ss << "matDepthVP[" << i << "]";
-
-			glUniformMatrix4fv(matVPUniformLocation_, 1, GL_FALSE, reinterpret_cast<GLfloat*>(&depthVPMatrix));
+			setPassVP(depthVPMatrix);
 
 			// Switch buffer to depth buffer
-			glBindFramebuffer(GL_FRAMEBUFFER, frameBufferId_.at(i));
+			GLStateCache::getInstance().bindFramebuffer(frameBufferId_.at(i));
 	        printOpenGLError();
-			glViewport(0,0, shadowMapSize_, shadowMapSize_);
+			GLStateCache::getInstance().viewport(0,0, shadowMapSize_, shadowMapSize_);
 	        printOpenGLError();
 			glClear(GL_DEPTH_BUFFER_BIT);
 	        printOpenGLError();
-			// Render scene into that buffer
-			renderSceneObjects(true);
+			// Render scene into that buffer, clusters facing away from the light are culled like back faces
+			ClusterCulling clusterCulling;
+			clusterCulling.viewProjection = depthVPMatrix;
+			if (gLights.at(i)->position.w == 0)
+				clusterCulling.viewOrigin = glm::vec4(glm::normalize(-glm::vec3(gLights.at(i)->position)), 0.0f);
+			else
+				clusterCulling.viewOrigin = glm::vec4(glm::vec3(gLights.at(i)->position), 1.0f);
+			renderSceneObjects(true, clusterCulling, i + 1);
 		}
 
     }
     void Scene::renderRealImage()
     {
         if(enablePostProc_){
-			glBindFramebuffer(GL_FRAMEBUFFER, frameBufferPostProc_);
+			GLStateCache::getInstance().bindFramebuffer(frameBufferPostProc_);
 			printOpenGLError();
         }else{
-			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			GLStateCache::getInstance().bindFramebuffer(0);
 			printOpenGLError();
         }
-    	glViewport(0,0, config::windowWidth, config::windowHeight);
+    	GLStateCache::getInstance().viewport(0,0, config::windowWidth, config::windowHeight);
         printOpenGLError();
 		glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
         printOpenGLError();
-		glActiveTexture(GL_TEXTURE0 + depthTextureSlot);
+		GLStateCache::getInstance().bindTexture(depthTextureSlot, GL_TEXTURE_2D_ARRAY, depthTextureArrayId_);
         printOpenGLError();
-		glBindTexture(GL_TEXTURE_2D_ARRAY, depthTextureArrayId_);
-        printOpenGLError();
-
-        glUniformMatrix4fv(matVPUniformLocation_, 1, GL_FALSE, reinterpret_cast<GLfloat*>(&VPMatrix_));
 
-        if(enableShadowMapping_){
-			for(int i = 0; i < gLights.size(); i++){
-				glm::mat4 depthVPMatrix = calculateDepthVPMat(i);
-				glm::mat4 biasMatrix(
-				 0.5, 0.0, 0.0, 0.0,
-				 0.0, 0.5, 0.0, 0.0,
-				 0.0, 0.0, 0.5, 0.0,
-				 0.5, 0.5, 0.5, 1.0
-				 );
+        setPassVP(VPMatrix_);
 
-				 glm::mat4 depthBiasMVP = biasMatrix*depthVPMatrix;
+        ClusterCulling clusterCulling;
+        clusterCulling.viewProjection = VPMatrix_;
+        clusterCulling.viewOrigin = glm::vec4(camPos_, 1.0f);
+        renderSceneObjects(false, clusterCulling, 0);
+        numClusters_ = clusterCulling.numClusters;
+        numVisibleClusters_ = clusterCulling.numVisibleClusters;
 
-				std::ostringstream ss;
-				ss << "matDepthVP[" << i << "]";
-
-				glUniformMatrix4fv(glGetUniformLocation(program_->getProgramId(), ss.str().c_str()), 1, GL_FALSE, reinterpret_cast<GLfloat*>(&depthBiasMVP));
-			}
-        }
-        renderSceneObjects();
-
-    }
-    void Scene::enableShadowMapping(bool enable, int smooth)
-    {
-        glUniform1i(enableShadowMappingUniformLocation_, enable?1:0);
-        glUniform1i(enableSmoothShadowsUniformLocation_, smooth);
-		printOpenGLError();
-        enableShadowMapping_ = enable;
-    }
-
-	void Scene::enableNormalMapping(bool enable)
-	{
-		glUniform1i(enableNormalMappingUniformLocation_, enable ? 1 : 0);
-		printOpenGLError();
-	}
-
-    void Scene::enableLighting(bool enable)
-    {
-        glUniform1i(enableLightingUniformLocation_, enable?1:0);
-		printOpenGLError();
-        enableLighting_ = enable;
     }
     glm::mat4 Scene::calculateDepthVPMat(int lightIdx)
     {
@@ -603,30 +795,33 @@ namespace cg1 {
 		return depthVPMatrix;
 
     }
-    void Scene::getLightUniformLocations()
+    /**
+     *  Requests the uniform handles of a variant of the scenes GPU program and binds its uniform blocks. The handles
+     *  are resolved by the program, uniforms the variant does not use are ignored when set.
+     *  @param program the variant.
+     *  @param uniforms the handles to fill.
+     */
+    void Scene::loadUniforms(GPUProgram& program, ProgramUniforms& uniforms)
     {
-    	numLightsUniformLocation_ = glGetUniformLocation(program_->getProgramId(), "numLights");
-    	for(size_t i = 0; i < gLights.size(); ++i){
-    		Light* l = gLights.at(i);
-    		l->positionLoc = glGetUniformLocation(program_->getProgramId(), getLightUniformName("position", i).c_str());
-    		l->intensitiesLoc = glGetUniformLocation(program_->getProgramId(), getLightUniformName("intensities", i).c_str());
-    		l->att_c1Loc = glGetUniformLocation(program_->getProgramId(), getLightUniformName("att_c1", i).c_str());
-    		l->att_c2Loc = glGetUniformLocation(program_->getProgramId(), getLightUniformName("att_c2", i).c_str());
-    		l->att_c3Loc = glGetUniformLocation(program_->getProgramId(), getLightUniformName("att_c3", i).c_str());
-    		l->ambientCoefficientLoc = glGetUniformLocation(program_->getProgramId(), getLightUniformName("ambientCoefficient", i).c_str());
-    		l->coneAngleLoc = glGetUniformLocation(program_->getProgramId(), getLightUniformName("coneAngle", i).c_str());
-    		l->coneDirectionLoc = glGetUniformLocation(program_->getProgramId(), getLightUniformName("coneDirection", i).c_str());
-    	}
+    	uniforms.matVP = program.getUniform<glm::mat4>("matVP");
+    	uniforms.tex0 = program.getUniform<int>("tex");
+    	uniforms.tex1 = program.getUniform<int>("normalTex");
+    	uniforms.depthTextureArray = program.getUniform<int>("shadowTexArray");
+    	uniforms.texColorPostProc = program.getUniform<int>("postProcTexColor");
+    	program.setUniformBlockBinding("FrameConstants", frameConstantsBuffer_->getBinding());
+    	program.setUniformBlockBinding("Lights", lightsBuffer_->getBinding());
+    	program.setUniformBlockBinding("DrawConstants", drawConstantsRing_->getBinding());
     }
     void Scene::initPostProcessing(){
 
 		  glGenFramebuffers(1, &frameBufferPostProc_);
 	        printOpenGLError();
-		  glBindFramebuffer(GL_FRAMEBUFFER, frameBufferPostProc_);
+		  GLStateCache::getInstance().bindFramebuffer(frameBufferPostProc_);
 	        printOpenGLError();
 
 		  glGenTextures(1, &texColorPostProc_);
-		  glBindTexture(GL_TEXTURE_2D, texColorPostProc_);
+		  GLStateCache::getInstance().activeTexture(textureSlotPostProc_);
+		  GLStateCache::getInstance().bindTexture(textureSlotPostProc_, GL_TEXTURE_2D, texColorPostProc_);
 		  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 		  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 		  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -654,30 +849,23 @@ namespace cg1 {
 			exit(-1);
 		  }
 
-		  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		  GLStateCache::getInstance().bindFramebuffer(0);
     }
     void Scene::renderPostProcImage()
     {
-    	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    	GLStateCache::getInstance().bindFramebuffer(0);
 		printOpenGLError();
-		glViewport(0,0, config::windowWidth, config::windowHeight);
+		GLStateCache::getInstance().viewport(0,0, config::windowWidth, config::windowHeight);
 		printOpenGLError();
 		glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
 		printOpenGLError();
 
-		glUniform1i(texColorPostProcUniformLocation_, textureSlotPostProc_);
-        printOpenGLError();
-
-		glUniform1i(postProcModeUniformLocation_, postProcMode_);
-        printOpenGLError();
-
-		glActiveTexture(GL_TEXTURE0 + textureSlotPostProc_);
-		printOpenGLError();
-		glBindTexture(GL_TEXTURE_2D, texColorPostProc_);
+		GLStateCache::getInstance().bindTexture(textureSlotPostProc_, GL_TEXTURE_2D, texColorPostProc_);
 		printOpenGLError();
 
         glm::mat4 orthoProj = glm::ortho<float>(-1, 1, -1, 1, -1, 1);
-		glUniformMatrix4fv(matVPUniformLocation_, 1, GL_FALSE, reinterpret_cast<GLfloat*>(&orthoProj));
+		setPassVP(orthoProj);
+		useProgram(Pass::PostProcessing, false);
 
 		planeMesh_->DrawComplete();
     }
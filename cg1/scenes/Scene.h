@@ -4,15 +4,23 @@
 #include <glm/glm.hpp>
 #include "core/Camera.h"
 #include "core/FreeCamera.h"
+#include "gfx/BoundingVolumeHierarchy.h"
+#include "gfx/RenderQueue.h"
+#include "gfx/Uniform.h"
+#include <unordered_map>
 
 namespace cg1 {
 
     class GPUProgram;
+    class GPUProgramVariants;
+    class UniformBuffer;
+    class UniformBufferRing;
     class Camera;
     class Mesh;
     class Texture;
     class SceneObject;
     class FlashLight;
+    struct ClusterCulling;
 
     // TODO: select the camera model for the application here. [1/13/2016 Sebastian Maisch]
     // also: if camera model is free, GUI should be disabled.
@@ -32,32 +40,88 @@ namespace cg1 {
 
         struct Light {
             glm::vec4 position;
-            GLint positionLoc;
             glm::vec3 intensities; //a.k.a. the color of the light
-            GLint intensitiesLoc;
             float att_c1;
-            GLint att_c1Loc;
             float att_c2;
-            GLint att_c2Loc;
             float att_c3;
-            GLint att_c3Loc;
             float ambientCoefficient;
-            GLint ambientCoefficientLoc;
             float coneAngle;
-            GLint coneAngleLoc;
             glm::vec3 coneDirection;
-            GLint coneDirectionLoc;
+        };
+
+        // Private types
+    private:
+        /** The passes rendered with the scenes GPU program, matches PASS_* in the shaders. */
+        enum class Pass : unsigned int { Depth = 0, Color = 1, PostProcessing = 2 };
+
+        /** Mirror of the FrameConstants uniform block in std140 layout. */
+        struct FrameConstants {
+            glm::mat4 matV;
+            float time;
+            int waterMode;
+            float padding[2];
+        };
+
+        /** Mirror of a light in the Lights uniform block in std140 layout, in view space. */
+        struct LightConstants {
+            glm::mat4 matDepthVP;
+            glm::vec4 position;
+            glm::vec3 intensities;
+            float att_c1;
+            float att_c2;
+            float att_c3;
+            float ambientCoefficient;
+            float coneAngle;
+            glm::vec3 coneDirection;
+            float padding;
+        };
+        /** Mirror of the DrawConstants uniform block in std140 layout. */
+        struct DrawConstants {
+            glm::mat4 matModel;
+            glm::mat4 matNormal;
+            glm::vec3 materialSpecularColor;
+            float materialShininess;
+            glm::ivec2 textureLayers;
+            int hasNormalMap;
+            int packedVertices;
+        };
+        static_assert(sizeof(FrameConstants) == 80, "FrameConstants does not match the std140 layout.");
+        static_assert(sizeof(LightConstants) == 128, "LightConstants does not match the std140 layout.");
+        static_assert(sizeof(DrawConstants) == 160, "DrawConstants does not match the std140 layout.");
+
+        /** The number of objects and sub-meshes tested and drawn in a pass. */
+        struct CullingStatistics {
+            /** Holds the number of objects tested. */
+            unsigned int numObjects = 0;
+            /** Holds the number of objects inside the view frustum. */
+            unsigned int numVisibleObjects = 0;
+            /** Holds the number of sub-meshes tested, those of objects crossing the frustum boundary. */
+            unsigned int numSubMeshes = 0;
+            /** Holds the number of sub-meshes inside the view frustum. */
+            unsigned int numVisibleSubMeshes = 0;
+        };
+
+        /** Uniform handles of one variant of the scenes GPU program. */
+        struct ProgramUniforms {
+            Uniform<glm::mat4> matVP;
+            Uniform<int> tex0;
+            Uniform<int> tex1;
+            Uniform<int> depthTextureArray;
+            Uniform<int> texColorPostProc;
         };
 
         // Private member functions
     private:
-        /* Updates uniforms for light calculations in the shader. */
-        void updateLight(glm::mat4 viewMat);
-        std::string getLightUniformName(const char* propertyName, size_t lightIndex);
-        void updateMaterial(float shininess, glm::vec3 specularColor);
-        void getLightUniformLocations();
+        /* Updates the uniform buffers for the camera and light calculations in the shader. */
+        void updateFrameConstants();
+        void updateDrawConstants();
+        void updateBoundingVolumes();
+        void cullSceneObjects(const glm::mat4& viewProjection, std::vector<BoundingVolumeHierarchy::VisibleLeaf>& visible);
+        void loadUniforms(GPUProgram& program, ProgramUniforms& uniforms);
+        void useProgram(Pass pass, bool water);
+        void setPassVP(const glm::mat4& vp);
 
-        void renderSceneObjects(bool onlyDepth=false);
+        void renderSceneObjects(bool onlyDepth, ClusterCulling& view, std::size_t passIndex);
 
         void initPostProcessing();
 
@@ -67,14 +131,44 @@ namespace cg1 {
         void renderPostProcImage();
         glm::mat4 calculateDepthVPMat(int lightIdx);
 
-		void enableNormalMapping(bool enable);
-        void enableShadowMapping(bool enable, int smooth);
-        void enableLighting(bool enable);
-
         // Private member variables
     private:
-        /** Holds the scenes GPU program. */
-        std::unique_ptr<GPUProgram> program_;
+        /** Holds the variants of the scenes GPU program. */
+        std::unique_ptr<GPUProgramVariants> programVariants_;
+        /** Holds the variant currently in use, nullptr if no program is bound. */
+        GPUProgram* currentProgram_;
+        /** Holds the uniform handles of the variant currently in use. */
+        ProgramUniforms* uniforms_;
+        /** Holds the uniform handles of all variants used so far. */
+        std::unordered_map<const GPUProgram*, ProgramUniforms> programUniforms_;
+        /** Holds the uniform buffer of the FrameConstants block. */
+        std::unique_ptr<UniformBuffer> frameConstantsBuffer_;
+        /** Holds the uniform buffer of the Lights block. */
+        std::unique_ptr<UniformBuffer> lightsBuffer_;
+        /** Holds the CPU copy of the Lights block. */
+        std::vector<LightConstants> lightConstants_;
+        /** Holds the ring the draw constants of each frame are streamed through. */
+        std::unique_ptr<UniformBufferRing> drawConstantsRing_;
+        /** Holds the draw constants of the current frame, one record per object drawn in any pass. */
+        std::vector<DrawConstants> drawConstants_;
+        /** Holds the objects drawn in the current frame in the order of their draw constants records. */
+        std::vector<std::uint32_t> drawnObjects_;
+        /** Holds the draw constants record of each scene object, noRecord if it is not drawn in the current frame. */
+        std::vector<std::uint32_t> drawRecords_;
+        /** Holds the draws of the pass currently rendered. */
+        RenderQueue renderQueue_;
+        /** Holds the bounding volumes of the scene objects in world space, the objects move their leaves themselves. */
+        BoundingVolumeHierarchy objectBvh_;
+        /** Holds the objects whose mesh was not loaded yet when they were added to the hierarchy. */
+        std::vector<SceneObject*> pendingBounds_;
+        /** Holds the indices of the objects that are never culled. */
+        std::vector<std::uint32_t> unculledObjects_;
+        /** Holds the objects inside the view frustum of each pass, the camera pass first, then one per shadow pass. */
+        std::vector<std::vector<BoundingVolumeHierarchy::VisibleLeaf>> passVisibleObjects_;
+        /** Holds the positions of the lights with a position, for lookups of lights near a point. */
+        BoundingVolumeHierarchy lightBvh_;
+        /** Holds the leaf of each light in the light hierarchy, -1 for directional lights. */
+        std::vector<int> lightLeaves_;
 
         std::vector<Light*> gLights;
 
@@ -82,34 +176,13 @@ namespace cg1 {
         float lastUpdate_;
         float lastFPS_;
 
-        /////////////////////////////////////////////////////////////////////////////////////////////////////
-        // Uniforms
-        /////////////////////////////////////////////////////////////////////////////////////////////////////
-        /** Holds uniform name for the model matrix. */
-        GLint matModelUniformLocation_;
-        /** Holds uniform name for the normal matrix. */
-        GLint matNormalUniformLocation_;
-        /** Holds uniform name for the view-projection matrix. */
-        GLint matVPUniformLocation_;
-        /** Holds uniform name for the view matrix. */
-        GLint matVUniformLocation_;
-
-        GLint tex0UniformLocation_;
-		GLint tex1UniformLocation_;
-        GLint waterModeUniformLocation_;
-        GLint shaderModeUniformLocation_;
-        GLint timeUniformLocation_;
-
-        GLint numLightsUniformLocation_;
-        GLint enableLightingUniformLocation_;
-        GLint materialSpecularColUniformLocation_;
-        GLint materialShininessUniformLocation_;
-
         /////////////////////////////////////////////////////////////////////////////////////////////////////
         //
         /////////////////////////////////////////////////////////////////////////////////////////////////////
         /** Holds the VP matrix. */
         glm::mat4 VPMatrix_;
+        /** Holds the view-projection matrix of the current pass. */
+        glm::mat4 passVP_;
         /* Holds the view matrix.*/
         glm::mat4 viewMatrix_;
 
@@ -136,11 +209,6 @@ namespace cg1 {
         int depthTextureSlot;
         std::vector<GLuint> frameBufferId_;
         GLuint depthTextureArrayId_;
-        GLuint depthTextureArrayUniformLocation_;
-        GLint enableShadowMappingUniformLocation_;
-		GLint enableNormalMappingUniformLocation_;
-		GLint hasNormalMapUniformLocation_;
-        GLint enableSmoothShadowsUniformLocation_;
 
         bool enableFlashLights_;
 
@@ -150,11 +218,34 @@ namespace cg1 {
         GLuint frameBufferPostProc_;
         GLuint texColorPostProc_;
         std::unique_ptr<Mesh> planeMesh_;
-        GLuint texColorPostProcUniformLocation_;
-        GLuint enablePostProcUniformLocation_;
-        GLuint postProcModeUniformLocation_;
         int textureSlotPostProc_;
         bool enablePostProc_;
         int postProcMode_;
+
+        /////////////////////////////////////////////////////////////////////////////////////////////////////
+        // Level of Detail
+        /////////////////////////////////////////////////////////////////////////////////////////////////////
+        /** Holds the size in pixels of one world space unit at distance one from the camera. */
+        float lodPixelScale_;
+        /** Holds the largest allowed screen-space error of the camera pass in pixels. */
+        float lodPixelError_;
+        /** Holds the largest allowed screen-space error of the shadow passes in pixels. */
+        float shadowLodPixelError_;
+        /** Holds whether clusters of large meshes are culled against the view frustum and their normal cones. */
+        bool enableClusterCulling_;
+        /** Holds the number of clusters tested in the last camera pass. */
+        unsigned int numClusters_;
+        /** Holds the number of clusters drawn in the last camera pass. */
+        unsigned int numVisibleClusters_;
+
+        /////////////////////////////////////////////////////////////////////////////////////////////////////
+        // Draw Submission
+        /////////////////////////////////////////////////////////////////////////////////////////////////////
+        /** Holds whether the draws are sorted by state and depth, otherwise they are drawn in object order. */
+        bool enableDrawSorting_;
+        /** Holds whether objects and sub-meshes outside of the view frustum are skipped. */
+        bool enableFrustumCulling_;
+        /** Holds the culling statistics of the last frame, the camera pass first, then one per shadow pass. */
+        std::vector<CullingStatistics> passCulling_;
     };
 }
@@ -1,25 +1,59 @@
 #version 330
 #extension GL_EXT_texture_array : enable
 
+/////////////////////////////////////////////////////////////////////////////
+// Variants, the application defines these before compiling
+/////////////////////////////////////////////////////////////////////////////
+#define PASS_DEPTH 0
+#define PASS_COLOR 1
+#define PASS_POST_PROCESSING 2
+#ifndef PASS
+#define PASS PASS_COLOR
+#endif
+#ifndef LIGHTING
+#define LIGHTING 0
+#endif
+#ifndef SHADOW_MAPPING
+#define SHADOW_MAPPING 0
+#endif
+#ifndef SMOOTH_SHADOWS
+#define SMOOTH_SHADOWS 0 // 0: disabled, 1: fast (4 samples), 2: slow (16 samples)
+#endif
+#ifndef NORMAL_MAPPING
+#define NORMAL_MAPPING 0
+#endif
+#ifndef POST_PROC_MODE
+#define POST_PROC_MODE 0 // 0: copy, 1: gaussian, 2: sobel, 3: sharpen, 4: rgb-max, 5: intensity-max
+#endif
 #define MAX_LIGHTS 10
+#ifndef NUM_LIGHTS
+#define NUM_LIGHTS MAX_LIGHTS
+#endif
 /////////////////////////////////////////////////////////////////////////////
 // Uniforms
 /////////////////////////////////////////////////////////////////////////////
-uniform sampler2D tex;	// Diffuse texture
-uniform sampler2D normalTex;
+uniform sampler2DArray tex;	// Diffuse texture
+uniform sampler2DArray normalTex;
 uniform sampler2D postProcTexColor;
 
-uniform int enablePostProc;
-uniform	int postProcMode ;
+// per draw, each draw binds its record of the draw constants ring. Has to match the block in the vertex shader.
+layout(std140) uniform DrawConstants {
+	mat4 matModel;
+	mat4 matNormal;
+	vec3 materialSpecularColor;
+	float materialShininess;
+	ivec2 textureLayers;	// layers of the diffuse texture and the normal map in their arrays
+	int hasNormalMap;	// 0: disabled, 1:enabled
+	int packedVertices;	// 0: float normals and tangents, 1: octahedral-encoded in xy
+};
 
 /////////////////////////////////////////////////////////////////////////////
 // Light
 // Source: http://www.tomdalling.com/blog/modern-opengl/08-even-more-lighting-directional-lights-spotlights-multiple-lights/
 /////////////////////////////////////////////////////////////////////////////
-// array of lights
-uniform int enableLighting; // 0: disabled, 1: enabled
-uniform int numLights;
-uniform struct Light {
+// array of lights, has to match the block in the vertex shader
+struct Light {
+   mat4 matDepthVP; // biased to texture space for shadow lookups
    vec4 position;
    vec3 intensities; //a.k.a the color of the light
    float att_c1;
@@ -28,28 +62,23 @@ uniform struct Light {
    float ambientCoefficient;
    float coneAngle;
    vec3 coneDirection;
-} allLights[MAX_LIGHTS];
-
-uniform struct Material{
-	float shininess;
-	vec3 specularColor;
-} material;
+};
+layout(std140) uniform Lights {
+   Light allLights[NUM_LIGHTS];
+};
 
 
 /////////////////////////////////////////////////////////////////////////////
 // Shadow Mapping
 /////////////////////////////////////////////////////////////////////////////
-uniform int enableShadowMapping;	// 0: disabled, 1:enabled
-uniform int enableSmoothShadows;	// 0: disabled, 1:enabled
 uniform sampler2DArray shadowTexArray;
-in vec4 fragVertShadowClip[MAX_LIGHTS];
+in vec4 fragVertShadowClip[NUM_LIGHTS];
 
 /////////////////////////////////////////////////////////////////////////////
 // Normal Mapping
 /////////////////////////////////////////////////////////////////////////////
-uniform int enableNormalMapping; // 0: disabled, 1:enabled
-uniform int hasNormalMap; // 0: disabled, 1:enabled
 in vec3 fragTangentViewSpace;
+in float fragTangentHandedness;
 
 /////////////////////////////////////////////////////////////////////////////
 // Varyings
@@ -57,7 +86,6 @@ in vec3 fragTangentViewSpace;
 in vec3 fragVaryingNormalViewSpace;
 in vec2 fragTexCoord;
 in vec3 fragVertViewSpace;
-uniform int shaderMode;
 
 /////////////////////////////////////////////////////////////////////////////
 // Output
@@ -89,12 +117,13 @@ float smoothedShadowCoeff(int lightNr, vec3 surfaceToLightViewSpace)
 	
 	vec4 shadowCoord = fragVertShadowClip[lightNr];
 	
-	if(enableSmoothShadows == 0)
-		return texture2DArrayCompare(lightNr,shadowCoord,bias);
-	
+#if SMOOTH_SHADOWS == 0
+	return texture2DArrayCompare(lightNr,shadowCoord,bias);
+#else
 	float sum = 0;
   	float shadowMapSize = 700;
-	if(enableSmoothShadows == 1){
+#if SMOOTH_SHADOWS == 1
+	{
 		vec2 poissonDisk[4] = vec2[](
 		   vec2( -0.94201624, -0.39906216 ),
 		   vec2( 0.94558609, -0.76890725 ),
@@ -105,7 +134,9 @@ float smoothedShadowCoeff(int lightNr, vec3 surfaceToLightViewSpace)
 		for (int i = 0; i < 4; i ++)
 		  	sum += texture2DArrayCompare(lightNr,shadowCoord + vec4(poissonDisk[i]*shadowCoord.w/shadowMapSize,0,0),bias);
 	  	sum/= 4.0;
-  	}else if(enableSmoothShadows == 2){
+  	}
+#else
+	{
 		for (float i = -1.5; i <= 1.5; i ++)
 			for (float j = -1.5; j<= 1.5; j ++)
 		  		sum += texture2DArrayCompare(lightNr,shadowCoord + vec4(i, j,0,0)*shadowCoord.w/shadowMapSize,bias);
@@ -113,8 +144,10 @@ float smoothedShadowCoeff(int lightNr, vec3 surfaceToLightViewSpace)
 	  	sum = sum/16.0;
   	
   	}
+#endif
   	
 	return sum;
+#endif
 }
 
 
@@ -148,22 +181,22 @@ vec3 ApplyLight(int lightNr, vec3 surfaceColor, vec3 normalViewSpace, vec3 surfa
     vec3 diffuse = diffuseCoefficient * surfaceColor.rgb * light.intensities;
     //specular
     float specularCoefficient = 1;
-    if(material.shininess > 0){
-    	specularCoefficient = pow(max(0.0, dot(-surfaceToCameraViewSpace, reflect(surfaceToLightViewSpace, normalViewSpace))), material.shininess);
+    if(materialShininess > 0){
+    	specularCoefficient = pow(max(0.0, dot(-surfaceToCameraViewSpace, reflect(surfaceToLightViewSpace, normalViewSpace))), materialShininess);
 	}
     vec3  specular = specularCoefficient * surfaceColor * light.intensities;
 
 
 	// Shadow Mapping
-	if (enableShadowMapping == 1){
-		float visibility  = smoothedShadowCoeff(lightNr,surfaceToLightViewSpace);
-		
-    	// linear color (color before gamma correction)
-    	return ambient + visibility*attenuation*(diffuse + specular);
- 	}else{
-	    // linear color (color before gamma correction)
-	    return ambient + attenuation*(diffuse + specular);
- 	}
+#if SHADOW_MAPPING
+	float visibility  = smoothedShadowCoeff(lightNr,surfaceToLightViewSpace);
+	
+    // linear color (color before gamma correction)
+    return ambient + visibility*attenuation*(diffuse + specular);
+#else
+    // linear color (color before gamma correction)
+    return ambient + attenuation*(diffuse + specular);
+#endif
 	
 }
 
@@ -172,16 +205,11 @@ vec3 ApplyLight(int lightNr, vec3 surfaceColor, vec3 normalViewSpace, vec3 surfa
 // Phong lighting model + shadow mapping
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 void LightShader(){
-	if(enableLighting == 0)
-	{
-		emptyShader();
-		return;
-	}
-	vec3 surfaceColor = vec3(texture(tex,fragTexCoord.xy));
+	vec3 surfaceColor = vec3(texture(tex,vec3(fragTexCoord.xy,textureLayers.x)));
 	vec3 surfaceToCameraViewSpace = normalize(-fragVertViewSpace);
 	
 	vec3 linearColor = vec3(0);
-	for(int i = 0; i < numLights; ++i){
+	for(int i = 0; i < NUM_LIGHTS; ++i){
 	    linearColor += ApplyLight(i, surfaceColor, fragNormalViewSpace, fragVertViewSpace, surfaceToCameraViewSpace);
 	}
 	outputColor = vec4(linearColor,1.0f);
@@ -191,15 +219,15 @@ void LightShader(){
 
 void emptyShader(){
 
-	outputColor = texture(tex,fragTexCoord.xy);
+	outputColor = texture(tex,vec3(fragTexCoord.xy,textureLayers.x));
 	//outputColor = vec4(fragTangentViewSpace,1.0f);
 }
 
 void postProcShader(){
 
+#if POST_PROC_MODE == 0
 	outputColor = texture(postProcTexColor,fragTexCoord.xy);
-	
-	if(postProcMode == 1)
+#elif POST_PROC_MODE == 1
 	{
 		int gausKernel[25] = int[](
 			1,4,7,4,1,
@@ -218,7 +246,7 @@ void postProcShader(){
 		
 		outputColor = vec4(sum/273.0,1.0f);
 	}
-	else if(postProcMode == 2)
+#elif POST_PROC_MODE == 2
 	{
 		int sobelX[9] = int[](
 			1,0,-1,
@@ -242,7 +270,7 @@ void postProcShader(){
 		float val = sqrt(length(sumX)*length(sumX)+length(sumY)*length(sumY));
 		outputColor = vec4(vec3(val),1.0f);
 	}
-	else if(postProcMode == 3)
+#elif POST_PROC_MODE == 3
 	{
 		int sharpKernel[9] = int[](
 			0,-1,0,
@@ -259,7 +287,7 @@ void postProcShader(){
 		
 		outputColor = vec4(sum,1.0f);
 	}
-	else if(postProcMode == 4)
+#elif POST_PROC_MODE == 4
 	{
 		vec3 maxCol = vec3(0);
 				vec3 col = texture(postProcTexColor,fragTexCoord.xy).rgb;
@@ -278,7 +306,7 @@ void postProcShader(){
 		
 		outputColor = vec4(maxCol,1.0f);
 	}
-	else if(postProcMode == 5)
+#elif POST_PROC_MODE == 5
 	{
 		vec3 maxCol = vec3(0);
 		for(int i = -3; i <= 3; i++){
@@ -292,7 +320,7 @@ void postProcShader(){
 		
 		outputColor = vec4(maxCol,1.0f);
 	}
-
+#endif
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -300,33 +328,32 @@ void postProcShader(){
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 void main()
 {
-	if(enablePostProc == 1)
-	{
-		postProcShader();
-		return;
-	}
-	if(enableNormalMapping == 1 && hasNormalMap == 1){
-		vec3 fragBitangentViewSpace = cross(fragTangentViewSpace, fragVaryingNormalViewSpace);
+#if PASS == PASS_DEPTH
+	// only the depth is written, the shadow map framebuffers have no color buffer
+	outputColor = vec4(1.0);
+#elif PASS == PASS_POST_PROCESSING
+	postProcShader();
+#else
+#if NORMAL_MAPPING
+	if(hasNormalMap == 1){
+		vec3 fragBitangentViewSpace = cross(fragTangentViewSpace, fragVaryingNormalViewSpace) * fragTangentHandedness;
 
 		mat3 TBN = mat3(fragTangentViewSpace.x, fragTangentViewSpace.y, fragTangentViewSpace.z,
 					fragBitangentViewSpace.x, fragBitangentViewSpace.y, fragBitangentViewSpace.z,
 					fragVaryingNormalViewSpace.x, fragVaryingNormalViewSpace.y, fragVaryingNormalViewSpace.z);
 
-		fragNormalViewSpace = normalize(TBN * normalize(vec3(texture(normalTex,fragTexCoord.xy)) * 2 - 1));
+		// normal maps are compressed to two channels, z is reconstructed from the unit length
+		vec2 normalXY = texture(normalTex,vec3(fragTexCoord.xy,textureLayers.y)).rg * 2 - 1;
+		vec3 normalTangentSpace = vec3(normalXY, sqrt(max(0.0, 1.0 - dot(normalXY, normalXY))));
+		fragNormalViewSpace = normalize(TBN * normalTangentSpace);
 	} else
+#endif
 		fragNormalViewSpace = fragVaryingNormalViewSpace;
 
-	switch(shaderMode){
-		case 0:
-		case 1:
-			LightShader();
-			break;
-		case 4:
-		case 5:
-			emptyShader();
-			break;
-	
-		default:
-			emptyShader();
-	}
+#if LIGHTING
+	LightShader();
+#else
+	emptyShader();
+#endif
+#endif
 }
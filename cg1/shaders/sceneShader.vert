@@ -1,26 +1,59 @@
 #version 330
 
 
+/////////////////////////////////////////////////////////////////////////////
+// Variants, the application defines these before compiling
+/////////////////////////////////////////////////////////////////////////////
+#define PASS_DEPTH 0
+#define PASS_COLOR 1
+#define PASS_POST_PROCESSING 2
+#ifndef PASS
+#define PASS PASS_COLOR
+#endif
+#ifndef WATER
+#define WATER 0 // 0: static mesh, 1: animated water surface
+#endif
+#ifndef SHADOW_MAPPING
+#define SHADOW_MAPPING 0
+#endif
+#ifndef NORMAL_MAPPING
+#define NORMAL_MAPPING 0
+#endif
+#define MAX_LIGHTS 10
+#ifndef NUM_LIGHTS
+#define NUM_LIGHTS MAX_LIGHTS
+#endif
+
 /////////////////////////////////////////////////////////////////////////////
 // Attributes
 /////////////////////////////////////////////////////////////////////////////
 layout(location = 0) in vec4 position;
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 texCoord;
-layout(location = 3) in vec3 tangent;
+layout(location = 3) in vec4 tangent;
 
 /////////////////////////////////////////////////////////////////////////////
 // Uniforms
 /////////////////////////////////////////////////////////////////////////////
-uniform mat4 matModel;
-uniform mat4 matNormal;
 uniform mat4 matVP;
-uniform mat4 matV;
 
-uniform float time;
-uniform int shaderMode;
-uniform	int waterMode;
-uniform int enablePostProc;
+// per draw, each draw binds its record of the draw constants ring. Has to match the block in the fragment shader.
+layout(std140) uniform DrawConstants {
+	mat4 matModel;
+	mat4 matNormal;
+	vec3 materialSpecularColor;
+	float materialShininess;
+	ivec2 textureLayers;	// layers of the diffuse texture and the normal map in their arrays
+	int hasNormalMap;	// 0: disabled, 1:enabled
+	int packedVertices;	// 0: float normals and tangents, 1: octahedral-encoded in xy
+};
+
+// constant for all draws of a frame
+layout(std140) uniform FrameConstants {
+	mat4 matV;
+	float time;
+	int waterMode;
+};
 
 /////////////////////////////////////////////////////////////////////////////
 // Varyings
@@ -32,18 +65,28 @@ out vec3 fragVertViewSpace;
 /////////////////////////////////////////////////////////////////////////////
 // ShadowMapping
 /////////////////////////////////////////////////////////////////////////////
-uniform int enableShadowMapping;	// 0: disabled, 1:enabled
-#define MAX_LIGHTS 10
-uniform mat4 matDepthVP[MAX_LIGHTS];
-out vec4 fragVertShadowClip[MAX_LIGHTS];
-uniform int numLights;
+// has to match the block in the fragment shader
+struct Light {
+   mat4 matDepthVP; // biased to texture space for shadow lookups
+   vec4 position;
+   vec3 intensities;
+   float att_c1;
+   float att_c2;
+   float att_c3;
+   float ambientCoefficient;
+   float coneAngle;
+   vec3 coneDirection;
+};
+layout(std140) uniform Lights {
+   Light allLights[NUM_LIGHTS];
+};
+out vec4 fragVertShadowClip[NUM_LIGHTS];
 
 /////////////////////////////////////////////////////////////////////////////
 // NormalMapping
 /////////////////////////////////////////////////////////////////////////////
-uniform int enableNormalMapping; // 0: disabled, 1:enabled
-uniform int hasNormalMap; // 0: disabled, 1:enabled
 out vec3 fragTangentViewSpace;
+out float fragTangentHandedness;
 
 struct waveData{
 	float amplitude;
@@ -53,21 +96,44 @@ struct waveData{
 	float k;
 };
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Vertex decoding
+////////////////////////////////////////////////////////////////////////////////////////////////////
+vec3 decodeOctahedral(vec2 e){
+	vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if(v.z < 0)
+		v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0 ? 1.0 : -1.0, v.y >= 0 ? 1.0 : -1.0);
+	return normalize(v);
+}
+
+vec3 vertexNormal(){
+	return packedVertices == 1 ? decodeOctahedral(normal.xy) : normal;
+}
+
+// the packed tangent stores the handedness in the sign of y, with y remapped to [1/32767, 1]
+vec4 vertexTangent(){
+	if(packedVertices == 0)
+		return tangent;
+	float handedness = tangent.y < 0 ? -1.0 : 1.0;
+	float y = (abs(tangent.y) - 1.0 / 32767.0) / (1.0 - 1.0 / 32767.0) * 2.0 - 1.0;
+	return vec4(decodeOctahedral(vec2(tangent.x, y)), handedness);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Empty shader
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 void emptyShader(){
 
     fragTexCoord = texCoord;
-    fragVaryingNormalViewSpace = normalize(mat3(matV)*mat3(matNormal)*normal);
+    fragVaryingNormalViewSpace = normalize(mat3(matV)*mat3(matNormal)*vertexNormal());
     fragVertViewSpace = vec3(matV*matModel*position);
     gl_Position = matVP * matModel* position;
     
-    if(enableShadowMapping == 1){
-	    for(int i = 0; i < numLights; i++){
-		    fragVertShadowClip[i] = matDepthVP[i] * matModel * position;
-	    }
+#if SHADOW_MAPPING && PASS == PASS_COLOR
+    for(int i = 0; i < NUM_LIGHTS; i++){
+	    fragVertShadowClip[i] = allLights[i].matDepthVP * matModel * position;
     }
+#endif
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -203,11 +269,11 @@ void waterShader(){
     
     fragTexCoord = texCoord+moveDir*time;
    
-    if(enableShadowMapping == 1){
-	    for(int i = 0; i < numLights; i++){
-		    fragVertShadowClip[i] = matDepthVP[i] * matModel * pos;
-	    }
+#if SHADOW_MAPPING && PASS == PASS_COLOR
+    for(int i = 0; i < NUM_LIGHTS; i++){
+	    fragVertShadowClip[i] = allLights[i].matDepthVP * matModel * pos;
     }
+#endif
 }
 
 void postProcShader(){
@@ -220,26 +286,21 @@ void postProcShader(){
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 void main()
 {
-	if(enablePostProc == 1)
-	{
-		postProcShader();
-		return;
-	}
-	
-	if(enableNormalMapping == 1 && hasNormalMap == 1)
-		fragTangentViewSpace = normalize(mat3(matV)*mat3(matNormal)*tangent);
-
-	switch(shaderMode){
-		case 1:
-		case 5:
-			waterShader();
-			break;
-		case 0:
-		case 4:
-			emptyShader();
-			break;
-		default:
-			emptyShader();
+#if PASS == PASS_POST_PROCESSING
+	postProcShader();
+#else
+#if NORMAL_MAPPING && PASS == PASS_COLOR
+	if(hasNormalMap == 1){
+		vec4 t = vertexTangent();
+		fragTangentViewSpace = normalize(mat3(matV)*mat3(matNormal)*t.xyz);
+		fragTangentHandedness = t.w;
 	}
-    
+#endif
+
+#if WATER
+	waterShader();
+#else
+	emptyShader();
+#endif
+#endif
 }